@@ -0,0 +1,239 @@
+/**
+ * Keyed memoization of expensive background computations (portable C++, no C++/CX).
+ *
+ * AsyncCache<K, V>::Get(key, compute, done):
+ *  - if the value is cached, done(value, nullptr) is called right away on the calling thread
+ *  - if the same key is being computed, done is queued behind that computation (single flight)
+ *  - otherwise compute() is started on the thread pool and done is called on the worker with
+ *    the result, or with the exception thrown by compute (errors are not cached)
+ * Values are shared as std::shared_ptr<const V> and kept under a total weight bound (one per value
+ * unless a weigher is given), evicting the least recently used. Invalidate(key) and Clear() are
+ * explicit; a computation in flight when its key is invalidated still completes its waiters but
+ * its result is not cached. The cache must outlive the computations it started.
+ */
+
+#ifndef _LUWPUTILITIES_ASYNC_CACHE_
+#define _LUWPUTILITIES_ASYNC_CACHE_
+
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "ThreadPool.h"
+
+namespace LUwpUtilities
+{
+	template<typename K, typename V, typename Hash = std::hash<K>>
+	class AsyncCache
+	{
+	public:
+		typedef std::shared_ptr<const V> Value;
+		typedef std::function<V()> Compute;
+		typedef std::function<void(Value value, std::exception_ptr error)> Callback;
+		typedef std::function<size_t(const V &value)> Weigher;
+
+		struct Statistics
+		{
+			size_t hits;      // served from the cache
+			size_t misses;    // started a computation
+			size_t coalesced; // joined a computation in flight
+			size_t evictions;
+		};
+
+		explicit AsyncCache(size_t capacity, Weigher weigher = nullptr, ThreadPool &pool = ThreadPool::Default())
+			: _capacity(capacity), _weigher(weigher), _pool(pool), _weight(0)
+		{
+			_hits = 0;
+			_misses = 0;
+			_coalesced = 0;
+			_evictions = 0;
+		}
+
+		AsyncCache(const AsyncCache&) = delete;
+		AsyncCache &operator=(const AsyncCache&) = delete;
+
+		void Get(const K &key, Compute compute, Callback done, WorkPriority priority = WorkPriority::Normal)
+		{
+			std::unique_lock<std::mutex> guard(_lock);
+			auto found = _entries.find(key);
+			if (found != _entries.end() && found->second.value != nullptr)
+			{
+				auto &entry = found->second;
+				_lru.splice(_lru.begin(), _lru, entry.position);
+				auto value = entry.value;
+				_hits.fetch_add(1, std::memory_order_relaxed);
+				guard.unlock();
+				done(value, nullptr);
+				return;
+			}
+
+			if (found != _entries.end())
+			{
+				found->second.flight->waiters.push_back(std::move(done));
+				_coalesced.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+
+			auto flight = std::make_shared<Flight>();
+			flight->waiters.push_back(std::move(done));
+			_entries[key].flight = flight;
+			_misses.fetch_add(1, std::memory_order_relaxed);
+			guard.unlock();
+
+			_pool.Submit([this, key, compute, flight]()
+			{
+				Value value;
+				std::exception_ptr error;
+				try
+				{
+					value = std::make_shared<const V>(compute());
+				}
+				catch (...)
+				{
+					error = std::current_exception();
+				}
+				Complete(key, flight, value, error);
+			}, priority);
+		}
+
+		// Cached value, or null; does not start a computation
+		Value TryGet(const K &key)
+		{
+			std::lock_guard<std::mutex> guard(_lock);
+			auto found = _entries.find(key);
+			if (found == _entries.end() || found->second.value == nullptr)
+				return nullptr;
+
+			_lru.splice(_lru.begin(), _lru, found->second.position);
+			_hits.fetch_add(1, std::memory_order_relaxed);
+			return found->second.value;
+		}
+
+		// Forget the cached value (or the computation in flight) of the key
+		void Invalidate(const K &key)
+		{
+			std::lock_guard<std::mutex> guard(_lock);
+			auto found = _entries.find(key);
+			if (found != _entries.end())
+				Erase(found);
+		}
+
+		void Clear()
+		{
+			std::lock_guard<std::mutex> guard(_lock);
+			_entries.clear();
+			_lru.clear();
+			_weight = 0;
+		}
+
+		Statistics GetStatistics() const
+		{
+			Statistics s;
+			s.hits = _hits.load(std::memory_order_relaxed);
+			s.misses = _misses.load(std::memory_order_relaxed);
+			s.coalesced = _coalesced.load(std::memory_order_relaxed);
+			s.evictions = _evictions.load(std::memory_order_relaxed);
+			return s;
+		}
+
+	private:
+		struct Flight
+		{
+			std::vector<Callback> waiters; // guarded by _lock
+		};
+
+		// Either computed (value set, in _lru) or in flight (flight set)
+		struct Entry
+		{
+			Value value;
+			size_t weight;
+			typename std::list<K>::iterator position;
+			std::shared_ptr<Flight> flight;
+		};
+
+		typedef typename std::unordered_map<K, Entry, Hash>::iterator EntryIterator;
+
+		void Complete(const K &key, const std::shared_ptr<Flight> &flight, Value value, std::exception_ptr error)
+		{
+			std::vector<Callback> waiters;
+			{
+				std::lock_guard<std::mutex> guard(_lock);
+				waiters.swap(flight->waiters);
+
+				// Only the computation the entry is waiting for may fill it (not one invalidated meanwhile)
+				auto found = _entries.find(key);
+				if (found != _entries.end() && found->second.flight == flight)
+				{
+					if (error)
+					{
+						_entries.erase(found);
+					}
+					else
+					{
+						auto &entry = found->second;
+						entry.flight = nullptr;
+						entry.value = value;
+						entry.weight = (_weigher ? _weigher(*value) : 1);
+						_lru.push_front(key);
+						entry.position = _lru.begin();
+						_weight += entry.weight;
+						Evict();
+					}
+				}
+			}
+
+			for (auto &waiter : waiters)
+			{
+				try
+				{
+					waiter(value, error);
+				}
+				catch (...)
+				{
+				}
+			}
+		}
+
+		// Drop the least recently used values until the weight fits (the newest value always stays)
+		void Evict()
+		{
+			while (_weight > _capacity && _lru.size() > 1)
+			{
+				auto found = _entries.find(_lru.back());
+				Erase(found);
+				_evictions.fetch_add(1, std::memory_order_relaxed);
+			}
+		}
+
+		void Erase(EntryIterator found)
+		{
+			if (found->second.value != nullptr)
+			{
+				_weight -= found->second.weight;
+				_lru.erase(found->second.position);
+			}
+			_entries.erase(found);
+		}
+
+		size_t _capacity;
+		Weigher _weigher;
+		ThreadPool &_pool;
+
+		std::mutex _lock;
+		std::unordered_map<K, Entry, Hash> _entries;
+		std::list<K> _lru; // most recently used first
+		size_t _weight;
+
+		std::atomic<size_t> _hits;
+		std::atomic<size_t> _misses;
+		std::atomic<size_t> _coalesced;
+		std::atomic<size_t> _evictions;
+	};
+} // namespace LUwpUtilities
+
+#endif // #ifndef _LUWPUTILITIES_ASYNC_CACHE_
@@ -0,0 +1,85 @@
+/**
+ * AsyncMemo: keyed memoization of background computations for C++/CX callers, over AsyncCache.h.
+ * The computations run through TH and the results come back on the calling thread's dispatcher.
+ */
+
+#ifndef _LUWPUTILITIES_ASYNC_MEMO_
+#define _LUWPUTILITIES_ASYNC_MEMO_
+
+#ifdef LUU_EXPORT
+
+#include "LUwpUtilities.h"
+#include "AsyncCache.h"
+#include "TaskHelper.h"
+#include <memory>
+#include <string>
+
+namespace LUwpUtilities
+{
+	/// Keyed memoization of background computations (see AsyncCache.h): concurrent GetAsync for
+	/// the same key share one computation and the results are kept for the most recent keys.
+	[Windows::Foundation::Metadata::WebHostHidden]
+	LUU_EXPORT ref class AsyncMemo sealed
+	{
+	public:
+		/// Keep at most capacity results
+		AsyncMemo(int capacity) : _cache(new AsyncCache<std::wstring, Platform::Object^>((size_t)capacity))
+		{
+		}
+
+		/// Call continuation with the result of compute(param) for the key, computed in background
+		/// unless it is cached or in flight; the handlers run on the calling thread's dispatcher
+		void GetAsync(
+			Platform::String^ key,
+			ExecutionCallbackWithValue^ compute,
+			Platform::Object^ param,
+			ExecutionCallback^ continuation,
+			ExceptionHandler^ on_error
+		)
+		{
+			auto dispatcher = TH::CurrentDispatcher();
+			auto cache = _cache;
+			_cache->Get(key->Data(), [compute, param, cache]() { return compute(param); },
+				[dispatcher, continuation, on_error](std::shared_ptr<Platform::Object^ const> value, std::exception_ptr error)
+			{
+				TH::CompleteParallel(dispatcher, error, [continuation, value]()
+				{
+					continuation(*value);
+				}, on_error);
+			});
+		}
+
+		void Invalidate(Platform::String^ key)
+		{
+			_cache->Invalidate(key->Data());
+		}
+
+		void Clear()
+		{
+			_cache->Clear();
+		}
+
+		property int Hits
+		{
+			int get() { return (int)_cache->GetStatistics().hits; }
+		}
+
+		/// Requests that joined a computation already in flight
+		property int Coalesced
+		{
+			int get() { return (int)_cache->GetStatistics().coalesced; }
+		}
+
+		property int Misses
+		{
+			int get() { return (int)_cache->GetStatistics().misses; }
+		}
+
+	private:
+		// Also held by the computations in flight, which may outlive this object
+		std::shared_ptr<AsyncCache<std::wstring, Platform::Object^>> _cache;
+	};
+} // namespace LUwpUtilities
+#endif
+
+#endif // #ifndef _LUWPUTILITIES_ASYNC_MEMO_
@@ -1,34 +1,80 @@
 /**
  * Some method to deal with IBuffer and char* conversion.
+ *
+ * The bytes are accessed in place via IBufferByteAccess (see GetBufferView)
+ * and copied in bulk instead of one DataReader::ReadByte() call per byte.
  */
 
-STATIC_INLINE char * BufferToByteArray(Windows::Storage::Streams::IBuffer^ data)
+#ifndef _LUWPUTILITIES_BUFFER_HELPER_
+#define _LUWPUTILITIES_BUFFER_HELPER_
+
+#include <robuffer.h>
+#include <wrl/client.h>
+#include "LUwpUtilities.h"
+#include "BufferPool.h"
+#include "BufferView.h"
+
+// Pointer to the memory backing an IBuffer; valid as long as the buffer is alive
+STATIC_INLINE unsigned char * GetBufferData(Windows::Storage::Streams::IBuffer^ data)
 {
-	size_t len = data->Length;
-	char * result = new char[len];
-	auto reader = Windows::Storage::Streams::DataReader::FromBuffer(data);
-	for (size_t i = 0; i < len; i++)
-		result[i] = reader->ReadByte();
+	Microsoft::WRL::ComPtr<Windows::Storage::Streams::IBufferByteAccess> access;
+	HRESULT hr = reinterpret_cast<IInspectable*>(data)->QueryInterface(IID_PPV_ARGS(&access));
+	if (FAILED(hr))
+		throw Platform::Exception::CreateException(hr);
 
-	return result;
+	byte * bytes = nullptr;
+	hr = access->Buffer(&bytes);
+	if (FAILED(hr))
+		throw Platform::Exception::CreateException(hr);
+
+	return bytes;
+}
+
+// View the content of an IBuffer without copying it
+STATIC_INLINE LUwpUtilities::BufferView GetBufferView(Windows::Storage::Streams::IBuffer^ data)
+{
+	if (data == nullptr || data->Length == 0)
+		return LUwpUtilities::BufferView();
+
+	return LUwpUtilities::BufferView(GetBufferData(data), data->Length);
+}
+
+STATIC_INLINE char * BufferToByteArray(Windows::Storage::Streams::IBuffer^ data)
+{
+	return GetBufferView(data).ToByteArray();
 }
 
 STATIC_INLINE void BufferToByteArray(Windows::Storage::Streams::IBuffer^ data, char *dest)
 {
-	auto len = data->Length;
-	auto reader = Windows::Storage::Streams::DataReader::FromBuffer(data);
-	for (size_t i = 0; i < len; i++)
-		dest[i] = reader->ReadByte();
+	GetBufferView(data).CopyTo(dest);
 }
 
 STATIC_INLINE char * BufferToCString(Windows::Storage::Streams::IBuffer^ data)
 {
-	size_t len = data->Length;
-	char * result = new char[len + 1];
-	auto reader = Windows::Storage::Streams::DataReader::FromBuffer(data);
-	for (size_t i = 0; i < len; i++)
-		result[i] = reader->ReadByte();
-	result[len] = '\0';
+	return GetBufferView(data).ToCString();
+}
+
+STATIC_INLINE void BufferToCString(Windows::Storage::Streams::IBuffer^ data, char *dest)
+{
+	GetBufferView(data).CopyToCString(dest);
+}
 
+// Same as BufferToByteArray/BufferToCString but the memory is borrowed from BufferPool::Default()
+// and given back automatically instead of having to delete[] it
+STATIC_INLINE LUwpUtilities::PooledBuffer<char> BufferToPooledByteArray(Windows::Storage::Streams::IBuffer^ data)
+{
+	auto view = GetBufferView(data);
+	auto result = LUwpUtilities::BufferPool::Default().Allocate<char>(view.length);
+	view.CopyTo(result.Get());
 	return result;
 }
+
+STATIC_INLINE LUwpUtilities::PooledBuffer<char> BufferToPooledCString(Windows::Storage::Streams::IBuffer^ data)
+{
+	auto view = GetBufferView(data);
+	auto result = LUwpUtilities::BufferPool::Default().Allocate<char>(view.length + 1);
+	view.CopyToCString(result.Get());
+	return result;
+}
+
+#endif // #ifndef _LUWPUTILITIES_BUFFER_HELPER_
@@ -0,0 +1,297 @@
+/**
+ * Thread-safe pool of temporary buffers to avoid the new[]/delete[] churn of
+ * short-lived buffers (BufferToPooledCString, Http::EncodeUrl, etc.)
+ *
+ * Requests are rounded up to a power-of-two size class. Freed blocks go to a
+ * small per-thread cache first and then to a shared free list per size class;
+ * both are bounded in bytes, so that the large classes keep few blocks.
+ * Requests larger than the largest class go straight to the heap.
+ * Buffers are handed out as move-only RAII handles:
+ *
+ *     auto buf = BufferPool::Default().Allocate<wchar_t>(length + 1);
+ *     ... use buf.Get() ...
+ *     // returned to the pool when buf goes out of scope
+ *
+ * This header does not depend on C++/CX.
+ */
+
+#ifndef _LUWPUTILITIES_BUFFER_POOL_
+#define _LUWPUTILITIES_BUFFER_POOL_
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace LUwpUtilities
+{
+	class BufferPool;
+
+	// Buffer of at least Size() elements of T borrowed from a BufferPool
+	template<typename T>
+	class PooledBuffer
+	{
+	public:
+		PooledBuffer() : _pool(nullptr), _data(nullptr), _size(0), _class(-1)
+		{
+		}
+
+		PooledBuffer(PooledBuffer &&other) : _pool(other._pool), _data(other._data), _size(other._size), _class(other._class)
+		{
+			other._pool = nullptr;
+			other._data = nullptr;
+			other._size = 0;
+		}
+
+		PooledBuffer &operator=(PooledBuffer &&other)
+		{
+			if (this != &other)
+			{
+				Release();
+				_pool = other._pool;
+				_data = other._data;
+				_size = other._size;
+				_class = other._class;
+				other._pool = nullptr;
+				other._data = nullptr;
+				other._size = 0;
+			}
+			return *this;
+		}
+
+		PooledBuffer(const PooledBuffer&) = delete;
+		PooledBuffer &operator=(const PooledBuffer&) = delete;
+
+		~PooledBuffer()
+		{
+			Release();
+		}
+
+		T *Get() const { return _data; }
+		size_t Size() const { return _size; }
+		T &operator[](size_t i) const { return _data[i]; }
+
+		// Return the memory to the pool early
+		inline void Release();
+
+	private:
+		friend class BufferPool;
+
+		PooledBuffer(BufferPool *pool, void *data, size_t size, int sizeClass)
+			: _pool(pool), _data(static_cast<T*>(data)), _size(size), _class(sizeClass)
+		{
+		}
+
+		BufferPool *_pool;
+		T *_data;
+		size_t _size;
+		int _class;
+	};
+
+	class BufferPool
+	{
+	public:
+		// Smallest class is 2^MinShift bytes, largest is 2^MaxShift bytes
+		static const int MinShift = 8;
+		static const int MaxShift = 20;
+		static const int ClassCount = MaxShift - MinShift + 1;
+		// Number of free blocks kept per size class in each thread and in the shared list...
+		static const size_t ThreadCacheLimit = 4;
+		static const size_t SharedLimit = 32;
+		// ...and bytes at most, in each thread over all classes and in each shared list
+		static const size_t ThreadCacheBytes = 256 * 1024;
+		static const size_t SharedBytes = 4 * 1024 * 1024;
+
+		// Counters to observe how well the pool does its job
+		struct Statistics
+		{
+			size_t requests;
+			size_t heapAllocations;
+			size_t threadCacheHits;
+			size_t sharedHits;
+		};
+
+		BufferPool()
+		{
+			_requests = 0;
+			_heapAllocations = 0;
+			_threadCacheHits = 0;
+			_sharedHits = 0;
+		}
+
+		~BufferPool()
+		{
+			for (int c = 0; c < ClassCount; c++)
+				for (auto block : _shared[c].blocks)
+					::operator delete(block);
+		}
+
+		BufferPool(const BufferPool&) = delete;
+		BufferPool &operator=(const BufferPool&) = delete;
+
+		// The pool used by the helpers of this library
+		static BufferPool &Default()
+		{
+			static BufferPool pool;
+			return pool;
+		}
+
+		// Borrow a buffer that holds at least count elements of T
+		template<typename T>
+		PooledBuffer<T> Allocate(size_t count)
+		{
+			size_t bytes = count * sizeof(T);
+			int c = SizeClass(bytes);
+			size_t capacity = (c < 0 ? bytes : ClassBytes(c));
+			return PooledBuffer<T>(this, Acquire(c, capacity), capacity / sizeof(T), c);
+		}
+
+		Statistics GetStatistics() const
+		{
+			Statistics s;
+			s.requests = _requests.load(std::memory_order_relaxed);
+			s.heapAllocations = _heapAllocations.load(std::memory_order_relaxed);
+			s.threadCacheHits = _threadCacheHits.load(std::memory_order_relaxed);
+			s.sharedHits = _sharedHits.load(std::memory_order_relaxed);
+			return s;
+		}
+
+		// Size class for a request of the given number of bytes; -1 if it is too big to be pooled
+		static int SizeClass(size_t bytes)
+		{
+			int c = 0;
+			while (c < ClassCount && ClassBytes(c) < bytes)
+				c++;
+			return c < ClassCount ? c : -1;
+		}
+
+		static size_t ClassBytes(int c)
+		{
+			return size_t(1) << (c + MinShift);
+		}
+
+	private:
+		template<typename T> friend class PooledBuffer;
+
+		struct SharedList
+		{
+			std::mutex lock;
+			std::vector<void*> blocks;
+		};
+
+		// Per-thread free blocks; flushed to the shared lists when the thread exits
+		struct ThreadCache
+		{
+			BufferPool *owner;
+			void *blocks[ClassCount][ThreadCacheLimit];
+			size_t count[ClassCount];
+			size_t bytes;
+
+			ThreadCache() : owner(nullptr), bytes(0)
+			{
+				for (int c = 0; c < ClassCount; c++)
+					count[c] = 0;
+			}
+
+			~ThreadCache()
+			{
+				if (owner == nullptr)
+					return;
+				for (int c = 0; c < ClassCount; c++)
+					while (count[c] > 0)
+						owner->ReleaseShared(c, blocks[c][--count[c]]);
+			}
+		};
+
+		// Only the Default() pool, which outlives every thread, has per-thread caches
+		ThreadCache *GetThreadCache()
+		{
+			if (this != &Default())
+				return nullptr;
+
+			thread_local ThreadCache cache;
+			cache.owner = this;
+			return &cache;
+		}
+
+		void *Acquire(int c, size_t capacity)
+		{
+			_requests.fetch_add(1, std::memory_order_relaxed);
+			if (c >= 0)
+			{
+				auto cache = GetThreadCache();
+				if (cache != nullptr && cache->count[c] > 0)
+				{
+					_threadCacheHits.fetch_add(1, std::memory_order_relaxed);
+					cache->bytes -= ClassBytes(c);
+					return cache->blocks[c][--cache->count[c]];
+				}
+
+				auto &shared = _shared[c];
+				std::lock_guard<std::mutex> guard(shared.lock);
+				if (!shared.blocks.empty())
+				{
+					_sharedHits.fetch_add(1, std::memory_order_relaxed);
+					void *block = shared.blocks.back();
+					shared.blocks.pop_back();
+					return block;
+				}
+			}
+
+			_heapAllocations.fetch_add(1, std::memory_order_relaxed);
+			return ::operator new(capacity);
+		}
+
+		void Release(int c, void *block)
+		{
+			if (c < 0)
+			{
+				::operator delete(block);
+				return;
+			}
+
+			auto cache = GetThreadCache();
+			if (cache != nullptr && cache->count[c] < ThreadCacheLimit && cache->bytes + ClassBytes(c) <= ThreadCacheBytes)
+			{
+				cache->bytes += ClassBytes(c);
+				cache->blocks[c][cache->count[c]++] = block;
+				return;
+			}
+
+			ReleaseShared(c, block);
+		}
+
+		void ReleaseShared(int c, void *block)
+		{
+			{
+				auto &shared = _shared[c];
+				std::lock_guard<std::mutex> guard(shared.lock);
+				if (shared.blocks.size() < SharedLimit && (shared.blocks.size() + 1) * ClassBytes(c) <= SharedBytes)
+				{
+					shared.blocks.push_back(block);
+					return;
+				}
+			}
+			::operator delete(block);
+		}
+
+		SharedList _shared[ClassCount];
+		std::atomic<size_t> _requests;
+		std::atomic<size_t> _heapAllocations;
+		std::atomic<size_t> _threadCacheHits;
+		std::atomic<size_t> _sharedHits;
+	};
+
+	template<typename T>
+	inline void PooledBuffer<T>::Release()
+	{
+		if (_pool != nullptr && _data != nullptr)
+			_pool->Release(_class, _data);
+		_pool = nullptr;
+		_data = nullptr;
+		_size = 0;
+	}
+} // namespace LUwpUtilities
+
+#endif // #ifndef _LUWPUTILITIES_BUFFER_POOL_
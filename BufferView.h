@@ -0,0 +1,82 @@
+/**
+ * Non-owning view over a contiguous block of bytes, e.g. the memory backing an IBuffer.
+ * It does not depend on C++/CX so that it can be used (and tested) outside of UWP;
+ * see BufferHelper.cpp for the method to view an IBuffer without copying it.
+ */
+
+#ifndef _LUWPUTILITIES_BUFFER_VIEW_
+#define _LUWPUTILITIES_BUFFER_VIEW_
+
+#include <cstddef>
+#include <cstring>
+
+namespace LUwpUtilities
+{
+	// The view is only valid as long as the underlying memory is alive
+	struct BufferView
+	{
+		const unsigned char *data;
+		size_t length;
+
+		BufferView() : data(nullptr), length(0)
+		{
+		}
+
+		BufferView(const void *data, size_t length) : data(static_cast<const unsigned char*>(data)), length(length)
+		{
+		}
+
+		const unsigned char *begin() const { return data; }
+		const unsigned char *end() const { return data + length; }
+		size_t size() const { return length; }
+		bool empty() const { return length == 0; }
+		unsigned char operator[](size_t i) const { return data[i]; }
+
+		const char *Chars() const
+		{
+			return reinterpret_cast<const char*>(data);
+		}
+
+		// Sub-view of (at most) count bytes starting at offset
+		BufferView Slice(size_t offset, size_t count) const
+		{
+			if (offset > length)
+				offset = length;
+			if (count > length - offset)
+				count = length - offset;
+			return BufferView(data + offset, count);
+		}
+
+		// Copy all bytes to dest which must hold at least length bytes
+		void CopyTo(void *dest) const
+		{
+			if (length > 0)
+				memcpy(dest, data, length);
+		}
+
+		// Copy all bytes to dest and append '\0'; dest must hold at least length + 1 bytes
+		void CopyToCString(char *dest) const
+		{
+			CopyTo(dest);
+			dest[length] = '\0';
+		}
+
+		// Copy to a new char array; caller must delete[] the result
+		char *ToByteArray() const
+		{
+			char *result = new char[length];
+			CopyTo(result);
+			return result;
+		}
+
+		// Copy to a new null-terminated char array; caller must delete[] the result
+		char *ToCString() const
+		{
+			char *result = new char[length + 1];
+			CopyToCString(result);
+			return result;
+		}
+	};
+} // namespace LUwpUtilities
+
+#endif // #ifndef _LUWPUTILITIES_BUFFER_VIEW_
@@ -0,0 +1,148 @@
+/**
+ * Cooperative cancellation flag with callbacks and deadlines (portable C++, no C++/CX);
+ * it is the state behind TaskCancellation in TaskHelper.h.
+ *
+ *  - Work checks IsCancelled() (one atomic load) before starting and at convenient points
+ *  - Register() attaches a callback run once on Cancel(), e.g. to abort an operation in flight
+ *  - CancelAfter() sets a deadline on TimerService::Default(); when it passes, Cancel() runs on
+ *    ThreadPool::Default() rather than on the timer thread, which holds the wheel's lock
+ */
+
+#ifndef _LUWPUTILITIES_CANCELLATION_STATE_
+#define _LUWPUTILITIES_CANCELLATION_STATE_
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include "ThreadPool.h"
+#include "TimerWheel.h"
+
+namespace LUwpUtilities
+{
+	class CancellationState
+	{
+	public:
+		typedef std::function<void()> Callback;
+
+		explicit CancellationState(TimerService &service = TimerService::Default())
+			: _service(service), _owner(std::make_shared<Owner>(this)), _cancelled(false), _nextId(1)
+		{
+			// Construct the pool first, so that it outlives a state of static duration that posts to it
+			ThreadPool::Default();
+			auto owner = _owner;
+			_deadline.callback = [owner]()
+			{
+				ThreadPool::Default().Submit([owner]()
+				{
+					std::lock_guard<std::recursive_mutex> guard(owner->lock);
+					if (owner->state != nullptr)
+						owner->state->Cancel();
+				}, WorkPriority::UserBlocking);
+			};
+		}
+
+		// Waits for a deadline Cancel() running on the pool, if any (unless from one of its callbacks)
+		~CancellationState()
+		{
+			_service.Cancel(_deadline);
+			std::lock_guard<std::recursive_mutex> guard(_owner->lock);
+			_owner->state = nullptr;
+		}
+
+		CancellationState(const CancellationState&) = delete;
+		CancellationState &operator=(const CancellationState&) = delete;
+
+		bool IsCancelled() const
+		{
+			return _cancelled.load(std::memory_order_acquire);
+		}
+
+		// Set the flag and run the registered callbacks (once, on the calling thread)
+		void Cancel()
+		{
+			std::vector<std::pair<size_t, Callback>> callbacks;
+			{
+				std::lock_guard<std::mutex> guard(_lock);
+				if (_cancelled.load())
+					return;
+				_cancelled.store(true, std::memory_order_release);
+				callbacks.swap(_callbacks);
+			}
+			_service.Cancel(_deadline);
+
+			for (auto &callback : callbacks)
+			{
+				try
+				{
+					callback.second();
+				}
+				catch (...)
+				{
+				}
+			}
+		}
+
+		// Cancel when the delay is over, unless Cancel() is called before; a later call replaces the deadline
+		void CancelAfter(std::chrono::milliseconds delay)
+		{
+			if (!IsCancelled())
+				_service.Schedule(_deadline, delay);
+		}
+
+		// Run callback on Cancel(), or right away if already cancelled (then return 0);
+		// return an id for Unregister()
+		size_t Register(Callback callback)
+		{
+			{
+				std::lock_guard<std::mutex> guard(_lock);
+				if (!_cancelled.load())
+				{
+					_callbacks.emplace_back(_nextId, std::move(callback));
+					return _nextId++;
+				}
+			}
+			callback();
+			return 0;
+		}
+
+		// Drop a callback that is no longer needed (e.g. the operation completed)
+		void Unregister(size_t id)
+		{
+			std::lock_guard<std::mutex> guard(_lock);
+			for (auto it = _callbacks.begin(); it != _callbacks.end(); ++it)
+			{
+				if (it->first == id)
+				{
+					_callbacks.erase(it);
+					return;
+				}
+			}
+		}
+
+	private:
+		// Shared with the Cancel() posted by the deadline, which may run after the state is gone
+		struct Owner
+		{
+			explicit Owner(CancellationState *state) : state(state)
+			{
+			}
+
+			std::recursive_mutex lock; // a callback may drop the last reference to the state
+			CancellationState *state;
+		};
+
+		TimerService &_service;
+		std::shared_ptr<Owner> _owner;
+		TimerWheel::Timer _deadline;
+		std::atomic<bool> _cancelled;
+		std::mutex _lock;
+		std::vector<std::pair<size_t, Callback>> _callbacks;
+		size_t _nextId;
+	};
+} // namespace LUwpUtilities
+
+#endif // #ifndef _LUWPUTILITIES_CANCELLATION_STATE_
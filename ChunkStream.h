@@ -0,0 +1,287 @@
+/**
+ * Incremental consumption of a byte stream, e.g. an HTTP response body (portable C++, no C++/CX).
+ *
+ *  - ChunkConsumer receives the body chunk by chunk (a parser, a file writer, a hash...) instead of
+ *    waiting for the whole body in memory
+ *  - ChunkPump drives an asynchronous read function: it asks for the next chunk only once the
+ *    consumer returned from the previous one, so memory stays at one chunk whatever the body size,
+ *    and a slow consumer slows down the reads instead of letting data pile up
+ *  - CollectingConsumer keeps the body in memory up to a limit, for the small responses
+ *  - CountingConsumer only counts the body and drops it, e.g. for load tests
+ *
+ * See Http::GetStreamingAsync for the reads from a Windows::Web::Http response.
+ */
+
+#ifndef _LUWPUTILITIES_CHUNK_STREAM_
+#define _LUWPUTILITIES_CHUNK_STREAM_
+
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+#include "BufferView.h"
+
+namespace LUwpUtilities
+{
+	// Exactly one of OnEnd() and OnError() ends the calls, unless OnChunk() returned false
+	class ChunkConsumer
+	{
+	public:
+		virtual ~ChunkConsumer()
+		{
+		}
+
+		// The body starts; contentLength is -1 if unknown
+		virtual void OnStart(int64_t contentLength)
+		{
+		}
+
+		// Next bytes of the body, only valid during the call; return false to stop reading
+		virtual bool OnChunk(BufferView chunk) = 0;
+
+		// The whole body went through OnChunk()
+		virtual void OnEnd()
+		{
+		}
+
+		// The read failed or was stopped; also called when OnChunk() throws
+		virtual void OnError(std::exception_ptr error)
+		{
+		}
+	};
+
+	class ChunkPump : public std::enable_shared_from_this<ChunkPump>
+	{
+	public:
+		// An empty chunk means the end of the stream; the chunk must stay valid until the next read
+		typedef std::function<void(BufferView chunk, std::exception_ptr error)> ReadDone;
+		// Read at most capacity bytes and call done, right away or later from any thread
+		typedef std::function<void(size_t capacity, ReadDone done)> Read;
+
+		static const size_t DefaultChunkSize = 64 * 1024;
+
+		// Start feeding the consumer from read; the pump keeps itself alive until the end
+		static std::shared_ptr<ChunkPump> Start(
+			Read read,
+			std::shared_ptr<ChunkConsumer> consumer,
+			int64_t contentLength,
+			size_t chunkSize = DefaultChunkSize
+		)
+		{
+			std::shared_ptr<ChunkPump> pump(new ChunkPump(std::move(read), std::move(consumer), chunkSize));
+			try
+			{
+				pump->_consumer->OnStart(contentLength);
+			}
+			catch (...)
+			{
+				pump->Finish(std::current_exception());
+				return pump;
+			}
+			pump->Pump();
+			return pump;
+		}
+
+		ChunkPump(const ChunkPump&) = delete;
+		ChunkPump &operator=(const ChunkPump&) = delete;
+
+		// Read no further: the consumer gets OnError(error) once the read in progress returns
+		void Stop(std::exception_ptr error)
+		{
+			std::lock_guard<std::mutex> guard(_lock);
+			if (!_stopError)
+				_stopError = error;
+			_stopped.store(true, std::memory_order_release);
+		}
+
+		bool IsFinished() const
+		{
+			return _finished.load(std::memory_order_acquire);
+		}
+
+		uint64_t BytesRead() const
+		{
+			return _bytes.load(std::memory_order_relaxed);
+		}
+
+	private:
+		ChunkPump(Read read, std::shared_ptr<ChunkConsumer> consumer, size_t chunkSize)
+			: _read(std::move(read)), _consumer(std::move(consumer)), _chunkSize(chunkSize == 0 ? 1 : chunkSize),
+			_stopped(false), _finished(false), _bytes(0), _phase(0)
+		{
+		}
+
+		enum Phase
+		{
+			Reading = 0,   // read() was called and has neither returned nor called done
+			Completed = 1, // done was called before read() returned
+			Waiting = 2    // read() returned first: done continues the loop
+		};
+
+		// Reads completing synchronously are handled in this loop rather than by recursion
+		void Pump()
+		{
+			auto self = shared_from_this();
+			for (;;)
+			{
+				_phase.store(Reading);
+				_read(_chunkSize, [self](BufferView chunk, std::exception_ptr error)
+				{
+					self->_chunk = chunk;
+					self->_error = error;
+					if (self->_phase.exchange(Completed) == Waiting && self->Handle())
+						self->Pump();
+				});
+				if (_phase.exchange(Waiting) != Completed || !Handle())
+					return;
+			}
+		}
+
+		// Give the last read to the consumer; return whether to read again
+		bool Handle()
+		{
+			if (_stopped.load(std::memory_order_acquire))
+			{
+				std::lock_guard<std::mutex> guard(_lock);
+				_error = _stopError;
+			}
+			if (_error)
+			{
+				Finish(_error);
+				return false;
+			}
+			if (_chunk.empty())
+			{
+				Finish(nullptr);
+				return false;
+			}
+
+			_bytes.fetch_add(_chunk.size(), std::memory_order_relaxed);
+			try
+			{
+				if (!_consumer->OnChunk(_chunk))
+				{
+					_finished.store(true, std::memory_order_release);
+					return false;
+				}
+			}
+			catch (...)
+			{
+				Finish(std::current_exception());
+				return false;
+			}
+			return true;
+		}
+
+		void Finish(std::exception_ptr error)
+		{
+			_finished.store(true, std::memory_order_release);
+			try
+			{
+				if (error)
+					_consumer->OnError(error);
+				else
+					_consumer->OnEnd();
+			}
+			catch (...)
+			{
+			}
+		}
+
+		Read _read;
+		std::shared_ptr<ChunkConsumer> _consumer;
+		size_t _chunkSize;
+
+		std::mutex _lock;
+		std::exception_ptr _stopError; // guarded by _lock
+		std::atomic<bool> _stopped;
+		std::atomic<bool> _finished;
+		std::atomic<uint64_t> _bytes;
+
+		// Result of the last read, handed over through _phase
+		std::atomic<int> _phase;
+		BufferView _chunk;
+		std::exception_ptr _error;
+	};
+
+	// Keeps the whole body, failing with std::length_error beyond maxBytes
+	class CollectingConsumer : public ChunkConsumer
+	{
+	public:
+		typedef std::function<void(std::vector<unsigned char> &body, std::exception_ptr error)> Done;
+
+		CollectingConsumer(size_t maxBytes, Done done) : _maxBytes(maxBytes), _done(std::move(done))
+		{
+		}
+
+		void OnStart(int64_t contentLength) override
+		{
+			if (contentLength > (int64_t)_maxBytes)
+				throw std::length_error("The content is larger than the limit");
+			if (contentLength > 0)
+				_body.reserve((size_t)contentLength);
+		}
+
+		bool OnChunk(BufferView chunk) override
+		{
+			if (chunk.size() > _maxBytes - _body.size())
+				throw std::length_error("The content is larger than the limit");
+			_body.insert(_body.end(), chunk.begin(), chunk.end());
+			return true;
+		}
+
+		void OnEnd() override
+		{
+			_done(_body, nullptr);
+		}
+
+		void OnError(std::exception_ptr error) override
+		{
+			_body.clear();
+			_done(_body, error);
+		}
+
+	private:
+		size_t _maxBytes;
+		Done _done;
+		std::vector<unsigned char> _body;
+	};
+
+	// Counts the body and drops it; done gets whether the body was read whole and the bytes read
+	// (the signature of LoadGenerator::RequestDone)
+	class CountingConsumer : public ChunkConsumer
+	{
+	public:
+		typedef std::function<void(bool success, int64_t bytes)> Done;
+
+		explicit CountingConsumer(Done done) : _done(std::move(done)), _bytes(0)
+		{
+		}
+
+		bool OnChunk(BufferView chunk) override
+		{
+			_bytes += (int64_t)chunk.size();
+			return true;
+		}
+
+		void OnEnd() override
+		{
+			_done(true, _bytes);
+		}
+
+		void OnError(std::exception_ptr) override
+		{
+			_done(false, _bytes);
+		}
+
+	private:
+		Done _done;
+		int64_t _bytes;
+	};
+} // namespace LUwpUtilities
+
+#endif // #ifndef _LUWPUTILITIES_CHUNK_STREAM_
@@ -0,0 +1,355 @@
+/**
+ * Minimal co_await-able task type as a lightweight alternative to create_task().then().
+ *
+ *  - CoTask<T> is lazily started: the body runs when the task is awaited, and when it finishes
+ *    it transfers control straight to the awaiting coroutine (symmetric transfer, so long
+ *    chains of awaits neither grow the stack nor go through a scheduler).
+ *  - Spawn(task) starts a CoTask<void> from ordinary code (fire-and-forget).
+ *  - ResumeBackground() moves the rest of the coroutine to ThreadPool::Default().
+ *
+ * With C++/CX, AwaitAsync(op) awaits an IAsyncOperation/IAsyncAction (with or without progress),
+ * e.g. the operations used by SH and Http, and ResumeOnDispatcher(dispatcher) comes back to the UI thread:
+ *
+ *     CoTask<void> LoadAsync(StorageFile^ file, CoreDispatcher^ dispatcher)
+ *     {
+ *         auto text = co_await AwaitAsync(FileIO::ReadTextAsync(file));
+ *         co_await ResumeOnDispatcher(dispatcher);
+ *         textBlock->Text = text;
+ *     }
+ *     ...
+ *     Spawn(LoadAsync(file, Dispatcher));
+ *
+ * The core (everything but AwaitAsync and ResumeOnDispatcher) does not depend on C++/CX.
+ * Requires a compiler supporting coroutines with symmetric transfer: C++20, or /await with the
+ * v142 toolset (VS2019) or later. The library project itself builds with v141 and does not include
+ * this header, so include it in your own project with one of these settings.
+ */
+
+#ifndef _LUWPUTILITIES_CO_TASK_
+#define _LUWPUTILITIES_CO_TASK_
+
+#if !defined(__cpp_impl_coroutine) && !defined(__cpp_coroutines)
+#error CoTask.h needs coroutines: compile with C++20 (/std:c++latest) or /await
+#elif defined(_MSC_VER) && _MSC_VER < 1920
+#error CoTask.h needs the v142 toolset (VS2019) or later: v141 has no symmetric transfer (noop_coroutine)
+#endif
+
+#include <exception>
+#include <utility>
+#include "ThreadPool.h"
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#include <coroutine>
+namespace LUwpUtilities { namespace coro = std; }
+#else
+#include <experimental/coroutine>
+namespace LUwpUtilities { namespace coro = std::experimental; }
+#endif
+
+namespace LUwpUtilities
+{
+	template<typename T> class CoTask;
+
+	namespace Coroutine
+	{
+		// Resume whoever awaited the finished task (or nobody)
+		struct FinalAwaiter
+		{
+			bool await_ready() noexcept { return false; }
+
+			template<typename Promise>
+			coro::coroutine_handle<> await_suspend(coro::coroutine_handle<Promise> finished) noexcept
+			{
+				auto continuation = finished.promise().continuation;
+				return continuation ? continuation : coro::noop_coroutine();
+			}
+
+			void await_resume() noexcept {}
+		};
+
+		struct PromiseBase
+		{
+			coro::coroutine_handle<> continuation;
+			std::exception_ptr error;
+
+			coro::suspend_always initial_suspend() noexcept { return coro::suspend_always(); }
+			FinalAwaiter final_suspend() noexcept { return FinalAwaiter(); }
+			void unhandled_exception() { error = std::current_exception(); }
+
+			void RethrowIfFailed()
+			{
+				if (error)
+					std::rethrow_exception(error);
+			}
+		};
+
+		template<typename T>
+		struct Promise : PromiseBase
+		{
+			T value;
+
+			CoTask<T> get_return_object();
+			void return_value(T result) { value = std::move(result); }
+		};
+
+		template<>
+		struct Promise<void> : PromiseBase
+		{
+			CoTask<void> get_return_object();
+			void return_void() {}
+		};
+	} // namespace Coroutine
+
+	// Lazily-started coroutine producing a T (T must be default-constructible); move-only
+	template<typename T>
+	class CoTask
+	{
+	public:
+		typedef Coroutine::Promise<T> promise_type;
+		typedef coro::coroutine_handle<promise_type> Handle;
+
+		CoTask() : _handle(nullptr)
+		{
+		}
+
+		explicit CoTask(Handle handle) : _handle(handle)
+		{
+		}
+
+		CoTask(CoTask &&other) noexcept : _handle(other._handle)
+		{
+			other._handle = nullptr;
+		}
+
+		CoTask &operator=(CoTask &&other) noexcept
+		{
+			if (this != &other)
+			{
+				if (_handle)
+					_handle.destroy();
+				_handle = other._handle;
+				other._handle = nullptr;
+			}
+			return *this;
+		}
+
+		CoTask(const CoTask&) = delete;
+		CoTask &operator=(const CoTask&) = delete;
+
+		~CoTask()
+		{
+			if (_handle)
+				_handle.destroy();
+		}
+
+		struct Awaiter
+		{
+			Handle handle;
+
+			bool await_ready() noexcept { return !handle || handle.done(); }
+
+			// Start the task and let it resume us directly when it is done
+			coro::coroutine_handle<> await_suspend(coro::coroutine_handle<> awaiting) noexcept
+			{
+				handle.promise().continuation = awaiting;
+				return handle;
+			}
+
+			T await_resume()
+			{
+				handle.promise().RethrowIfFailed();
+				return Result(handle.promise());
+			}
+
+		private:
+			template<typename P>
+			static T Result(P &promise) { return std::move(promise.value); }
+			static void Result(Coroutine::Promise<void>&) {}
+		};
+
+		Awaiter operator co_await() && noexcept
+		{
+			return Awaiter{ _handle };
+		}
+
+		Awaiter operator co_await() & noexcept
+		{
+			return Awaiter{ _handle };
+		}
+
+	private:
+		Handle _handle;
+	};
+
+	namespace Coroutine
+	{
+		template<typename T>
+		inline CoTask<T> Promise<T>::get_return_object()
+		{
+			return CoTask<T>(coro::coroutine_handle<Promise<T>>::from_promise(*this));
+		}
+
+		inline CoTask<void> Promise<void>::get_return_object()
+		{
+			return CoTask<void>(coro::coroutine_handle<Promise<void>>::from_promise(*this));
+		}
+
+		// Self-destroying coroutine used by Spawn()
+		struct Detached
+		{
+			struct promise_type
+			{
+				Detached get_return_object() { return Detached(); }
+				coro::suspend_never initial_suspend() noexcept { return coro::suspend_never(); }
+				coro::suspend_never final_suspend() noexcept { return coro::suspend_never(); }
+				void return_void() {}
+				void unhandled_exception() {}
+			};
+		};
+
+		inline Detached RunDetached(CoTask<void> task)
+		{
+			co_await std::move(task);
+		}
+	} // namespace Coroutine
+
+	// Start the task from non-coroutine code; it keeps itself alive until it completes.
+	// Exceptions escaping the task are swallowed (catch them inside the task).
+	inline void Spawn(CoTask<void> task)
+	{
+		Coroutine::RunDetached(std::move(task));
+	}
+
+	// co_await ResumeBackground() continues the coroutine on a ThreadPool worker
+	struct ResumeBackground
+	{
+		ThreadPool *pool;
+
+		explicit ResumeBackground(ThreadPool &pool = ThreadPool::Default()) : pool(&pool)
+		{
+		}
+
+		bool await_ready() noexcept { return false; }
+
+		void await_suspend(coro::coroutine_handle<> awaiting)
+		{
+			pool->Submit([awaiting]() { awaiting.resume(); });
+		}
+
+		void await_resume() noexcept {}
+	};
+} // namespace LUwpUtilities
+
+#ifdef LUU_EXPORT
+
+#include "TaskHelper.h"
+
+namespace LUwpUtilities
+{
+	namespace Coroutine
+	{
+		template<typename TAsync, typename TResult>
+		struct AsyncOperationAwaiterBase
+		{
+			TAsync operation;
+
+			bool await_ready() { return operation->Status != Windows::Foundation::AsyncStatus::Started; }
+			TResult await_resume() { return operation->GetResults(); }
+		};
+
+		template<typename TResult>
+		struct AsyncOperationAwaiter : AsyncOperationAwaiterBase<Windows::Foundation::IAsyncOperation<TResult>^, TResult>
+		{
+			void await_suspend(coro::coroutine_handle<> awaiting)
+			{
+				this->operation->Completed = ref new Windows::Foundation::AsyncOperationCompletedHandler<TResult>(
+					[awaiting](Windows::Foundation::IAsyncOperation<TResult>^, Windows::Foundation::AsyncStatus) { awaiting.resume(); });
+			}
+		};
+
+		template<typename TResult, typename TProgress>
+		struct AsyncOperationWithProgressAwaiter : AsyncOperationAwaiterBase<Windows::Foundation::IAsyncOperationWithProgress<TResult, TProgress>^, TResult>
+		{
+			void await_suspend(coro::coroutine_handle<> awaiting)
+			{
+				this->operation->Completed = ref new Windows::Foundation::AsyncOperationWithProgressCompletedHandler<TResult, TProgress>(
+					[awaiting](Windows::Foundation::IAsyncOperationWithProgress<TResult, TProgress>^, Windows::Foundation::AsyncStatus) { awaiting.resume(); });
+			}
+		};
+
+		struct AsyncActionAwaiter : AsyncOperationAwaiterBase<Windows::Foundation::IAsyncAction^, void>
+		{
+			void await_suspend(coro::coroutine_handle<> awaiting)
+			{
+				operation->Completed = ref new Windows::Foundation::AsyncActionCompletedHandler(
+					[awaiting](Windows::Foundation::IAsyncAction^, Windows::Foundation::AsyncStatus) { awaiting.resume(); });
+			}
+		};
+
+		template<typename TProgress>
+		struct AsyncActionWithProgressAwaiter : AsyncOperationAwaiterBase<Windows::Foundation::IAsyncActionWithProgress<TProgress>^, void>
+		{
+			void await_suspend(coro::coroutine_handle<> awaiting)
+			{
+				this->operation->Completed = ref new Windows::Foundation::AsyncActionWithProgressCompletedHandler<TProgress>(
+					[awaiting](Windows::Foundation::IAsyncActionWithProgress<TProgress>^, Windows::Foundation::AsyncStatus) { awaiting.resume(); });
+			}
+		};
+	} // namespace Coroutine
+
+	// Await a WinRT async operation; the coroutine resumes on the thread that completes the operation
+	// and await_resume() throws the operation's error, if any
+	template<typename TResult>
+	inline Coroutine::AsyncOperationAwaiter<TResult> AwaitAsync(Windows::Foundation::IAsyncOperation<TResult>^ operation)
+	{
+		Coroutine::AsyncOperationAwaiter<TResult> awaiter;
+		awaiter.operation = operation;
+		return awaiter;
+	}
+
+	template<typename TResult, typename TProgress>
+	inline Coroutine::AsyncOperationWithProgressAwaiter<TResult, TProgress> AwaitAsync(Windows::Foundation::IAsyncOperationWithProgress<TResult, TProgress>^ operation)
+	{
+		Coroutine::AsyncOperationWithProgressAwaiter<TResult, TProgress> awaiter;
+		awaiter.operation = operation;
+		return awaiter;
+	}
+
+	inline Coroutine::AsyncActionAwaiter AwaitAsync(Windows::Foundation::IAsyncAction^ action)
+	{
+		Coroutine::AsyncActionAwaiter awaiter;
+		awaiter.operation = action;
+		return awaiter;
+	}
+
+	template<typename TProgress>
+	inline Coroutine::AsyncActionWithProgressAwaiter<TProgress> AwaitAsync(Windows::Foundation::IAsyncActionWithProgress<TProgress>^ action)
+	{
+		Coroutine::AsyncActionWithProgressAwaiter<TProgress> awaiter;
+		awaiter.operation = action;
+		return awaiter;
+	}
+
+	// co_await ResumeOnDispatcher(dispatcher) continues the coroutine on the UI thread,
+	// batched with the other continuations of TH
+	struct ResumeOnDispatcher
+	{
+		Windows::UI::Core::CoreDispatcher^ dispatcher;
+
+		explicit ResumeOnDispatcher(Windows::UI::Core::CoreDispatcher^ dispatcher) : dispatcher(dispatcher)
+		{
+		}
+
+		bool await_ready() { return dispatcher == nullptr || dispatcher->HasThreadAccess; }
+
+		void await_suspend(coro::coroutine_handle<> awaiting)
+		{
+			TH::UIQueue(dispatcher).Post([awaiting]() { awaiting.resume(); });
+		}
+
+		void await_resume() {}
+	};
+} // namespace LUwpUtilities
+#endif
+
+#endif // #ifndef _LUWPUTILITIES_CO_TASK_
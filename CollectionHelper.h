@@ -1,5 +1,5 @@
 /**
- * Various static helper method MakeIntVector, MakeStringVector and MakeObjectVector to avoid the heavy header #include <collection.h>
+ * Various static helper method MakeIntVector, MakeStringVector, MakeObjectVector and MakeStringMap to avoid the heavy header #include <collection.h>
  */
 
 #ifndef _LUWPUTILITIES_COLLECTION_HELPER_
@@ -30,6 +30,11 @@ namespace LUwpUtilities
 		{
 			return ref new Platform::Collections::Vector<Platform::Object^>();
 		}
+
+		STATIC_INLINE Windows::Foundation::Collections::IMap<Platform::String^, Platform::String^>^ MakeStringMap()
+		{
+			return ref new Platform::Collections::Map<Platform::String^, Platform::String^>();
+		}
 	}; // class SH
 } // namespace LUwpUtilities
 #endif
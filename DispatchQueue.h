@@ -0,0 +1,177 @@
+/**
+ * Coalescing dispatcher for continuations that must run on the UI thread.
+ *
+ * Any thread can Post() work to a lock-free multi-producer/single-consumer queue.
+ * Only the first Post() after the queue became idle calls the wake-up callback, which
+ * must arrange for Drain() to be called once on the UI thread (e.g. via CoreDispatcher);
+ * Drain() then runs the whole batch, stopping early when the time budget is spent and
+ * waking itself up again for the rest. So 50 continuations finishing at once cost one
+ * UI-thread dispatch instead of 50.
+ *
+ * This header does not depend on C++/CX; the wake-up callback is the only link to the UI loop.
+ */
+
+#ifndef _LUWPUTILITIES_DISPATCH_QUEUE_
+#define _LUWPUTILITIES_DISPATCH_QUEUE_
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+
+namespace LUwpUtilities
+{
+	class CoalescingDispatcher
+	{
+	public:
+		typedef std::function<void()> Work;
+		typedef std::function<void()> WakeUp;
+
+		struct Statistics
+		{
+			size_t posted;
+			size_t executed;
+			size_t wakeUps;
+			size_t drains;
+		};
+
+		// Default budget is a quarter of a 60Hz frame
+		explicit CoalescingDispatcher(WakeUp wakeUp, std::chrono::microseconds budget = std::chrono::microseconds(4000))
+			: _wakeUp(wakeUp), _budget(budget)
+		{
+			_tail = new Node();
+			_head = _tail;
+			_scheduled = false;
+			_posted = 0;
+			_executed = 0;
+			_wakeUps = 0;
+			_drains = 0;
+		}
+
+		~CoalescingDispatcher()
+		{
+			Work work;
+			while (TryPop(work))
+				;
+			delete _tail;
+		}
+
+		CoalescingDispatcher(const CoalescingDispatcher&) = delete;
+		CoalescingDispatcher &operator=(const CoalescingDispatcher&) = delete;
+
+		// Queue work for the consumer (UI) thread; safe to call from any thread
+		void Post(Work work)
+		{
+			auto node = new Node();
+			node->work = std::move(work);
+			Node *previous = _head.exchange(node, std::memory_order_acq_rel);
+			previous->next.store(node, std::memory_order_release);
+
+			_posted.fetch_add(1, std::memory_order_relaxed);
+			if (!_scheduled.exchange(true))
+				RequestDrain();
+		}
+
+		// Run the queued work on the consumer thread until the queue is empty or the budget is spent.
+		// Return true if the queue was emptied.
+		bool Drain()
+		{
+			_drains.fetch_add(1, std::memory_order_relaxed);
+			auto deadline = std::chrono::steady_clock::now() + _budget;
+
+			Work work;
+			while (TryPop(work))
+			{
+				try
+				{
+					work();
+				}
+				catch (...)
+				{
+					// Let the exception reach the UI loop but do not strand the rest of the queue
+					RequestDrain();
+					throw;
+				}
+				work = nullptr;
+				_executed.fetch_add(1, std::memory_order_relaxed);
+
+				if (std::chrono::steady_clock::now() >= deadline)
+				{
+					if (IsEmpty())
+						break;
+					// Leave the rest for the next round; _scheduled stays true
+					RequestDrain();
+					return false;
+				}
+			}
+
+			_scheduled.store(false);
+			// A producer may have pushed after TryPop() failed but before _scheduled was reset
+			if (!IsEmpty() && !_scheduled.exchange(true))
+			{
+				RequestDrain();
+				return false;
+			}
+			return true;
+		}
+
+		Statistics GetStatistics() const
+		{
+			Statistics s;
+			s.posted = _posted.load(std::memory_order_relaxed);
+			s.executed = _executed.load(std::memory_order_relaxed);
+			s.wakeUps = _wakeUps.load(std::memory_order_relaxed);
+			s.drains = _drains.load(std::memory_order_relaxed);
+			return s;
+		}
+
+	private:
+		// Vyukov's intrusive MPSC queue: producers exchange _head, the consumer follows next from _tail
+		struct Node
+		{
+			std::atomic<Node*> next;
+			Work work;
+
+			Node() : next(nullptr)
+			{
+			}
+		};
+
+		// Consumer only
+		bool TryPop(Work &work)
+		{
+			Node *tail = _tail;
+			Node *next = tail->next.load(std::memory_order_acquire);
+			if (next == nullptr)
+				return false;
+
+			_tail = next;
+			work = std::move(next->work);
+			delete tail;
+			return true;
+		}
+
+		// Consumer only; a push in progress counts as not empty
+		bool IsEmpty() const
+		{
+			return _tail->next.load(std::memory_order_acquire) == nullptr && _head.load(std::memory_order_acquire) == _tail;
+		}
+
+		void RequestDrain()
+		{
+			_wakeUps.fetch_add(1, std::memory_order_relaxed);
+			_wakeUp();
+		}
+
+		WakeUp _wakeUp;
+		std::chrono::microseconds _budget;
+		std::atomic<Node*> _head;
+		Node *_tail;
+		std::atomic<bool> _scheduled;
+		std::atomic<size_t> _posted;
+		std::atomic<size_t> _executed;
+		std::atomic<size_t> _wakeUps;
+		std::atomic<size_t> _drains;
+	};
+} // namespace LUwpUtilities
+
+#endif // #ifndef _LUWPUTILITIES_DISPATCH_QUEUE_
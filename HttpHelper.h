@@ -11,11 +11,340 @@
 #ifdef LUU_EXPORT
 
 #include "LUwpUtilities.h"
+#include "BufferHelper.cpp"
+#include "ChunkStream.h"
+#include "CollectionHelper.h"
+#include "JsonReader.h"
+#include "LoadGenerator.h"
+#include "RequestCoalescer.h"
+#include "RequestPolicy.h"
+#include "RequestRecorder.h"
+#include "RequestScheduler.h"
+#include "ResponseCache.h"
+#include "SegmentedDownload.h"
+#include "Sha256.h"
+#include "StorageHelper.h"
+#include "StringHelper.cpp"
+#include "TaskHelper.h"
+#include "UrlCodec.h"
 #include <ppltasks.h>
+#include <direct.h>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace LUwpUtilities
 {
 	LUU_EXPORT delegate void HttpResponseHandler(Windows::Web::Http::HttpResponseMessage^ response);
+	// A piece of a streamed body, only valid during the call; return false to stop reading
+	LUU_EXPORT delegate bool HttpChunkHandler(Windows::Storage::Streams::IBuffer^ chunk);
+	// Bytes written so far and size of the file (-1 until known)
+	LUU_EXPORT delegate void HttpDownloadProgressHandler(uint64 done, int64 size);
+
+	/// Request path measured by Http::RunLoadAsync
+	LUU_EXPORT enum class HttpLoadPath
+	{
+		Get,       // GetAsync: host scheduler and coalescing
+		Policy,    // GetWithPolicyAsync with a default HttpRequestPolicy
+		Streaming, // GetStreamingAsync, the body is counted and dropped
+		Cached     // GetCachedAsync
+	};
+
+	// Outcome of a GET shared by the callers of Http::GetAsync
+	struct HttpResult
+	{
+		Windows::Web::Http::HttpResponseMessage^ response;
+		Platform::Exception^ error;
+		int64_t admitted; // TaskTrace::Now() when the scheduler started the request, 0 if not traced
+
+		HttpResult() : admitted(0)
+		{
+		}
+	};
+
+	typedef RequestCoalescer<HttpResult> HttpCoalescer;
+
+	// Operation in progress of an Http request (a scheduled GET, or the current step of
+	// Http::GetStreamingAsync), aborted on cancellation
+	struct HttpStreamState
+	{
+		std::mutex lock;
+		Windows::Foundation::IAsyncInfo^ pending;
+		bool cancelled = false;
+		// Keeps the last chunk alive while the consumer reads it
+		Windows::Storage::Streams::IBuffer^ chunk;
+		std::shared_ptr<CancellationState> cancellation;
+		size_t registration = 0;
+
+		~HttpStreamState()
+		{
+			if (cancellation != nullptr && registration != 0)
+				cancellation->Unregister(registration);
+		}
+
+		// Remember the operation in progress, or cancel it right away if the stream was cancelled
+		void Track(Windows::Foundation::IAsyncInfo^ operation)
+		{
+			bool cancel;
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				cancel = cancelled;
+				pending = operation;
+			}
+			if (cancel)
+				operation->Cancel();
+		}
+
+		void Cancel()
+		{
+			Windows::Foundation::IAsyncInfo^ operation;
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				cancelled = true;
+				operation = pending;
+			}
+			if (operation != nullptr)
+				operation->Cancel();
+		}
+	};
+
+	// Hands the chunks of Http::GetStreamingAsync to the delegates: on_chunk on the reading thread
+	// (through one reused IBuffer), on_complete and on_error on the dispatcher
+	class HttpChunkDelegates : public ChunkConsumer
+	{
+	public:
+		HttpChunkDelegates(
+			Windows::UI::Core::CoreDispatcher^ dispatcher,
+			HttpChunkHandler^ on_chunk,
+			HttpResponseHandler^ on_complete,
+			ExceptionHandler^ on_error
+		) : _dispatcher(dispatcher), _onChunk(on_chunk), _onComplete(on_complete), _onError(on_error)
+		{
+		}
+
+		Windows::Web::Http::HttpResponseMessage^ response;
+
+		bool OnChunk(BufferView chunk) override
+		{
+			if (_buffer == nullptr || _buffer->Capacity < chunk.size())
+				_buffer = ref new Windows::Storage::Streams::Buffer((unsigned int)chunk.size());
+			chunk.CopyTo(GetBufferData(_buffer));
+			_buffer->Length = (unsigned int)chunk.size();
+			return _onChunk(_buffer);
+		}
+
+		void OnEnd() override
+		{
+			auto on_complete = _onComplete;
+			auto on_error = _onError;
+			auto result = response;
+			TH::RunOnContext(_dispatcher, [=]()
+			{
+				try
+				{
+					if (on_complete != nullptr)
+						on_complete(result);
+				}
+				catch (Platform::Exception^ e)
+				{
+					if (on_error != nullptr)
+						on_error(e);
+				}
+			});
+		}
+
+		void OnError(std::exception_ptr error) override
+		{
+			auto on_error = _onError;
+			TH::RunOnContext(_dispatcher, [=]()
+			{
+				if (on_error == nullptr)
+					return;
+				try
+				{
+					std::rethrow_exception(error);
+				}
+				catch (Platform::Exception^ e)
+				{
+					on_error(e);
+				}
+				catch (...)
+				{
+					on_error(ref new Platform::FailureException());
+				}
+			});
+		}
+
+	private:
+		Windows::UI::Core::CoreDispatcher^ _dispatcher;
+		HttpChunkHandler^ _onChunk;
+		HttpResponseHandler^ _onComplete;
+		ExceptionHandler^ _onError;
+		Windows::Storage::Streams::Buffer^ _buffer;
+	};
+
+	// Target of Http::DownloadAsync: a StorageFile opened for random access. The calls block, which is
+	// fine on the network threads and the thread pool where the download runs (never the UI thread).
+	class StorageDownloadFile : public DownloadFile
+	{
+	public:
+		explicit StorageDownloadFile(Windows::Storage::StorageFile^ file)
+		{
+			_stream = Guard([&]()
+			{
+				return concurrency::create_task(file->OpenAsync(Windows::Storage::FileAccessMode::ReadWrite)).get();
+			});
+		}
+
+		~StorageDownloadFile()
+		{
+			Close();
+		}
+
+		// Release the file, e.g. before handing it to the app
+		void Close()
+		{
+			std::lock_guard<std::mutex> guard(_lock);
+			if (_stream != nullptr)
+			{
+				delete _stream;
+				_stream = nullptr;
+			}
+		}
+
+		uint64_t Size() override
+		{
+			std::lock_guard<std::mutex> guard(_lock);
+			return Guard([&]() { return (uint64_t)Stream()->Size; });
+		}
+
+		void Resize(uint64_t size) override
+		{
+			std::lock_guard<std::mutex> guard(_lock);
+			Guard([&]() { Stream()->Size = size; });
+		}
+
+		// The segments share one stream, so the writes take turns (they are far faster than the network)
+		void Write(uint64_t offset, const unsigned char *data, size_t size) override
+		{
+			std::lock_guard<std::mutex> guard(_lock);
+			Guard([&]()
+			{
+				if (_buffer == nullptr || _buffer->Capacity < size)
+					_buffer = ref new Windows::Storage::Streams::Buffer((unsigned int)size);
+				memcpy(GetBufferData(_buffer), data, size);
+				_buffer->Length = (unsigned int)size;
+				concurrency::create_task(Stream()->GetOutputStreamAt(offset)->WriteAsync(_buffer)).get();
+			});
+		}
+
+		size_t Read(uint64_t offset, unsigned char *data, size_t size) override
+		{
+			std::lock_guard<std::mutex> guard(_lock);
+			return Guard([&]()
+			{
+				auto buffer = ref new Windows::Storage::Streams::Buffer((unsigned int)size);
+				auto result = concurrency::create_task(Stream()->GetInputStreamAt(offset)->ReadAsync(buffer, (unsigned int)size,
+					Windows::Storage::Streams::InputStreamOptions::None)).get();
+				memcpy(data, GetBufferData(result), result->Length);
+				return (size_t)result->Length;
+			});
+		}
+
+		void Flush() override
+		{
+			std::lock_guard<std::mutex> guard(_lock);
+			Guard([&]() { concurrency::create_task(Stream()->FlushAsync()).get(); });
+		}
+
+	private:
+		Windows::Storage::Streams::IRandomAccessStream^ Stream()
+		{
+			if (_stream == nullptr)
+				throw ref new Platform::ObjectDisposedException();
+			return _stream;
+		}
+
+		// A storage error (disk full, access denied...) would fail again: no retry
+		template <typename F>
+		static auto Guard(F f) -> decltype(f())
+		{
+			try
+			{
+				return f();
+			}
+			catch (Platform::Exception^ e)
+			{
+				throw DownloadError(ToUtf8String(e->Message), true);
+			}
+		}
+
+		std::mutex _lock;
+		Windows::Storage::Streams::IRandomAccessStream^ _stream;
+		Windows::Storage::Streams::Buffer^ _buffer;
+	};
+
+	// Holds the scheduler slot of a request of Http::GetStreamingAsync until its body was read, stopped
+	// or failed, then hands the calls on
+	class HttpSlotConsumer : public ChunkConsumer
+	{
+	public:
+		HttpSlotConsumer(std::shared_ptr<ChunkConsumer> consumer, RequestScheduler::Done done)
+			: _consumer(std::move(consumer)), _done(std::move(done)), _released(false)
+		{
+		}
+
+		void OnStart(int64_t contentLength) override
+		{
+			_consumer->OnStart(contentLength);
+		}
+
+		bool OnChunk(BufferView chunk) override
+		{
+			if (_consumer->OnChunk(chunk))
+				return true;
+			Release();
+			return false;
+		}
+
+		void OnEnd() override
+		{
+			Release();
+			_consumer->OnEnd();
+		}
+
+		void OnError(std::exception_ptr error) override
+		{
+			Release();
+			_consumer->OnError(error);
+		}
+
+	private:
+		void Release()
+		{
+			if (!_released.exchange(true))
+				_done();
+		}
+
+		std::shared_ptr<ChunkConsumer> _consumer;
+		RequestScheduler::Done _done;
+		std::atomic<bool> _released;
+	};
+
+	// Shared by Http::DownloadAsync and its HttpDownload, which may be cancelled before the download starts
+	struct HttpDownloadState
+	{
+		std::mutex lock;
+		std::shared_ptr<SegmentedDownload> download;
+		bool cancelled = false;
+	};
 
 using namespace Concurrency;
 using namespace Windows::Foundation;
@@ -23,6 +352,125 @@ using namespace Windows::Storage::Streams;
 using namespace Windows::Web::Http;
 using namespace Windows::Web::Http::Filters;
 
+	/// Request queued by Http::GetAsync with a priority
+	[Windows::Foundation::Metadata::WebHostHidden]
+	LUU_EXPORT ref class HttpRequestHandle sealed
+	{
+	public:
+		/// Move the request to another priority lane if it is still waiting for a slot, e.g. to
+		/// UserBlocking when its element scrolls into view or to Idle when it scrolls out
+		void Reprioritize(TaskPriority priority)
+		{
+			_reprioritize((WorkPriority)priority);
+		}
+
+	internal:
+		HttpRequestHandle(std::function<void(WorkPriority priority)> reprioritize) : _reprioritize(reprioritize)
+		{
+		}
+
+	private:
+		std::function<void(WorkPriority priority)> _reprioritize;
+	};
+
+	/// Hedging and retry policy of Http::GetWithPolicyAsync, for idempotent requests. The latencies it
+	/// observes set the hedge delay, so use one policy per kind of endpoint (API, images...).
+	[Windows::Foundation::Metadata::WebHostHidden]
+	LUU_EXPORT ref class HttpRequestPolicy sealed
+	{
+	public:
+		/// Hedge after the 95th percentile latency, 3 attempts with backoff from 100 ms up to 5 s,
+		/// hedges and retries within 10% of the calls
+		HttpRequestPolicy() : _policy(std::make_shared<RequestPolicy>())
+		{
+		}
+
+		/// hedge_percentile 0 disables hedging; max_attempts 1 disables retries
+		HttpRequestPolicy(double hedge_percentile, int max_attempts, int base_backoff_ms, int max_backoff_ms, double budget_ratio)
+		{
+			auto options = RequestPolicy::DefaultOptions();
+			options.hedgePercentile = hedge_percentile;
+			options.maxAttempts = max_attempts;
+			options.baseBackoff = (uint64_t)base_backoff_ms * 1000;
+			options.maxBackoff = (uint64_t)max_backoff_ms * 1000;
+			options.budgetRatio = budget_ratio;
+			_policy = std::make_shared<RequestPolicy>(options);
+		}
+
+		/// Counters for tuning: calls, hedges (and how many answered first), retries and denials
+		Platform::String^ DescribeStatistics()
+		{
+			auto statistics = _policy->GetStatistics();
+			wchar_t text[200];
+			swprintf_s(text, L"calls=%zu hedges=%zu hedgeWins=%zu retries=%zu budgetDenied=%zu hedgeDelay=%llums",
+				statistics.calls, statistics.hedges, statistics.hedgeWins, statistics.retries, statistics.budgetDenied,
+				(unsigned long long)(statistics.hedgeDelay / 1000));
+			return ref new Platform::String(text);
+		}
+
+	internal:
+		// Shared with the calls in flight so that they can outlive this object
+		std::shared_ptr<RequestPolicy> Policy()
+		{
+			return _policy;
+		}
+
+	private:
+		std::shared_ptr<RequestPolicy> _policy;
+	};
+
+	/// Download in progress of Http::DownloadAsync
+	[Windows::Foundation::Metadata::WebHostHidden]
+	LUU_EXPORT ref class HttpDownload sealed
+	{
+	public:
+		/// Stop the download and keep what was downloaded: DownloadAsync with the same URL and file resumes it
+		void Cancel()
+		{
+			std::shared_ptr<SegmentedDownload> download;
+			{
+				std::lock_guard<std::mutex> guard(_state->lock);
+				_state->cancelled = true;
+				download = _state->download;
+			}
+			if (download != nullptr)
+				download->Cancel();
+		}
+
+		property uint64 BytesDone
+		{
+			uint64 get()
+			{
+				auto download = Download();
+				return (download != nullptr ? download->BytesDone() : 0);
+			}
+		}
+
+		/// -1 until known
+		property int64 Size
+		{
+			int64 get()
+			{
+				auto download = Download();
+				return (download != nullptr ? download->Size() : -1);
+			}
+		}
+
+	internal:
+		HttpDownload(std::shared_ptr<HttpDownloadState> state) : _state(state)
+		{
+		}
+
+	private:
+		std::shared_ptr<SegmentedDownload> Download()
+		{
+			std::lock_guard<std::mutex> guard(_state->lock);
+			return _state->download;
+		}
+
+		std::shared_ptr<HttpDownloadState> _state;
+	};
+
 	// Static methods to perform basic Http operations like cURL
 	LUU_EXPORT ref class Http sealed
 	{
@@ -42,20 +490,62 @@ using namespace Windows::Web::Http::Filters;
 			return httpClient;
 		}
 
+		// Decode the %HH escapes of the UTF-8 text (RFC 3986); '+' is left as is
 		STATIC_INLINE Platform::String^ DecodeUrl(
 			Platform::String^ text
 		)
 		{
-			// TODO Implement
-			return nullptr;
+			auto utf8 = ToUtf8String(text);
+			auto length = (utf8.empty() ? 0 : UrlDecode(utf8.data(), utf8.size(), &utf8[0]));
+			return ToPlatformString(utf8.data(), (int)length);
 		}
 
+		// Percent-encode the UTF-8 text except the unreserved characters (like encodeURIComponent)
 		STATIC_INLINE Platform::String^ EncodeUrl(
 			Platform::String^ text
 		)
 		{
-			// TODO Implement
-			return nullptr;
+			auto utf8 = ToUtf8String(text);
+			auto encoded = BufferPool::Default().Allocate<char>(UrlEncodedLength(utf8.data(), utf8.size()));
+			auto length = UrlEncode(utf8.data(), utf8.size(), encoded.Get());
+			return ToPlatformString(encoded.Get(), (int)length);
+		}
+
+		// "key1=value1&key2=value2" with the keys and values percent-encoded, e.g. from an IMap
+		STATIC_INLINE Platform::String^ BuildQuery(
+			Windows::Foundation::Collections::IIterable<Windows::Foundation::Collections::IKeyValuePair<Platform::String^, Platform::String^>^>^ parameters
+		)
+		{
+			std::vector<std::string> strings;
+			for (auto it = parameters->First(); it->HasCurrent; it->MoveNext())
+			{
+				strings.push_back(ToUtf8String(it->Current->Key));
+				strings.push_back(ToUtf8String(it->Current->Value));
+			}
+
+			QueryBuilder builder;
+			for (size_t i = 0; i < strings.size(); i += 2)
+				builder.Add(strings[i], strings[i + 1]);
+			auto query = BufferPool::Default().Allocate<char>(builder.Length());
+			auto length = builder.WriteTo(query.Get());
+			return ToPlatformString(query.Get(), (int)length);
+		}
+
+		// Decoded parameters of a query string (with or without the leading '?'); the last of repeated keys wins
+		STATIC_INLINE Windows::Foundation::Collections::IMap<Platform::String^, Platform::String^>^ ParseQuery(
+			Platform::String^ query
+		)
+		{
+			auto utf8 = ToUtf8String(query);
+			ParsedQuery parsed(utf8);
+			auto result = CH::MakeStringMap();
+			for (size_t i = 0; i < parsed.Count(); i++)
+			{
+				auto key = parsed.Key(i);
+				auto value = parsed.Value(i);
+				result->Insert(ToPlatformString(key.data, (int)key.length), ToPlatformString(value.data, (int)value.length));
+			}
+			return result;
 		}
 
 		STATIC_INLINE Platform::String^ HttpResponseToText(
@@ -72,11 +562,48 @@ using namespace Windows::Web::Http::Filters;
 			return create_task(response->Content->ReadAsBufferAsync()).get();
 		}
 
+		// Values at a JSON pointer in a UTF-8 body (e.g. from HttpResponseToBuffer), read without building
+		// a DOM nor widening the body: "/items/*/title" gives the title of every item. Strings are unescaped,
+		// numbers and true/false/null are as written, objects and arrays are skipped.
+		STATIC_INLINE Windows::Foundation::Collections::IVector<Platform::String^>^ ExtractJsonValues(
+			Windows::Storage::Streams::IBuffer^ buffer,
+			Platform::String^ pointer
+		)
+		{
+			auto values = CH::MakeStringVector();
+			JsonPointerExtractor extractor(std::vector<std::string>(1, ToUtf8String(pointer)), [values](size_t, JsonToken, Utf8Slice text)
+			{
+				values->Append(ToPlatformString(text.data, (int)text.length));
+				return true;
+			});
+			auto view = GetBufferView(buffer);
+			JsonPushParser parser(extractor);
+			if (!parser.Feed(view.Chars(), view.size()) || !parser.Finish())
+				throw ref new Platform::InvalidArgumentException(ToPlatformString(parser.ErrorMessage()));
+			return values;
+		}
+
 		STATIC_INLINE Windows::Web::Http::HttpResponseMessage^ Get(
 			Platform::String^ url
 		)
 		{
-			return create_task(GetHttpClient()->GetAsync(ref new Uri(url), HttpCompletionOption::ResponseContentRead)).get();
+			auto timing = RequestRecorder::Default().Begin(ToUtf8String(url));
+			if (timing == nullptr)
+				return create_task(GetHttpClient()->GetAsync(ref new Uri(url), HttpCompletionOption::ResponseContentRead)).get();
+
+			timing->sent = timing->enqueued;
+			HttpResponseMessage^ response = nullptr;
+			try
+			{
+				response = create_task(GetHttpClient()->GetAsync(ref new Uri(url), HttpCompletionOption::ResponseContentRead)).get();
+			}
+			catch (...)
+			{
+				RecordTiming(timing, nullptr, RequestCacheStatus::None, -1);
+				throw;
+			}
+			RecordTiming(timing, response, RequestCacheStatus::None, -1);
+			return response;
 		}
 
 		STATIC_INLINE void GetAsync(
@@ -84,59 +611,1231 @@ using namespace Windows::Web::Http::Filters;
 			HttpResponseHandler^ on_response
 		)
 		{
-			create_task(GetHttpClient()->GetAsync(ref new Uri(url), HttpCompletionOption::ResponseContentRead))
-				.then([=](task<HttpResponseMessage^> previous_task)
-			{
-				try
-				{
-					auto response = previous_task.get();
-					on_response(response);
-				}
-				catch (Platform::Exception^ e)
-				{
-				}
-			}, task_continuation_context::use_current());
+			GetAsync(url, on_response, nullptr);
 		}
 
+		// The handlers are called on the calling thread's dispatcher, coalesced with other continuations (see TH)
 		STATIC_INLINE void GetAsync(
 			Platform::String^ url,
 			HttpResponseHandler^ on_response,
 			ExceptionHandler^ on_error
 		)
 		{
-			create_task(GetHttpClient()->GetAsync(ref new Uri(url), HttpCompletionOption::ResponseContentRead))
-				.then([=](task<HttpResponseMessage^> previous_task)
+			GetAsync(url, on_response, on_error, nullptr);
+		}
+
+		// Identical GETs in flight (same URL once normalized) share one request: every caller gets the
+		// same (fully buffered) response object, so none of them should Close() it.
+		// Cancelling the token drops this caller, with an OperationCanceledException to on_error;
+		// the request itself is aborted when every caller sharing it was cancelled.
+		STATIC_INLINE void GetAsync(
+			Platform::String^ url,
+			HttpResponseHandler^ on_response,
+			ExceptionHandler^ on_error,
+			TaskCancellation^ cancellation
+		)
+		{
+			GetAsync(url, on_response, on_error, cancellation, TaskPriority::Normal);
+		}
+
+		// The requests wait in a scheduler (see RequestScheduler.h) for a slot of their host, most
+		// urgent priority first, so that a burst of Prefetch thumbnails does not hold back the
+		// UserBlocking call the user is waiting on. The handle reprioritizes the request while it
+		// waits, e.g. once the element it is for becomes visible.
+		STATIC_INLINE HttpRequestHandle^ GetAsync(
+			Platform::String^ url,
+			HttpResponseHandler^ on_response,
+			ExceptionHandler^ on_error,
+			TaskCancellation^ cancellation,
+			TaskPriority priority
+		)
+		{
+			auto dispatcher = TH::CurrentDispatcher();
+			auto key = NormalizeUrl(ToUtf8String(url));
+			auto state = (cancellation == nullptr ? nullptr : cancellation->State());
+			if (state != nullptr && state->IsCancelled())
 			{
-				try
-				{
-					auto response = previous_task.get();
-					on_response(response);
-				}
-				catch (Platform::Exception^ e)
+				TH::RunOnContext(dispatcher, [=]()
 				{
 					if (on_error != nullptr)
-						on_error(e);
+						on_error(ref new Platform::OperationCanceledException());
+				});
+				return ref new HttpRequestHandle([](WorkPriority) {});
+			}
+
+			// The wait for a scheduler slot is the queue wait, the network time is the execution
+			auto timer = TaskTrace::Timer::Enqueue("Http::GetAsync");
+			// Id of the cancellation callback; Unregistered once the request completed
+			auto registration = std::make_shared<std::atomic<size_t>>(0);
+			auto work_priority = (WorkPriority)priority;
+			auto ticket = GetCoalescer().Request(key, [url, key, work_priority](HttpCoalescer::Callback complete)
+			{
+				return ScheduleGet(url, key, work_priority, complete, TraceAdmission(), std::make_shared<std::atomic<size_t>>(0));
+			}, [=](const HttpResult &result)
+			{
+				// Callers that joined the request late count their queue wait up to its admission at most
+				auto trace = timer;
+				trace.StartedAt(result.admitted);
+				trace.End();
+				if (state != nullptr)
+				{
+					auto id = registration->exchange(SIZE_MAX);
+					if (id != 0)
+						state->Unregister(id);
 				}
-			}, task_continuation_context::use_current());
+
+				auto response = result.response;
+				auto error = result.error;
+				TH::RunOnContext(dispatcher, [=]()
+				{
+					trace.Dispatched();
+					try
+					{
+						if (error != nullptr)
+							throw error;
+						if (state != nullptr && state->IsCancelled())
+							throw ref new Platform::OperationCanceledException();
+						on_response(response);
+					}
+					catch (Platform::Exception^ e)
+					{
+						if (on_error != nullptr)
+							on_error(e);
+					}
+				});
+			});
+
+			if (state != nullptr)
+			{
+				auto id = state->Register([=]()
+				{
+					// Still waiting: this caller gets the cancellation now, the others keep waiting
+					if (GetCoalescer().Leave(key, ticket))
+					{
+						TH::RunOnContext(dispatcher, [=]()
+						{
+							if (on_error != nullptr)
+								on_error(ref new Platform::OperationCanceledException());
+						});
+					}
+				});
+				// Completed already ran (or Register() cancelled right away): nothing to keep
+				if (id != 0 && registration->exchange(id) == SIZE_MAX)
+					state->Unregister(id);
+			}
+
+			// The request this call started or joined, if it still waits for a slot; joining it can only
+			// make it more urgent
+			auto waiting = WaitingGet(key);
+			Reschedule(waiting, work_priority, true);
+			return ref new HttpRequestHandle([waiting](WorkPriority priority) { Reschedule(waiting, priority, false); });
 		}
 
-		STATIC_INLINE void PrintHttpResponse(HttpResponseMessage^ response)
+		// GetAsync for idempotent GETs that should not wait for one slow or failed attempt: a duplicate
+		// is sent when the first attempt is slower than the policy's percentile and the first answer
+		// wins; network errors, 408, 429 and 5xx are retried with jittered exponential backoff, within
+		// the policy's retry budget. Once out of attempts, the last answer (or error) is delivered.
+		// The attempts are not shared with GetAsync callers, but they go through the host scheduler.
+		STATIC_INLINE void GetWithPolicyAsync(
+			Platform::String^ url,
+			HttpResponseHandler^ on_response,
+			ExceptionHandler^ on_error,
+			TaskCancellation^ cancellation,
+			HttpRequestPolicy^ policy
+		)
 		{
-			if (response == nullptr)
+			auto dispatcher = TH::CurrentDispatcher();
+			auto state = (cancellation == nullptr ? nullptr : cancellation->State());
+			if (state != nullptr && state->IsCancelled())
+			{
+				TH::RunOnContext(dispatcher, [=]()
+				{
+					if (on_error != nullptr)
+						on_error(ref new Platform::OperationCanceledException());
+				});
 				return;
+			}
 
-			create_task(response->Content->ReadAsBufferAsync())
-				.then([response](IBuffer^ responseBuffer)
+			// Queue wait up to the admission of the first attempt; the retries count as execution
+			auto timer = TaskTrace::Timer::Enqueue("Http::GetWithPolicyAsync");
+			auto admitted = TraceAdmission();
+			auto registration = std::make_shared<std::atomic<size_t>>(0);
+			auto key = NormalizeUrl(ToUtf8String(url));
+			auto engine = policy->Policy();
+			auto cancel = engine->Execute<HttpResult>([url, key, engine, admitted](RequestPolicy::AttemptDone<HttpResult> done)
 			{
-				OutputDebugString(response->ToString()->Data());
-				auto responseReader = DataReader::FromBuffer(responseBuffer);
-				auto size = responseReader->UnconsumedBufferLength;
-				char *buf = new char[size + 1];
-				for (int i = 0; i < size; i++)
-					buf[i] = responseReader->ReadByte();
-				buf[size] = '\0';
-				OutputDebugStringA(buf);
-				delete[] buf;
+				// Capturing engine keeps the policy alive as long as the call
+				return ScheduleGet(url, key, WorkPriority::Normal, [done](const HttpResult &result)
+				{
+					done(result, Classify(result));
+				}, admitted);
+			}, [=](const HttpResult &result, AttemptOutcome)
+			{
+				auto trace = timer;
+				trace.StartedAt(result.admitted);
+				trace.End();
+				if (state != nullptr)
+				{
+					auto id = registration->exchange(SIZE_MAX);
+					if (id != 0)
+						state->Unregister(id);
+				}
+
+				auto response = result.response;
+				auto error = result.error;
+				TH::RunOnContext(dispatcher, [=]()
+				{
+					trace.Dispatched();
+					try
+					{
+						if (error != nullptr)
+							throw error;
+						on_response(response);
+					}
+					catch (Platform::Exception^ e)
+					{
+						if (on_error != nullptr)
+							on_error(e);
+					}
+				});
+			});
+
+			if (state != nullptr)
+			{
+				auto id = state->Register([=]()
+				{
+					if (cancel())
+					{
+						TH::RunOnContext(dispatcher, [=]()
+						{
+							if (on_error != nullptr)
+								on_error(ref new Platform::OperationCanceledException());
+						});
+					}
+				});
+				if (id != 0 && registration->exchange(id) == SIZE_MAX)
+					state->Unregister(id);
+			}
+		}
+
+		// Concurrency and rate limits of the requests to a host ("example.com" or "example.com:8080");
+		// requests_per_second 0 means no rate limit, burst is how many may start at once after a pause
+		STATIC_INLINE void SetHostLimits(
+			Platform::String^ host,
+			int concurrency,
+			double requests_per_second,
+			int burst
+		)
+		{
+			RequestScheduler::HostLimits limits;
+			limits.concurrency = (size_t)(concurrency < 1 ? 1 : concurrency);
+			limits.ratePerSecond = requests_per_second;
+			limits.burst = burst;
+			GetScheduler().SetHostLimits(ToUtf8String(host), limits);
+		}
+
+		// Stream the body instead of buffering it whole: on_chunk gets it piece by piece (at most 64 KB,
+		// one at a time, on a background thread) as soon as the headers are in and returns false to stop;
+		// on_complete then gets the response (whose content was consumed) and on_error gets a failure,
+		// a status other than 2xx or the cancellation, both on the calling thread's dispatcher. Like GetAsync,
+		// the request waits for a slot of its host (see SetHostLimits), which it holds until the body was read
+		STATIC_INLINE void GetStreamingAsync(
+			Platform::String^ url,
+			HttpChunkHandler^ on_chunk,
+			HttpResponseHandler^ on_complete,
+			ExceptionHandler^ on_error,
+			TaskCancellation^ cancellation
+		)
+		{
+			auto consumer = std::make_shared<HttpChunkDelegates>(TH::CurrentDispatcher(), on_chunk, on_complete, on_error);
+			GetStreamingAsync(ref new HttpRequestMessage(HttpMethod::Get, ref new Uri(url)), consumer, [consumer](HttpResponseMessage^ response)
+			{
+				response->EnsureSuccessStatusCode();
+				consumer->response = response;
+			}, cancellation);
+		}
+
+		// Download the URL to the file chunk by chunk instead of buffering the body (see SegmentedDownload.h):
+		// when the server supports Range, 4 MB segments are fetched over up to 4 connections and a segment
+		// that fails resumes from its last byte. The progress is saved under LocalFolder\Downloads, so that
+		// calling DownloadAsync again with the same URL and file after a cancellation, an error or a restart
+		// of the app resumes the download (with If-Range: a file that changed on the server starts over).
+		// Every segment in progress holds a slot of the host in the scheduler of GetAsync (see SetHostLimits).
+		// Once complete, the file is checked against sha256 (hexadecimal, or null to skip). on_progress,
+		// on_complete and on_error (OperationCanceledException on cancellation) run on the calling thread's
+		// dispatcher.
+		STATIC_INLINE HttpDownload^ DownloadAsync(
+			Platform::String^ url,
+			Windows::Storage::StorageFile^ file,
+			Platform::String^ sha256,
+			HttpDownloadProgressHandler^ on_progress,
+			FileHandler^ on_complete,
+			ExceptionHandler^ on_error
+		)
+		{
+			auto dispatcher = TH::CurrentDispatcher();
+			auto state = std::make_shared<HttpDownloadState>();
+			auto options = SegmentedDownload::DefaultOptions();
+			options.sha256 = (sha256 != nullptr ? ToUtf8String(sha256) : std::string());
+
+			auto fail = [dispatcher, on_error](std::exception_ptr error)
+			{
+				TH::RunOnContext(dispatcher, [=]()
+				{
+					if (on_error == nullptr)
+						return;
+					try
+					{
+						std::rethrow_exception(error);
+					}
+					catch (const DownloadCancelled&)
+					{
+						on_error(ref new Platform::OperationCanceledException());
+					}
+					catch (Platform::Exception^ e)
+					{
+						on_error(e);
+					}
+					catch (const std::exception &e)
+					{
+						on_error(ref new Platform::FailureException(ToPlatformString(e.what())));
+					}
+					catch (...)
+					{
+						on_error(ref new Platform::FailureException());
+					}
+				});
+			};
+
+			// The progress of the latest chunk, posted to the dispatcher at most once at a time
+			struct Progress
+			{
+				std::atomic<uint64_t> done;
+				std::atomic<int64_t> size;
+				std::atomic<bool> posted;
+			};
+			auto progress = std::make_shared<Progress>();
+			progress->done = 0;
+			progress->size = -1;
+			progress->posted = false;
+
+			// Opening the file blocks
+			ThreadPool::Default().Submit([=]()
+			{
+				std::shared_ptr<StorageDownloadFile> target;
+				auto download_options = options;
+				try
+				{
+					target = std::make_shared<StorageDownloadFile>(file);
+					auto key = ToUtf8String(url) + "\n" + ToUtf8String(file->Path);
+					download_options.statePath = DownloadStatePath(key);
+				}
+				catch (...)
+				{
+					fail(std::current_exception());
+					return;
+				}
+
+				auto fetch = [url](const RangeRequest &range, SegmentedDownload::Headers headers, std::shared_ptr<ChunkConsumer> consumer)
+				{
+					return FetchRange(url, range, headers, consumer);
+				};
+				auto report = [dispatcher, on_progress, progress](uint64_t done, int64_t size)
+				{
+					progress->done = done;
+					progress->size = size;
+					if (on_progress == nullptr || progress->posted.exchange(true))
+						return;
+					TH::RunOnContext(dispatcher, [=]()
+					{
+						progress->posted = false;
+						on_progress(progress->done, progress->size);
+					});
+				};
+				auto done = [dispatcher, file, target, on_complete, fail](std::exception_ptr error)
+				{
+					target->Close();
+					if (error != nullptr)
+					{
+						fail(error);
+						return;
+					}
+					TH::RunOnContext(dispatcher, [=]()
+					{
+						try
+						{
+							if (on_complete != nullptr)
+								on_complete(file);
+						}
+						catch (Platform::Exception^ e)
+						{
+							fail(std::make_exception_ptr(e));
+						}
+					});
+				};
+
+				{
+					std::lock_guard<std::mutex> guard(state->lock);
+					if (state->cancelled)
+					{
+						fail(std::make_exception_ptr(DownloadCancelled()));
+						return;
+					}
+				}
+				auto download = SegmentedDownload::Start(ToUtf8String(url), fetch, target, download_options, report, done);
+				bool cancelled;
+				{
+					std::lock_guard<std::mutex> guard(state->lock);
+					state->download = download;
+					cancelled = state->cancelled;
+				}
+				if (cancelled)
+					download->Cancel();
+			});
+			return ref new HttpDownload(state);
+		}
+
+		// Load test of a request path of this library (see LoadGenerator.h), e.g. against a local stand-in
+		// of the backend such as tools/LoopbackServer: concurrency requests in flight until requests were
+		// measured (after 20 warmup ones), as fast as they complete or at requests_per_second if not 0
+		// (latencies then count from when each request was due). "{i}" in the URL is replaced by the request number, to measure
+		// requests that are not coalesced or cached. on_report gets requests/s, errors and latency
+		// percentiles on the calling thread's dispatcher, also after a cancellation.
+		STATIC_INLINE void RunLoadAsync(
+			Platform::String^ url,
+			HttpLoadPath path,
+			int concurrency,
+			int requests,
+			double requests_per_second,
+			StringHandler^ on_report,
+			TaskCancellation^ cancellation
+		)
+		{
+			auto dispatcher = TH::CurrentDispatcher();
+			auto state = (cancellation == nullptr ? nullptr : cancellation->State());
+			auto options = LoadGenerator::DefaultOptions();
+			options.concurrency = (size_t)(concurrency < 1 ? 1 : concurrency);
+			options.requests = (size_t)(requests < 0 ? 0 : requests);
+			options.ratePerSecond = requests_per_second;
+			auto pattern = ToUtf8String(url);
+			auto policy = (path == HttpLoadPath::Policy ? ref new HttpRequestPolicy() : nullptr);
+			auto registration = std::make_shared<std::atomic<size_t>>(0);
+
+			auto request = [pattern, path, policy](size_t index, LoadGenerator::RequestDone done)
+			{
+				auto target = pattern;
+				auto number = std::to_string(index);
+				for (size_t found; (found = target.find("{i}")) != std::string::npos; )
+					target.replace(found, 3, number);
+				auto uri = ToPlatformString(target.data(), (int)target.size());
+
+				auto on_response = ref new HttpResponseHandler([done](HttpResponseMessage^ response)
+				{
+					auto length = response->Content->Headers->ContentLength;
+					done(response->IsSuccessStatusCode, length != nullptr ? (int64_t)length->Value : -1);
+				});
+				auto on_error = ref new ExceptionHandler([done](Platform::Exception^)
+				{
+					done(false, -1);
+				});
+				switch (path)
+				{
+				case HttpLoadPath::Policy:
+					GetWithPolicyAsync(uri, on_response, on_error, nullptr, policy);
+					break;
+				case HttpLoadPath::Streaming:
+					GetStreamingAsync(ref new HttpRequestMessage(HttpMethod::Get, ref new Uri(uri)), std::make_shared<CountingConsumer>(done),
+						nullptr, nullptr);
+					break;
+				case HttpLoadPath::Cached:
+					GetCachedAsync(uri, on_response, on_error, false);
+					break;
+				default:
+					GetAsync(uri, on_response, on_error, nullptr);
+					break;
+				}
+			};
+			auto finished = [dispatcher, on_report, state, registration](const LoadReport &report)
+			{
+				if (state != nullptr)
+				{
+					auto id = registration->exchange(SIZE_MAX);
+					if (id != 0)
+						state->Unregister(id);
+				}
+				auto text = report.Describe();
+				auto description = ToPlatformString(text.data(), (int)text.size());
+				TH::RunOnContext(dispatcher, [=]()
+				{
+					if (on_report != nullptr)
+						on_report(description);
+				});
+			};
+
+			// Started from the thread pool, the request paths complete without a trip to the dispatcher
+			ThreadPool::Default().Submit([=]()
+			{
+				auto generator = LoadGenerator::Start(request, options, finished);
+				if (state != nullptr)
+				{
+					auto id = state->Register([generator]()
+					{
+						generator->Cancel();
+					});
+					if (id != 0 && registration->exchange(id) == SIZE_MAX)
+						state->Unregister(id);
+				}
+			});
+		}
+
+		// GET through the application-level response cache (see ResponseCache.h): a fresh entry is served
+		// without any request, an expired one is revalidated with If-None-Match/If-Modified-Since and served
+		// from the cache on 304 Not Modified. With stale_while_revalidate, a stale entry is served right away
+		// and refreshed in background for next time. Responses from the cache have Source == Cache.
+		// The requests go through the scheduler of GetAsync, the background refreshes at Prefetch priority.
+		STATIC_INLINE void GetCachedAsync(
+			Platform::String^ url,
+			HttpResponseHandler^ on_response,
+			ExceptionHandler^ on_error,
+			bool stale_while_revalidate
+		)
+		{
+			auto dispatcher = TH::CurrentDispatcher();
+			// The same entry for the spellings of a URL, as for the coalescer
+			auto key = NormalizeUrl(ToUtf8String(url));
+			// The disk tier is read in background
+			ThreadPool::Default().Submit([=]()
+			{
+				try
+				{
+					auto &cache = GetResponseCache();
+					auto entry = cache.Find(key);
+					if (entry != nullptr)
+					{
+						auto freshness = ResponseCache::Check(*entry, ResponseCache::Now(), stale_while_revalidate);
+						if (freshness != CacheFreshness::Expired)
+						{
+							cache.RecordHit(entry);
+							RecordCacheHit(key, entry, freshness == CacheFreshness::Stale ? RequestCacheStatus::Stale : RequestCacheStatus::Hit);
+							Respond(dispatcher, MakeCachedResponse(url, entry), nullptr, on_response, on_error);
+							if (freshness == CacheFreshness::Stale)
+							{
+								// Already answered: a failed refresh only leaves the entry stale
+								try
+								{
+									SendCachedRequest(url, key, entry, nullptr, nullptr, nullptr, WorkPriority::Prefetch);
+								}
+								catch (...)
+								{
+								}
+							}
+							return;
+						}
+					}
+					SendCachedRequest(url, key, entry, dispatcher, on_response, on_error, WorkPriority::Normal);
+				}
+				catch (...)
+				{
+					Respond(dispatcher, nullptr, CurrentPlatformException(), on_response, on_error);
+				}
+			});
+		}
+
+		// Drop the cached response of the URL from memory and disk
+		STATIC_INLINE void InvalidateCachedResponse(Platform::String^ url)
+		{
+			GetResponseCache().Remove(NormalizeUrl(ToUtf8String(url)));
+		}
+
+		// Counters of GetCachedAsync: served from cache, revalidated (304), downloaded and bytes not downloaded
+		STATIC_INLINE Platform::String^ DescribeCacheStatistics()
+		{
+			auto statistics = GetResponseCache().GetStatistics();
+			wchar_t text[160];
+			swprintf_s(text, L"hits=%zu revalidations=%zu misses=%zu bytesSaved=%llu",
+				statistics.hits, statistics.revalidations, statistics.misses, (unsigned long long)statistics.bytesSaved);
+			return ref new Platform::String(text);
+		}
+
+		// Record the timings of every request from now on (see RequestRecorder.h): queue time, time to
+		// headers, time to last byte, body size and cache status, by request and by host
+		STATIC_INLINE void EnableRequestTimings(bool enabled)
+		{
+			RequestRecorder::Default().Enable(enabled);
+		}
+
+		// Percentiles (in milliseconds) and counters of the recorded requests, by host
+		STATIC_INLINE Platform::String^ DescribeRequestTimings()
+		{
+			auto text = RequestRecorder::Default().Dump();
+			return ToPlatformString(text.data(), (int)text.size());
+		}
+
+		// The last recorded requests, one CSV line each
+		STATIC_INLINE Platform::String^ ExportRequestTimings()
+		{
+			auto text = RequestRecorder::Default().ExportCsv();
+			return ToPlatformString(text.data(), (int)text.size());
+		}
+
+		STATIC_INLINE void PrintHttpResponse(HttpResponseMessage^ response)
+		{
+			if (response == nullptr)
+				return;
+
+			create_task(response->Content->ReadAsBufferAsync())
+				.then([response](IBuffer^ responseBuffer)
+			{
+				OutputDebugString(response->ToString()->Data());
+				auto buf = BufferToPooledCString(responseBuffer);
+				OutputDebugStringA(buf.Get());
+			});
+		}
+	internal:
+		// Send the request, and once the headers are read stream the body to the consumer from a
+		// background thread: the next chunk (at most chunk_size bytes, in a single reused buffer) is only
+		// read when the consumer is done with the previous one. on_headers looks at the response first
+		// and throws to reject it (by default, a status other than 2xx is an error). On cancellation
+		// the operation in progress is aborted and the consumer gets an OperationCanceledException.
+		// The request first waits for a slot of its host in the scheduler of GetAsync, at priority.
+		STATIC_INLINE void GetStreamingAsync(
+			HttpRequestMessage^ request,
+			std::shared_ptr<ChunkConsumer> consumer,
+			std::function<void(HttpResponseMessage^ response)> on_headers,
+			TaskCancellation^ cancellation,
+			WorkPriority priority = WorkPriority::Normal,
+			size_t chunk_size = ChunkPump::DefaultChunkSize
+		)
+		{
+			auto url = ToUtf8String(request->RequestUri->AbsoluteUri);
+			auto timing = RequestRecorder::Default().Begin(url);
+			if (timing != nullptr)
+				consumer = std::make_shared<RecordingConsumer>(consumer, timing, RequestRecorder::Default());
+
+			auto stream = std::make_shared<HttpStreamState>();
+			// Scheduler ticket of the request: 0 until Submit() returned, SIZE_MAX once it started
+			auto ticket = std::make_shared<std::atomic<size_t>>(0);
+			if (cancellation != nullptr)
+			{
+				std::weak_ptr<HttpStreamState> weak = stream;
+				stream->cancellation = cancellation->State();
+				stream->registration = stream->cancellation->Register([weak, ticket, consumer]()
+				{
+					auto alive = weak.lock();
+					if (alive == nullptr)
+						return;
+					alive->Cancel();
+					// Still waiting for a slot: it never starts
+					auto waiting = ticket->load();
+					if (waiting != 0 && waiting != SIZE_MAX && GetScheduler().Cancel(waiting))
+					{
+						try
+						{
+							consumer->OnError(std::make_exception_ptr(ref new Platform::OperationCanceledException()));
+						}
+						catch (...)
+						{
+						}
+					}
+				});
+			}
+
+			// The slot is held until the body was read, stopped or failed, so that the host limits count
+			// the open streams and not only their headers
+			auto start = [=](RequestScheduler::Done release)
+			{
+				ticket->store(SIZE_MAX);
+				auto held = std::make_shared<HttpSlotConsumer>(consumer, release);
+				if (timing != nullptr)
+					timing->sent = RequestRecorder::Default().Now();
+
+				auto fail = [held](std::exception_ptr error)
+				{
+					try
+					{
+						held->OnError(error);
+					}
+					catch (...)
+					{
+					}
+				};
+
+				IAsyncOperationWithProgress<HttpResponseMessage^, HttpProgress>^ send;
+				try
+				{
+					send = GetHttpClient()->SendRequestAsync(request, HttpCompletionOption::ResponseHeadersRead);
+				}
+				catch (...)
+				{
+					fail(std::current_exception());
+					return;
+				}
+				stream->Track(send);
+				send->Completed = ref new AsyncOperationWithProgressCompletedHandler<HttpResponseMessage^, HttpProgress>(
+					[=](IAsyncOperationWithProgress<HttpResponseMessage^, HttpProgress>^ operation, AsyncStatus status)
+				{
+					HttpResponseMessage^ response;
+					int64_t content_length = -1;
+					try
+					{
+						if (status == AsyncStatus::Canceled)
+							throw ref new Platform::OperationCanceledException();
+						response = operation->GetResults();
+						if (timing != nullptr)
+						{
+							timing->headers = RequestRecorder::Default().Now();
+							timing->status = (int)response->StatusCode;
+						}
+						if (on_headers)
+							on_headers(response);
+						else
+							response->EnsureSuccessStatusCode();
+						auto length = response->Content->Headers->ContentLength;
+						if (length != nullptr)
+							content_length = (int64_t)length->Value;
+					}
+					catch (...)
+					{
+						fail(std::current_exception());
+						return;
+					}
+
+					auto open = response->Content->ReadAsInputStreamAsync();
+					stream->Track(open);
+					open->Completed = ref new AsyncOperationWithProgressCompletedHandler<IInputStream^, unsigned long long>(
+						[=](IAsyncOperationWithProgress<IInputStream^, unsigned long long>^ operation, AsyncStatus status)
+					{
+						IInputStream^ input;
+						try
+						{
+							if (status == AsyncStatus::Canceled)
+								throw ref new Platform::OperationCanceledException();
+							input = operation->GetResults();
+						}
+						catch (...)
+						{
+							fail(std::current_exception());
+							return;
+						}
+
+						auto buffer = ref new Buffer((unsigned int)chunk_size);
+						ChunkPump::Start([=](size_t capacity, ChunkPump::ReadDone done)
+						{
+							// The response stays alive as long as its stream is read
+							(void)response;
+							auto read = input->ReadAsync(buffer, (unsigned int)capacity, InputStreamOptions::Partial);
+							stream->Track(read);
+							read->Completed = ref new AsyncOperationWithProgressCompletedHandler<IBuffer^, unsigned int>(
+								[=](IAsyncOperationWithProgress<IBuffer^, unsigned int>^ operation, AsyncStatus status)
+							{
+								BufferView chunk;
+								std::exception_ptr error;
+								try
+								{
+									if (status == AsyncStatus::Canceled)
+										throw ref new Platform::OperationCanceledException();
+									stream->chunk = operation->GetResults();
+									chunk = GetBufferView(stream->chunk);
+								}
+								catch (...)
+								{
+									error = std::current_exception();
+								}
+								done(chunk, error);
+							});
+						}, held, content_length, chunk_size);
+					});
+				});
+			};
+
+			auto submitted = GetScheduler().Submit(UrlAuthority(NormalizeUrl(url)), priority, start);
+			// Unless it started already
+			size_t none = 0;
+			ticket->compare_exchange_strong(none, submitted);
+		}
+
+		// Stream the JSON body of a GET to the handler (see JsonReader.h) as it is downloaded, so that only
+		// one chunk is in memory; done gets null once the document was read or the handler stopped it, or
+		// the error (network, status, invalid JSON, cancellation). Everything runs on a background thread.
+		STATIC_INLINE void GetJsonAsync(
+			Platform::String^ url,
+			std::shared_ptr<JsonHandler> handler,
+			std::function<void(std::exception_ptr error)> done,
+			TaskCancellation^ cancellation
+		)
+		{
+			auto consumer = std::make_shared<JsonChunkConsumer>(std::move(handler), std::move(done));
+			GetStreamingAsync(ref new HttpRequestMessage(HttpMethod::Get, ref new Uri(url)), consumer, [](HttpResponseMessage^ response)
+			{
+				response->EnsureSuccessStatusCode();
+			}, cancellation);
+		}
+
+		// GET of a range for SegmentedDownload: Range and If-Range from the request, the headers it needs
+		// from the response, and the body streamed to the consumer; the returned function aborts it
+		STATIC_INLINE SegmentedDownload::Abort FetchRange(
+			Platform::String^ url,
+			const RangeRequest &range,
+			SegmentedDownload::Headers headers,
+			std::shared_ptr<ChunkConsumer> consumer
+		)
+		{
+			auto request = ref new HttpRequestMessage(HttpMethod::Get, ref new Uri(url));
+			if (range.start != 0 || range.end != 0)
+			{
+				auto value = "bytes=" + std::to_string(range.start) + "-" + (range.end != 0 ? std::to_string(range.end - 1) : std::string());
+				request->Headers->TryAppendWithoutValidation(L"Range", ToPlatformString(value.data(), (int)value.size()));
+			}
+			if (!range.ifRange.empty())
+				request->Headers->TryAppendWithoutValidation(L"If-Range", ToPlatformString(range.ifRange.data(), (int)range.ifRange.size()));
+
+			auto cancellation = ref new TaskCancellation();
+			GetStreamingAsync(request, consumer, [headers](HttpResponseMessage^ response)
+			{
+				RangeResponse result;
+				result.status = (int)response->StatusCode;
+				auto length = response->Content->Headers->ContentLength;
+				result.contentLength = (length != nullptr ? (int64_t)length->Value : -1);
+				result.contentRange = HeaderValue(response->Content->Headers, L"Content-Range");
+				result.etag = HeaderValue(response->Headers, L"ETag");
+				result.lastModified = HeaderValue(response->Content->Headers, L"Last-Modified");
+				headers(result);
+			}, cancellation);
+			return [cancellation]()
+			{
+				cancellation->Cancel();
+			};
+		}
+
+		// LocalFolder\Downloads\<hash of the key>.download
+		STATIC_INLINE std::string DownloadStatePath(const std::string &key)
+		{
+			auto folder = Windows::Storage::ApplicationData::Current->LocalFolder->Path + L"\\Downloads";
+			_wmkdir(folder->Data());
+			Sha256 hash;
+			hash.Update(key.data(), key.size());
+			auto name = hash.HexDigest().substr(0, 32) + ".download";
+			return ToUtf8String(folder) + "\\" + name;
+		}
+
+		STATIC_INLINE RequestScheduler &GetScheduler()
+		{
+			static RequestScheduler scheduler;
+			return scheduler;
+		}
+
+		// Scheduler ticket of a GET of GetAsync: 0 until Submit() returned, then the ticket while the
+		// GET waits for a slot, SIZE_MAX once it started
+		typedef std::shared_ptr<std::atomic<size_t>> HttpTicket;
+
+		// Tickets of the (coalesced, so one per URL) GetAsync requests waiting for a slot, by normalized URL
+		STATIC_INLINE std::pair<std::mutex, std::unordered_map<std::string, HttpTicket>> &ScheduledGets()
+		{
+			static std::pair<std::mutex, std::unordered_map<std::string, HttpTicket>> scheduled;
+			return scheduled;
+		}
+
+		STATIC_INLINE HttpTicket WaitingGet(const std::string &key)
+		{
+			auto &scheduled = ScheduledGets();
+			std::lock_guard<std::mutex> guard(scheduled.first);
+			auto found = scheduled.second.find(key);
+			return (found == scheduled.second.end() ? nullptr : found->second);
+		}
+
+		// Forget the GET of the URL unless another one replaced it
+		STATIC_INLINE void ForgetWaitingGet(const std::string &key, const HttpTicket &waiting)
+		{
+			auto &scheduled = ScheduledGets();
+			std::lock_guard<std::mutex> guard(scheduled.first);
+			auto found = scheduled.second.find(key);
+			if (found != scheduled.second.end() && found->second == waiting)
+				scheduled.second.erase(found);
+		}
+
+		// Cell for the time ScheduleGet admits a request, null when tracing is disabled
+		STATIC_INLINE std::shared_ptr<std::atomic<int64_t>> TraceAdmission()
+		{
+			return (TaskTrace::IsEnabled() ? std::make_shared<std::atomic<int64_t>>(0) : nullptr);
+		}
+
+		// Queue the GET in the scheduler; the returned function aborts it, waiting or in flight.
+		// The first admission of the requests sharing admitted (if not null) sets it to TaskTrace::Now(),
+		// and the result carries it. With waiting, the GET can be found by URL (WaitingGet) and
+		// reprioritized while it waits.
+		STATIC_INLINE HttpCoalescer::Abort ScheduleGet(
+			Platform::String^ url,
+			const std::string &key,
+			WorkPriority priority,
+			HttpCoalescer::Callback complete,
+			std::shared_ptr<std::atomic<int64_t>> admitted = nullptr,
+			HttpTicket waiting = nullptr
+		)
+		{
+			auto pending = std::make_shared<HttpStreamState>();
+			auto timing = RequestRecorder::Default().Begin(key);
+			if (waiting != nullptr)
+			{
+				auto &scheduled = ScheduledGets();
+				std::lock_guard<std::mutex> guard(scheduled.first);
+				scheduled.second[key] = waiting;
+			}
+			auto ticket = GetScheduler().Submit(UrlAuthority(key), priority, [=](RequestScheduler::Done done)
+			{
+				if (admitted != nullptr)
+				{
+					int64_t none = 0;
+					admitted->compare_exchange_strong(none, TaskTrace::Now());
+				}
+				if (waiting != nullptr)
+				{
+					waiting->store(SIZE_MAX);
+					ForgetWaitingGet(key, waiting);
+				}
+
+				auto request = GetHttpClient()->GetAsync(ref new Uri(url), HttpCompletionOption::ResponseContentRead);
+				pending->Track(request);
+				std::shared_ptr<RequestProgress> progress;
+				if (timing != nullptr)
+				{
+					timing->sent = RequestRecorder::Default().Now();
+					progress = TrackProgress(request);
+				}
+				request->Completed = ref new AsyncOperationWithProgressCompletedHandler<HttpResponseMessage^, HttpProgress>(
+					[complete, done, timing, progress, admitted](IAsyncOperationWithProgress<HttpResponseMessage^, HttpProgress>^ operation, AsyncStatus status)
+				{
+					done();
+					HttpResult result;
+					if (admitted != nullptr)
+						result.admitted = admitted->load();
+					try
+					{
+						if (status == AsyncStatus::Canceled)
+							throw ref new Platform::OperationCanceledException();
+						result.response = operation->GetResults();
+					}
+					catch (Platform::Exception^ e)
+					{
+						result.error = e;
+					}
+					RecordTiming(timing, result.response, RequestCacheStatus::None, -1, progress);
+					complete(result);
+				});
+			});
+
+			// Unless it started already
+			size_t none = 0;
+			if (waiting != nullptr)
+				waiting->compare_exchange_strong(none, ticket);
+
+			return [=]()
+			{
+				if (waiting != nullptr)
+					ForgetWaitingGet(key, waiting);
+				if (!GetScheduler().Cancel(ticket))
+					pending->Cancel();
+			};
+		}
+
+		// Whether an attempt of GetWithPolicyAsync is worth retrying
+		STATIC_INLINE AttemptOutcome Classify(const HttpResult &result)
+		{
+			if (result.error != nullptr)
+				return AttemptOutcome::Transient;
+
+			switch ((int)result.response->StatusCode)
+			{
+			case 408: // Request Timeout
+			case 429: // Too Many Requests
+			case 500:
+			case 502:
+			case 503:
+			case 504:
+				return AttemptOutcome::Transient;
+			default:
+				return AttemptOutcome::Success;
+			}
+		}
+
+		// Move the GET to another lane if it is still waiting for a slot
+		STATIC_INLINE void Reschedule(const HttpTicket &waiting, WorkPriority priority, bool raise_only)
+		{
+			if (waiting == nullptr)
+				return;
+			auto ticket = waiting->load();
+			if (ticket == 0 || ticket == SIZE_MAX)
+				return;
+			if (raise_only)
+				GetScheduler().Raise(ticket, priority);
+			else
+				GetScheduler().Reprioritize(ticket, priority);
+		}
+
+		STATIC_INLINE HttpCoalescer &GetCoalescer()
+		{
+			static HttpCoalescer coalescer;
+			return coalescer;
+		}
+
+		// 8 MB in memory, then files under LocalFolder\HttpCache
+		STATIC_INLINE ResponseCache &GetResponseCache()
+		{
+			static ResponseCache cache(8 << 20, CacheDirectory());
+			return cache;
+		}
+
+		STATIC_INLINE std::string CacheDirectory()
+		{
+			auto path = Windows::Storage::ApplicationData::Current->LocalFolder->Path + L"\\HttpCache";
+			_wmkdir(path->Data());
+			return ToUtf8String(path);
+		}
+
+		STATIC_INLINE std::string HeaderValue(
+			Windows::Foundation::Collections::IMap<Platform::String^, Platform::String^>^ headers,
+			Platform::String^ name
+		)
+		{
+			return headers->HasKey(name) ? ToUtf8String(headers->Lookup(name)) : std::string();
+		}
+
+		// Rebuild a 200 response from a cache entry
+		STATIC_INLINE HttpResponseMessage^ MakeCachedResponse(
+			Platform::String^ url,
+			const ResponseCache::Entry &entry
+		)
+		{
+			auto size = (unsigned int)(entry->body ? entry->body->size() : 0);
+			auto buffer = ref new Buffer(size);
+			buffer->Length = size;
+			if (size > 0)
+				memcpy(GetBufferData(buffer), entry->body->data(), size);
+
+			auto content = ref new HttpBufferContent(buffer);
+			if (!entry->contentType.empty())
+				content->Headers->TryAppendWithoutValidation(L"Content-Type", ToPlatformString(entry->contentType.data(), (int)entry->contentType.size()));
+			if (!entry->lastModified.empty())
+				content->Headers->TryAppendWithoutValidation(L"Last-Modified", ToPlatformString(entry->lastModified.data(), (int)entry->lastModified.size()));
+
+			auto response = ref new HttpResponseMessage(HttpStatusCode::Ok);
+			response->Content = content;
+			response->RequestMessage = ref new HttpRequestMessage(HttpMethod::Get, ref new Uri(url));
+			response->Source = HttpResponseMessageSource::Cache;
+			if (!entry->etag.empty())
+				response->Headers->TryAppendWithoutValidation(L"ETag", ToPlatformString(entry->etag.data(), (int)entry->etag.size()));
+			return response;
+		}
+
+		// Request the URL (conditionally if there is an entry with validators) once the scheduler admits
+		// it, update the cache and respond on the dispatcher; without handlers (background revalidation)
+		// only the cache is updated
+		STATIC_INLINE void SendCachedRequest(
+			Platform::String^ url,
+			const std::string &key,
+			ResponseCache::Entry entry,
+			Windows::UI::Core::CoreDispatcher^ dispatcher,
+			HttpResponseHandler^ on_response,
+			ExceptionHandler^ on_error,
+			WorkPriority priority
+		)
+		{
+			auto request = ref new HttpRequestMessage(HttpMethod::Get, ref new Uri(url));
+			if (entry != nullptr && !entry->etag.empty())
+				request->Headers->TryAppendWithoutValidation(L"If-None-Match", ToPlatformString(entry->etag.data(), (int)entry->etag.size()));
+			if (entry != nullptr && !entry->lastModified.empty())
+				request->Headers->TryAppendWithoutValidation(L"If-Modified-Since", ToPlatformString(entry->lastModified.data(), (int)entry->lastModified.size()));
+
+			auto timing = RequestRecorder::Default().Begin(key);
+			// The response is read whole (ResponseContentRead), so the slot is free once it completed
+			GetScheduler().Submit(UrlAuthority(key), priority, [=](RequestScheduler::Done done)
+			{
+				IAsyncOperationWithProgress<HttpResponseMessage^, HttpProgress>^ send;
+				try
+				{
+					send = GetHttpClient()->SendRequestAsync(request, HttpCompletionOption::ResponseContentRead);
+				}
+				catch (...)
+				{
+					done();
+					RecordTiming(timing, nullptr, RequestCacheStatus::None, -1, nullptr);
+					Respond(dispatcher, nullptr, CurrentPlatformException(), on_response, on_error);
+					return;
+				}
+				std::shared_ptr<RequestProgress> progress;
+				if (timing != nullptr)
+				{
+					timing->sent = RequestRecorder::Default().Now();
+					progress = TrackProgress(send);
+				}
+				send->Completed = ref new AsyncOperationWithProgressCompletedHandler<HttpResponseMessage^, HttpProgress>(
+					[=](IAsyncOperationWithProgress<HttpResponseMessage^, HttpProgress>^ operation, AsyncStatus status)
+				{
+					done();
+					try
+					{
+						if (status == AsyncStatus::Canceled)
+							throw ref new Platform::OperationCanceledException();
+
+						auto response = operation->GetResults();
+						auto &cache = GetResponseCache();
+						auto control = CacheControl::Parse(HeaderValue(response->Headers, L"Cache-Control"));
+						if (response->StatusCode == HttpStatusCode::NotModified && entry != nullptr)
+						{
+							RecordTiming(timing, response, RequestCacheStatus::Revalidated, entry->body ? (int64_t)entry->body->size() : 0, progress);
+							Respond(dispatcher, MakeCachedResponse(url, cache.Revalidated(entry, control)), nullptr, on_response, on_error);
+							return;
+						}
+						if (!response->IsSuccessStatusCode)
+						{
+							RecordTiming(timing, response, RequestCacheStatus::None, -1, progress);
+							Respond(dispatcher, response, nullptr, on_response, on_error);
+							return;
+						}
+
+						// The content is already buffered (ResponseContentRead) and can be read again by the handler
+						auto etag = HeaderValue(response->Headers, L"ETag");
+						auto lastModified = HeaderValue(response->Content->Headers, L"Last-Modified");
+						auto contentType = HeaderValue(response->Content->Headers, L"Content-Type");
+						response->Content->ReadAsBufferAsync()->Completed = ref new AsyncOperationWithProgressCompletedHandler<IBuffer^, unsigned long long>(
+							[=](IAsyncOperationWithProgress<IBuffer^, unsigned long long>^ read, AsyncStatus)
+						{
+							try
+							{
+								auto view = GetBufferView(read->GetResults());
+								auto body = std::make_shared<std::vector<unsigned char>>(view.begin(), view.end());
+								GetResponseCache().Store(key, control, etag, lastModified, contentType, body);
+								RecordTiming(timing, response, RequestCacheStatus::None, (int64_t)view.size(), progress);
+								Respond(dispatcher, response, nullptr, on_response, on_error);
+							}
+							catch (...)
+							{
+								RecordTiming(timing, nullptr, RequestCacheStatus::None, -1, progress);
+								Respond(dispatcher, nullptr, CurrentPlatformException(), on_response, on_error);
+							}
+						});
+					}
+					catch (...)
+					{
+						// Also std::bad_alloc or an error of the cache, which would otherwise be lost
+						RecordTiming(timing, nullptr, RequestCacheStatus::None, -1, progress);
+						Respond(dispatcher, nullptr, CurrentPlatformException(), on_response, on_error);
+					}
+				});
+			});
+		}
+
+		// The exception being handled (call from a catch block), as the Platform::Exception for on_error
+		STATIC_INLINE Platform::Exception^ CurrentPlatformException()
+		{
+			try
+			{
+				throw;
+			}
+			catch (Platform::Exception^ e)
+			{
+				return e;
+			}
+			catch (const std::bad_alloc&)
+			{
+				return ref new Platform::OutOfMemoryException();
+			}
+			catch (const std::exception &e)
+			{
+				return ref new Platform::FailureException(ToPlatformString(e.what()));
+			}
+			catch (...)
+			{
+				return ref new Platform::FailureException();
+			}
+		}
+
+		// Time to headers and bytes received of a timed request; the progress handler runs on another
+		// thread than Completed, so it reports to atomics that RecordTiming folds into the timing
+		STATIC_INLINE std::shared_ptr<RequestProgress> TrackProgress(
+			IAsyncOperationWithProgress<HttpResponseMessage^, HttpProgress>^ operation
+		)
+		{
+			auto stages = std::make_shared<RequestProgress>();
+			operation->Progress = ref new AsyncOperationProgressHandler<HttpResponseMessage^, HttpProgress>(
+				[stages](IAsyncOperationWithProgress<HttpResponseMessage^, HttpProgress>^, HttpProgress progress)
+			{
+				stages->Update(progress.Stage >= HttpProgressStage::ReceivingContent, (int64_t)progress.BytesReceived,
+					RequestRecorder::Default());
+			});
+			return stages;
+		}
+
+		// Record a timed request (no-op if timing is null) that ended now with the response, or with an
+		// error if response is null; bytes -1 takes the size from Content-Length or the progress
+		STATIC_INLINE void RecordTiming(
+			const std::shared_ptr<RequestTiming> &timing,
+			HttpResponseMessage^ response,
+			RequestCacheStatus cache,
+			int64_t bytes,
+			const std::shared_ptr<RequestProgress> &progress = nullptr
+		)
+		{
+			if (timing == nullptr)
+				return;
+
+			auto &recorder = RequestRecorder::Default();
+			if (progress != nullptr)
+				progress->FoldInto(*timing);
+			if (response != nullptr)
+			{
+				auto now = recorder.Now();
+				timing->status = (int)response->StatusCode;
+				if (timing->headers == 0)
+					timing->headers = now;
+				timing->lastByte = now;
+				auto length = (response->Content != nullptr ? response->Content->Headers->ContentLength : nullptr);
+				if (bytes >= 0)
+					timing->bytes = bytes;
+				else if (length != nullptr)
+					timing->bytes = (int64_t)length->Value;
+				timing->cache = (response->Source == HttpResponseMessageSource::Cache ? RequestCacheStatus::Hit : cache);
+			}
+			recorder.Record(*timing);
+		}
+
+		// Record a response of GetCachedAsync served from the cache, without any request
+		STATIC_INLINE void RecordCacheHit(const std::string &key, const ResponseCache::Entry &entry, RequestCacheStatus cache)
+		{
+			auto timing = RequestRecorder::Default().Begin(key);
+			if (timing == nullptr)
+				return;
+			timing->status = 200;
+			timing->cache = cache;
+			timing->bytes = (entry->body ? (int64_t)entry->body->size() : 0);
+			RequestRecorder::Default().Record(*timing);
+		}
+
+		// Call on_response (or on_error) on the dispatcher, if there is a handler
+		STATIC_INLINE void Respond(
+			Windows::UI::Core::CoreDispatcher^ dispatcher,
+			HttpResponseMessage^ response,
+			Platform::Exception^ error,
+			HttpResponseHandler^ on_response,
+			ExceptionHandler^ on_error
+		)
+		{
+			if (on_response == nullptr && on_error == nullptr)
+				return;
+
+			TH::RunOnContext(dispatcher, [=]()
+			{
+				try
+				{
+					if (error != nullptr)
+						throw error;
+					if (on_response != nullptr)
+						on_response(response);
+				}
+				catch (Platform::Exception^ e)
+				{
+					if (on_error != nullptr)
+						on_error(e);
+				}
 			});
 		}
 	}; // class Http
@@ -0,0 +1,1005 @@
+/**
+ * Streaming JSON reader over UTF-8 bytes (portable C++, no C++/CX).
+ *
+ * Reads a response body as it is, without widening it to UTF-16 nor building a DOM:
+ *  - JsonTokenizer is a cursor over the tokens of a buffer: Next() gives StartObject, Key, String,
+ *    Number... with their text as a slice of the input (strings are only copied when they contain
+ *    escapes); the nesting is an explicit stack, so the depth is bounded and there is no recursion
+ *  - JsonPushParser takes the input in chunks of any size (e.g. from ChunkStream.h) and calls a
+ *    JsonHandler; a token cut by the end of a chunk is kept and completed with the next chunk
+ *  - JsonPointerExtractor is a JsonHandler that picks the values at a few JSON pointers (RFC 6901,
+ *    plus a "*" segment for any array index or key, e.g. the title of every item of "/items")
+ *
+ *     JsonTokenizer json;
+ *     json.SetInput(data, length, true);
+ *     for (auto token = json.Next(); token != JsonToken::End && token != JsonToken::Error; token = json.Next())
+ *         ...
+ *
+ * Runs of string characters and of whitespace are scanned 16 bytes at a time with SSE2 or NEON.
+ * The bytes of strings are not validated as UTF-8; numbers are given as written (see JsonToDouble).
+ */
+
+#ifndef _LUWPUTILITIES_JSON_READER_
+#define _LUWPUTILITIES_JSON_READER_
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "ChunkStream.h"
+#include "UnicodeHelper.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace LUwpUtilities
+{
+	enum class JsonToken
+	{
+		StartObject,
+		EndObject,
+		StartArray,
+		EndArray,
+		Key,
+		String,
+		Number,
+		True,
+		False,
+		Null,
+		End,      // the value is complete and the input is over
+		NeedMore, // the input ends inside a token (only when it is not the last input)
+		Error
+	};
+
+	namespace JsonScan
+	{
+		struct Tables
+		{
+			bool whitespace[256];
+			bool plain[256]; // string byte that needs no attention: not '"', '\\' nor a control character
+
+			Tables()
+			{
+				for (int c = 0; c < 256; c++)
+				{
+					whitespace[c] = (c == ' ' || c == '\t' || c == '\n' || c == '\r');
+					plain[c] = (c >= 0x20 && c != '"' && c != '\\');
+				}
+			}
+		};
+
+		inline const Tables &GetTables()
+		{
+			static const Tables tables;
+			return tables;
+		}
+
+		inline int LowestBit(unsigned int mask)
+		{
+#if defined(_MSC_VER)
+			unsigned long index;
+			_BitScanForward(&index, mask);
+			return (int)index;
+#else
+			return __builtin_ctz(mask);
+#endif
+		}
+
+		// Number of leading bytes of [src, src + len) that need no attention inside a string
+		inline size_t StringRunLength(const unsigned char *src, size_t len)
+		{
+			size_t i = 0;
+#if defined(LUU_SIMD_SSE2)
+			const __m128i quote = _mm_set1_epi8('"');
+			const __m128i backslash = _mm_set1_epi8('\\');
+			const __m128i control = _mm_set1_epi8(0x1F);
+			for (; i + 16 <= len; i += 16)
+			{
+				__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+				// v <= 0x1F as unsigned bytes
+				__m128i special = _mm_or_si128(
+					_mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+					_mm_cmpeq_epi8(_mm_min_epu8(v, control), v));
+				int mask = _mm_movemask_epi8(special);
+				if (mask != 0)
+					return i + LowestBit((unsigned int)mask);
+			}
+#elif defined(LUU_SIMD_NEON)
+			const uint8x16_t quote = vdupq_n_u8('"');
+			const uint8x16_t backslash = vdupq_n_u8('\\');
+			const uint8x16_t control = vdupq_n_u8(0x1F);
+			for (; i + 16 <= len; i += 16)
+			{
+				uint8x16_t v = vld1q_u8(src + i);
+				uint8x16_t special = vorrq_u8(vorrq_u8(vceqq_u8(v, quote), vceqq_u8(v, backslash)), vcleq_u8(v, control));
+				if (vmaxvq_u8(special) != 0)
+					break;
+			}
+#endif
+			const auto &tables = GetTables();
+			while (i < len && tables.plain[src[i]])
+				i++;
+			return i;
+		}
+
+		// Number of leading whitespace bytes of [src, src + len)
+		inline size_t WhitespaceLength(const unsigned char *src, size_t len)
+		{
+			const auto &tables = GetTables();
+			// Minified JSON: most tokens are not preceded by any whitespace
+			if (len == 0 || !tables.whitespace[src[0]])
+				return 0;
+
+			size_t i = 0;
+#if defined(LUU_SIMD_SSE2)
+			for (; i + 16 <= len; i += 16)
+			{
+				__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+				__m128i space = _mm_or_si128(
+					_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))),
+					_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'))));
+				unsigned int mask = ~(unsigned int)_mm_movemask_epi8(space) & 0xFFFF;
+				if (mask != 0)
+					return i + LowestBit(mask);
+			}
+#elif defined(LUU_SIMD_NEON)
+			for (; i + 16 <= len; i += 16)
+			{
+				uint8x16_t v = vld1q_u8(src + i);
+				uint8x16_t space = vorrq_u8(
+					vorrq_u8(vceqq_u8(v, vdupq_n_u8(' ')), vceqq_u8(v, vdupq_n_u8('\t'))),
+					vorrq_u8(vceqq_u8(v, vdupq_n_u8('\n')), vceqq_u8(v, vdupq_n_u8('\r'))));
+				if (vminvq_u8(space) == 0)
+					break;
+			}
+#endif
+			while (i < len && tables.whitespace[src[i]])
+				i++;
+			return i;
+		}
+
+		inline int HexValue(char c)
+		{
+			return (c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1);
+		}
+
+		inline void AppendUtf8(std::string &dest, uint32_t cp)
+		{
+			if (cp < 0x80)
+			{
+				dest += (char)cp;
+			}
+			else if (cp < 0x800)
+			{
+				dest += (char)(0xC0 | (cp >> 6));
+				dest += (char)(0x80 | (cp & 0x3F));
+			}
+			else if (cp < 0x10000)
+			{
+				dest += (char)(0xE0 | (cp >> 12));
+				dest += (char)(0x80 | ((cp >> 6) & 0x3F));
+				dest += (char)(0x80 | (cp & 0x3F));
+			}
+			else
+			{
+				dest += (char)(0xF0 | (cp >> 18));
+				dest += (char)(0x80 | ((cp >> 12) & 0x3F));
+				dest += (char)(0x80 | ((cp >> 6) & 0x3F));
+				dest += (char)(0x80 | (cp & 0x3F));
+			}
+		}
+	} // namespace JsonScan
+
+	class JsonTokenizer
+	{
+	public:
+		explicit JsonTokenizer(size_t maxDepth = 512) : _maxDepth(maxDepth)
+		{
+			Reset();
+		}
+
+		// Start over with a new document
+		void Reset()
+		{
+			_stack.clear();
+			_state = Value;
+			_error = nullptr;
+			_data = nullptr;
+			_length = 0;
+			_position = 0;
+			_last = true;
+			_text.data = nullptr;
+			_text.length = 0;
+		}
+
+		// Input to read from (it continues the document); unless last, a token cut by the end of the
+		// input gives NeedMore and stays in the input, from Consumed() on
+		void SetInput(const char *data, size_t length, bool last)
+		{
+			_data = reinterpret_cast<const unsigned char*>(data);
+			_length = length;
+			_position = 0;
+			_last = last;
+		}
+
+		JsonToken Next()
+		{
+			if (_error != nullptr)
+				return JsonToken::Error;
+
+			for (;;)
+			{
+				_position += JsonScan::WhitespaceLength(_data + _position, _length - _position);
+				if (_position == _length)
+				{
+					if (!_last)
+						return JsonToken::NeedMore;
+					return (_state == Done ? JsonToken::End : Fail("Unexpected end of the input"));
+				}
+
+				unsigned char c = _data[_position];
+				switch (_state)
+				{
+				case Done:
+					return Fail("Unexpected data after the value");
+
+				case Colon:
+					if (c != ':')
+						return Fail("Expected ':'");
+					_position++;
+					_state = Value;
+					continue;
+
+				case Comma:
+					if (c == ',')
+					{
+						_position++;
+						_state = (_stack.back() == '{' ? Key : Value);
+						continue;
+					}
+					if (c == (_stack.back() == '{' ? '}' : ']'))
+						return Close();
+					return Fail("Expected ',' or the end of the container");
+
+				case FirstKey:
+					if (c == '}')
+						return Close();
+					// fall through
+				case Key:
+				{
+					if (c != '"')
+						return Fail("Expected a key");
+					auto token = ReadString();
+					if (token != JsonToken::String)
+						return token;
+					_state = Colon;
+					return JsonToken::Key;
+				}
+
+				case FirstValue:
+					if (c == ']')
+						return Close();
+					// fall through
+				case Value:
+					return ReadValue(c);
+				}
+			}
+		}
+
+		// Key and String (without escapes), Number and literals (as written); valid until the next call
+		Utf8Slice Text() const
+		{
+			return _text;
+		}
+
+		// Number of containers open
+		size_t Depth() const
+		{
+			return _stack.size();
+		}
+
+		// Input bytes read so far (the rest is the token that NeedMore could not complete)
+		size_t Consumed() const
+		{
+			return _position;
+		}
+
+		const char *ErrorMessage() const
+		{
+			return _error;
+		}
+
+		// After StartObject or StartArray (or inside a container): read up to the end of the container
+		// and return its EndObject or EndArray, or Error/NeedMore
+		JsonToken SkipContainer()
+		{
+			size_t depth = Depth();
+			if (depth == 0)
+				return Fail("Not in a container");
+			for (;;)
+			{
+				auto token = Next();
+				if (token == JsonToken::Error || token == JsonToken::NeedMore || token == JsonToken::End)
+					return token;
+				if ((token == JsonToken::EndObject || token == JsonToken::EndArray) && Depth() == depth - 1)
+					return token;
+			}
+		}
+
+	private:
+		enum State
+		{
+			Value,      // a value
+			FirstValue, // a value or ']' (after '[')
+			FirstKey,   // a key or '}' (after '{')
+			Key,        // a key (after ',' in an object)
+			Colon,
+			Comma,      // ',' or the end of the container (after a value)
+			Done        // the root value is complete
+		};
+
+		JsonToken Fail(const char *message)
+		{
+			_error = message;
+			return JsonToken::Error;
+		}
+
+		void AfterValue()
+		{
+			_state = (_stack.empty() ? Done : Comma);
+		}
+
+		JsonToken Open(char container, State state, JsonToken token)
+		{
+			if (_stack.size() >= _maxDepth)
+				return Fail("Too deeply nested");
+			_stack.push_back(container);
+			_position++;
+			_state = state;
+			return token;
+		}
+
+		JsonToken Close()
+		{
+			auto token = (_stack.back() == '{' ? JsonToken::EndObject : JsonToken::EndArray);
+			_stack.pop_back();
+			_position++;
+			AfterValue();
+			return token;
+		}
+
+		JsonToken ReadValue(unsigned char c)
+		{
+			switch (c)
+			{
+			case '{':
+				return Open('{', FirstKey, JsonToken::StartObject);
+			case '[':
+				return Open('[', FirstValue, JsonToken::StartArray);
+			case '"':
+			{
+				auto token = ReadString();
+				if (token == JsonToken::String)
+					AfterValue();
+				return token;
+			}
+			case 't':
+				return ReadLiteral("true", 4, JsonToken::True);
+			case 'f':
+				return ReadLiteral("false", 5, JsonToken::False);
+			case 'n':
+				return ReadLiteral("null", 4, JsonToken::Null);
+			default:
+				if (c == '-' || (c >= '0' && c <= '9'))
+					return ReadNumber();
+				return Fail("Unexpected character");
+			}
+		}
+
+		JsonToken ReadLiteral(const char *literal, size_t length, JsonToken token)
+		{
+			size_t available = _length - _position;
+			if (available < length)
+			{
+				if (!_last && memcmp(_data + _position, literal, available) == 0)
+					return JsonToken::NeedMore;
+				return Fail("Invalid literal");
+			}
+			if (memcmp(_data + _position, literal, length) != 0)
+				return Fail("Invalid literal");
+			_text.data = reinterpret_cast<const char*>(_data + _position);
+			_text.length = length;
+			_position += length;
+			AfterValue();
+			return token;
+		}
+
+		JsonToken ReadNumber()
+		{
+			size_t start = _position;
+			size_t i = start;
+			auto digits = [&]()
+			{
+				size_t first = i;
+				while (i < _length && _data[i] >= '0' && _data[i] <= '9')
+					i++;
+				return i - first;
+			};
+
+			if (_data[i] == '-')
+				i++;
+			size_t integer = digits();
+			bool valid = (integer > 0 && !(integer > 1 && _data[i - integer] == '0'));
+			if (valid && i < _length && _data[i] == '.')
+			{
+				i++;
+				valid = (digits() > 0);
+			}
+			if (valid && i < _length && (_data[i] == 'e' || _data[i] == 'E'))
+			{
+				i++;
+				if (i < _length && (_data[i] == '+' || _data[i] == '-'))
+					i++;
+				valid = (digits() > 0);
+			}
+
+			// More digits may follow in the next input
+			if (i == _length && !_last)
+				return JsonToken::NeedMore;
+			if (!valid)
+				return Fail("Invalid number");
+
+			_text.data = reinterpret_cast<const char*>(_data + start);
+			_text.length = i - start;
+			_position = i;
+			AfterValue();
+			return JsonToken::Number;
+		}
+
+		// From the opening quote at _position; String or NeedMore/Error (the caller updates the state)
+		JsonToken ReadString()
+		{
+			size_t start = _position + 1;
+			size_t i = start;
+			bool escaped = false;
+			for (;;)
+			{
+				i += JsonScan::StringRunLength(_data + i, _length - i);
+				if (i >= _length)
+					return (_last ? Fail("Unterminated string") : JsonToken::NeedMore);
+
+				unsigned char c = _data[i];
+				if (c == '"')
+					break;
+				if (c != '\\')
+					return Fail("Control character in a string");
+
+				escaped = true;
+				size_t escape = (i + 1 < _length && _data[i + 1] == 'u' ? 6 : 2);
+				if (i + escape > _length)
+					return (_last ? Fail("Unterminated string") : JsonToken::NeedMore);
+				i += escape;
+			}
+
+			if (!escaped)
+			{
+				_text.data = reinterpret_cast<const char*>(_data + start);
+				_text.length = i - start;
+			}
+			else
+			{
+				if (!Unescape(start, i))
+					return JsonToken::Error;
+				_text.data = _scratch.data();
+				_text.length = _scratch.size();
+			}
+			_position = i + 1;
+			return JsonToken::String;
+		}
+
+		// Decode [start, end) into _scratch
+		bool Unescape(size_t start, size_t end)
+		{
+			_scratch.clear();
+			size_t i = start;
+			while (i < end)
+			{
+				size_t run = JsonScan::StringRunLength(_data + i, end - i);
+				_scratch.append(reinterpret_cast<const char*>(_data + i), run);
+				i += run;
+				if (i >= end)
+					break;
+
+				char c = (char)_data[i + 1];
+				i += 2;
+				switch (c)
+				{
+				case '"': _scratch += '"'; break;
+				case '\\': _scratch += '\\'; break;
+				case '/': _scratch += '/'; break;
+				case 'b': _scratch += '\b'; break;
+				case 'f': _scratch += '\f'; break;
+				case 'n': _scratch += '\n'; break;
+				case 'r': _scratch += '\r'; break;
+				case 't': _scratch += '\t'; break;
+				case 'u':
+				{
+					uint32_t cp;
+					if (!ReadHex(i, cp))
+					{
+						Fail("Invalid \\u escape");
+						return false;
+					}
+					i += 4;
+					// A surrogate pair is two escapes; a lone surrogate becomes U+FFFD
+					if (cp >= 0xD800 && cp <= 0xDBFF)
+					{
+						uint32_t low;
+						if (i + 6 <= end && _data[i] == '\\' && _data[i + 1] == 'u' && ReadHex(i + 2, low) && low >= 0xDC00 && low <= 0xDFFF)
+						{
+							cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+							i += 6;
+						}
+						else
+						{
+							cp = 0xFFFD;
+						}
+					}
+					else if (cp >= 0xDC00 && cp <= 0xDFFF)
+					{
+						cp = 0xFFFD;
+					}
+					JsonScan::AppendUtf8(_scratch, cp);
+					break;
+				}
+				default:
+					Fail("Invalid escape");
+					return false;
+				}
+			}
+			return true;
+		}
+
+		bool ReadHex(size_t at, uint32_t &value)
+		{
+			value = 0;
+			for (size_t k = 0; k < 4; k++)
+			{
+				int digit = JsonScan::HexValue((char)_data[at + k]);
+				if (digit < 0)
+					return false;
+				value = (value << 4) | (uint32_t)digit;
+			}
+			return true;
+		}
+
+		size_t _maxDepth;
+		std::vector<char> _stack; // '{' or '[' per open container
+		State _state;
+		const char *_error;
+
+		const unsigned char *_data;
+		size_t _length;
+		size_t _position;
+		bool _last;
+
+		Utf8Slice _text;
+		std::string _scratch; // unescaped strings
+	};
+
+	// Events of JsonPushParser; every method returns false to stop the parse
+	class JsonHandler
+	{
+	public:
+		virtual ~JsonHandler()
+		{
+		}
+
+		virtual bool StartObject() { return true; }
+		virtual bool EndObject() { return true; }
+		virtual bool StartArray() { return true; }
+		virtual bool EndArray() { return true; }
+		virtual bool Key(Utf8Slice key) { return true; }
+
+		// String (unescaped), Number (as written), True, False or Null (as written)
+		virtual bool Value(JsonToken type, Utf8Slice text) { return true; }
+	};
+
+	// Parses a document given in chunks of any size; only the token cut by the end of a chunk is copied
+	class JsonPushParser
+	{
+	public:
+		explicit JsonPushParser(JsonHandler &handler, size_t maxDepth = 512)
+			: _handler(handler), _tokenizer(maxDepth), _stopped(false), _offset(0)
+		{
+		}
+
+		// Parse the next chunk; false on error or when the handler stopped
+		bool Feed(const char *data, size_t length)
+		{
+			if (Failed())
+				return false;
+
+			size_t used = 0;
+			if (!_tail.empty())
+			{
+				// Complete the cut token with a few bytes of the chunk, doubling them while the token
+				// goes on (so a long token is not read again and again), then read the rest in place
+				for (;;)
+				{
+					size_t held = _tail.size();
+					size_t take = std::min(length - used, std::max(held, (size_t)64));
+					_tail.append(data + used, take);
+					used += take;
+
+					_tokenizer.SetInput(_tail.data(), _tail.size(), false);
+					if (!Pump())
+						return false;
+					size_t consumed = _tokenizer.Consumed();
+					_offset += consumed;
+					if (consumed >= held)
+					{
+						// The bytes of the chunk left in the tail are read again in place
+						used -= _tail.size() - consumed;
+						_tail.clear();
+						break;
+					}
+					_tail.erase(0, consumed);
+					if (used == length)
+						return true;
+				}
+			}
+
+			_tokenizer.SetInput(data + used, length - used, false);
+			if (!Pump())
+				return false;
+			size_t consumed = _tokenizer.Consumed();
+			_offset += consumed;
+			_tail.assign(data + used + consumed, length - used - consumed);
+			return true;
+		}
+
+		// The input is over: parse what is left; false if the document is incomplete or invalid
+		bool Finish()
+		{
+			if (Failed())
+				return false;
+			_tokenizer.SetInput(_tail.data(), _tail.size(), true);
+			bool ok = Pump();
+			_offset += _tokenizer.Consumed();
+			_tail.clear();
+			return ok && !Failed();
+		}
+
+		bool IsStopped() const
+		{
+			return _stopped;
+		}
+
+		// Null unless the document is invalid
+		const char *ErrorMessage() const
+		{
+			return _tokenizer.ErrorMessage();
+		}
+
+		// Offset of the input read so far, e.g. to locate an error
+		uint64_t Offset() const
+		{
+			return _offset;
+		}
+
+	private:
+		bool Failed() const
+		{
+			return _stopped || _tokenizer.ErrorMessage() != nullptr;
+		}
+
+		// Read the tokens of the current input up to NeedMore or End; false on error or stop
+		bool Pump()
+		{
+			for (;;)
+			{
+				auto token = _tokenizer.Next();
+				bool go = true;
+				switch (token)
+				{
+				case JsonToken::StartObject: go = _handler.StartObject(); break;
+				case JsonToken::EndObject: go = _handler.EndObject(); break;
+				case JsonToken::StartArray: go = _handler.StartArray(); break;
+				case JsonToken::EndArray: go = _handler.EndArray(); break;
+				case JsonToken::Key: go = _handler.Key(_tokenizer.Text()); break;
+				case JsonToken::NeedMore:
+				case JsonToken::End:
+					return true;
+				case JsonToken::Error:
+					return false;
+				default:
+					go = _handler.Value(token, _tokenizer.Text());
+					break;
+				}
+				if (!go)
+				{
+					_stopped = true;
+					return false;
+				}
+			}
+		}
+
+		JsonHandler &_handler;
+		JsonTokenizer _tokenizer;
+		std::string _tail; // start of the token cut by the end of the previous chunk
+		bool _stopped;
+		uint64_t _offset;
+	};
+
+	// Value of a Number token; false if it does not fit a double
+	inline bool JsonToDouble(Utf8Slice text, double &value)
+	{
+		static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+			1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+		// Exact fast path: at most 15 significant digits and a small power of ten
+		const char *p = text.data;
+		const char *end = text.data + text.length;
+		bool negative = (p < end && *p == '-');
+		if (negative)
+			p++;
+		uint64_t mantissa = 0;
+		int digits = 0;
+		int exponent = 0;
+		for (; p < end && *p >= '0' && *p <= '9'; p++, digits++)
+			mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+		if (p < end && *p == '.')
+		{
+			for (p++; p < end && *p >= '0' && *p <= '9'; p++, digits++, exponent--)
+				mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+		}
+		if (p == end && digits <= 15 && exponent >= -22)
+		{
+			value = (double)mantissa / powers[-exponent];
+			if (negative)
+				value = -value;
+			return true;
+		}
+
+		std::string copy(text.data, text.length);
+		char *stop = nullptr;
+		value = strtod(copy.c_str(), &stop);
+		return stop == copy.c_str() + copy.size();
+	}
+
+	// Value of a Number token without fraction nor exponent; false if it is not such a number
+	inline bool JsonToInt64(Utf8Slice text, int64_t &value)
+	{
+		const char *p = text.data;
+		const char *end = text.data + text.length;
+		bool negative = (p < end && *p == '-');
+		if (negative)
+			p++;
+		if (p == end || end - p > 19)
+			return false;
+
+		uint64_t magnitude = 0;
+		for (; p < end; p++)
+		{
+			if (*p < '0' || *p > '9')
+				return false;
+			magnitude = magnitude * 10 + (uint64_t)(*p - '0');
+		}
+		if (magnitude > (negative ? (uint64_t)INT64_MAX + 1 : (uint64_t)INT64_MAX))
+			return false;
+		value = (negative ? (int64_t)(0 - magnitude) : (int64_t)magnitude);
+		return true;
+	}
+
+	// Picks the scalar values at a few JSON pointers, e.g. "/items/*/title" and "/next"
+	class JsonPointerExtractor : public JsonHandler
+	{
+	public:
+		// pointer is the index in the pointers given to the constructor; return false to stop
+		typedef std::function<bool(size_t pointer, JsonToken type, Utf8Slice text)> Callback;
+
+		JsonPointerExtractor(const std::vector<std::string> &pointers, Callback callback) : _callback(std::move(callback))
+		{
+			for (auto &pointer : pointers)
+				_pointers.push_back(Parse(pointer));
+		}
+
+		// Index in the array at the given depth (0 is inside the root) of the current value,
+		// e.g. to tell which item a field belongs to
+		size_t IndexAt(size_t depth) const
+		{
+			return (depth < _path.size() && _path[depth].array ? _path[depth].count - 1 : (size_t)-1);
+		}
+
+		bool StartObject() override
+		{
+			return Enter(false);
+		}
+
+		bool EndObject() override
+		{
+			_depth--;
+			return true;
+		}
+
+		bool StartArray() override
+		{
+			return Enter(true);
+		}
+
+		bool EndArray() override
+		{
+			_depth--;
+			return true;
+		}
+
+		bool Key(Utf8Slice key) override
+		{
+			_path[_depth - 1].key.assign(key.data, key.length);
+			return true;
+		}
+
+		bool Value(JsonToken type, Utf8Slice text) override
+		{
+			Advance();
+			for (size_t i = 0; i < _pointers.size(); i++)
+			{
+				if (Matches(_pointers[i]) && !_callback(i, type, text))
+					return false;
+			}
+			return true;
+		}
+
+	private:
+		struct Segment
+		{
+			std::string text;
+			size_t index; // the text as an array index, or -1
+			bool any;     // "*"
+		};
+
+		// The frames are reused from one container to the next to keep their key buffers
+		struct Frame
+		{
+			bool array;
+			size_t count; // values seen so far in the array
+			std::string key;
+		};
+
+		static std::vector<Segment> Parse(const std::string &pointer)
+		{
+			std::vector<Segment> segments;
+			size_t i = 0;
+			while (i < pointer.size() && pointer[i] == '/')
+			{
+				Segment segment;
+				size_t end = pointer.find('/', i + 1);
+				if (end == std::string::npos)
+					end = pointer.size();
+				for (size_t k = i + 1; k < end; k++)
+				{
+					if (pointer[k] == '~' && k + 1 < end && (pointer[k + 1] == '0' || pointer[k + 1] == '1'))
+					{
+						segment.text += (pointer[k + 1] == '0' ? '~' : '/');
+						k++;
+					}
+					else
+					{
+						segment.text += pointer[k];
+					}
+				}
+				segment.any = (segment.text == "*");
+				segment.index = (size_t)-1;
+				if (!segment.text.empty() && segment.text.size() <= 18 &&
+					segment.text.find_first_not_of("0123456789") == std::string::npos &&
+					(segment.text.size() == 1 || segment.text[0] != '0'))
+				{
+					segment.index = (size_t)strtoull(segment.text.c_str(), nullptr, 10);
+				}
+				segments.push_back(segment);
+				i = end;
+			}
+			return segments;
+		}
+
+		// A value starts in the current container
+		void Advance()
+		{
+			if (_depth > 0 && _path[_depth - 1].array)
+				_path[_depth - 1].count++;
+		}
+
+		bool Enter(bool array)
+		{
+			Advance();
+			if (_path.size() <= _depth)
+				_path.emplace_back();
+			auto &frame = _path[_depth++];
+			frame.array = array;
+			frame.count = 0;
+			frame.key.clear();
+			return true;
+		}
+
+		bool Matches(const std::vector<Segment> &segments) const
+		{
+			if (segments.size() != _depth)
+				return false;
+			for (size_t d = 0; d < _depth; d++)
+			{
+				auto &segment = segments[d];
+				if (segment.any)
+					continue;
+				auto &frame = _path[d];
+				if (frame.array ? segment.index != frame.count - 1 : segment.text != frame.key)
+					return false;
+			}
+			return true;
+		}
+
+		Callback _callback;
+		std::vector<std::vector<Segment>> _pointers;
+		std::vector<Frame> _path;
+		size_t _depth = 0;
+	};
+
+	// Feeds a streamed body (see ChunkStream.h) to a JsonPushParser; done gets null once the document
+	// was parsed (or the handler stopped it), or the error
+	class JsonChunkConsumer : public ChunkConsumer
+	{
+	public:
+		typedef std::function<void(std::exception_ptr error)> Done;
+
+		JsonChunkConsumer(std::shared_ptr<JsonHandler> handler, Done done)
+			: _handler(std::move(handler)), _parser(*_handler), _done(std::move(done))
+		{
+		}
+
+		bool OnChunk(BufferView chunk) override
+		{
+			if (_parser.Feed(chunk.Chars(), chunk.size()))
+				return true;
+			if (!_parser.IsStopped())
+				throw std::runtime_error(Describe());
+			_done(nullptr);
+			return false;
+		}
+
+		void OnEnd() override
+		{
+			if (_parser.Finish())
+				_done(nullptr);
+			else if (_parser.IsStopped())
+				_done(nullptr);
+			else
+				_done(std::make_exception_ptr(std::runtime_error(Describe())));
+		}
+
+		void OnError(std::exception_ptr error) override
+		{
+			_done(error);
+		}
+
+	private:
+		std::string Describe() const
+		{
+			auto message = _parser.ErrorMessage();
+			return std::string("Invalid JSON near byte ") + std::to_string(_parser.Offset()) + ": " +
+				(message != nullptr ? message : "incomplete document");
+		}
+
+		std::shared_ptr<JsonHandler> _handler;
+		JsonPushParser _parser;
+		Done _done;
+	};
+} // namespace LUwpUtilities
+
+#endif // #ifndef _LUWPUTILITIES_JSON_READER_
@@ -2,6 +2,7 @@
 // (which already contains implementation of the utility classes)
 // to compile the library.
 
+#include "AsyncMemo.h"
 #include "CollectionHelper.h"
 #include "CustomPropertyBase.h"
 #include "HttpHelper.h"
@@ -9,4 +10,5 @@
 #include "SettingsHelper.h"
 #include "StorageHelper.h"
 #include "TaskHelper.h"
+#include "TaskPipeline.h"
 #include "XamlHelper.h"
@@ -0,0 +1,272 @@
+/**
+ * Load generator for request paths (portable C++, no C++/CX); Http::RunLoadAsync drives the Http
+ * helpers with it, e.g. against a local stand-in of the backend, to catch regressions in request
+ * handling before they reach users.
+ *
+ * A fixed number of workers each send a request, wait for it, then send the next one:
+ *  - closed loop (ratePerSecond 0): as fast as the requests complete, which gives the throughput
+ *  - open loop (ratePerSecond > 0): request i is due at start + i / rate; its latency counts from
+ *    when it was due rather than when a worker got to it, so that a stall shows in the percentiles
+ *    instead of silently lowering the load (coordinated omission)
+ * The first warmup requests (connections, caches, JIT...) are sent but not measured:
+ *
+ *     LoadGenerator::Start([](size_t index, LoadGenerator::RequestDone done)
+ *     {
+ *         ... send request index, then done(success, body_bytes) ...
+ *     }, LoadGenerator::DefaultOptions(), [](const LoadReport &report)
+ *     {
+ *         OutputDebugStringA(report.Describe().c_str());
+ *     });
+ */
+
+#ifndef _LUWPUTILITIES_LOAD_GENERATOR_
+#define _LUWPUTILITIES_LOAD_GENERATOR_
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "RequestPolicy.h"
+#include "TaskTrace.h"
+#include "ThreadPool.h"
+
+namespace LUwpUtilities
+{
+	// Durations in nanoseconds
+	struct LoadReport
+	{
+		uint64_t requests; // measured ones, without the warmup
+		uint64_t errors;
+		uint64_t bytes;
+		int64_t elapsed;   // from the first measured request to the last answer
+		LatencySnapshot latency;
+
+		LoadReport() : requests(0), errors(0), bytes(0), elapsed(0)
+		{
+		}
+
+		double RequestsPerSecond() const
+		{
+			return (elapsed > 0 ? requests * 1e9 / elapsed : 0);
+		}
+
+		// One line, latencies in milliseconds
+		std::string Describe() const
+		{
+			char text[256];
+			snprintf(text, sizeof(text), "requests=%llu errors=%llu bytes=%llu rps=%.1f p50=%.2f p90=%.2f p99=%.2f max=%.2f\n",
+				(unsigned long long)requests, (unsigned long long)errors, (unsigned long long)bytes, RequestsPerSecond(),
+				latency.Percentile(0.5) / 1e6, latency.Percentile(0.9) / 1e6, latency.Percentile(0.99) / 1e6,
+				latency.Percentile(1.0) / 1e6);
+			return text;
+		}
+	};
+
+	class LoadGenerator : public std::enable_shared_from_this<LoadGenerator>
+	{
+	public:
+		// Outcome of a request (bytes of the body, or -1 if unknown); call it exactly once, from any thread
+		typedef std::function<void(bool success, int64_t bytes)> RequestDone;
+		// Send request number index
+		typedef std::function<void(size_t index, RequestDone done)> Request;
+		// Once every request answered, or after Cancel() with what was measured so far
+		typedef std::function<void(const LoadReport &report)> Finished;
+		typedef std::function<int64_t()> Clock;
+
+		struct Options
+		{
+			size_t concurrency;   // requests in flight at most
+			size_t requests;      // measured requests, sent after the warmup
+			size_t warmup;
+			double ratePerSecond; // 0 for a closed loop
+		};
+
+		static Options DefaultOptions()
+		{
+			Options options;
+			options.concurrency = 8;
+			options.requests = 1000;
+			options.warmup = 20;
+			options.ratePerSecond = 0;
+			return options;
+		}
+
+		static std::shared_ptr<LoadGenerator> Start(
+			Request request,
+			const Options &options,
+			Finished finished,
+			Clock clock = nullptr,
+			RequestPolicy::Delay delay = nullptr
+		)
+		{
+			std::shared_ptr<LoadGenerator> generator(new LoadGenerator(std::move(request), options, std::move(finished),
+				std::move(clock), std::move(delay)));
+			auto workers = std::min(generator->_options.concurrency, generator->_total);
+			for (size_t i = 0; i < workers; i++)
+				generator->Next();
+			if (workers == 0)
+				generator->Finish();
+			return generator;
+		}
+
+		LoadGenerator(const LoadGenerator&) = delete;
+		LoadGenerator &operator=(const LoadGenerator&) = delete;
+
+		// Stop sending; the report comes once the requests in flight answered
+		void Cancel()
+		{
+			_cancelled = true;
+			Finish();
+		}
+
+	private:
+		LoadGenerator(Request request, const Options &options, Finished finished, Clock clock, RequestPolicy::Delay delay)
+			: _request(std::move(request)), _options(options), _finished(std::move(finished)), _clock(std::move(clock)),
+			_delay(std::move(delay)), _total(options.warmup + options.requests), _next(0), _inFlight(0), _cancelled(false),
+			_reported(false), _paceStart(0), _start(0), _last(0)
+		{
+			if (!_clock)
+				_clock = &TaskTrace::Now;
+			if (!_delay)
+				_delay = &RequestPolicy::TimerDelay;
+			if (_options.concurrency == 0)
+				_options.concurrency = 1;
+		}
+
+		// Take the next request for a worker whose slot is free
+		void Next()
+		{
+			if (_cancelled)
+			{
+				Finish();
+				return;
+			}
+			// Counted before taking an index, so that Finish() never sees a request between the two
+			_inFlight++;
+			size_t index = _next.fetch_add(1);
+			if (index >= _total)
+			{
+				_inFlight--;
+				Finish();
+				return;
+			}
+
+			int64_t due = 0;
+			if (_options.ratePerSecond > 0)
+			{
+				std::lock_guard<std::mutex> guard(_lock);
+				if (_paceStart == 0)
+					_paceStart = _clock();
+				due = _paceStart + (int64_t)(index * 1e9 / _options.ratePerSecond);
+			}
+			auto now = _clock();
+			// Below the timer resolution, the request goes out late and the lateness is measured
+			if (due - now >= 1000000)
+			{
+				auto self = shared_from_this();
+				_delay((uint64_t)(due - now) / 1000, [self, index, due]() { self->Send(index, due); });
+				return;
+			}
+			Send(index, due);
+		}
+
+		void Send(size_t index, int64_t due)
+		{
+			if (_cancelled)
+			{
+				_inFlight--;
+				Finish();
+				return;
+			}
+			auto sent = _clock();
+			auto from = (due != 0 && due < sent ? due : sent);
+			if (index == _options.warmup)
+			{
+				std::lock_guard<std::mutex> guard(_lock);
+				_start = from;
+			}
+
+			auto self = shared_from_this();
+			auto answered = std::make_shared<std::atomic<bool>>(false);
+			RequestDone done = [self, index, from, answered](bool success, int64_t bytes)
+			{
+				if (answered->exchange(true))
+					return;
+				self->Answered(index, from, success, bytes);
+			};
+			try
+			{
+				_request(index, done);
+			}
+			catch (...)
+			{
+				done(false, -1);
+			}
+		}
+
+		void Answered(size_t index, int64_t from, bool success, int64_t bytes)
+		{
+			auto now = _clock();
+			if (index >= _options.warmup)
+			{
+				std::lock_guard<std::mutex> guard(_lock);
+				_report.requests++;
+				if (!success)
+					_report.errors++;
+				if (bytes > 0)
+					_report.bytes += (uint64_t)bytes;
+				_report.latency.Add((uint64_t)(now > from ? now - from : 0));
+				if (now > _last)
+					_last = now;
+			}
+			_inFlight--;
+
+			// Not from the completion, which may be inside the request call itself
+			auto self = shared_from_this();
+			ThreadPool::Default().Submit([self]() { self->Next(); });
+		}
+
+		// Report once nothing is left to send and nothing is in flight
+		void Finish()
+		{
+			if (_inFlight > 0 || (!_cancelled && _next < _total))
+				return;
+
+			LoadReport report;
+			{
+				std::lock_guard<std::mutex> guard(_lock);
+				if (_reported || _inFlight > 0)
+					return;
+				_reported = true;
+				_report.elapsed = (_report.requests > 0 ? _last - _start : 0);
+				report = _report;
+			}
+			if (_finished)
+				_finished(report);
+		}
+
+		Request _request;
+		Options _options;
+		Finished _finished;
+		Clock _clock;
+		RequestPolicy::Delay _delay;
+		size_t _total;
+
+		std::atomic<size_t> _next;
+		std::atomic<size_t> _inFlight;
+		std::atomic<bool> _cancelled;
+
+		std::mutex _lock;
+		bool _reported;
+		int64_t _paceStart; // open loop: when request 0 was due
+		int64_t _start; // of the first measured request
+		int64_t _last;  // last answer
+		LoadReport _report;
+	};
+} // namespace LUwpUtilities
+
+#endif // #ifndef _LUWPUTILITIES_LOAD_GENERATOR_
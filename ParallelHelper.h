@@ -0,0 +1,163 @@
+/**
+ * Data-parallel loops over an index range on top of ThreadPool (portable C++, no C++/CX).
+ *
+ *  - ParallelForAsync(pool, begin, end, body, done) runs body(first, last) on sub-ranges of
+ *    [begin, end) and calls done once, on whichever worker finishes the last sub-range
+ *  - ParallelFor(pool, begin, end, body) does the same but blocks; the calling thread takes
+ *    part in the loop so it is safe to use from a worker
+ *
+ * The range is split with guided self-scheduling: every participant repeatedly claims a chunk
+ * of remaining / (2 * workers) indices (at least minChunk), so the chunks start large and get
+ * smaller towards the end, which balances uneven per-item costs without many claims.
+ */
+
+#ifndef _LUWPUTILITIES_PARALLEL_HELPER_
+#define _LUWPUTILITIES_PARALLEL_HELPER_
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "ThreadPool.h"
+
+namespace LUwpUtilities
+{
+	typedef std::function<void(size_t first, size_t last)> RangeBody;
+	typedef std::function<void(std::exception_ptr error)> RangeCompletion;
+
+	namespace Parallel
+	{
+		struct LoopState
+		{
+			size_t end;
+			size_t minChunk;
+			size_t divisor;
+			std::atomic<size_t> next;
+			std::atomic<size_t> remaining;
+			RangeBody body;
+			RangeCompletion done;
+			std::mutex errorLock;
+			std::exception_ptr error;
+
+			// Claim a chunk; return false when the range is exhausted
+			bool Claim(size_t &first, size_t &last)
+			{
+				size_t current = next.load();
+				do
+				{
+					if (current >= end)
+						return false;
+					size_t chunk = std::max(minChunk, (end - current) / divisor);
+					last = std::min(end, current + chunk);
+				} while (!next.compare_exchange_weak(current, last));
+				first = current;
+				return true;
+			}
+
+			// Process chunks until there is none left; return true if we finished the last one
+			bool Participate()
+			{
+				size_t first, last;
+				bool finished = false;
+				while (Claim(first, last))
+				{
+					try
+					{
+						body(first, last);
+					}
+					catch (...)
+					{
+						std::lock_guard<std::mutex> guard(errorLock);
+						if (!error)
+							error = std::current_exception();
+					}
+					if (remaining.fetch_sub(last - first) == last - first)
+						finished = true;
+				}
+				return finished;
+			}
+		};
+
+		inline std::shared_ptr<LoopState> MakeLoop(ThreadPool &pool, size_t begin, size_t end, RangeBody body, size_t minChunk)
+		{
+			auto state = std::make_shared<LoopState>();
+			state->end = end;
+			state->minChunk = std::max<size_t>(minChunk, 1);
+			state->divisor = 2 * (size_t)pool.WorkerCount();
+			state->next = begin;
+			state->remaining = end - begin;
+			state->body = std::move(body);
+			return state;
+		}
+
+		// Number of pool participants worth starting for the range
+		inline size_t Participants(ThreadPool &pool, size_t count, size_t minChunk)
+		{
+			size_t chunks = (count + minChunk - 1) / std::max<size_t>(minChunk, 1);
+			return std::min<size_t>(pool.WorkerCount(), chunks);
+		}
+	} // namespace Parallel
+
+	// Run body over sub-ranges of [begin, end) on the pool then call done (on a worker)
+	// with the first exception thrown by body, if any
+	inline void ParallelForAsync(
+		ThreadPool &pool,
+		size_t begin,
+		size_t end,
+		RangeBody body,
+		RangeCompletion done,
+		size_t minChunk = 1,
+		WorkPriority priority = WorkPriority::Normal
+	)
+	{
+		if (begin >= end)
+		{
+			pool.Submit([done]() { done(nullptr); }, priority);
+			return;
+		}
+
+		auto state = Parallel::MakeLoop(pool, begin, end, std::move(body), minChunk);
+		state->done = std::move(done);
+		size_t participants = Parallel::Participants(pool, end - begin, state->minChunk);
+		for (size_t i = 0; i < participants; i++)
+		{
+			pool.Submit([state]()
+			{
+				if (state->Participate())
+					state->done(state->error);
+			}, priority);
+		}
+	}
+
+	// Run body over sub-ranges of [begin, end) and wait; rethrow the first exception thrown by body
+	inline void ParallelFor(
+		ThreadPool &pool,
+		size_t begin,
+		size_t end,
+		RangeBody body,
+		size_t minChunk = 1
+	)
+	{
+		if (begin >= end)
+			return;
+
+		auto state = Parallel::MakeLoop(pool, begin, end, std::move(body), minChunk);
+		size_t helpers = Parallel::Participants(pool, end - begin, state->minChunk);
+		for (size_t i = 1; i < helpers; i++)
+			pool.Submit([state]() { state->Participate(); });
+
+		// Take part so that progress does not depend on free workers, then wait for
+		// the chunks other participants are still processing
+		state->Participate();
+		while (state->remaining.load() > 0)
+			std::this_thread::yield();
+
+		if (state->error)
+			std::rethrow_exception(state->error);
+	}
+} // namespace LUwpUtilities
+
+#endif // #ifndef _LUWPUTILITIES_PARALLEL_HELPER_
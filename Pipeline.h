@@ -0,0 +1,316 @@
+/**
+ * Multi-stage pipeline with bounded queues and backpressure (portable C++, no C++/CX).
+ *
+ *     auto pipeline = Pipeline<Item>::Create();
+ *     pipeline->AddStage("parse", parse, 4, 16);  // up to 4 items in parallel, at most 16 waiting
+ *     pipeline->AddStage("map", map, 2, 16);
+ *     pipeline->AddStage("ui", append, 1, 64, postToUIThread);
+ *     pipeline->Push(item); ...
+ *     pipeline->Close(onDrained);
+ *
+ * Every stage has an input queue of fixed capacity and runs at most `parallelism` items at a time
+ * on the thread pool (or through its own executor, e.g. the UI thread). A stage only starts an
+ * item when the next queue has room for the result, so a slow stage stalls the stages before it
+ * instead of letting items pile up; in the end TryPush() fails (or Push() waits) at the entrance.
+ * A stage function transforms the item in place and returns false to drop it; exceptions drop the
+ * item and go to the error handler. GetStatistics() reports per-stage throughput and utilization
+ * to find the bottleneck.
+ */
+
+#ifndef _LUWPUTILITIES_PIPELINE_
+#define _LUWPUTILITIES_PIPELINE_
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include "ThreadPool.h"
+
+namespace LUwpUtilities
+{
+	struct StageStatistics
+	{
+		std::string name;
+		size_t processed;    // items the stage function returned true for
+		size_t dropped;      // items filtered out or failed
+		size_t queued;       // items waiting in the input queue now
+		size_t running;      // items being processed now
+		size_t stalls;       // times an item could not start because the next queue was full
+		double busySeconds;  // total time spent in the stage function
+		double throughput;   // items per second since the pipeline started
+		double utilization;  // busySeconds / (parallelism * elapsed), near 1 for the bottleneck
+	};
+
+	template<typename T>
+	class Pipeline : public std::enable_shared_from_this<Pipeline<T>>
+	{
+	public:
+		typedef std::function<bool(T &item)> StageFunction;
+		typedef std::function<void(std::function<void()> work)> Executor;
+		typedef std::function<void(std::exception_ptr error)> ErrorHandler;
+
+		// The items in flight keep the pipeline alive, so it is always owned by a shared_ptr
+		static std::shared_ptr<Pipeline> Create(ThreadPool &pool = ThreadPool::Default())
+		{
+			return std::shared_ptr<Pipeline>(new Pipeline(pool));
+		}
+
+		Pipeline(const Pipeline&) = delete;
+		Pipeline &operator=(const Pipeline&) = delete;
+
+		// Add a stage after the existing ones; call before pushing items.
+		// Without executor the stage runs on the thread pool.
+		void AddStage(const std::string &name, StageFunction function, size_t parallelism, size_t capacity, Executor executor = nullptr)
+		{
+			std::unique_ptr<Stage> stage(new Stage());
+			stage->name = name;
+			stage->function = std::move(function);
+			stage->parallelism = (parallelism == 0 ? 1 : parallelism);
+			stage->capacity = (capacity == 0 ? 1 : capacity);
+			stage->executor = std::move(executor);
+			_stages.push_back(std::move(stage));
+		}
+
+		void OnError(ErrorHandler handler)
+		{
+			_onError = std::move(handler);
+		}
+
+		// Enter an item if the first queue has room; never blocks
+		bool TryPush(T item)
+		{
+			std::vector<Start> starts;
+			{
+				std::lock_guard<std::mutex> guard(_lock);
+				auto &first = *_stages.front();
+				if (_closed || first.queue.size() + first.reserved >= first.capacity)
+					return false;
+
+				first.queue.push_back(std::move(item));
+				Pump(starts);
+			}
+			Launch(starts);
+			return true;
+		}
+
+		// Enter an item, waiting for room in the first queue; not for the UI thread or pool workers
+		void Push(T item)
+		{
+			std::vector<Start> starts;
+			{
+				std::unique_lock<std::mutex> guard(_lock);
+				auto &first = *_stages.front();
+				_space.wait(guard, [&]() { return first.queue.size() + first.reserved < first.capacity; });
+				first.queue.push_back(std::move(item));
+				Pump(starts);
+			}
+			Launch(starts);
+		}
+
+		// No more items; done is called (from the thread finishing the last item) once everything went through
+		void Close(std::function<void()> done)
+		{
+			bool drained;
+			{
+				std::lock_guard<std::mutex> guard(_lock);
+				_closed = true;
+				_onDrained = std::move(done);
+				drained = IsDrained();
+				if (drained)
+					std::swap(done, _onDrained);
+			}
+			if (drained && done)
+				done();
+		}
+
+		std::vector<StageStatistics> GetStatistics()
+		{
+			std::lock_guard<std::mutex> guard(_lock);
+			double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - _start).count();
+			std::vector<StageStatistics> result;
+			for (auto &stage : _stages)
+			{
+				StageStatistics s;
+				s.name = stage->name;
+				s.processed = stage->processed;
+				s.dropped = stage->dropped;
+				s.queued = stage->queue.size();
+				s.running = stage->running;
+				s.stalls = stage->stalls;
+				s.busySeconds = stage->busy.count();
+				s.throughput = (elapsed > 0 ? stage->processed / elapsed : 0);
+				s.utilization = (elapsed > 0 ? s.busySeconds / (stage->parallelism * elapsed) : 0);
+				result.push_back(s);
+			}
+			return result;
+		}
+
+	private:
+		explicit Pipeline(ThreadPool &pool)
+			: _pool(pool), _closed(false), _inFlight(0), _start(std::chrono::steady_clock::now())
+		{
+		}
+
+		struct Stage
+		{
+			std::string name;
+			StageFunction function;
+			size_t parallelism;
+			size_t capacity;
+			Executor executor;
+
+			std::deque<T> queue;
+			size_t running = 0;
+			size_t reserved = 0; // room held for the results of the previous stage's running items
+			bool stalled = false;
+
+			size_t processed = 0;
+			size_t dropped = 0;
+			size_t stalls = 0;
+			std::chrono::duration<double> busy = std::chrono::duration<double>(0);
+		};
+
+		struct Start
+		{
+			size_t stage;
+			std::shared_ptr<T> item;
+		};
+
+		// Under _lock: start every item that can start, from the last stage backwards so that
+		// room freed downstream is used before more items enter
+		void Pump(std::vector<Start> &starts)
+		{
+			for (size_t i = _stages.size(); i-- > 0;)
+			{
+				auto &stage = *_stages[i];
+				Stage *next = (i + 1 < _stages.size() ? _stages[i + 1].get() : nullptr);
+				while (stage.running < stage.parallelism && !stage.queue.empty())
+				{
+					if (next != nullptr && next->queue.size() + next->reserved >= next->capacity)
+					{
+						if (!stage.stalled)
+							stage.stalls++;
+						stage.stalled = true;
+						break;
+					}
+
+					stage.stalled = false;
+					Start start;
+					start.stage = i;
+					start.item = std::make_shared<T>(std::move(stage.queue.front()));
+					stage.queue.pop_front();
+					stage.running++;
+					if (next != nullptr)
+						next->reserved++;
+					_inFlight++;
+					starts.push_back(start);
+				}
+			}
+			if (!starts.empty())
+				_space.notify_all();
+		}
+
+		void Launch(std::vector<Start> &starts)
+		{
+			for (auto &start : starts)
+			{
+				auto self = this->shared_from_this();
+				auto index = start.stage;
+				auto item = start.item;
+				std::function<void()> work = [self, index, item]() { self->Run(index, *item); };
+				auto &executor = _stages[index]->executor;
+				if (executor)
+					executor(std::move(work));
+				else
+					_pool.Submit(std::move(work));
+			}
+		}
+
+		void Run(size_t index, T &item)
+		{
+			auto &stage = *_stages[index];
+			bool keep = false;
+			std::exception_ptr error;
+			auto begin = std::chrono::steady_clock::now();
+			try
+			{
+				keep = stage.function(item);
+			}
+			catch (...)
+			{
+				error = std::current_exception();
+			}
+			auto busy = std::chrono::steady_clock::now() - begin;
+
+			if (error && _onError)
+			{
+				try
+				{
+					_onError(error);
+				}
+				catch (...)
+				{
+				}
+			}
+
+			std::vector<Start> starts;
+			std::function<void()> done;
+			{
+				std::lock_guard<std::mutex> guard(_lock);
+				stage.running--;
+				stage.busy += busy;
+				if (keep)
+					stage.processed++;
+				else
+					stage.dropped++;
+
+				if (index + 1 < _stages.size())
+				{
+					auto &next = *_stages[index + 1];
+					next.reserved--;
+					if (keep)
+						next.queue.push_back(std::move(item));
+				}
+
+				Pump(starts);
+				_inFlight--;
+				if (_closed && IsDrained())
+					std::swap(done, _onDrained);
+			}
+			Launch(starts);
+			if (done)
+				done();
+		}
+
+		bool IsDrained() const
+		{
+			if (_inFlight > 0)
+				return false;
+			for (auto &stage : _stages)
+			{
+				if (!stage->queue.empty())
+					return false;
+			}
+			return true;
+		}
+
+		ThreadPool &_pool;
+		std::vector<std::unique_ptr<Stage>> _stages;
+		ErrorHandler _onError;
+
+		std::mutex _lock;
+		std::condition_variable _space; // room in the first queue
+		bool _closed;
+		size_t _inFlight;
+		std::function<void()> _onDrained;
+		std::chrono::steady_clock::time_point _start;
+	};
+} // namespace LUwpUtilities
+
+#endif // #ifndef _LUWPUTILITIES_PIPELINE_
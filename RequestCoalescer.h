@@ -0,0 +1,193 @@
+/**
+ * Single flight of identical requests (portable C++, no C++/CX); it is the table behind the
+ * coalescing of Http::GetAsync.
+ *
+ *     RequestCoalescer<Result> coalescer;
+ *     auto ticket = coalescer.Request(NormalizeUrl(url), send, onResult);
+ *     ...
+ *     coalescer.Leave(key, ticket); // the caller was cancelled
+ *
+ * The first Request() of a key calls send(complete) to start the actual request; the ones that come
+ * while it is in flight only queue their callback. complete(result) calls every queued callback with
+ * the same result (a response or an error) and forgets the key, so the next Request() starts anew.
+ * A caller can Leave() before completion; when the last one leaves, the request is aborted through
+ * the function returned by send and its result is dropped.
+ */
+
+#ifndef _LUWPUTILITIES_REQUEST_COALESCER_
+#define _LUWPUTILITIES_REQUEST_COALESCER_
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace LUwpUtilities
+{
+	template<typename Result>
+	class RequestCoalescer
+	{
+	public:
+		typedef std::function<void(const Result &result)> Callback;
+		typedef std::function<void()> Abort;
+		// Start the request and return how to abort it (or null); complete may be called from any
+		// thread, even before send returns
+		typedef std::function<Abort(Callback complete)> Send;
+
+		struct Statistics
+		{
+			size_t requests;  // actually sent
+			size_t coalesced; // joined a request in flight
+			size_t aborted;   // abandoned by every caller
+		};
+
+		RequestCoalescer() : _nextTicket(1)
+		{
+			_requests = 0;
+			_coalesced = 0;
+			_aborted = 0;
+		}
+
+		RequestCoalescer(const RequestCoalescer&) = delete;
+		RequestCoalescer &operator=(const RequestCoalescer&) = delete;
+
+		// Call callback with the result of the request for key, sending it only if it is not in flight;
+		// return a ticket for Leave()
+		size_t Request(const std::string &key, const Send &send, Callback callback)
+		{
+			std::shared_ptr<Flight> flight;
+			size_t ticket;
+			{
+				std::lock_guard<std::mutex> guard(_lock);
+				ticket = _nextTicket++;
+				auto found = _flights.find(key);
+				if (found != _flights.end())
+				{
+					found->second->waiters.emplace_back(ticket, std::move(callback));
+					_coalesced.fetch_add(1, std::memory_order_relaxed);
+					return ticket;
+				}
+
+				flight = std::make_shared<Flight>();
+				flight->waiters.emplace_back(ticket, std::move(callback));
+				_flights[key] = flight;
+				_requests.fetch_add(1, std::memory_order_relaxed);
+			}
+
+			auto abort = send([this, key, flight](const Result &result) { Complete(key, flight, result); });
+
+			bool abandoned;
+			{
+				std::lock_guard<std::mutex> guard(_lock);
+				abandoned = flight->abandoned;
+				if (!abandoned && !flight->completed)
+					flight->abort = abort;
+			}
+			// Every caller left while send was running
+			if (abandoned && abort)
+				abort();
+			return ticket;
+		}
+
+		// Give up waiting; return false if the callback already ran (or is about to run)
+		bool Leave(const std::string &key, size_t ticket)
+		{
+			Abort abort;
+			{
+				std::lock_guard<std::mutex> guard(_lock);
+				auto found = _flights.find(key);
+				if (found == _flights.end())
+					return false;
+
+				auto &flight = *found->second;
+				auto &waiters = flight.waiters;
+				auto it = waiters.begin();
+				while (it != waiters.end() && it->first != ticket)
+					++it;
+				if (it == waiters.end())
+					return false;
+
+				waiters.erase(it);
+				if (waiters.empty())
+				{
+					flight.abandoned = true;
+					std::swap(abort, flight.abort);
+					_flights.erase(found);
+					_aborted.fetch_add(1, std::memory_order_relaxed);
+				}
+			}
+			if (abort)
+				abort();
+			return true;
+		}
+
+		// Number of requests in flight
+		size_t Count()
+		{
+			std::lock_guard<std::mutex> guard(_lock);
+			return _flights.size();
+		}
+
+		Statistics GetStatistics() const
+		{
+			Statistics s;
+			s.requests = _requests.load(std::memory_order_relaxed);
+			s.coalesced = _coalesced.load(std::memory_order_relaxed);
+			s.aborted = _aborted.load(std::memory_order_relaxed);
+			return s;
+		}
+
+	private:
+		struct Flight
+		{
+			// Guarded by _lock
+			std::vector<std::pair<size_t, Callback>> waiters;
+			Abort abort;
+			bool abandoned = false;
+			bool completed = false;
+		};
+
+		void Complete(const std::string &key, const std::shared_ptr<Flight> &flight, const Result &result)
+		{
+			std::vector<std::pair<size_t, Callback>> waiters;
+			{
+				std::lock_guard<std::mutex> guard(_lock);
+				if (flight->completed)
+					return;
+				flight->completed = true;
+				flight->abort = nullptr;
+				waiters.swap(flight->waiters);
+
+				// An abandoned flight is no longer in the table (and a new one may be there)
+				auto found = _flights.find(key);
+				if (found != _flights.end() && found->second == flight)
+					_flights.erase(found);
+			}
+
+			for (auto &waiter : waiters)
+			{
+				try
+				{
+					waiter.second(result);
+				}
+				catch (...)
+				{
+				}
+			}
+		}
+
+		std::mutex _lock;
+		std::unordered_map<std::string, std::shared_ptr<Flight>> _flights;
+		size_t _nextTicket;
+
+		std::atomic<size_t> _requests;
+		std::atomic<size_t> _coalesced;
+		std::atomic<size_t> _aborted;
+	};
+} // namespace LUwpUtilities
+
+#endif // #ifndef _LUWPUTILITIES_REQUEST_COALESCER_
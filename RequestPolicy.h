@@ -0,0 +1,394 @@
+/**
+ * Hedging and retries of idempotent requests to cut the latency tail (portable C++, no C++/CX);
+ * it is the engine behind Http::GetWithPolicyAsync.
+ *
+ *     RequestPolicy policy(options);
+ *     policy.Execute<Response>([](RequestPolicy::AttemptDone<Response> done)
+ *     {
+ *         ... send one attempt, call done(response, AttemptOutcome::...) ...
+ *         return abort; // function to abort the attempt
+ *     }, [](const Response &response, AttemptOutcome outcome) { ... });
+ *
+ *  - Hedging: when an attempt takes longer than a percentile (e.g. p95) of the latencies observed
+ *    by the policy, a second identical attempt is sent and the first answer wins; the other is aborted
+ *  - Retries: a transient failure (timeout, reset, 503...) is retried after a capped exponential
+ *    backoff with full jitter, so that clients do not retry in lockstep
+ *  - Budget: every call deposits a fraction of a token and every hedge or retry takes a whole one,
+ *    so the extra load stays a small fraction of the traffic (e.g. 10%) even when the server is down
+ * Time and delays come from a clock and a timer that can be replaced, and the jitter from a seed that
+ * can be given, e.g. for a reproducible simulation.
+ */
+
+#ifndef _LUWPUTILITIES_REQUEST_POLICY_
+#define _LUWPUTILITIES_REQUEST_POLICY_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include "TaskTrace.h"
+#include "ThreadPool.h"
+#include "TimerWheel.h"
+
+namespace LUwpUtilities
+{
+	enum class AttemptOutcome
+	{
+		Success,   // an answer to deliver
+		Transient, // worth retrying: network error, timeout, 408, 429, 5xx...
+		Permanent  // an error to deliver as is
+	};
+
+	class RequestPolicy
+	{
+	public:
+		template<typename Result>
+		using AttemptDone = std::function<void(const Result &result, AttemptOutcome outcome)>;
+		typedef std::function<void()> Abort;
+		// Abort a call; false if it already completed (or is completing)
+		typedef std::function<bool()> Cancel;
+		// Microseconds from an arbitrary origin
+		typedef std::function<uint64_t()> Clock;
+		// Run action after the delay (microseconds), on any thread
+		typedef std::function<void(uint64_t delay, std::function<void()> action)> Delay;
+
+		struct Options
+		{
+			double hedgePercentile;     // 0 for no hedging, e.g. 0.95
+			uint64_t initialHedgeDelay; // microseconds, until enough latencies were observed
+			uint64_t minHedgeDelay;     // microseconds
+			int maxAttempts;            // first attempt and retries, hedges not included
+			uint64_t baseBackoff;       // microseconds, doubled on each retry...
+			uint64_t maxBackoff;        // ...up to this
+			double budgetRatio;         // tokens deposited per call
+			double budgetMax;           // tokens kept at most
+			uint64_t seed;              // of the backoff jitter; 0 for one from the clock
+		};
+
+		struct Statistics
+		{
+			size_t calls;
+			size_t hedges;
+			size_t hedgeWins;     // hedges that answered first
+			size_t retries;
+			size_t budgetDenied;  // hedges or retries skipped for lack of budget
+			uint64_t hedgeDelay;  // microseconds, current
+		};
+
+		static Options DefaultOptions()
+		{
+			Options options;
+			options.hedgePercentile = 0.95;
+			options.initialHedgeDelay = 1000000;
+			options.minHedgeDelay = 10000;
+			options.maxAttempts = 3;
+			options.baseBackoff = 100000;
+			options.maxBackoff = 5000000;
+			options.budgetRatio = 0.1;
+			options.budgetMax = 10;
+			options.seed = 0;
+			return options;
+		}
+
+		explicit RequestPolicy(const Options &options = DefaultOptions(), Clock clock = nullptr, Delay delay = nullptr)
+			: _options(options), _clock(std::move(clock)), _delay(std::move(delay)), _random(options.seed), _tokens(options.budgetMax),
+			_calls(0), _hedges(0), _hedgeWins(0), _retries(0), _budgetDenied(0)
+		{
+			if (_random == 0)
+			{
+				_random = (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count() ^
+					(uint64_t)(uintptr_t)this ^ 0x9E3779B97F4A7C15ull;
+				if (_random == 0)
+					_random = 1;
+			}
+			if (!_clock)
+			{
+				_clock = []()
+				{
+					return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+						std::chrono::steady_clock::now().time_since_epoch()).count();
+				};
+			}
+			if (!_delay)
+				_delay = &RequestPolicy::TimerDelay;
+		}
+
+		RequestPolicy(const RequestPolicy&) = delete;
+		RequestPolicy &operator=(const RequestPolicy&) = delete;
+
+		// Run attempts until one succeeds or fails for good; complete gets the answer, or the last
+		// transient failure once the attempts or the budget ran out. An attempt reports its failures
+		// through done rather than by throwing. Return a function to abort the call: when it returns
+		// true, complete is not called. The policy must outlive its calls.
+		template<typename Result>
+		Cancel Execute(std::function<Abort(AttemptDone<Result> done)> attempt, AttemptDone<Result> complete)
+		{
+			auto call = std::make_shared<Call<Result>>();
+			call->attempt = std::move(attempt);
+			call->complete = std::move(complete);
+			{
+				std::lock_guard<std::mutex> guard(_lock);
+				_calls++;
+				_tokens = std::min(_options.budgetMax, _tokens + _options.budgetRatio);
+			}
+			Start(call, false);
+			return [call]()
+			{
+				bool running;
+				auto aborts = call->Finish(&running);
+				for (auto &abort : aborts)
+					abort();
+				return running;
+			};
+		}
+
+		// Delay before hedging an attempt
+		uint64_t HedgeDelay()
+		{
+			std::lock_guard<std::mutex> guard(_lock);
+			return HedgeDelayLocked();
+		}
+
+		// Delay before the retry that follows the given number of retries
+		uint64_t Backoff(int retries)
+		{
+			uint64_t ceiling = _options.baseBackoff;
+			for (int i = 0; i < retries && ceiling < _options.maxBackoff; i++)
+				ceiling *= 2;
+			ceiling = std::min(ceiling, _options.maxBackoff);
+			std::lock_guard<std::mutex> guard(_lock);
+			return (ceiling == 0 ? 0 : Random() % (ceiling + 1));
+		}
+
+		Statistics GetStatistics()
+		{
+			std::lock_guard<std::mutex> guard(_lock);
+			Statistics s;
+			s.calls = _calls;
+			s.hedges = _hedges;
+			s.hedgeWins = _hedgeWins;
+			s.retries = _retries;
+			s.budgetDenied = _budgetDenied;
+			s.hedgeDelay = HedgeDelayLocked();
+			return s;
+		}
+
+		// One-shot timer on TimerService::Default(), the default Delay; the action runs on the thread pool
+		static void TimerDelay(uint64_t delay, std::function<void()> action)
+		{
+			auto timer = new TimerWheel::Timer();
+			timer->callback = [timer, action]()
+			{
+				ThreadPool::Default().Submit([timer, action]()
+				{
+					{
+						// The service is done with the timer once it released the lock
+						std::lock_guard<std::recursive_mutex> guard(TimerService::Default().Lock());
+						delete timer;
+					}
+					action();
+				});
+			};
+			TimerService::Default().Schedule(*timer, std::chrono::milliseconds((delay + 999) / 1000));
+		}
+
+	private:
+		// Latencies kept for the percentile before the old ones are halved
+		static const uint64_t LatencyWindow = 1000;
+		// Latencies needed before the percentile replaces initialHedgeDelay
+		static const uint64_t LatencyWarmup = 20;
+
+		template<typename Result>
+		struct Call
+		{
+			std::function<Abort(AttemptDone<Result> done)> attempt;
+			AttemptDone<Result> complete;
+
+			// Guarded by lock
+			std::mutex lock;
+			bool finished = false;
+			int primaries = 0;      // first attempt and retries started
+			size_t outstanding = 0; // attempts in flight
+			std::vector<Abort> aborts;
+			std::vector<uint64_t> starts;
+			std::vector<bool> hedge;
+			std::vector<bool> done;
+
+			// Mark the call finished; return the aborts of the attempts still in flight
+			std::vector<Abort> Finish(bool *running = nullptr)
+			{
+				std::vector<Abort> result;
+				std::lock_guard<std::mutex> guard(lock);
+				if (running != nullptr)
+					*running = !finished;
+				finished = true;
+				for (size_t i = 0; i < aborts.size(); i++)
+				{
+					if (!done[i] && aborts[i])
+						result.push_back(std::move(aborts[i]));
+					aborts[i] = nullptr;
+				}
+				return result;
+			}
+		};
+
+		template<typename Result>
+		void Start(const std::shared_ptr<Call<Result>> &call, bool isHedge)
+		{
+			size_t index;
+			{
+				std::lock_guard<std::mutex> guard(call->lock);
+				if (call->finished)
+					return;
+				index = call->aborts.size();
+				call->aborts.push_back(nullptr);
+				call->starts.push_back(_clock());
+				call->hedge.push_back(isHedge);
+				call->done.push_back(false);
+				call->outstanding++;
+				if (!isHedge)
+					call->primaries++;
+			}
+
+			if (!isHedge && _options.hedgePercentile > 0)
+				_delay(HedgeDelay(), [this, call, index]() { Hedge(call, index); });
+
+			auto abort = call->attempt([this, call, index](const Result &result, AttemptOutcome outcome)
+			{
+				Done(call, index, result, outcome);
+			});
+
+			bool late;
+			{
+				std::lock_guard<std::mutex> guard(call->lock);
+				late = call->finished && !call->done[index];
+				if (!late && !call->done[index])
+					call->aborts[index] = abort;
+			}
+			// The call finished (another attempt won or it was aborted) while this one was starting
+			if (late && abort)
+				abort();
+		}
+
+		// The attempt is still running after the hedge delay: send a duplicate
+		template<typename Result>
+		void Hedge(const std::shared_ptr<Call<Result>> &call, size_t index)
+		{
+			{
+				std::lock_guard<std::mutex> guard(call->lock);
+				if (call->finished || call->done[index] || call->outstanding > 1)
+					return;
+			}
+			if (!Withdraw())
+				return;
+			{
+				std::lock_guard<std::mutex> guard(_lock);
+				_hedges++;
+			}
+			Start(call, true);
+		}
+
+		template<typename Result>
+		void Done(const std::shared_ptr<Call<Result>> &call, size_t index, const Result &result, AttemptOutcome outcome)
+		{
+			uint64_t latency;
+			bool hedge;
+			int retries;
+			{
+				std::lock_guard<std::mutex> guard(call->lock);
+				if (call->finished || call->done[index])
+					return;
+				call->done[index] = true;
+				call->aborts[index] = nullptr;
+				call->outstanding--;
+				latency = _clock() - call->starts[index];
+				hedge = call->hedge[index];
+				retries = call->primaries - 1;
+
+				// Another attempt may still answer
+				if (outcome == AttemptOutcome::Transient && call->outstanding > 0)
+					return;
+			}
+
+			if (outcome == AttemptOutcome::Success)
+			{
+				std::lock_guard<std::mutex> guard(_lock);
+				_latencies.Add(latency);
+				if (_latencies.total >= LatencyWindow)
+					_latencies.Decay();
+				if (hedge)
+					_hedgeWins++;
+			}
+
+			if (outcome == AttemptOutcome::Transient && retries + 1 < _options.maxAttempts && Withdraw())
+			{
+				{
+					std::lock_guard<std::mutex> guard(_lock);
+					_retries++;
+				}
+				_delay(Backoff(retries), [this, call]() { Start(call, false); });
+				return;
+			}
+
+			auto aborts = call->Finish();
+			for (auto &abort : aborts)
+				abort();
+			try
+			{
+				call->complete(result, outcome);
+			}
+			catch (...)
+			{
+			}
+		}
+
+		bool Withdraw()
+		{
+			std::lock_guard<std::mutex> guard(_lock);
+			if (_tokens < 1)
+			{
+				_budgetDenied++;
+				return false;
+			}
+			_tokens -= 1;
+			return true;
+		}
+
+		uint64_t HedgeDelayLocked() const
+		{
+			if (_latencies.total < LatencyWarmup)
+				return _options.initialHedgeDelay;
+			return std::max(_options.minHedgeDelay, _latencies.Percentile(_options.hedgePercentile));
+		}
+
+		// xorshift64*; called with the lock held
+		uint64_t Random()
+		{
+			_random ^= _random >> 12;
+			_random ^= _random << 25;
+			_random ^= _random >> 27;
+			return _random * 0x2545F4914F6CDD1Dull;
+		}
+
+		Options _options;
+		Clock _clock;
+		Delay _delay;
+
+		std::mutex _lock;
+		uint64_t _random;           // state of the backoff jitter
+		LatencySnapshot _latencies; // of the successful attempts, in microseconds
+		double _tokens;
+		size_t _calls;
+		size_t _hedges;
+		size_t _hedgeWins;
+		size_t _retries;
+		size_t _budgetDenied;
+	};
+} // namespace LUwpUtilities
+
+#endif // #ifndef _LUWPUTILITIES_REQUEST_POLICY_
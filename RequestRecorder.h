@@ -0,0 +1,402 @@
+/**
+ * Per-request HTTP timings (portable C++, no C++/CX); Http records its requests here once
+ * Http::EnableRequestTimings(true) was called.
+ *
+ * Each request gives one RequestTiming:
+ *  - queue time: from the call to the send (e.g. the wait for a slot of the host scheduler)
+ *  - time to headers and time to last byte, both from the send
+ *  - HTTP status, body bytes and what the cache did (served it, revalidated it...)
+ * The last records are kept in a ring buffer, and every record also goes to the histograms of
+ * its host (see LatencySnapshot in TaskTrace.h), so that percentiles cover the whole session:
+ *
+ *     auto timing = RequestRecorder::Default().Begin(url); // null when disabled
+ *     ... timing->sent = recorder.Now(); ... timing->headers = recorder.Now(); ...
+ *     RequestRecorder::Default().Record(*timing);
+ *
+ * A RequestTiming belongs to one thread at a time; progress callbacks running concurrently with
+ * the completion report through a RequestProgress instead.
+ *
+ *     OutputDebugStringA(RequestRecorder::Default().Dump().c_str());
+ *
+ * When disabled (the default), Begin() costs one relaxed atomic load and a branch.
+ */
+
+#ifndef _LUWPUTILITIES_REQUEST_RECORDER_
+#define _LUWPUTILITIES_REQUEST_RECORDER_
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ChunkStream.h"
+#include "TaskTrace.h"
+#include "UrlCodec.h"
+
+namespace LUwpUtilities
+{
+	enum class RequestCacheStatus
+	{
+		None,        // downloaded
+		Hit,         // served from the cache without any request
+		Stale,       // served stale from the cache while it is refreshed in background
+		Revalidated  // the server answered 304 Not Modified and the cached body was served
+	};
+
+	// Timestamps in nanoseconds of RequestRecorder::Now(), 0 if the stage was not reached
+	struct RequestTiming
+	{
+		std::string url;
+		std::string host;
+		int status; // 0 for a network error or a cancellation
+		RequestCacheStatus cache;
+		int64_t enqueued;
+		int64_t sent;
+		int64_t headers;
+		int64_t lastByte;
+		int64_t bytes; // of the body, -1 if unknown
+
+		RequestTiming() : status(0), cache(RequestCacheStatus::None), enqueued(0), sent(0), headers(0), lastByte(0), bytes(-1)
+		{
+		}
+
+		int64_t QueueTime() const
+		{
+			return (sent != 0 ? sent - enqueued : -1);
+		}
+
+		int64_t TimeToHeaders() const
+		{
+			return (sent != 0 && headers != 0 ? headers - sent : -1);
+		}
+
+		int64_t TimeToLastByte() const
+		{
+			return (sent != 0 && lastByte != 0 ? lastByte - sent : -1);
+		}
+	};
+
+	class RequestRecorder
+	{
+	public:
+		typedef std::function<int64_t()> Clock;
+
+		struct HostStatistics
+		{
+			std::string host;
+			uint64_t requests;
+			uint64_t errors;        // network errors and statuses from 400 on
+			uint64_t bytes;
+			uint64_t cacheHits;     // Hit and Stale
+			uint64_t revalidations;
+			LatencySnapshot queueTime;
+			LatencySnapshot timeToHeaders;
+			LatencySnapshot timeToLastByte;
+		};
+
+		// Hosts beyond the limit share one entry, so that the memory stays bounded
+		static const size_t MaxHosts = 64;
+
+		explicit RequestRecorder(size_t capacity = 512, Clock clock = nullptr)
+			: _clock(std::move(clock)), _enabled(false), _ring(capacity == 0 ? 1 : capacity), _next(0), _count(0)
+		{
+			if (!_clock)
+				_clock = &TaskTrace::Now;
+		}
+
+		RequestRecorder(const RequestRecorder&) = delete;
+		RequestRecorder &operator=(const RequestRecorder&) = delete;
+
+		static RequestRecorder &Default()
+		{
+			static RequestRecorder recorder;
+			return recorder;
+		}
+
+		bool IsEnabled() const
+		{
+			return _enabled.load(std::memory_order_relaxed);
+		}
+
+		void Enable(bool enabled)
+		{
+			_enabled.store(enabled, std::memory_order_relaxed);
+		}
+
+		int64_t Now() const
+		{
+			return _clock();
+		}
+
+		// Start the timing of a request that is being queued; null when disabled
+		std::shared_ptr<RequestTiming> Begin(const std::string &url)
+		{
+			if (!IsEnabled())
+				return nullptr;
+			auto timing = std::make_shared<RequestTiming>();
+			timing->url = url;
+			timing->host = UrlAuthority(url);
+			timing->enqueued = Now();
+			return timing;
+		}
+
+		// Record a finished request; missing stages are left out of the histograms
+		void Record(const RequestTiming &timing)
+		{
+			std::lock_guard<std::mutex> guard(_lock);
+			_ring[_next] = timing;
+			_next = (_next + 1) % _ring.size();
+			if (_count < _ring.size())
+				_count++;
+
+			auto &host = Host(timing.host);
+			host.requests++;
+			if (timing.status == 0 || timing.status >= 400)
+				host.errors++;
+			if (timing.bytes > 0)
+				host.bytes += (uint64_t)timing.bytes;
+			if (timing.cache == RequestCacheStatus::Hit || timing.cache == RequestCacheStatus::Stale)
+				host.cacheHits++;
+			else if (timing.cache == RequestCacheStatus::Revalidated)
+				host.revalidations++;
+
+			if (timing.QueueTime() >= 0)
+				host.queueTime.Add((uint64_t)timing.QueueTime());
+			if (timing.TimeToHeaders() >= 0)
+				host.timeToHeaders.Add((uint64_t)timing.TimeToHeaders());
+			if (timing.TimeToLastByte() >= 0)
+				host.timeToLastByte.Add((uint64_t)timing.TimeToLastByte());
+		}
+
+		// The records still in the ring buffer, oldest first
+		std::vector<RequestTiming> Recent() const
+		{
+			std::lock_guard<std::mutex> guard(_lock);
+			std::vector<RequestTiming> result;
+			result.reserve(_count);
+			size_t first = (_next + _ring.size() - _count) % _ring.size();
+			for (size_t i = 0; i < _count; i++)
+				result.push_back(_ring[(first + i) % _ring.size()]);
+			return result;
+		}
+
+		// Statistics of every host since the start (or the last Clear()), busiest first
+		std::vector<HostStatistics> Hosts() const
+		{
+			std::vector<HostStatistics> result;
+			{
+				std::lock_guard<std::mutex> guard(_lock);
+				result.reserve(_hosts.size());
+				for (auto &host : _hosts)
+					result.push_back(*host.second);
+			}
+			std::sort(result.begin(), result.end(), [](const HostStatistics &a, const HostStatistics &b)
+			{
+				return a.requests > b.requests;
+			});
+			return result;
+		}
+
+		void Clear()
+		{
+			std::lock_guard<std::mutex> guard(_lock);
+			_next = 0;
+			_count = 0;
+			_hosts.clear();
+		}
+
+		// Human-readable summary by host (durations in milliseconds)
+		std::string Dump() const
+		{
+			std::string result;
+			char line[256];
+			for (auto &host : Hosts())
+			{
+				snprintf(line, sizeof(line), "%s requests=%llu errors=%llu bytes=%llu cacheHits=%llu revalidations=%llu\n",
+					host.host.empty() ? "(no host)" : host.host.c_str(),
+					(unsigned long long)host.requests, (unsigned long long)host.errors, (unsigned long long)host.bytes,
+					(unsigned long long)host.cacheHits, (unsigned long long)host.revalidations);
+				result += line;
+				AppendLine(result, line, sizeof(line), "queue", host.queueTime);
+				AppendLine(result, line, sizeof(line), "headers", host.timeToHeaders);
+				AppendLine(result, line, sizeof(line), "last byte", host.timeToLastByte);
+			}
+			return result;
+		}
+
+		// The records of the ring buffer as CSV (durations in microseconds, -1 if the stage was not reached)
+		std::string ExportCsv() const
+		{
+			static const char *const cacheNames[] = { "none", "hit", "stale", "revalidated" };
+			std::string result = "url,host,status,cache,queue_us,headers_us,last_byte_us,bytes\n";
+			char line[128];
+			for (auto &timing : Recent())
+			{
+				AppendCsvField(result, timing.url);
+				result += ',';
+				AppendCsvField(result, timing.host);
+				snprintf(line, sizeof(line), ",%d,%s,%lld,%lld,%lld,%lld\n", timing.status, cacheNames[(int)timing.cache],
+					Microseconds(timing.QueueTime()), Microseconds(timing.TimeToHeaders()),
+					Microseconds(timing.TimeToLastByte()), (long long)timing.bytes);
+				result += line;
+			}
+			return result;
+		}
+
+	private:
+		HostStatistics &Host(const std::string &name)
+		{
+			auto found = _hosts.find(name);
+			if (found != _hosts.end())
+				return *found->second;
+
+			auto key = (_hosts.size() < MaxHosts ? name : std::string("(other hosts)"));
+			auto &entry = _hosts[key];
+			if (entry == nullptr)
+			{
+				entry.reset(new HostStatistics());
+				entry->host = key;
+				entry->requests = entry->errors = entry->bytes = entry->cacheHits = entry->revalidations = 0;
+			}
+			return *entry;
+		}
+
+		static long long Microseconds(int64_t nanoseconds)
+		{
+			return (nanoseconds < 0 ? -1 : (long long)(nanoseconds / 1000));
+		}
+
+		static void AppendCsvField(std::string &result, const std::string &value)
+		{
+			if (value.find_first_of(",\"\r\n") == std::string::npos)
+			{
+				result += value;
+				return;
+			}
+			result += '"';
+			for (auto c : value)
+			{
+				if (c == '"')
+					result += '"';
+				result += c;
+			}
+			result += '"';
+		}
+
+		static void AppendLine(std::string &result, char *line, size_t size, const char *label, const LatencySnapshot &snapshot)
+		{
+			if (snapshot.total == 0)
+				return;
+
+			snprintf(line, size, "  %-10s n=%llu p50=%.1f p90=%.1f p99=%.1f max=%.1f\n", label,
+				(unsigned long long)snapshot.total,
+				snapshot.Percentile(0.5) / 1e6,
+				snapshot.Percentile(0.9) / 1e6,
+				snapshot.Percentile(0.99) / 1e6,
+				snapshot.Percentile(1.0) / 1e6);
+			result += line;
+		}
+
+		Clock _clock;
+		std::atomic<bool> _enabled;
+
+		mutable std::mutex _lock;
+		std::vector<RequestTiming> _ring;
+		size_t _next;
+		size_t _count;
+		// LatencySnapshot is a few KB: the statistics stay where they were allocated
+		std::unordered_map<std::string, std::unique_ptr<HostStatistics>> _hosts;
+	};
+
+	// Stages reported by progress callbacks, which may run on another thread than the completion of
+	// the request: they only touch these atomics, and the completion folds them into its RequestTiming
+	struct RequestProgress
+	{
+		std::atomic<int64_t> headers; // RequestRecorder::Now() once the headers were received, else 0
+		std::atomic<int64_t> bytes;   // of the body received so far, -1 until reported
+
+		RequestProgress() : headers(0), bytes(-1)
+		{
+		}
+
+		void Update(bool headersReceived, int64_t received, const RequestRecorder &recorder)
+		{
+			if (headersReceived && headers.load(std::memory_order_relaxed) == 0)
+			{
+				int64_t none = 0;
+				headers.compare_exchange_strong(none, recorder.Now(), std::memory_order_relaxed);
+			}
+			bytes.store(received, std::memory_order_relaxed);
+		}
+
+		// Copy the stages reported so far into timing, where it has none yet
+		void FoldInto(RequestTiming &timing) const
+		{
+			auto time = headers.load(std::memory_order_relaxed);
+			if (timing.headers == 0)
+				timing.headers = time;
+			auto received = bytes.load(std::memory_order_relaxed);
+			if (received >= 0)
+				timing.bytes = received;
+		}
+	};
+
+	// Passes a streamed body on to another consumer and records the request once it ends
+	class RecordingConsumer : public ChunkConsumer
+	{
+	public:
+		RecordingConsumer(std::shared_ptr<ChunkConsumer> consumer, std::shared_ptr<RequestTiming> timing, RequestRecorder &recorder)
+			: _consumer(std::move(consumer)), _timing(std::move(timing)), _recorder(recorder), _bytes(0)
+		{
+		}
+
+		void OnStart(int64_t contentLength) override
+		{
+			_consumer->OnStart(contentLength);
+		}
+
+		bool OnChunk(BufferView chunk) override
+		{
+			_bytes += (int64_t)chunk.size();
+			if (_consumer->OnChunk(chunk))
+				return true;
+			Finish(true);
+			return false;
+		}
+
+		void OnEnd() override
+		{
+			Finish(true);
+			_consumer->OnEnd();
+		}
+
+		void OnError(std::exception_ptr error) override
+		{
+			Finish(false);
+			_consumer->OnError(error);
+		}
+
+	private:
+		// Only a complete body (or one the consumer stopped) has a last byte
+		void Finish(bool complete)
+		{
+			if (complete && _timing->headers != 0)
+				_timing->lastByte = _recorder.Now();
+			_timing->bytes = _bytes;
+			_recorder.Record(*_timing);
+		}
+
+		std::shared_ptr<ChunkConsumer> _consumer;
+		std::shared_ptr<RequestTiming> _timing;
+		RequestRecorder &_recorder;
+		int64_t _bytes;
+	};
+} // namespace LUwpUtilities
+
+#endif // #ifndef _LUWPUTILITIES_REQUEST_RECORDER_
@@ -0,0 +1,436 @@
+/**
+ * Admission control of network requests by host and priority (portable C++, no C++/CX);
+ * it is the scheduler in front of the requests of Http (GetAsync, GetStreamingAsync, GetCachedAsync,
+ * DownloadAsync).
+ *
+ *     RequestScheduler scheduler;
+ *     auto ticket = scheduler.Submit("example.com", WorkPriority::Prefetch, [](RequestScheduler::Done done)
+ *     {
+ *         ... send the request, call done() once it completed ...
+ *     });
+ *     scheduler.Raise(ticket, WorkPriority::UserBlocking); // its element became visible
+ *
+ *  - Every host has a concurrency limit and optionally a token bucket (requests per second with a
+ *    burst); the whole scheduler has a total concurrency limit
+ *  - Requests start in priority order (the WorkPriority lanes of ThreadPool.h), FIFO within a host;
+ *    within a lane the host that started a request least recently goes first, so that one busy
+ *    host cannot starve the others
+ *  - A few slots of every host and of the total are reserved to UserBlocking and Normal requests, so
+ *    a burst of Prefetch requests (thumbnails) never delays the call the user is waiting on by more
+ *    than the end of a single request
+ *  - Queued requests can be cancelled, reprioritized or raised (never lowered) at any time
+ * Time and wake-ups come from a clock and a timer that can be replaced, e.g. to simulate the
+ * scheduler in virtual time.
+ */
+
+#ifndef _LUWPUTILITIES_REQUEST_SCHEDULER_
+#define _LUWPUTILITIES_REQUEST_SCHEDULER_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "ThreadPool.h"
+#include "TimerWheel.h"
+
+namespace LUwpUtilities
+{
+	class RequestScheduler
+	{
+	public:
+		// To call exactly once when the request completed (or failed), to free its slot
+		typedef std::function<void()> Done;
+		typedef std::function<void(Done done)> Start;
+		// Microseconds from an arbitrary origin
+		typedef std::function<uint64_t()> Clock;
+		// Call Pump() after the delay (microseconds)
+		typedef std::function<void(uint64_t delay)> Wake;
+
+		static const int PriorityCount = 4;
+
+		struct HostLimits
+		{
+			size_t concurrency;
+			double ratePerSecond; // 0 for no rate limit
+			double burst;         // requests that can start at once after a quiet time
+		};
+
+		struct Options
+		{
+			HostLimits host;          // for the hosts without SetHostLimits()
+			size_t totalConcurrency;
+			size_t reservedSlots;     // per host and in total, only for UserBlocking and Normal
+		};
+
+		struct Statistics
+		{
+			size_t submitted;
+			size_t started;
+			size_t cancelled;
+			size_t reprioritized;
+			size_t queued;
+			size_t running;
+		};
+
+		static Options DefaultOptions()
+		{
+			Options options;
+			options.host.concurrency = 6;
+			options.host.ratePerSecond = 0;
+			options.host.burst = 1;
+			options.totalConcurrency = 16;
+			options.reservedSlots = 2;
+			return options;
+		}
+
+		// The default wake-up is a timer of service; the default argument constructs the service before
+		// the scheduler, so that a static scheduler is destroyed before it
+		explicit RequestScheduler(const Options &options = DefaultOptions(), Clock clock = nullptr, Wake wake = nullptr,
+			TimerService &service = TimerService::Default())
+			: _options(options), _clock(std::move(clock)), _wake(std::move(wake)), _service(service), _nextTicket(1), _turns(0),
+			_running(0), _wakeAt(0)
+		{
+			_submitted = 0;
+			_started = 0;
+			_cancelled = 0;
+			_reprioritized = 0;
+			if (!_clock)
+			{
+				_clock = []()
+				{
+					return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+						std::chrono::steady_clock::now().time_since_epoch()).count();
+				};
+			}
+			if (!_wake)
+			{
+				// Same for the pool: the timer callbacks must be short, so the requests start from it
+				ThreadPool::Default();
+				_timer.callback = [this]() { ThreadPool::Default().Submit([this]() { Pump(); }); };
+				_wake = [this](uint64_t delay)
+				{
+					// One more millisecond since the timer ticks count from a truncated time
+					_service.Schedule(_timer, std::chrono::milliseconds((delay + 999) / 1000 + 1));
+				};
+			}
+		}
+
+		~RequestScheduler()
+		{
+			_service.Cancel(_timer);
+		}
+
+		RequestScheduler(const RequestScheduler&) = delete;
+		RequestScheduler &operator=(const RequestScheduler&) = delete;
+
+		// Limits of one host (e.g. "api.example.com" or "example.com:8080"); applies to the next starts
+		void SetHostLimits(const std::string &host, const HostLimits &limits)
+		{
+			{
+				std::lock_guard<std::mutex> guard(_lock);
+				auto &state = GetHost(host);
+				state.limits = limits;
+				state.tokens = std::min(state.tokens, Burst(limits));
+			}
+			Pump();
+		}
+
+		// Queue the request; start is called (maybe right away, from this thread) when it is admitted.
+		// Return a ticket for Cancel() and Reprioritize().
+		size_t Submit(const std::string &host, WorkPriority priority, Start start)
+		{
+			size_t ticket;
+			{
+				std::lock_guard<std::mutex> guard(_lock);
+				ticket = _nextTicket++;
+				Enqueue(GetHost(host), ticket, Lane(priority), std::move(start));
+				_submitted++;
+			}
+			Pump();
+			return ticket;
+		}
+
+		// Drop a request that did not start yet
+		bool Cancel(size_t ticket)
+		{
+			std::lock_guard<std::mutex> guard(_lock);
+			auto found = _tickets.find(ticket);
+			if (found == _tickets.end())
+				return false;
+
+			found->second.host->queues[found->second.lane].erase(found->second.position);
+			_tickets.erase(found);
+			_cancelled++;
+			return true;
+		}
+
+		// Move a request that did not start yet to another lane, behind the requests already there
+		bool Reprioritize(size_t ticket, WorkPriority priority)
+		{
+			return Move(ticket, Lane(priority), false);
+		}
+
+		// Same as Reprioritize() but only toward more urgent lanes, e.g. when an element becomes visible
+		bool Raise(size_t ticket, WorkPriority priority)
+		{
+			return Move(ticket, Lane(priority), true);
+		}
+
+		// Start every request that can start; called after every change and by the wake-up timer
+		void Pump()
+		{
+			std::vector<std::pair<Start, Host*>> starts;
+			uint64_t wake = 0;
+			uint64_t now = _clock();
+			{
+				std::lock_guard<std::mutex> guard(_lock);
+				if (_wakeAt != 0 && _wakeAt <= now)
+					_wakeAt = 0;
+
+				uint64_t next = Never;
+				for (int lane = 0; lane < PriorityCount; lane++)
+				{
+					auto &ready = _ready[lane];
+					for (;;)
+					{
+						// Of the hosts that can start a request, the one that started one least recently
+						Host *best = nullptr;
+						for (size_t i = 0; i < ready.size();)
+						{
+							Host *host = ready[i];
+							if (host->queues[lane].empty())
+							{
+								host->ready[lane] = false;
+								ready[i] = ready.back();
+								ready.pop_back();
+								continue;
+							}
+
+							uint64_t wait = Admit(*host, lane, now);
+							if (wait != 0)
+								next = std::min(next, wait);
+							else if (best == nullptr || host->turn < best->turn)
+								best = host;
+							i++;
+						}
+						if (best == nullptr)
+							break;
+
+						auto &queue = best->queues[lane];
+						_tickets.erase(queue.front().ticket);
+						starts.emplace_back(std::move(queue.front().start), best);
+						queue.pop_front();
+						if (best->limits.ratePerSecond > 0)
+							best->tokens -= 1;
+						best->turn = ++_turns;
+						best->running++;
+						_running++;
+						_started++;
+					}
+				}
+
+				if (next != Never && (_wakeAt == 0 || next < _wakeAt))
+				{
+					_wakeAt = next;
+					wake = next - now;
+				}
+			}
+
+			if (wake != 0)
+				_wake(wake);
+
+			for (auto &start : starts)
+			{
+				auto host = start.second;
+				auto once = std::make_shared<std::atomic<bool>>(false);
+				Done done = [this, host, once]()
+				{
+					if (!once->exchange(true))
+						Finish(*host);
+				};
+				try
+				{
+					start.first(done);
+				}
+				catch (...)
+				{
+					done();
+				}
+			}
+		}
+
+		Statistics GetStatistics()
+		{
+			std::lock_guard<std::mutex> guard(_lock);
+			Statistics s;
+			s.submitted = _submitted;
+			s.started = _started;
+			s.cancelled = _cancelled;
+			s.reprioritized = _reprioritized;
+			s.queued = _tickets.size();
+			s.running = _running;
+			return s;
+		}
+
+	private:
+		static const uint64_t Never = UINT64_MAX; // blocked by the concurrency limits, not by time
+
+		struct Pending
+		{
+			size_t ticket;
+			Start start;
+		};
+
+		struct Host
+		{
+			HostLimits limits;
+			size_t running = 0;
+			double tokens = 0;
+			uint64_t refilled = 0;
+			uint64_t turn = 0; // when it last started a request
+			std::list<Pending> queues[PriorityCount];
+			bool ready[PriorityCount] = {}; // in _ready[lane]
+		};
+
+		struct Ticket
+		{
+			Host *host;
+			int lane;
+			std::list<Pending>::iterator position;
+		};
+
+		static int Lane(WorkPriority priority)
+		{
+			int lane = (int)priority;
+			return lane < 0 ? 0 : lane >= PriorityCount ? PriorityCount - 1 : lane;
+		}
+
+		static double Burst(const HostLimits &limits)
+		{
+			return limits.burst < 1 ? 1 : limits.burst;
+		}
+
+		Host &GetHost(const std::string &name)
+		{
+			auto &host = _hosts[name];
+			if (host == nullptr)
+			{
+				host.reset(new Host());
+				host->limits = _options.host;
+				host->tokens = Burst(host->limits);
+				host->refilled = _clock();
+			}
+			return *host;
+		}
+
+		void Enqueue(Host &host, size_t ticket, int lane, Start start)
+		{
+			Pending pending;
+			pending.ticket = ticket;
+			pending.start = std::move(start);
+			auto &queue = host.queues[lane];
+			queue.push_back(std::move(pending));
+
+			Ticket entry;
+			entry.host = &host;
+			entry.lane = lane;
+			entry.position = std::prev(queue.end());
+			_tickets[ticket] = entry;
+
+			if (!host.ready[lane])
+			{
+				host.ready[lane] = true;
+				_ready[lane].push_back(&host);
+			}
+		}
+
+		bool Move(size_t ticket, int lane, bool raiseOnly)
+		{
+			{
+				std::lock_guard<std::mutex> guard(_lock);
+				auto found = _tickets.find(ticket);
+				if (found == _tickets.end())
+					return false;
+
+				auto entry = found->second;
+				if (entry.lane == lane || (raiseOnly && entry.lane < lane))
+					return true;
+
+				auto start = std::move(entry.position->start);
+				entry.host->queues[entry.lane].erase(entry.position);
+				Enqueue(*entry.host, ticket, lane, std::move(start));
+				_reprioritized++;
+			}
+			Pump();
+			return true;
+		}
+
+		// 0 if a request of the lane can start on the host now, Never if the
+		// concurrency limits block it, otherwise the time a token will be available
+		uint64_t Admit(Host &host, int lane, uint64_t now)
+		{
+			size_t hostLimit = std::max<size_t>(host.limits.concurrency, 1);
+			size_t totalLimit = std::max<size_t>(_options.totalConcurrency, 1);
+			if (lane >= (int)WorkPriority::Prefetch)
+			{
+				hostLimit = (hostLimit > _options.reservedSlots ? hostLimit - _options.reservedSlots : 1);
+				totalLimit = (totalLimit > _options.reservedSlots ? totalLimit - _options.reservedSlots : 1);
+			}
+			if (host.running >= hostLimit || _running >= totalLimit)
+				return Never;
+
+			double rate = host.limits.ratePerSecond;
+			if (rate > 0)
+			{
+				if (now > host.refilled)
+				{
+					host.tokens = std::min(Burst(host.limits), host.tokens + (now - host.refilled) * rate / 1e6);
+					host.refilled = now;
+				}
+				if (host.tokens < 1)
+					return now + 1 + (uint64_t)((1 - host.tokens) * 1e6 / rate);
+			}
+			return 0;
+		}
+
+		void Finish(Host &host)
+		{
+			{
+				std::lock_guard<std::mutex> guard(_lock);
+				host.running--;
+				_running--;
+			}
+			Pump();
+		}
+
+		Options _options;
+		Clock _clock;
+		Wake _wake;
+		TimerService &_service;
+		TimerWheel::Timer _timer;
+
+		std::mutex _lock;
+		std::unordered_map<std::string, std::unique_ptr<Host>> _hosts;
+		std::vector<Host*> _ready[PriorityCount]; // hosts with requests queued in the lane
+		std::unordered_map<size_t, Ticket> _tickets; // queued requests
+		size_t _nextTicket;
+		uint64_t _turns;
+		size_t _running;
+		uint64_t _wakeAt; // 0 if no wake-up is scheduled
+
+		size_t _submitted;
+		size_t _started;
+		size_t _cancelled;
+		size_t _reprioritized;
+	};
+} // namespace LUwpUtilities
+
+#endif // #ifndef _LUWPUTILITIES_REQUEST_SCHEDULER_
@@ -0,0 +1,425 @@
+/**
+ * Application-level HTTP response cache (portable C++, no C++/CX); Http::GetCachedAsync uses it.
+ *
+ *  - Two tiers: an in-memory LRU bounded in bytes, then one file per URL in a directory
+ *    (the app's local folder); entries found on disk are promoted to memory
+ *  - Freshness comes from Cache-Control (max-age, no-cache, no-store, stale-while-revalidate);
+ *    an entry without max-age is stale right away and revalidated on every use
+ *  - The validators (ETag, Last-Modified) are kept so that a stale entry is revalidated with a
+ *    conditional request, and a 304 Not Modified refreshes it without downloading the body again
+ *  - Counters: hits (served without download), revalidations (304), misses (full download)
+ *    and bytes saved (body bytes served from the cache)
+ */
+
+#ifndef _LUWPUTILITIES_RESPONSE_CACHE_
+#define _LUWPUTILITIES_RESPONSE_CACHE_
+
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "UnicodeHelper.h"
+
+namespace LUwpUtilities
+{
+	struct CacheControl
+	{
+		bool noStore;
+		bool noCache;
+		int64_t maxAge;               // seconds, -1 if absent
+		int64_t staleWhileRevalidate; // seconds
+
+		CacheControl() : noStore(false), noCache(false), maxAge(-1), staleWhileRevalidate(0)
+		{
+		}
+
+		// Parse the value of a Cache-Control header, e.g. "public, max-age=60, stale-while-revalidate=30"
+		static CacheControl Parse(const std::string &value)
+		{
+			CacheControl result;
+			size_t start = 0;
+			while (start < value.size())
+			{
+				auto end = value.find(',', start);
+				if (end == std::string::npos)
+					end = value.size();
+
+				auto first = value.find_first_not_of(" \t", start);
+				if (first < end)
+				{
+					auto directive = value.substr(first, end - first);
+					for (auto &c : directive)
+						c = (char)tolower((unsigned char)c);
+					if (directive.compare(0, 8, "no-store") == 0)
+						result.noStore = true;
+					else if (directive.compare(0, 8, "no-cache") == 0)
+						result.noCache = true;
+					else if (directive.compare(0, 8, "max-age=") == 0)
+						result.maxAge = atoll(directive.c_str() + 8);
+					else if (directive.compare(0, 23, "stale-while-revalidate=") == 0)
+						result.staleWhileRevalidate = atoll(directive.c_str() + 23);
+				}
+				start = end + 1;
+			}
+			return result;
+		}
+	};
+
+	struct CachedResponse
+	{
+		std::string url;
+		std::string etag;
+		std::string lastModified;
+		std::string contentType;
+		int64_t freshUntil; // seconds since the epoch
+		int64_t staleUntil; // end of the stale-while-revalidate window
+		std::shared_ptr<const std::vector<unsigned char>> body;
+
+		bool HasValidators() const
+		{
+			return !etag.empty() || !lastModified.empty();
+		}
+
+		size_t Size() const
+		{
+			return url.size() + etag.size() + lastModified.size() + contentType.size() + (body ? body->size() : 0);
+		}
+	};
+
+	enum class CacheFreshness
+	{
+		Fresh,   // serve it
+		Stale,   // serve it and revalidate in background
+		Expired  // revalidate before serving
+	};
+
+	class ResponseCache
+	{
+	public:
+		typedef std::shared_ptr<const CachedResponse> Entry;
+
+		struct Statistics
+		{
+			size_t hits;
+			size_t revalidations;
+			size_t misses;
+			uint64_t bytesSaved;
+		};
+
+		// directory (UTF-8) may be empty for a memory-only cache
+		ResponseCache(size_t memoryBytes, const std::string &directory)
+			: _capacity(memoryBytes), _directory(directory), _size(0)
+		{
+			_hits = 0;
+			_revalidations = 0;
+			_misses = 0;
+			_bytesSaved = 0;
+		}
+
+		ResponseCache(const ResponseCache&) = delete;
+		ResponseCache &operator=(const ResponseCache&) = delete;
+
+		static int64_t Now()
+		{
+			return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+		}
+
+		// Entry of the URL from memory or disk, or null
+		Entry Find(const std::string &url)
+		{
+			{
+				std::lock_guard<std::mutex> guard(_lock);
+				auto found = _entries.find(url);
+				if (found != _entries.end())
+				{
+					_lru.splice(_lru.begin(), _lru, found->second.position);
+					return found->second.entry;
+				}
+			}
+
+			auto entry = Load(url);
+			if (entry != nullptr)
+				Remember(entry);
+			return entry;
+		}
+
+		// staleWhileRevalidate serves any stale entry right away, not only within its window
+		static CacheFreshness Check(const CachedResponse &entry, int64_t now, bool staleWhileRevalidate)
+		{
+			if (now < entry.freshUntil)
+				return CacheFreshness::Fresh;
+			if (staleWhileRevalidate || now < entry.staleUntil)
+				return CacheFreshness::Stale;
+			return CacheFreshness::Expired;
+		}
+
+		// Store a downloaded response unless Cache-Control forbids it; return the entry (even if not stored)
+		Entry Store(const std::string &url, const CacheControl &control, const std::string &etag, const std::string &lastModified,
+			const std::string &contentType, std::shared_ptr<const std::vector<unsigned char>> body)
+		{
+			auto response = std::make_shared<CachedResponse>();
+			response->url = url;
+			response->etag = etag;
+			response->lastModified = lastModified;
+			response->contentType = contentType;
+			response->body = body;
+			SetFreshness(*response, control);
+			_misses.fetch_add(1, std::memory_order_relaxed);
+
+			Entry entry = response;
+			if (control.noStore || (control.maxAge <= 0 && !response->HasValidators()))
+			{
+				Remove(url);
+				return entry;
+			}
+
+			Remember(entry);
+			Save(*entry);
+			return entry;
+		}
+
+		// The server answered 304 Not Modified: extend the entry's freshness and return the refreshed entry
+		Entry Revalidated(const Entry &entry, const CacheControl &control)
+		{
+			auto response = std::make_shared<CachedResponse>(*entry);
+			SetFreshness(*response, control);
+			_revalidations.fetch_add(1, std::memory_order_relaxed);
+			_bytesSaved.fetch_add(entry->body ? entry->body->size() : 0, std::memory_order_relaxed);
+
+			Entry refreshed = response;
+			Remember(refreshed);
+			Save(*refreshed);
+			return refreshed;
+		}
+
+		// Count an entry served without any request
+		void RecordHit(const Entry &entry)
+		{
+			_hits.fetch_add(1, std::memory_order_relaxed);
+			_bytesSaved.fetch_add(entry->body ? entry->body->size() : 0, std::memory_order_relaxed);
+		}
+
+		void Remove(const std::string &url)
+		{
+			{
+				std::lock_guard<std::mutex> guard(_lock);
+				auto found = _entries.find(url);
+				if (found != _entries.end())
+				{
+					_size -= found->second.entry->Size();
+					_lru.erase(found->second.position);
+					_entries.erase(found);
+				}
+			}
+			if (!_directory.empty())
+			{
+				std::lock_guard<std::mutex> guard(_diskLock);
+				RemoveFile(PathOf(url));
+			}
+		}
+
+		Statistics GetStatistics() const
+		{
+			Statistics s;
+			s.hits = _hits.load(std::memory_order_relaxed);
+			s.revalidations = _revalidations.load(std::memory_order_relaxed);
+			s.misses = _misses.load(std::memory_order_relaxed);
+			s.bytesSaved = _bytesSaved.load(std::memory_order_relaxed);
+			return s;
+		}
+
+	private:
+		struct MemoryEntry
+		{
+			Entry entry;
+			std::list<std::string>::iterator position;
+		};
+
+		static void SetFreshness(CachedResponse &response, const CacheControl &control)
+		{
+			auto now = Now();
+			response.freshUntil = (control.noCache || control.maxAge < 0 ? now : now + control.maxAge);
+			response.staleUntil = response.freshUntil + control.staleWhileRevalidate;
+		}
+
+		// Put the entry in the memory tier and evict the least recently used ones over the capacity
+		void Remember(const Entry &entry)
+		{
+			std::lock_guard<std::mutex> guard(_lock);
+			auto found = _entries.find(entry->url);
+			if (found != _entries.end())
+			{
+				_size -= found->second.entry->Size();
+				found->second.entry = entry;
+				_lru.splice(_lru.begin(), _lru, found->second.position);
+			}
+			else
+			{
+				_lru.push_front(entry->url);
+				MemoryEntry memory = { entry, _lru.begin() };
+				_entries[entry->url] = memory;
+			}
+			_size += entry->Size();
+
+			while (_size > _capacity && _lru.size() > 1)
+			{
+				auto victim = _entries.find(_lru.back());
+				_size -= victim->second.entry->Size();
+				_entries.erase(victim);
+				_lru.pop_back();
+			}
+		}
+
+#ifdef _WIN32
+		// Wide paths so that directories with non-ASCII names (e.g. the user's) work
+		typedef std::wstring Path;
+
+		static Path ToPath(const std::string &utf8)
+		{
+			std::wstring path(Utf8ToUtf16Length(utf8.data(), utf8.size()), L'\0');
+			if (!path.empty())
+				Utf8ToUtf16(utf8.data(), utf8.size(), reinterpret_cast<char16_t*>(&path[0]));
+			return path;
+		}
+
+		static void RemoveFile(const Path &path)
+		{
+			_wremove(path.c_str());
+		}
+
+		static void RenameFile(const Path &from, const Path &to)
+		{
+			_wrename(from.c_str(), to.c_str());
+		}
+#else
+		typedef std::string Path;
+
+		static Path ToPath(const std::string &utf8)
+		{
+			return utf8;
+		}
+
+		static void RemoveFile(const Path &path)
+		{
+			std::remove(path.c_str());
+		}
+
+		static void RenameFile(const Path &from, const Path &to)
+		{
+			std::rename(from.c_str(), to.c_str());
+		}
+#endif
+
+		// File of the URL: FNV-1a hash of the URL in hexadecimal
+		Path PathOf(const std::string &url) const
+		{
+			uint64_t hash = 14695981039346656037ULL;
+			for (unsigned char c : url)
+			{
+				hash ^= c;
+				hash *= 1099511628211ULL;
+			}
+			char name[32];
+			snprintf(name, sizeof(name), "%016llx.http", (unsigned long long)hash);
+#ifdef _WIN32
+			return ToPath(_directory + "\\" + name);
+#else
+			return ToPath(_directory + "/" + name);
+#endif
+		}
+
+		// File format: a line per field (url, etag, last-modified, content type, fresh until,
+		// stale until, body size) then the body
+		void Save(const CachedResponse &response)
+		{
+			if (_directory.empty())
+				return;
+
+			std::lock_guard<std::mutex> guard(_diskLock);
+			auto path = PathOf(response.url);
+			auto temporary = path + ToPath(".tmp");
+			{
+				std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+				if (!file)
+					return;
+				file << response.url << '\n' << response.etag << '\n' << response.lastModified << '\n' << response.contentType << '\n'
+					<< response.freshUntil << '\n' << response.staleUntil << '\n' << (response.body ? response.body->size() : 0) << '\n';
+				if (response.body && !response.body->empty())
+					file.write(reinterpret_cast<const char*>(response.body->data()), response.body->size());
+				if (!file)
+				{
+					file.close();
+					RemoveFile(temporary);
+					return;
+				}
+			}
+			RemoveFile(path);
+			RenameFile(temporary, path);
+		}
+
+		Entry Load(const std::string &url)
+		{
+			if (_directory.empty())
+				return nullptr;
+
+			std::lock_guard<std::mutex> guard(_diskLock);
+			std::ifstream file(PathOf(url), std::ios::binary);
+			if (!file)
+				return nullptr;
+
+			auto response = std::make_shared<CachedResponse>();
+			std::string freshUntil, staleUntil, size;
+			if (!std::getline(file, response->url) || response->url != url ||
+				!std::getline(file, response->etag) || !std::getline(file, response->lastModified) ||
+				!std::getline(file, response->contentType) || !std::getline(file, freshUntil) ||
+				!std::getline(file, staleUntil) || !std::getline(file, size))
+				return nullptr;
+
+			// The size must be the rest of the file: a truncated or corrupt file is a miss,
+			// not a huge allocation
+			std::streamoff start = file.tellg();
+			file.seekg(0, std::ios::end);
+			std::streamoff end = file.tellg();
+			file.seekg(start);
+			char *last = nullptr;
+			auto length = strtoull(size.c_str(), &last, 10);
+			if (size.empty() || *last != '\0' || start < 0 || end < start || length != (unsigned long long)(end - start))
+				return nullptr;
+
+			response->freshUntil = atoll(freshUntil.c_str());
+			response->staleUntil = atoll(staleUntil.c_str());
+			auto body = std::make_shared<std::vector<unsigned char>>((size_t)length);
+			if (!body->empty() && !file.read(reinterpret_cast<char*>(body->data()), body->size()))
+				return nullptr;
+			response->body = body;
+			return response;
+		}
+
+		size_t _capacity;
+		std::string _directory;
+
+		std::mutex _lock;
+		std::unordered_map<std::string, MemoryEntry> _entries;
+		std::list<std::string> _lru; // most recently used first
+		size_t _size;
+
+		std::mutex _diskLock;
+
+		std::atomic<size_t> _hits;
+		std::atomic<size_t> _revalidations;
+		std::atomic<size_t> _misses;
+		std::atomic<uint64_t> _bytesSaved;
+	};
+} // namespace LUwpUtilities
+
+#endif // #ifndef _LUWPUTILITIES_RESPONSE_CACHE_
@@ -0,0 +1,931 @@
+/**
+ * Resumable, segmented download of a URL to a file (portable C++, no C++/CX); it is the engine
+ * behind Http::DownloadAsync.
+ *
+ *  - The body goes from the network to the file chunk by chunk (see ChunkStream.h), so memory
+ *    stays at one chunk per connection whatever the size of the file
+ *  - When the server honors Range, the file is split into segments fetched over a few parallel
+ *    connections; a segment that fails resumes from its last byte, with If-Range so that a
+ *    resource that changed restarts the download instead of mixing two versions
+ *  - The progress is saved to a small state file, so that a download interrupted by a failure, a
+ *    cancellation or the end of the app resumes where it was when it is started again
+ *  - Once complete, the file is checked against the expected SHA-256, if any
+ * The HTTP requests (Fetch) and the file (DownloadFile) are abstracted, e.g. for tests.
+ */
+
+#ifndef _LUWPUTILITIES_SEGMENTED_DOWNLOAD_
+#define _LUWPUTILITIES_SEGMENTED_DOWNLOAD_
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ChunkStream.h"
+#include "RequestPolicy.h"
+#include "Sha256.h"
+#include "ThreadPool.h"
+#include "UnicodeHelper.h"
+
+namespace LUwpUtilities
+{
+	// Failure of a download; the permanent ones (status 4xx, checksum mismatch, disk full...) are not retried
+	class DownloadError : public std::runtime_error
+	{
+	public:
+		DownloadError(const std::string &message, bool permanent) : std::runtime_error(message), _permanent(permanent)
+		{
+		}
+
+		bool IsPermanent() const
+		{
+			return _permanent;
+		}
+
+	private:
+		bool _permanent;
+	};
+
+	// The download was cancelled; its progress is kept for the next start
+	class DownloadCancelled : public std::runtime_error
+	{
+	public:
+		DownloadCancelled() : std::runtime_error("The download was cancelled")
+		{
+		}
+	};
+
+	struct RangeRequest
+	{
+		uint64_t start;
+		uint64_t end;        // exclusive; 0 for the rest of the resource (no Range header when start is 0 too)
+		std::string ifRange; // validator for If-Range, if not empty
+	};
+
+	struct RangeResponse
+	{
+		int status;
+		int64_t contentLength; // -1 if unknown
+		std::string contentRange;
+		std::string etag;
+		std::string lastModified;
+	};
+
+	// Parse a Content-Range value "bytes first-last/total" (total -1 for "*"); false if malformed
+	inline bool ParseContentRange(const std::string &value, uint64_t &first, uint64_t &last, int64_t &total)
+	{
+		if (value.compare(0, 6, "bytes ") != 0)
+			return false;
+
+		const char *p = value.c_str() + 6;
+		char *end;
+		first = strtoull(p, &end, 10);
+		if (end == p || *end != '-')
+			return false;
+		p = end + 1;
+		last = strtoull(p, &end, 10);
+		if (end == p || *end != '/' || last < first)
+			return false;
+		p = end + 1;
+		if (p[0] == '*' && p[1] == '\0')
+		{
+			total = -1;
+			return true;
+		}
+		total = (int64_t)strtoull(p, &end, 10);
+		return end != p && *end == '\0' && (uint64_t)total > last;
+	}
+
+	// Target of a download; Write() may be called from several threads at once, at distinct offsets.
+	// The methods throw to fail the download (a DownloadError to tell whether it is worth a retry).
+	class DownloadFile
+	{
+	public:
+		virtual ~DownloadFile()
+		{
+		}
+
+		virtual uint64_t Size() = 0;
+		virtual void Resize(uint64_t size) = 0;
+		virtual void Write(uint64_t offset, const unsigned char *data, size_t size) = 0;
+		// Up to size bytes at offset (for the checksum); 0 at the end of the file
+		virtual size_t Read(uint64_t offset, unsigned char *data, size_t size) = 0;
+
+		virtual void Flush()
+		{
+		}
+	};
+
+	// What was downloaded so far, as saved in the state file
+	struct DownloadState
+	{
+		struct Segment
+		{
+			uint64_t start;
+			uint64_t end;  // exclusive; UINT64_MAX until the end of a body of unknown size
+			uint64_t done; // bytes written from start
+		};
+
+		std::string url;
+		int64_t size;          // -1 if unknown
+		std::string validator; // strong ETag or Last-Modified, sent in If-Range
+		bool ranges;           // the server honors Range
+		std::vector<Segment> segments;
+
+		DownloadState() : size(-1), ranges(false)
+		{
+		}
+
+		uint64_t Done() const
+		{
+			uint64_t done = 0;
+			for (auto &segment : segments)
+				done += segment.done;
+			return done;
+		}
+
+		bool IsComplete() const
+		{
+			for (auto &segment : segments)
+			{
+				if (segment.start + segment.done != segment.end)
+					return false;
+			}
+			return !segments.empty();
+		}
+
+		// One line per field, then one line "start end done" per segment
+		std::string Serialize() const
+		{
+			std::ostringstream text;
+			text << url << '\n' << size << '\n' << validator << '\n' << (ranges ? 1 : 0) << '\n' << segments.size() << '\n';
+			for (auto &segment : segments)
+				text << segment.start << ' ' << segment.end << ' ' << segment.done << '\n';
+			return text.str();
+		}
+
+		bool Parse(const std::string &serialized)
+		{
+			std::istringstream text(serialized);
+			std::string line;
+			size_t count = 0;
+			int ranged = 0;
+			if (!std::getline(text, url) || !(text >> size) || !text.ignore(1) || !std::getline(text, validator) || !(text >> ranged >> count))
+				return false;
+			ranges = (ranged != 0);
+			segments.resize(count);
+			for (auto &segment : segments)
+			{
+				if (!(text >> segment.start >> segment.end >> segment.done) || segment.end < segment.start || segment.done > segment.end - segment.start)
+					return false;
+			}
+			return true;
+		}
+	};
+
+	class SegmentedDownload : public std::enable_shared_from_this<SegmentedDownload>
+	{
+	public:
+		typedef std::function<void()> Abort;
+		// Look at the response headers; throws to reject the response
+		typedef std::function<void(const RangeResponse &response)> Headers;
+		// Send the GET, call headers once they are in, then stream the body to the consumer (see
+		// Http::GetStreamingAsync); return how to abort it. Both may be called before Fetch returns.
+		typedef std::function<Abort(const RangeRequest &request, Headers headers, std::shared_ptr<ChunkConsumer> consumer)> Fetch;
+		// Bytes written so far and size of the file (-1 if unknown), from any thread
+		typedef std::function<void(uint64_t done, int64_t size)> Progress;
+		// Null once the file is complete (and verified), or the error
+		typedef std::function<void(std::exception_ptr error)> Done;
+
+		struct Options
+		{
+			uint64_t segmentSize;  // bytes per Range request
+			size_t connections;    // segments downloaded at once
+			int maxRetries;        // failures in a row of a segment without any progress
+			uint64_t baseBackoff;  // microseconds, doubled on each retry...
+			uint64_t maxBackoff;   // ...up to this
+			uint64_t saveInterval; // bytes written between two saves of the state
+			std::string statePath; // UTF-8; empty to not resume beyond this object
+			std::string sha256;    // expected digest in hexadecimal, or empty
+		};
+
+		static Options DefaultOptions()
+		{
+			Options options;
+			options.segmentSize = 4 << 20;
+			options.connections = 4;
+			options.maxRetries = 5;
+			options.baseBackoff = 500000;
+			options.maxBackoff = 30000000;
+			options.saveInterval = 1 << 20;
+			return options;
+		}
+
+		// Start (or resume, if the state file is of the same URL) downloading url to the file
+		static std::shared_ptr<SegmentedDownload> Start(
+			const std::string &url,
+			Fetch fetch,
+			std::shared_ptr<DownloadFile> file,
+			const Options &options,
+			Progress progress,
+			Done done,
+			RequestPolicy::Delay delay = nullptr
+		)
+		{
+			std::shared_ptr<SegmentedDownload> download(new SegmentedDownload(url, std::move(fetch), std::move(file), options,
+				std::move(progress), std::move(done), std::move(delay)));
+			download->Begin();
+			return download;
+		}
+
+		SegmentedDownload(const SegmentedDownload&) = delete;
+		SegmentedDownload &operator=(const SegmentedDownload&) = delete;
+
+		// Stop the transfers and save the progress; done gets a DownloadCancelled error
+		void Cancel()
+		{
+			Finish(std::make_exception_ptr(DownloadCancelled()));
+		}
+
+		uint64_t BytesDone()
+		{
+			std::lock_guard<std::mutex> guard(_lock);
+			return _state.Done();
+		}
+
+		int64_t Size()
+		{
+			std::lock_guard<std::mutex> guard(_lock);
+			return _state.size;
+		}
+
+	private:
+		// The response does not match the download (the resource changed): start over
+		class ResourceChanged : public std::runtime_error
+		{
+		public:
+			ResourceChanged() : std::runtime_error("The resource changed during the download")
+			{
+			}
+		};
+
+		// Restarts allowed before giving up on a resource that keeps changing
+		static const int MaxRestarts = 2;
+
+		// Body of one fetch of a segment
+		class SegmentConsumer : public ChunkConsumer
+		{
+		public:
+			SegmentConsumer(std::shared_ptr<SegmentedDownload> download, size_t segment, size_t fetch)
+				: _download(std::move(download)), _segment(segment), _fetch(fetch)
+			{
+			}
+
+			bool OnChunk(BufferView chunk) override
+			{
+				return _download->Write(_segment, _fetch, chunk);
+			}
+
+			void OnEnd() override
+			{
+				_download->Ended(_segment, _fetch, nullptr);
+			}
+
+			void OnError(std::exception_ptr error) override
+			{
+				_download->Ended(_segment, _fetch, error);
+			}
+
+		private:
+			std::shared_ptr<SegmentedDownload> _download;
+			size_t _segment;
+			size_t _fetch;
+		};
+
+		SegmentedDownload(const std::string &url, Fetch fetch, std::shared_ptr<DownloadFile> file, const Options &options,
+			Progress progress, Done done, RequestPolicy::Delay delay)
+			: _url(url), _fetch(std::move(fetch)), _file(std::move(file)), _options(options), _progress(std::move(progress)),
+			_done(std::move(done)), _delay(std::move(delay)), _finished(false), _verifying(false), _restarts(0), _generation(0),
+			_nextFetch(1), _unsaved(0),
+			_random(std::random_device()())
+		{
+			if (!_delay)
+				_delay = &RequestPolicy::TimerDelay;
+			if (_options.connections == 0)
+				_options.connections = 1;
+			if (_options.segmentSize == 0)
+				_options.segmentSize = DefaultOptions().segmentSize;
+		}
+
+		void Begin()
+		{
+			DownloadState saved;
+			if (LoadState(saved) && saved.url == _url && saved.ranges && saved.size >= 0 && !saved.validator.empty() && !saved.segments.empty()
+				&& FileSize() == (uint64_t)saved.size)
+			{
+				{
+					std::lock_guard<std::mutex> guard(_lock);
+					_state = saved;
+					_active.assign(_state.segments.size(), false);
+					_retries.assign(_state.segments.size(), 0);
+				}
+				if (_progress)
+					_progress(saved.Done(), saved.size);
+				Launch();
+				return;
+			}
+			Probe();
+		}
+
+		// Size of the file, or UINT64_MAX if it cannot be read (it is not resumed then)
+		uint64_t FileSize()
+		{
+			try
+			{
+				return _file->Size();
+			}
+			catch (...)
+			{
+				return UINT64_MAX;
+			}
+		}
+
+		// First request: a Range of one segment, which tells the size and whether ranges work
+		void Probe()
+		{
+			try
+			{
+				_file->Resize(0);
+			}
+			catch (...)
+			{
+				Finish(std::current_exception());
+				return;
+			}
+
+			size_t generation;
+			{
+				std::lock_guard<std::mutex> guard(_lock);
+				_state = DownloadState();
+				_state.url = _url;
+				DownloadState::Segment first = { 0, _options.segmentSize, 0 };
+				_state.segments.assign(1, first);
+				_active.assign(1, true);
+				_retries.assign(1, 0);
+				generation = ++_generation;
+			}
+			Send(0, true, generation);
+		}
+
+		// Fetch the rest of the segment, which is marked active; nothing if the download restarted since
+		void Send(size_t segment, bool probe, size_t generation)
+		{
+			RangeRequest request;
+			size_t id;
+			bool restart = false;
+			{
+				std::lock_guard<std::mutex> guard(_lock);
+				if (_finished || generation != _generation)
+					return;
+				auto &current = _state.segments[segment];
+				// Without ranges, a body can only be fetched again from the start
+				if (!probe && !_state.ranges && current.done > 0)
+				{
+					current.done = 0;
+					restart = true;
+				}
+				request.start = current.start + current.done;
+				request.end = (probe || _state.ranges ? current.end : 0);
+				if (_state.ranges)
+					request.ifRange = _state.validator;
+				id = _nextFetch++;
+				_fetches[id] = nullptr;
+			}
+			if (restart)
+			{
+				try
+				{
+					_file->Resize(0);
+				}
+				catch (...)
+				{
+					Finish(std::current_exception());
+					return;
+				}
+			}
+
+			auto self = shared_from_this();
+			auto consumer = std::make_shared<SegmentConsumer>(self, segment, id);
+			auto abort = _fetch(request, [self, segment, request, probe](const RangeResponse &response)
+			{
+				self->CheckHeaders(segment, request, response, probe);
+			}, consumer);
+
+			bool late = false;
+			{
+				std::lock_guard<std::mutex> guard(_lock);
+				auto found = _fetches.find(id);
+				if (found != _fetches.end())
+					found->second = abort;
+				else
+					late = _finished;
+			}
+			// Cancelled while the request was being sent
+			if (late && abort)
+				abort();
+		}
+
+		void CheckHeaders(size_t segment, const RangeRequest &request, const RangeResponse &response, bool probe)
+		{
+			if (response.status == 200)
+			{
+				// The server ignored the Range (or If-Range found another version of the resource)
+				bool whole = (probe || (request.start == 0 && request.end == 0));
+				if (!whole)
+					throw ResourceChanged();
+				{
+					std::lock_guard<std::mutex> guard(_lock);
+					_state.ranges = false;
+					_state.size = response.contentLength;
+					_state.segments[0].end = (response.contentLength >= 0 ? (uint64_t)response.contentLength : UINT64_MAX);
+				}
+				return;
+			}
+			if (response.status == 416 && probe && response.contentRange == "bytes */0")
+			{
+				// Empty resource: nothing to fetch
+				std::lock_guard<std::mutex> guard(_lock);
+				_state.size = 0;
+				_state.segments[0].end = 0;
+				return;
+			}
+			if (response.status == 416)
+				throw ResourceChanged();
+			if (response.status != 206)
+			{
+				auto message = "The server answered with status " + std::to_string(response.status);
+				bool transient = (response.status == 408 || response.status == 429 || response.status >= 500);
+				throw DownloadError(message, !transient);
+			}
+
+			uint64_t first, last;
+			int64_t total;
+			if (!ParseContentRange(response.contentRange, first, last, total) || first != request.start || (request.end != 0 && last >= request.end))
+				throw DownloadError("Invalid Content-Range: " + response.contentRange, true);
+			auto validator = StrongValidator(response);
+
+			if (probe)
+			{
+				if (total < 0)
+					throw DownloadError("The server does not tell the size of the resource", true);
+				{
+					std::lock_guard<std::mutex> guard(_lock);
+					_state.size = total;
+					_state.validator = validator;
+					_state.ranges = true;
+					_state.segments.clear();
+					for (uint64_t start = 0; start < (uint64_t)total; start += _options.segmentSize)
+					{
+						DownloadState::Segment next = { start, std::min(start + _options.segmentSize, (uint64_t)total), 0 };
+						_state.segments.push_back(next);
+					}
+					if (_state.segments.empty())
+					{
+						DownloadState::Segment empty = { 0, 0, 0 };
+						_state.segments.push_back(empty);
+					}
+					_active.assign(_state.segments.size(), false);
+					_active[0] = true;
+					_retries.assign(_state.segments.size(), 0);
+				}
+				_file->Resize((uint64_t)total);
+				SaveState();
+				Launch();
+				return;
+			}
+
+			std::lock_guard<std::mutex> guard(_lock);
+			if (total != _state.size || (!validator.empty() && validator != _state.validator))
+				throw ResourceChanged();
+		}
+
+		// Strong ETag, else Last-Modified (weak ETags are not allowed in If-Range)
+		static std::string StrongValidator(const RangeResponse &response)
+		{
+			if (!response.etag.empty() && response.etag.compare(0, 2, "W/") != 0)
+				return response.etag;
+			return response.lastModified;
+		}
+
+		// Write a chunk of a segment; false to stop reading
+		bool Write(size_t segment, size_t fetch, BufferView chunk)
+		{
+			uint64_t offset;
+			size_t size;
+			{
+				std::lock_guard<std::mutex> guard(_lock);
+				if (_finished || _fetches.find(fetch) == _fetches.end())
+					return false;
+				auto &current = _state.segments[segment];
+				offset = current.start + current.done;
+				size = (size_t)std::min((uint64_t)chunk.length, current.end - offset);
+			}
+
+			_file->Write(offset, chunk.data, size);
+
+			uint64_t done;
+			int64_t total;
+			bool complete;
+			bool save;
+			{
+				std::lock_guard<std::mutex> guard(_lock);
+				if (_finished || _fetches.find(fetch) == _fetches.end())
+					return false;
+				auto &current = _state.segments[segment];
+				current.done += size;
+				complete = (current.start + current.done == current.end);
+				_retries[segment] = 0;
+				_unsaved += size;
+				save = (_unsaved >= _options.saveInterval);
+				done = _state.Done();
+				total = _state.size;
+			}
+			if (_progress)
+				_progress(done, total);
+			if (save)
+				SaveState();
+			if (complete)
+			{
+				Completed(segment, fetch);
+				return false;
+			}
+			return true;
+		}
+
+		// A fetch ended without completing its segment, or with an error
+		void Ended(size_t segment, size_t fetch, std::exception_ptr error)
+		{
+			bool complete;
+			{
+				std::lock_guard<std::mutex> guard(_lock);
+				if (_finished || _fetches.find(fetch) == _fetches.end())
+					return;
+				auto &current = _state.segments[segment];
+				if (!error && current.end == UINT64_MAX)
+				{
+					// The end of a body of unknown size
+					current.end = current.start + current.done;
+					_state.size = (int64_t)current.end;
+				}
+				complete = (current.start + current.done == current.end);
+			}
+			if (!error && complete)
+			{
+				Completed(segment, fetch);
+				return;
+			}
+			if (!error)
+				error = std::make_exception_ptr(DownloadError("The connection closed before the end of the segment", false));
+			Failed(segment, fetch, error);
+		}
+
+		void Failed(size_t segment, size_t fetch, std::exception_ptr error)
+		{
+			bool transient = true;
+			try
+			{
+				std::rethrow_exception(error);
+			}
+			catch (const ResourceChanged&)
+			{
+				Restart(fetch);
+				return;
+			}
+			catch (const DownloadError &e)
+			{
+				transient = !e.IsPermanent();
+			}
+			catch (...)
+			{
+			}
+			if (!transient)
+			{
+				Finish(error);
+				return;
+			}
+
+			int retries;
+			size_t generation;
+			{
+				std::lock_guard<std::mutex> guard(_lock);
+				if (_finished || _fetches.erase(fetch) == 0)
+					return;
+				retries = ++_retries[segment];
+				generation = _generation;
+			}
+			if (retries > _options.maxRetries)
+			{
+				Finish(error);
+				return;
+			}
+
+			// The segment stays active while it waits
+			auto self = shared_from_this();
+			_delay(Backoff(retries - 1), [self, segment, generation]() { self->Send(segment, false, generation); });
+		}
+
+		void Restart(size_t fetch)
+		{
+			std::vector<Abort> aborts;
+			bool give_up;
+			{
+				std::lock_guard<std::mutex> guard(_lock);
+				if (_finished || _fetches.find(fetch) == _fetches.end())
+					return;
+				give_up = (_restarts >= MaxRestarts);
+				if (!give_up)
+				{
+					_restarts++;
+					for (auto &running : _fetches)
+					{
+						if (running.first != fetch && running.second)
+							aborts.push_back(std::move(running.second));
+					}
+					// Forgetting the fetches makes their late callbacks no-ops
+					_fetches.clear();
+				}
+			}
+			if (give_up)
+			{
+				Finish(std::make_exception_ptr(DownloadError("The resource keeps changing during the download", true)));
+				return;
+			}
+			for (auto &abort : aborts)
+				abort();
+			Probe();
+		}
+
+		void Completed(size_t segment, size_t fetch)
+		{
+			bool complete;
+			{
+				std::lock_guard<std::mutex> guard(_lock);
+				if (_finished || _fetches.erase(fetch) == 0)
+					return;
+				_active[segment] = false;
+				complete = _state.IsComplete();
+			}
+			if (complete)
+				Verify();
+			else
+				Launch();
+		}
+
+		// Start segments up to the number of connections
+		void Launch()
+		{
+			std::vector<size_t> next;
+			bool complete;
+			size_t generation;
+			{
+				std::lock_guard<std::mutex> guard(_lock);
+				if (_finished)
+					return;
+				complete = _state.IsComplete();
+				generation = _generation;
+				size_t active = (size_t)std::count(_active.begin(), _active.end(), true);
+				for (size_t i = 0; i < _state.segments.size() && active < _options.connections; i++)
+				{
+					auto &segment = _state.segments[i];
+					if (!_active[i] && segment.start + segment.done != segment.end)
+					{
+						_active[i] = true;
+						active++;
+						next.push_back(i);
+					}
+				}
+			}
+			// E.g. resumed after everything was written but before the end of the verification
+			if (complete)
+			{
+				Verify();
+				return;
+			}
+			for (auto segment : next)
+				Send(segment, false, generation);
+		}
+
+		// Check the whole file on the thread pool (not on a network thread) then finish
+		void Verify()
+		{
+			{
+				std::lock_guard<std::mutex> guard(_lock);
+				if (_verifying)
+					return;
+				_verifying = true;
+			}
+			SaveState();
+			auto self = shared_from_this();
+			ThreadPool::Default().Submit([self]()
+			{
+				try
+				{
+					self->_file->Flush();
+					if (!self->_options.sha256.empty())
+					{
+						Sha256 hash;
+						std::vector<unsigned char> buffer(1 << 20);
+						uint64_t offset = 0;
+						for (size_t read; (read = self->_file->Read(offset, buffer.data(), buffer.size())) > 0; offset += read)
+							hash.Update(buffer.data(), read);
+
+						auto expected = self->_options.sha256;
+						std::transform(expected.begin(), expected.end(), expected.begin(), [](char c) { return (char)tolower((unsigned char)c); });
+						if (hash.HexDigest() != expected)
+						{
+							// Start over next time rather than resume a corrupt file
+							self->RemoveState();
+							self->Finish(std::make_exception_ptr(DownloadError("The checksum of the file does not match", true)));
+							return;
+						}
+					}
+					self->RemoveState();
+					self->Finish(nullptr);
+				}
+				catch (...)
+				{
+					self->Finish(std::current_exception());
+				}
+			});
+		}
+
+		void Finish(std::exception_ptr error)
+		{
+			std::vector<Abort> aborts;
+			bool save;
+			{
+				std::lock_guard<std::mutex> guard(_lock);
+				if (_finished)
+					return;
+				_finished = true;
+				for (auto &running : _fetches)
+				{
+					if (running.second)
+						aborts.push_back(std::move(running.second));
+				}
+				_fetches.clear();
+				save = (error && !_state.segments.empty() && !_state.IsComplete());
+			}
+			for (auto &abort : aborts)
+				abort();
+			if (save)
+				SaveState();
+			try
+			{
+				_done(error);
+			}
+			catch (...)
+			{
+			}
+		}
+
+		// Full jitter: uniform in [0, min(maxBackoff, baseBackoff * 2^retries)]
+		uint64_t Backoff(int retries)
+		{
+			uint64_t ceiling = _options.baseBackoff;
+			for (int i = 0; i < retries && ceiling < _options.maxBackoff; i++)
+				ceiling *= 2;
+			ceiling = std::min(ceiling, _options.maxBackoff);
+			std::lock_guard<std::mutex> guard(_lock);
+			return (ceiling == 0 ? 0 : _random() % (ceiling + 1));
+		}
+
+#ifdef _WIN32
+		typedef std::wstring Path;
+
+		static Path ToPath(const std::string &utf8)
+		{
+			std::wstring path(Utf8ToUtf16Length(utf8.data(), utf8.size()), L'\0');
+			if (!path.empty())
+				Utf8ToUtf16(utf8.data(), utf8.size(), reinterpret_cast<char16_t*>(&path[0]));
+			return path;
+		}
+
+		static void RemoveFile(const Path &path)
+		{
+			_wremove(path.c_str());
+		}
+
+		static void RenameFile(const Path &from, const Path &to)
+		{
+			_wrename(from.c_str(), to.c_str());
+		}
+#else
+		typedef std::string Path;
+
+		static Path ToPath(const std::string &utf8)
+		{
+			return utf8;
+		}
+
+		static void RemoveFile(const Path &path)
+		{
+			std::remove(path.c_str());
+		}
+
+		static void RenameFile(const Path &from, const Path &to)
+		{
+			std::rename(from.c_str(), to.c_str());
+		}
+#endif
+
+		bool LoadState(DownloadState &state)
+		{
+			if (_options.statePath.empty())
+				return false;
+			std::ifstream file(ToPath(_options.statePath), std::ios::binary);
+			if (!file)
+				return false;
+			std::ostringstream text;
+			text << file.rdbuf();
+			return state.Parse(text.str());
+		}
+
+		// Written to a temporary file then renamed, so that a crash leaves the old state or the new one
+		void SaveState()
+		{
+			if (_options.statePath.empty())
+				return;
+
+			std::string text;
+			{
+				std::lock_guard<std::mutex> guard(_lock);
+				if (_state.segments.empty())
+					return;
+				text = _state.Serialize();
+				_unsaved = 0;
+			}
+
+			std::lock_guard<std::mutex> guard(_saveLock);
+			auto path = ToPath(_options.statePath);
+			auto temporary = path + ToPath(".tmp");
+			{
+				std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+				if (!file)
+					return;
+				file << text;
+				if (!file)
+				{
+					file.close();
+					RemoveFile(temporary);
+					return;
+				}
+			}
+			RemoveFile(path);
+			RenameFile(temporary, path);
+		}
+
+		void RemoveState()
+		{
+			if (_options.statePath.empty())
+				return;
+			std::lock_guard<std::mutex> guard(_saveLock);
+			RemoveFile(ToPath(_options.statePath));
+		}
+
+		std::string _url;
+		Fetch _fetch;
+		std::shared_ptr<DownloadFile> _file;
+		Options _options;
+		Progress _progress;
+		Done _done;
+		RequestPolicy::Delay _delay;
+
+		std::mutex _lock;
+		DownloadState _state;
+		std::vector<bool> _active;  // segment being fetched (or waiting for a retry)
+		std::vector<int> _retries;  // failures in a row
+		std::unordered_map<size_t, Abort> _fetches; // in flight, by id; forgotten ones are ignored
+		bool _finished;
+		bool _verifying;
+		int _restarts;
+		size_t _generation; // of the state, bumped when the download starts over
+		size_t _nextFetch;
+		uint64_t _unsaved;
+		std::minstd_rand _random;
+
+		std::mutex _saveLock;
+	};
+} // namespace LUwpUtilities
+
+#endif // #ifndef _LUWPUTILITIES_SEGMENTED_DOWNLOAD_
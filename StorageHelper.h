@@ -8,6 +8,7 @@
 #ifdef LUU_EXPORT
 
 #include "LUwpUtilities.h"
+#include "StringHelper.cpp"
 #include <ppltasks.h>
 
 namespace LUwpUtilities
@@ -63,12 +64,13 @@ using namespace Concurrency;
 			}, task_continuation_context::use_current());
 		}
 
+		// Write the string as UTF-8 (without BOM, same as WriteTextAsync)
 		STATIC_INLINE void WriteFile(
 			Windows::Storage::StorageFile^ file,
 			Platform::String^ data
 		)
 		{
-			create_task(Windows::Storage::FileIO::WriteTextAsync(file, data)).get();
+			create_task(Windows::Storage::FileIO::WriteBufferAsync(file, ToUtf8Buffer(data))).get();
 		}
 
 		STATIC_INLINE void WriteFile(
@@ -1,21 +1,109 @@
 /**
- * Some simple method to perform string conversion (C string to Platform::String).
+ * Some simple method to perform string conversion (C string to Platform::String and back).
+ *
+ * The input is transcoded by UnicodeHelper.h straight into the destination (a preallocated
+ * HSTRING buffer, std::string or IBuffer) whose exact size is computed first, so that each
+ * conversion costs exactly one allocation.
  */
 
-#include "LVitaCpp\StringHelper.h"
+#ifndef _LUWPUTILITIES_STRING_HELPER_
+#define _LUWPUTILITIES_STRING_HELPER_
+
+#include <Windows.h>
+#include <winstring.h>
+#include <cstring>
+#include <string>
+#include "LUwpUtilities.h"
+#include "BufferHelper.cpp"
+#include "UnicodeHelper.h"
+
+STATIC_INLINE Platform::String^ ToPlatformString(const char* str, int length)
+{
+	if (str == nullptr || length <= 0)
+		return ref new Platform::String();
+
+	auto wlength = LUwpUtilities::Utf8ToUtf16Length(str, length);
+
+	wchar_t * wstr = nullptr;
+	HSTRING_BUFFER buffer = nullptr;
+	HRESULT hr = WindowsPreallocateStringBuffer((UINT32)wlength, &wstr, &buffer);
+	if (FAILED(hr))
+		throw Platform::Exception::CreateException(hr);
+
+	LUwpUtilities::Utf8ToUtf16(str, length, reinterpret_cast<char16_t*>(wstr));
+
+	HSTRING hstr = nullptr;
+	hr = WindowsPromoteStringBuffer(buffer, &hstr);
+	if (FAILED(hr))
+	{
+		WindowsDeleteStringBuffer(buffer);
+		throw Platform::Exception::CreateException(hr);
+	}
+
+	// Attach the HSTRING to the handle without an extra reference
+	Platform::String^ result = nullptr;
+	*reinterpret_cast<HSTRING*>(&result) = hstr;
+	return result;
+}
 
 STATIC_INLINE Platform::String^ ToPlatformString(const char* str)
 {
-	wchar_t * wstr = ToWideString(str);
-	auto res = ref new Platform::String(wstr);
-	delete[] wstr;
-	return res;
+	if (str == nullptr)
+		return ref new Platform::String();
+
+	return ToPlatformString(str, (int)strlen(str));
 }
 
-STATIC_INLINE Platform::String^ ToPlatformString(const char* str, int length)
+// Convert a batch of (pointer, length) UTF-8 strings at once: everything is transcoded into
+// the arena in one pass, then each Platform::String is made from its slice of the arena.
+// Reuse the same arena for every page to avoid any temporary allocation.
+STATIC_INLINE Platform::Array<Platform::String^>^ ToPlatformStrings(
+	const LUwpUtilities::Utf8Slice *items,
+	size_t count,
+	LUwpUtilities::Utf16Arena &arena
+)
 {
-	wchar_t * wstr = ToWideString(str, length);
-	auto res = ref new Platform::String(wstr);
-	delete[] wstr;
-	return res;
+	arena.Transcode(items, count);
+
+	auto result = ref new Platform::Array<Platform::String^>((unsigned int)count);
+	for (size_t i = 0; i < count; i++)
+		result[(unsigned int)i] = ref new Platform::String(reinterpret_cast<const wchar_t*>(arena.Data(i)), (unsigned int)arena.Length(i));
+	return result;
 }
+
+// Same as above with an arena kept per thread
+STATIC_INLINE Platform::Array<Platform::String^>^ ToPlatformStrings(
+	const LUwpUtilities::Utf8Slice *items,
+	size_t count
+)
+{
+	thread_local LUwpUtilities::Utf16Arena arena;
+	return ToPlatformStrings(items, count, arena);
+}
+
+STATIC_INLINE std::string ToUtf8String(Platform::String^ str)
+{
+	if (str == nullptr || str->Length() == 0)
+		return std::string();
+
+	auto wstr = reinterpret_cast<const char16_t*>(str->Data());
+	std::string result(LUwpUtilities::Utf16ToUtf8Length(wstr, str->Length()), '\0');
+	LUwpUtilities::Utf16ToUtf8(wstr, str->Length(), &result[0]);
+	return result;
+}
+
+// UTF-8 encoded content of the string in an IBuffer, e.g. to write to a file or send as request body
+STATIC_INLINE Windows::Storage::Streams::IBuffer^ ToUtf8Buffer(Platform::String^ str)
+{
+	auto wstr = reinterpret_cast<const char16_t*>(str == nullptr ? L"" : str->Data());
+	auto wlength = (str == nullptr ? 0 : str->Length());
+	auto length = LUwpUtilities::Utf16ToUtf8Length(wstr, wlength);
+
+	auto buffer = ref new Windows::Storage::Streams::Buffer((unsigned int)length);
+	buffer->Length = (unsigned int)length;
+	if (length > 0)
+		LUwpUtilities::Utf16ToUtf8(wstr, wlength, reinterpret_cast<char*>(GetBufferData(buffer)));
+	return buffer;
+}
+
+#endif // #ifndef _LUWPUTILITIES_STRING_HELPER_
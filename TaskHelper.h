@@ -1,5 +1,10 @@
 /**
  * Static method to run code in background thread via callbacks; intended to avoid inclusion of <ppltasks.h>
+ *
+ * Background work runs on ThreadPool::Default() and the continuations are posted back to the
+ * dispatcher of the calling (UI) thread, as task_continuation_context::use_current() would do.
+ * Continuations for the same dispatcher are coalesced (see DispatchQueue.h) so that many of
+ * them completing at once cost a single UI-thread dispatch.
  */
 
 #ifndef _LUWPUTILITIES_TASK_HELPER_
@@ -8,14 +13,80 @@
 #ifdef LUU_EXPORT
 
 #include "LUwpUtilities.h"
-#include <ppltasks.h>
+#include "CancellationState.h"
+#include "DispatchQueue.h"
+#include "ParallelHelper.h"
+#include "TaskTrace.h"
+#include "ThreadPool.h"
+#include "TimerWheel.h"
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
 
 namespace LUwpUtilities
 {
 	LUU_EXPORT delegate void ExecutionCallback(Platform::Object^ params);
 	LUU_EXPORT delegate Platform::Object^ ExecutionCallbackWithValue(Platform::Object^ params);
 
-using namespace Concurrency;
+	/// Priority lanes of the background work, from the most to the least urgent (same as WorkPriority)
+	LUU_EXPORT enum class TaskPriority
+	{
+		UserBlocking,
+		Normal,
+		Prefetch,
+		Idle
+	};
+
+	/// Cancellation token for TH::RunAsync and Http::GetAsync: work that has not started yet is dropped,
+	/// HTTP requests in flight are aborted and the error handler receives an OperationCanceledException.
+	/// Long-running work can poll IsCancelled.
+	[Windows::Foundation::Metadata::WebHostHidden]
+	LUU_EXPORT ref class TaskCancellation sealed
+	{
+	public:
+		TaskCancellation() : _state(std::make_shared<CancellationState>())
+		{
+		}
+
+		property bool IsCancelled
+		{
+			bool get() { return _state->IsCancelled(); }
+		}
+
+		void Cancel()
+		{
+			_state->Cancel();
+		}
+
+		/// Deadline: cancel after the given number of milliseconds
+		void CancelAfter(int milliseconds)
+		{
+			_state->CancelAfter(std::chrono::milliseconds(milliseconds));
+		}
+
+	internal:
+		// Shared with the work and callbacks so that they can outlive this object
+		std::shared_ptr<CancellationState> State()
+		{
+			return _state;
+		}
+
+	private:
+		std::shared_ptr<CancellationState> _state;
+	};
+
+	// Pending call of TH::RunDebounced/RunThrottled for one token
+	struct KeyedTimer
+	{
+		TimerWheel::Timer timer;
+		Windows::UI::Core::CoreDispatcher^ dispatcher;
+		ExecutionCallback^ action;
+		Platform::Object^ param;
+		std::chrono::milliseconds interval;
+		bool pending; // RunThrottled: a call arrived during the current window
+	};
 
 	/// STATIC_INLINE method to run background task to avoid #include <ppltasks.h>
 	[Windows::Foundation::Metadata::WebHostHidden]
@@ -27,43 +98,74 @@ using namespace Concurrency;
 			Platform::Object^ param
 		)
 		{
-			create_task([=]()
-			{
-				execution(param);
-			});
+			RunAsync(execution, param, TaskPriority::Normal);
 		}
 
 		STATIC_INLINE void RunAsync(
-			Windows::Foundation::IAsyncOperation<Platform::String^>^ operation,
-			ExecutionCallback^ continuation
+			ExecutionCallback^ execution,
+			Platform::Object^ param,
+			TaskPriority priority
 		)
 		{
-			create_task(operation).then([=](Platform::String^ result)
-			{
-				continuation(result);
-			}, task_continuation_context::use_current());
+			RunAsync(execution, param, priority, nullptr);
 		}
 
+		// The work is skipped if the token is cancelled before it starts
 		STATIC_INLINE void RunAsync(
-			ExecutionCallbackWithValue^ execution,
+			ExecutionCallback^ execution,
 			Platform::Object^ param,
-			ExecutionCallback^ continuation
+			TaskPriority priority,
+			TaskCancellation^ cancellation
 		)
 		{
-			create_task([=]()
-			{
-				return execution(param);
-			}).then([=](task<Platform::Object^> previous_task)
+			auto timer = TaskTrace::Timer::Enqueue("TH::RunAsync");
+			auto state = (cancellation == nullptr ? nullptr : cancellation->State());
+			ThreadPool::Default().Submit([=]()
 			{
+				if (state != nullptr && state->IsCancelled())
+					return;
+
+				auto trace = timer;
+				trace.Start();
 				try
 				{
-					auto result = previous_task.get();
-					continuation(result);
+					execution(param);
 				}
 				catch (Platform::Exception^ e)
 				{
 				}
-			}, task_continuation_context::use_current());
+				trace.End();
+				trace.Finish();
+			}, (WorkPriority)priority);
+		}
+
+		STATIC_INLINE void RunAsync(
+			Windows::Foundation::IAsyncOperation<Platform::String^>^ operation,
+			ExecutionCallback^ continuation
+		)
+		{
+			auto dispatcher = CurrentDispatcher();
+			operation->Completed = ref new Windows::Foundation::AsyncOperationCompletedHandler<Platform::String^>(
+				[=](Windows::Foundation::IAsyncOperation<Platform::String^>^ op, Windows::Foundation::AsyncStatus status)
+			{
+				if (status != Windows::Foundation::AsyncStatus::Completed)
+					return;
+
+				auto result = op->GetResults();
+				RunOnContext(dispatcher, [=]()
+				{
+					continuation(result);
+				});
+			});
+		}
+
+		STATIC_INLINE void RunAsync(
+			ExecutionCallbackWithValue^ execution,
+			Platform::Object^ param,
+			ExecutionCallback^ continuation
+		)
+		{
+			RunAsync(execution, param, continuation, nullptr);
 		}
 
 		STATIC_INLINE void RunAsync(
@@ -73,22 +175,70 @@ using namespace Concurrency;
 			ExceptionHandler^ on_error
 		)
 		{
-			create_task([=]()
-			{
-				return execution(param);
-			}).then([=](task<Platform::Object^> previous_task)
+			RunAsync(execution, param, continuation, on_error, TaskPriority::Normal);
+		}
+
+		STATIC_INLINE void RunAsync(
+			ExecutionCallbackWithValue^ execution,
+			Platform::Object^ param,
+			ExecutionCallback^ continuation,
+			ExceptionHandler^ on_error,
+			TaskPriority priority
+		)
+		{
+			RunAsync(execution, param, continuation, on_error, priority, nullptr);
+		}
+
+		// With a cancellation token: if it is cancelled before the work starts, the work is skipped;
+		// if it is cancelled before the continuation runs, on_error gets an OperationCanceledException instead
+		STATIC_INLINE void RunAsync(
+			ExecutionCallbackWithValue^ execution,
+			Platform::Object^ param,
+			ExecutionCallback^ continuation,
+			ExceptionHandler^ on_error,
+			TaskPriority priority,
+			TaskCancellation^ cancellation
+		)
+		{
+			auto dispatcher = CurrentDispatcher();
+			auto timer = TaskTrace::Timer::Enqueue("TH::RunAsync");
+			auto state = (cancellation == nullptr ? nullptr : cancellation->State());
+			ThreadPool::Default().Submit([=]()
 			{
+				auto trace = timer;
+				trace.Start();
+				Platform::Object^ result = nullptr;
+				Platform::Exception^ error = nullptr;
 				try
 				{
-					auto result = previous_task.get();
-					continuation(result);
+					if (state != nullptr && state->IsCancelled())
+						throw ref new Platform::OperationCanceledException();
+					result = execution(param);
 				}
 				catch (Platform::Exception^ e)
 				{
-					if (on_error != nullptr)
-						on_error(e);
+					error = e;
 				}
-			}, task_continuation_context::use_current());
+				trace.End();
+
+				RunOnContext(dispatcher, [=]()
+				{
+					trace.Dispatched();
+					try
+					{
+						if (error != nullptr)
+							throw error;
+						if (state != nullptr && state->IsCancelled())
+							throw ref new Platform::OperationCanceledException();
+						continuation(result);
+					}
+					catch (Platform::Exception^ e)
+					{
+						if (on_error != nullptr)
+							on_error(e);
+					}
+				});
+			}, (WorkPriority)priority);
 		}
 
 		STATIC_INLINE void RunAsync(
@@ -97,11 +247,173 @@ using namespace Concurrency;
 			ExecutionCallback^ continuation
 		)
 		{
-			create_task(dispatcher->RunAsync(Windows::UI::Core::CoreDispatcherPriority::Normal, handler)).then([=]()
+			auto context = CurrentDispatcher();
+			dispatcher->RunAsync(Windows::UI::Core::CoreDispatcherPriority::Normal, handler)->Completed = ref new Windows::Foundation::AsyncActionCompletedHandler(
+				[=](Windows::Foundation::IAsyncAction^ action, Windows::Foundation::AsyncStatus status)
 			{
-				if (continuation != nullptr)
+				if (status != Windows::Foundation::AsyncStatus::Completed || continuation == nullptr)
+					return;
+
+				RunOnContext(context, [=]()
+				{
 					continuation(nullptr);
-			}, task_continuation_context::use_current());
+				});
+			});
+		}
+
+		// Call body(item) for every item of the vector in parallel, then call continuation(items)
+		// on the calling thread's dispatcher (or on_error with the first exception).
+		// The items are read on the calling thread before the loop starts.
+		STATIC_INLINE void ParallelFor(
+			Windows::Foundation::Collections::IVector<Platform::Object^>^ items,
+			ExecutionCallback^ body,
+			ExecutionCallback^ continuation,
+			ExceptionHandler^ on_error
+		)
+		{
+			auto dispatcher = CurrentDispatcher();
+			auto snapshot = ref new Platform::Array<Platform::Object^>(items->Size);
+			items->GetMany(0, snapshot);
+
+			ParallelForAsync(ThreadPool::Default(), 0, snapshot->Length, [=](size_t first, size_t last)
+			{
+				for (size_t i = first; i < last; i++)
+					body(snapshot[(unsigned int)i]);
+			}, [=](std::exception_ptr error)
+			{
+				CompleteParallel(dispatcher, error, [=]()
+				{
+					if (continuation != nullptr)
+						continuation(items);
+				}, on_error);
+			});
+		}
+
+		// Replace every item of the vector by transform(item), computed in parallel; the vector is
+		// updated on the calling thread's dispatcher, with a single ReplaceAll, before continuation(items) is called
+		STATIC_INLINE void ParallelTransform(
+			Windows::Foundation::Collections::IVector<Platform::Object^>^ items,
+			ExecutionCallbackWithValue^ transform,
+			ExecutionCallback^ continuation,
+			ExceptionHandler^ on_error
+		)
+		{
+			auto dispatcher = CurrentDispatcher();
+			auto snapshot = ref new Platform::Array<Platform::Object^>(items->Size);
+			items->GetMany(0, snapshot);
+			auto results = ref new Platform::Array<Platform::Object^>(snapshot->Length);
+
+			ParallelForAsync(ThreadPool::Default(), 0, snapshot->Length, [=](size_t first, size_t last)
+			{
+				for (size_t i = first; i < last; i++)
+					results[(unsigned int)i] = transform(snapshot[(unsigned int)i]);
+			}, [=](std::exception_ptr error)
+			{
+				CompleteParallel(dispatcher, error, [=]()
+				{
+					items->ReplaceAll(results);
+					if (continuation != nullptr)
+						continuation(items);
+				}, on_error);
+			});
+		}
+
+		// Call action(param) on the calling thread's dispatcher once no call with the same token
+		// has been made for delay_ms milliseconds; only the param of the last call is used
+		STATIC_INLINE void RunDebounced(
+			Platform::String^ token,
+			int delay_ms,
+			ExecutionCallback^ action,
+			Platform::Object^ param
+		)
+		{
+			auto &service = TimerService::Default();
+			std::lock_guard<std::recursive_mutex> guard(service.Lock());
+			auto &entry = KeyedTimers()[token->Data()];
+			if (entry == nullptr)
+			{
+				entry.reset(new KeyedTimer());
+				std::wstring key(token->Data());
+				entry->timer.callback = [key]()
+				{
+					auto &timers = KeyedTimers();
+					auto found = timers.find(key);
+					std::unique_ptr<KeyedTimer> fired(std::move(found->second));
+					timers.erase(found);
+					auto action = fired->action;
+					auto param = fired->param;
+					RunLater(fired->dispatcher, [action, param]() { action(param); });
+				};
+			}
+			entry->dispatcher = CurrentDispatcher();
+			entry->action = action;
+			entry->param = param;
+			service.Schedule(entry->timer, std::chrono::milliseconds(delay_ms));
+		}
+
+		// Call action(param) right away (on the calling thread) unless a call with the same token ran
+		// less than interval_ms milliseconds ago; in that case, call it with the param of the last call
+		// at the end of the interval, on the calling thread's dispatcher
+		STATIC_INLINE void RunThrottled(
+			Platform::String^ token,
+			int interval_ms,
+			ExecutionCallback^ action,
+			Platform::Object^ param
+		)
+		{
+			{
+				auto &service = TimerService::Default();
+				std::lock_guard<std::recursive_mutex> guard(service.Lock());
+				auto &entry = KeyedTimers()[token->Data()];
+				if (entry != nullptr)
+				{
+					entry->dispatcher = CurrentDispatcher();
+					entry->action = action;
+					entry->param = param;
+					entry->pending = true;
+					return;
+				}
+
+				entry.reset(new KeyedTimer());
+				entry->interval = std::chrono::milliseconds(interval_ms);
+				entry->pending = false;
+				std::wstring key(token->Data());
+				entry->timer.callback = [key]()
+				{
+					// End of the window: run the trailing call and start a new window, or forget the token
+					auto &timers = KeyedTimers();
+					auto found = timers.find(key);
+					auto &window = *found->second;
+					if (!window.pending)
+					{
+						timers.erase(found);
+						return;
+					}
+
+					window.pending = false;
+					auto action = window.action;
+					auto param = window.param;
+					RunLater(window.dispatcher, [action, param]() { action(param); });
+					TimerService::Default().Schedule(window.timer, window.interval);
+				};
+				service.Schedule(entry->timer, entry->interval);
+			}
+
+			action(param);
+		}
+
+		// Start or stop recording the queue wait, execution and dispatch times of the tasks (see TaskTrace.h)
+		STATIC_INLINE void EnableTaskTrace(bool enabled)
+		{
+			TaskTrace::Enable(enabled);
+		}
+
+		// Latency percentiles recorded so far, by call site
+		STATIC_INLINE Platform::String^ DumpTaskTrace()
+		{
+			auto dump = TaskTrace::Dump();
+			std::wstring text(dump.begin(), dump.end());
+			return ref new Platform::String(text.c_str(), (unsigned int)text.length());
 		}
 
 		STATIC_INLINE void NotifyUser(
@@ -118,6 +430,97 @@ using namespace Concurrency;
 				dialog->Commands->Append(secondary_command);
 			dialog->ShowAsync();
 		}
+
+	internal:
+		// Dispatcher of the calling thread; null if it is not a UI thread
+		STATIC_INLINE Windows::UI::Core::CoreDispatcher^ CurrentDispatcher()
+		{
+			auto window = Windows::UI::Core::CoreWindow::GetForCurrentThread();
+			return window == nullptr ? nullptr : window->Dispatcher;
+		}
+
+		// The coalescing queue of continuations for a dispatcher; it lives as long as the app
+		STATIC_INLINE CoalescingDispatcher &UIQueue(
+			Windows::UI::Core::CoreDispatcher^ dispatcher
+		)
+		{
+			static std::mutex lock;
+			static std::map<void*, std::unique_ptr<CoalescingDispatcher>> queues;
+
+			std::lock_guard<std::mutex> guard(lock);
+			auto &queue = queues[reinterpret_cast<void*>(dispatcher)];
+			if (queue == nullptr)
+			{
+				// Map nodes never move so the slot can be captured by the wake-up callback
+				auto slot = &queue;
+				queue.reset(new CoalescingDispatcher([dispatcher, slot]()
+				{
+					dispatcher->RunAsync(Windows::UI::Core::CoreDispatcherPriority::Normal, ref new Windows::UI::Core::DispatchedHandler([slot]()
+					{
+						(*slot)->Drain();
+					}));
+				}));
+			}
+			return *queue;
+		}
+
+		// Post the continuation to the dispatcher captured by CurrentDispatcher() or
+		// run it right away on the current (background) thread if there is none
+		STATIC_INLINE void RunOnContext(
+			Windows::UI::Core::CoreDispatcher^ dispatcher,
+			std::function<void()> continuation
+		)
+		{
+			if (dispatcher == nullptr)
+			{
+				continuation();
+				return;
+			}
+
+			UIQueue(dispatcher).Post(std::move(continuation));
+		}
+		// Timers of RunDebounced/RunThrottled by token; guarded by TimerService::Default().Lock()
+		STATIC_INLINE std::map<std::wstring, std::unique_ptr<KeyedTimer>> &KeyedTimers()
+		{
+			static std::map<std::wstring, std::unique_ptr<KeyedTimer>> timers;
+			return timers;
+		}
+
+		// Like RunOnContext but never inline: without a dispatcher the work goes to the thread pool
+		STATIC_INLINE void RunLater(
+			Windows::UI::Core::CoreDispatcher^ dispatcher,
+			std::function<void()> work
+		)
+		{
+			if (dispatcher == nullptr)
+				ThreadPool::Default().Submit(std::move(work));
+			else
+				UIQueue(dispatcher).Post(std::move(work));
+		}
+
+		// Marshal the single completion of background work (ParallelFor, AsyncMemo...) back to the dispatcher
+		STATIC_INLINE void CompleteParallel(
+			Windows::UI::Core::CoreDispatcher^ dispatcher,
+			std::exception_ptr error,
+			std::function<void()> on_success,
+			ExceptionHandler^ on_error
+		)
+		{
+			RunOnContext(dispatcher, [=]()
+			{
+				try
+				{
+					if (error)
+						std::rethrow_exception(error);
+					on_success();
+				}
+				catch (Platform::Exception^ e)
+				{
+					if (on_error != nullptr)
+						on_error(e);
+				}
+			});
+		}
 	}; // class TH
 } // namespace LUwpUtilities
 #endif
@@ -0,0 +1,102 @@
+/**
+ * TaskPipeline: a Pipeline.h chain of background stages for C++/CX callers, with an optional
+ * last stage on the calling thread's dispatcher, e.g. fetch -> parse -> map -> append to a list.
+ */
+
+#ifndef _LUWPUTILITIES_TASK_PIPELINE_
+#define _LUWPUTILITIES_TASK_PIPELINE_
+
+#ifdef LUU_EXPORT
+
+#include "LUwpUtilities.h"
+#include "Pipeline.h"
+#include "StringHelper.cpp"
+#include "TaskHelper.h"
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace LUwpUtilities
+{
+	/// Bounded multi-stage pipeline (see Pipeline.h), e.g. fetch -> parse -> map -> append to a list.
+	/// Stages are added in order before the first item is posted.
+	[Windows::Foundation::Metadata::WebHostHidden]
+	LUU_EXPORT ref class TaskPipeline sealed
+	{
+	public:
+		TaskPipeline() : _pipeline(Pipeline<Platform::Object^>::Create())
+		{
+		}
+
+		/// Background stage: the item is replaced by transform(item), or dropped if that returns nullptr
+		void AddStage(Platform::String^ name, ExecutionCallbackWithValue^ transform, int parallelism, int capacity)
+		{
+			_pipeline->AddStage(ToName(name), [transform](Platform::Object^ &item)
+			{
+				item = transform(item);
+				return item != nullptr;
+			}, (size_t)parallelism, (size_t)capacity);
+		}
+
+		/// Last stage, run one item at a time on the calling thread's dispatcher (e.g. to append to a bound list)
+		void AddUIStage(Platform::String^ name, ExecutionCallback^ sink, int capacity)
+		{
+			auto dispatcher = TH::CurrentDispatcher();
+			_pipeline->AddStage(ToName(name), [sink](Platform::Object^ &item)
+			{
+				sink(item);
+				return true;
+			}, 1, (size_t)capacity, [dispatcher](std::function<void()> work)
+			{
+				TH::RunOnContext(dispatcher, std::move(work));
+			});
+		}
+
+		/// Return false if the first stage is full; try again later (backpressure)
+		bool TryPost(Platform::Object^ item)
+		{
+			return _pipeline->TryPush(item);
+		}
+
+		/// No more items; on_completed(nullptr) is called on the calling thread's dispatcher once all went through
+		void Close(ExecutionCallback^ on_completed)
+		{
+			auto dispatcher = TH::CurrentDispatcher();
+			_pipeline->Close([dispatcher, on_completed]()
+			{
+				if (on_completed != nullptr)
+					TH::RunOnContext(dispatcher, [on_completed]() { on_completed(nullptr); });
+			});
+		}
+
+		/// One line per stage: items processed/dropped, throughput and utilization (the bottleneck is near 1)
+		Platform::String^ DescribeStatistics()
+		{
+			// The names are UTF-8 (see ToName)
+			std::string text;
+			char line[128];
+			for (auto &stage : _pipeline->GetStatistics())
+			{
+				snprintf(line, sizeof(line), ": processed=%zu dropped=%zu queued=%zu stalls=%zu throughput=%.1f/s utilization=%.2f\n",
+					stage.processed, stage.dropped, stage.queued, stage.stalls, stage.throughput, stage.utilization);
+				text += stage.name;
+				text += line;
+			}
+			return ToPlatformString(text.data(), (int)text.length());
+		}
+
+	private:
+		// Pipeline.h keeps the stage names in UTF-8
+		static std::string ToName(Platform::String^ name)
+		{
+			return ToUtf8String(name);
+		}
+
+		// Also held by the items in flight, which may outlive this object
+		std::shared_ptr<Pipeline<Platform::Object^>> _pipeline;
+	};
+} // namespace LUwpUtilities
+#endif
+
+#endif // #ifndef _LUWPUTILITIES_TASK_PIPELINE_
@@ -0,0 +1,410 @@
+/**
+ * Optional per-task instrumentation (portable C++, no C++/CX).
+ *
+ * When enabled with TaskTrace::Enable(true), TH and Http time each task they run:
+ *  - queue wait: from RunAsync/GetAsync to the start of the work (for Http, the wait for a slot
+ *    of the host in the RequestScheduler)
+ *  - execution: from the start to the end of the work (for Http, the network time)
+ *  - dispatch: from the end of the work to the start of the continuation on the UI thread
+ * The samples go to log-linear (HDR-style) histograms owned by the recording thread, so
+ * recording takes no lock and no atomic read-modify-write, and are tagged by call site:
+ *
+ *     {
+ *         TaskTrace::Site site("LoadFrontPage"); // tags every task started in this scope
+ *         TH::RunAsync(...);
+ *     }
+ *     OutputDebugStringA(TaskTrace::Dump().c_str());
+ *
+ * When disabled (the default), the cost per task is one relaxed atomic load and a branch.
+ */
+
+#ifndef _LUWPUTILITIES_TASK_TRACE_
+#define _LUWPUTILITIES_TASK_TRACE_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace LUwpUtilities
+{
+	// Histogram of durations in nanoseconds with 8 sub-buckets per power of two (at most 12.5% error).
+	// Only one thread records into it but any thread may read it.
+	class LatencyHistogram
+	{
+	public:
+		static const int SubBits = 3;
+		static const int SubCount = 1 << SubBits;
+		static const int MaxExponent = 40; // about 18 minutes
+		static const int BucketCount = (MaxExponent - SubBits + 2) * SubCount;
+
+		LatencyHistogram()
+		{
+			for (int i = 0; i < BucketCount; i++)
+				_counts[i] = 0;
+		}
+
+		// Single writer: a plain load and store is enough
+		void Record(uint64_t value)
+		{
+			auto &count = _counts[Index(value)];
+			count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		}
+
+		uint64_t Count(int bucket) const
+		{
+			return _counts[bucket].load(std::memory_order_relaxed);
+		}
+
+		static int Index(uint64_t value)
+		{
+			if (value < SubCount)
+				return (int)value;
+
+			int exponent = 0;
+			for (uint64_t v = value; v > 1; v >>= 1)
+				exponent++;
+			if (exponent > MaxExponent)
+				return BucketCount - 1;
+
+			return (exponent - SubBits + 1) * SubCount + (int)((value >> (exponent - SubBits)) & (SubCount - 1));
+		}
+
+		// Smallest value of the bucket
+		static uint64_t LowerBound(int bucket)
+		{
+			if (bucket < SubCount)
+				return bucket;
+
+			int exponent = bucket / SubCount + SubBits - 1;
+			return uint64_t(SubCount + bucket % SubCount) << (exponent - SubBits);
+		}
+
+	private:
+		std::atomic<uint64_t> _counts[BucketCount];
+	};
+
+	// Sum of several LatencyHistogram at one point in time
+	struct LatencySnapshot
+	{
+		uint64_t counts[LatencyHistogram::BucketCount];
+		uint64_t total;
+
+		LatencySnapshot() : total(0)
+		{
+			memset(counts, 0, sizeof(counts));
+		}
+
+		void Add(const LatencyHistogram &histogram)
+		{
+			for (int i = 0; i < LatencyHistogram::BucketCount; i++)
+			{
+				auto count = histogram.Count(i);
+				counts[i] += count;
+				total += count;
+			}
+		}
+
+		void Add(uint64_t value)
+		{
+			counts[LatencyHistogram::Index(value)]++;
+			total++;
+		}
+
+		// Halve every count, so that old values fade out of a running distribution
+		void Decay()
+		{
+			total = 0;
+			for (int i = 0; i < LatencyHistogram::BucketCount; i++)
+			{
+				counts[i] >>= 1;
+				total += counts[i];
+			}
+		}
+
+		// Value at quantile q (0 < q <= 1), as the lower bound of its bucket
+		uint64_t Percentile(double q) const
+		{
+			if (total == 0)
+				return 0;
+
+			auto rank = (uint64_t)(q * total);
+			if (rank == 0)
+				rank = 1;
+			uint64_t seen = 0;
+			for (int i = 0; i < LatencyHistogram::BucketCount; i++)
+			{
+				seen += counts[i];
+				if (seen >= rank)
+					return LatencyHistogram::LowerBound(i);
+			}
+			return LatencyHistogram::LowerBound(LatencyHistogram::BucketCount - 1);
+		}
+	};
+
+	class TaskTrace
+	{
+	public:
+		static bool IsEnabled()
+		{
+			return EnabledFlag().load(std::memory_order_relaxed);
+		}
+
+		static void Enable(bool enabled)
+		{
+			EnabledFlag().store(enabled, std::memory_order_relaxed);
+		}
+
+		static int64_t Now()
+		{
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+		}
+
+		// Tag the tasks started on this thread while the object is alive with the call site name;
+		// the name must outlive the traces (use a string literal)
+		class Site
+		{
+		public:
+			explicit Site(const char *name) : _previous(CurrentSite())
+			{
+				CurrentSite() = name;
+			}
+
+			~Site()
+			{
+				CurrentSite() = _previous;
+			}
+
+			Site(const Site&) = delete;
+			Site &operator=(const Site&) = delete;
+
+		private:
+			const char *_previous;
+		};
+
+		// Timestamps of one task; a small value type captured by the task's lambdas
+		struct Timer
+		{
+			const char *site; // null if tracing was disabled when the task was queued
+			int64_t enqueued;
+			int64_t started;
+			int64_t ended;
+
+			// Call where the task is queued; name is the site used outside of any TaskTrace::Site
+			static Timer Enqueue(const char *name)
+			{
+				Timer timer;
+				timer.site = nullptr;
+				if (!IsEnabled())
+					return timer;
+
+				timer.site = (CurrentSite() != nullptr ? CurrentSite() : name);
+				timer.enqueued = timer.started = timer.ended = Now();
+				return timer;
+			}
+
+			void Start()
+			{
+				if (site != nullptr)
+					started = Now();
+			}
+
+			// Start() for work admitted at the given time (Now()) by another thread; 0 leaves the timer as is
+			void StartedAt(int64_t time)
+			{
+				if (site != nullptr && time > enqueued)
+					started = time;
+			}
+
+			void End()
+			{
+				if (site != nullptr)
+					ended = Now();
+			}
+
+			// Record a task without continuation
+			void Finish() const
+			{
+				if (site != nullptr)
+					Record(site, started - enqueued, ended - started, -1);
+			}
+
+			// Record a task whose continuation is starting now
+			void Dispatched() const
+			{
+				if (site != nullptr)
+					Record(site, started - enqueued, ended - started, Now() - ended);
+			}
+		};
+
+		// Human-readable summary (durations in microseconds) of everything recorded so far
+		static std::string Dump()
+		{
+			std::vector<const char*> names;
+			std::vector<std::unique_ptr<SiteSnapshot>> sites;
+			{
+				auto &registry = GetRegistry();
+				std::lock_guard<std::mutex> guard(registry.lock);
+				for (auto &thread : registry.threads)
+				{
+					for (int i = 0; i < ThreadData::SlotCount; i++)
+					{
+						auto slot = thread->slots[i].load(std::memory_order_acquire);
+						if (slot == nullptr)
+							continue;
+
+						size_t k = 0;
+						while (k < names.size() && strcmp(names[k], slot->site) != 0)
+							k++;
+						if (k == names.size())
+						{
+							names.push_back(slot->site);
+							sites.emplace_back(new SiteSnapshot());
+						}
+						sites[k]->queueWait.Add(slot->queueWait);
+						sites[k]->execution.Add(slot->execution);
+						sites[k]->dispatch.Add(slot->dispatch);
+					}
+				}
+			}
+
+			std::string result;
+			char line[256];
+			for (size_t k = 0; k < names.size(); k++)
+			{
+				result += names[k];
+				result += "\n";
+				AppendLine(result, line, sizeof(line), "queue wait", sites[k]->queueWait);
+				AppendLine(result, line, sizeof(line), "execution", sites[k]->execution);
+				AppendLine(result, line, sizeof(line), "dispatch", sites[k]->dispatch);
+			}
+			return result;
+		}
+
+	private:
+		struct SiteSlot
+		{
+			const char *site;
+			LatencyHistogram queueWait;
+			LatencyHistogram execution;
+			LatencyHistogram dispatch;
+		};
+
+		struct SiteSnapshot
+		{
+			LatencySnapshot queueWait;
+			LatencySnapshot execution;
+			LatencySnapshot dispatch;
+		};
+
+		// Histograms of one thread, by call site (open addressing on the site pointer)
+		struct ThreadData
+		{
+			static const int SlotCount = 64;
+			std::atomic<SiteSlot*> slots[SlotCount];
+
+			ThreadData()
+			{
+				for (int i = 0; i < SlotCount; i++)
+					slots[i] = nullptr;
+			}
+
+			~ThreadData()
+			{
+				for (int i = 0; i < SlotCount; i++)
+					delete slots[i].load();
+			}
+
+			SiteSlot *Find(const char *site)
+			{
+				auto start = (size_t)((uintptr_t)site >> 3) % SlotCount;
+				for (int k = 0; k < SlotCount; k++)
+				{
+					auto &entry = slots[(start + k) % SlotCount];
+					auto slot = entry.load(std::memory_order_relaxed);
+					if (slot == nullptr)
+					{
+						slot = new SiteSlot();
+						slot->site = site;
+						entry.store(slot, std::memory_order_release);
+						return slot;
+					}
+					if (slot->site == site)
+						return slot;
+				}
+				return nullptr; // too many call sites
+			}
+		};
+
+		// Per-thread data outlives its thread so that Dump() still sees it
+		struct Registry
+		{
+			std::mutex lock;
+			std::vector<std::unique_ptr<ThreadData>> threads;
+		};
+
+		static std::atomic<bool> &EnabledFlag()
+		{
+			static std::atomic<bool> enabled(false);
+			return enabled;
+		}
+
+		static const char *&CurrentSite()
+		{
+			thread_local const char *site = nullptr;
+			return site;
+		}
+
+		static Registry &GetRegistry()
+		{
+			static Registry registry;
+			return registry;
+		}
+
+		static ThreadData &CurrentThreadData()
+		{
+			thread_local ThreadData *data = nullptr;
+			if (data == nullptr)
+			{
+				auto &registry = GetRegistry();
+				std::lock_guard<std::mutex> guard(registry.lock);
+				registry.threads.emplace_back(new ThreadData());
+				data = registry.threads.back().get();
+			}
+			return *data;
+		}
+
+		static void Record(const char *site, int64_t queueWait, int64_t execution, int64_t dispatch)
+		{
+			auto slot = CurrentThreadData().Find(site);
+			if (slot == nullptr)
+				return;
+
+			slot->queueWait.Record(queueWait < 0 ? 0 : queueWait);
+			slot->execution.Record(execution < 0 ? 0 : execution);
+			if (dispatch >= 0)
+				slot->dispatch.Record(dispatch);
+		}
+
+		static void AppendLine(std::string &result, char *line, size_t size, const char *label, const LatencySnapshot &snapshot)
+		{
+			if (snapshot.total == 0)
+				return;
+
+			snprintf(line, size, "  %-10s n=%llu p50=%.1f p90=%.1f p99=%.1f max=%.1f\n", label,
+				(unsigned long long)snapshot.total,
+				snapshot.Percentile(0.5) / 1000.0,
+				snapshot.Percentile(0.9) / 1000.0,
+				snapshot.Percentile(0.99) / 1000.0,
+				snapshot.Percentile(1.0) / 1000.0);
+			result += line;
+		}
+	};
+} // namespace LUwpUtilities
+
+#endif // #ifndef _LUWPUTILITIES_TASK_TRACE_
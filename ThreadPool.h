@@ -0,0 +1,286 @@
+/**
+ * Work-stealing thread pool in portable C++ (no C++/CX, no <ppltasks.h>); it is the
+ * backend of TH::RunAsync.
+ *
+ *  - Each worker has its own deque: work submitted from a worker goes to the back of its
+ *    deque and is popped from there (LIFO, cache friendly); idle workers steal from the
+ *    front of the others' deques (FIFO).
+ *  - Work submitted from any other thread goes to a global injection queue.
+ *  - Workers that find nothing to do park on a condition variable until work arrives.
+ *  - Work has one of four priorities (WorkPriority); every queue above exists once per lane
+ *    and a worker always takes the most urgent work available when it finishes a task,
+ *    so lower lanes are preempted at task boundaries. In addition, Prefetch and Idle work
+ *    never occupies all the workers: one is always left for UserBlocking and Normal work.
+ */
+
+#ifndef _LUWPUTILITIES_THREAD_POOL_
+#define _LUWPUTILITIES_THREAD_POOL_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace LUwpUtilities
+{
+	// From the most to the least urgent
+	enum class WorkPriority
+	{
+		UserBlocking, // the user is waiting for the result
+		Normal,
+		Prefetch,     // speculative work, e.g. loading the next page
+		Idle          // only when there is nothing else to do, e.g. cache warming
+	};
+
+	class ThreadPool
+	{
+	public:
+		typedef std::function<void()> Work;
+		static const int LaneCount = 4;
+
+		// Start the given number of workers; 0 means one per hardware thread
+		explicit ThreadPool(unsigned workerCount = 0)
+		{
+			if (workerCount == 0)
+				workerCount = std::thread::hardware_concurrency();
+			if (workerCount == 0)
+				workerCount = 2;
+
+			_pending = 0;
+			for (int lane = 0; lane < LaneCount; lane++)
+				_lanePending[lane] = 0;
+			_backgroundRunning = 0;
+			_idle = 0;
+			_stopping = false;
+
+			for (unsigned i = 0; i < workerCount; i++)
+				_workers.emplace_back(new Worker());
+			for (unsigned i = 0; i < workerCount; i++)
+				_workers[i]->thread = std::thread([this, i]() { Run(i); });
+		}
+
+		// Finish all submitted work, then stop the workers
+		~ThreadPool()
+		{
+			{
+				std::lock_guard<std::mutex> guard(_parkLock);
+				_stopping = true;
+			}
+			_parked.notify_all();
+			for (auto &worker : _workers)
+				worker->thread.join();
+		}
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool &operator=(const ThreadPool&) = delete;
+
+		// The pool used by TH
+		static ThreadPool &Default()
+		{
+			static ThreadPool pool;
+			return pool;
+		}
+
+		unsigned WorkerCount() const
+		{
+			return (unsigned)_workers.size();
+		}
+
+		// Queue work to run on one of the workers. Exceptions escaping the work are swallowed.
+		void Submit(Work work, WorkPriority priority = WorkPriority::Normal)
+		{
+			int lane = (int)priority;
+			auto &current = CurrentWorker();
+			if (current.pool == this)
+			{
+				auto &worker = *_workers[current.index];
+				std::lock_guard<std::mutex> guard(worker.lock);
+				worker.tasks[lane].push_back(std::move(work));
+			}
+			else
+			{
+				std::lock_guard<std::mutex> guard(_globalLock);
+				_global[lane].push_back(std::move(work));
+			}
+
+			// Paired with the check in Run(): either we see the idle worker
+			// or the worker sees the new work before it parks
+			_lanePending[lane].fetch_add(1);
+			_pending.fetch_add(1);
+			if (_idle.load() > 0)
+			{
+				std::lock_guard<std::mutex> guard(_parkLock);
+				_parked.notify_one();
+			}
+		}
+
+	private:
+		struct Worker
+		{
+			std::mutex lock;
+			std::deque<Work> tasks[LaneCount];
+			std::thread thread;
+		};
+
+		// Which pool (if any) the calling thread is a worker of
+		struct WorkerIdentity
+		{
+			ThreadPool *pool;
+			unsigned index;
+		};
+
+		static WorkerIdentity &CurrentWorker()
+		{
+			thread_local WorkerIdentity identity = { nullptr, 0 };
+			return identity;
+		}
+
+		// Most urgent work available; set lane to the lane it came from.
+		// Background (Prefetch and Idle) work is returned with a slot of _backgroundRunning reserved.
+		bool TryPop(unsigned self, Work &work, int &lane)
+		{
+			for (lane = 0; lane < LaneCount; lane++)
+			{
+				if (_lanePending[lane].load() == 0)
+					continue;
+
+				if (lane < (int)WorkPriority::Prefetch)
+				{
+					if (TryPop(self, work, _global[lane], lane))
+						return true;
+					continue;
+				}
+
+				// Reserve a background slot first, keeping a worker free for the upper lanes
+				size_t running = _backgroundRunning.load();
+				do
+				{
+					if (_workers.size() > 1 && running >= _workers.size() - 1)
+						return false;
+				} while (!_backgroundRunning.compare_exchange_weak(running, running + 1));
+
+				if (TryPop(self, work, _global[lane], lane))
+					return true;
+				_backgroundRunning.fetch_sub(1);
+			}
+			return false;
+		}
+
+		bool TryPop(unsigned self, Work &work, std::deque<Work> &global, int lane)
+		{
+			// Own deque, newest first
+			{
+				auto &worker = *_workers[self];
+				std::lock_guard<std::mutex> guard(worker.lock);
+				if (!worker.tasks[lane].empty())
+				{
+					work = std::move(worker.tasks[lane].back());
+					worker.tasks[lane].pop_back();
+					return true;
+				}
+			}
+
+			// Global injection queue
+			{
+				std::lock_guard<std::mutex> guard(_globalLock);
+				if (!global.empty())
+				{
+					work = std::move(global.front());
+					global.pop_front();
+					return true;
+				}
+			}
+
+			// Steal the oldest work of another worker
+			auto count = (unsigned)_workers.size();
+			for (unsigned k = 1; k < count; k++)
+			{
+				auto &victim = *_workers[(self + k) % count];
+				std::unique_lock<std::mutex> guard(victim.lock, std::try_to_lock);
+				if (guard.owns_lock() && !victim.tasks[lane].empty())
+				{
+					work = std::move(victim.tasks[lane].front());
+					victim.tasks[lane].pop_front();
+					return true;
+				}
+			}
+
+			return false;
+		}
+
+		void Run(unsigned self)
+		{
+			CurrentWorker().pool = this;
+			CurrentWorker().index = self;
+
+			while (true)
+			{
+				Work work;
+				int lane;
+				if (TryPop(self, work, lane))
+				{
+					bool background = (lane >= (int)WorkPriority::Prefetch);
+					_lanePending[lane].fetch_sub(1);
+					_pending.fetch_sub(1);
+					try
+					{
+						work();
+					}
+					catch (...)
+					{
+					}
+					if (background)
+					{
+						// Background work left queued may now be runnable by a parked worker
+						_backgroundRunning.fetch_sub(1);
+						if (_idle.load() > 0 && _pending.load() > 0)
+						{
+							std::lock_guard<std::mutex> guard(_parkLock);
+							_parked.notify_one();
+						}
+					}
+					continue;
+				}
+
+				// Declare ourselves idle before looking for work again, so that whoever
+				// queues work after our check sees us and wakes us up
+				std::unique_lock<std::mutex> guard(_parkLock);
+				_idle.fetch_add(1);
+				_parked.wait(guard, [this]() { return HasRunnableWork() || (_stopping && _pending.load() == 0); });
+				_idle.fetch_sub(1);
+
+				if (_stopping && _pending.load() == 0)
+				{
+					_parked.notify_all();
+					return;
+				}
+			}
+		}
+
+		// Is there queued work this worker is allowed to run?
+		bool HasRunnableWork()
+		{
+			if (_lanePending[(int)WorkPriority::UserBlocking].load() > 0 || _lanePending[(int)WorkPriority::Normal].load() > 0)
+				return true;
+			return _pending.load() > 0 && (_workers.size() == 1 || _backgroundRunning.load() < _workers.size() - 1);
+		}
+
+		std::vector<std::unique_ptr<Worker>> _workers;
+		std::mutex _globalLock;
+		std::deque<Work> _global[LaneCount];
+
+		std::mutex _parkLock;
+		std::condition_variable _parked;
+		std::atomic<size_t> _pending;                // submitted but not yet started
+		std::atomic<size_t> _lanePending[LaneCount]; // same, per lane
+		std::atomic<size_t> _backgroundRunning;      // Prefetch and Idle work being run
+		std::atomic<unsigned> _idle;                 // parked workers
+		bool _stopping;                              // guarded by _parkLock
+	};
+} // namespace LUwpUtilities
+
+#endif // #ifndef _LUWPUTILITIES_THREAD_POOL_
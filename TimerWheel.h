@@ -0,0 +1,403 @@
+/**
+ * Hierarchical timer wheel and the timer thread driving it (portable C++, no C++/CX).
+ *
+ *  - TimerWheel keeps timers in 4 levels of 64 slots (tick, 64 ticks, 64^2 ticks, 64^3 ticks)
+ *    plus an overflow list; timers are intrusive doubly-linked nodes owned by the caller, so
+ *    Schedule() and Cancel() are O(1) and allocate nothing. Advance(now) runs the expired
+ *    timers; a timer of a higher level is moved down (cascaded) when its slot comes up.
+ *    The wheel has no clock of its own (ticks are whatever the caller says) and is not thread-safe.
+ *  - TimerService owns a wheel ticking in milliseconds and a thread that sleeps until the next
+ *    timer is due; it backs TH::RunDebounced and TH::RunThrottled.
+ */
+
+#ifndef _LUWPUTILITIES_TIMER_WHEEL_
+#define _LUWPUTILITIES_TIMER_WHEEL_
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace LUwpUtilities
+{
+	class TimerWheel
+	{
+	public:
+		typedef std::function<void()> Callback;
+		static const int SlotBits = 6;
+		static const int SlotCount = 1 << SlotBits;
+		static const int LevelCount = 4;
+		static const uint64_t Never = UINT64_MAX;
+
+		struct Link
+		{
+			Link *prev;
+			Link *next;
+		};
+
+		// A timer must be cancelled (or have fired) before it is destroyed or moved
+		class Timer : private Link
+		{
+		public:
+			Callback callback;
+
+			Timer() : _expiry(0), _level(0), _slot(0)
+			{
+				prev = next = nullptr;
+			}
+
+			Timer(const Timer&) = delete;
+			Timer &operator=(const Timer&) = delete;
+
+			bool IsScheduled() const
+			{
+				return next != nullptr;
+			}
+
+			uint64_t Expiry() const
+			{
+				return _expiry;
+			}
+
+		private:
+			friend class TimerWheel;
+			uint64_t _expiry;
+			int _level; // LevelCount for the overflow list, -1 while being fired or cascaded
+			int _slot;
+		};
+
+		explicit TimerWheel(uint64_t now = 0) : _now(now), _count(0)
+		{
+			for (int level = 0; level < LevelCount; level++)
+			{
+				_occupied[level] = 0;
+				for (int slot = 0; slot < SlotCount; slot++)
+					Clear(_slots[level][slot]);
+			}
+			Clear(_overflow);
+		}
+
+		TimerWheel(const TimerWheel&) = delete;
+		TimerWheel &operator=(const TimerWheel&) = delete;
+
+		uint64_t Now() const
+		{
+			return _now;
+		}
+
+		// Number of scheduled timers
+		size_t Count() const
+		{
+			return _count;
+		}
+
+		// Run the timer's callback in the Advance() that reaches the expiry tick
+		// (a timer due now or in the past runs at the next tick); reschedule it if it is scheduled
+		void Schedule(Timer &timer, uint64_t expiry)
+		{
+			if (timer.IsScheduled())
+				Unlink(timer);
+			else
+				_count++;
+
+			timer._expiry = expiry;
+			Insert(timer, _now + 1);
+		}
+
+		// Return false if the timer was not scheduled
+		bool Cancel(Timer &timer)
+		{
+			if (!timer.IsScheduled())
+				return false;
+
+			Unlink(timer);
+			_count--;
+			return true;
+		}
+
+		// Earliest tick at which Advance() has something to do (Never if no timer is scheduled);
+		// the driving thread can sleep until then
+		uint64_t NextTick() const
+		{
+			if (_count == 0)
+				return Never;
+
+			uint64_t next = Never;
+			for (int level = 0; level < LevelCount; level++)
+			{
+				if (_occupied[level] == 0)
+					continue;
+
+				// Occupied slots are always after the current one
+				int shift = level * SlotBits;
+				uint64_t tick = (((_now >> shift) & ~uint64_t(SlotCount - 1)) | LowestBit(_occupied[level])) << shift;
+				if (tick < next)
+					next = tick;
+			}
+			if (_overflow.next != &_overflow)
+			{
+				int shift = LevelCount * SlotBits;
+				uint64_t tick = ((_now >> shift) + 1) << shift;
+				if (tick < next)
+					next = tick;
+			}
+			return next;
+		}
+
+		// Move the clock forward to now, running the callbacks of the timers expiring on the way
+		// in expiry order; return the number of timers run. Callbacks may schedule and cancel timers.
+		size_t Advance(uint64_t now)
+		{
+			size_t fired = 0;
+			while (_now < now)
+			{
+				// Jump over the ticks where nothing happens
+				uint64_t next = NextTick();
+				if (next > now)
+				{
+					_now = now;
+					break;
+				}
+
+				_now = next;
+				if ((_now & ((uint64_t(1) << (LevelCount * SlotBits)) - 1)) == 0)
+					Cascade(_overflow);
+				for (int level = LevelCount - 1; level > 0; level--)
+				{
+					int shift = level * SlotBits;
+					if ((_now & ((uint64_t(1) << shift) - 1)) == 0)
+					{
+						int slot = (int)((_now >> shift) & (SlotCount - 1));
+						_occupied[level] &= ~(uint64_t(1) << slot);
+						Cascade(_slots[level][slot]);
+					}
+				}
+				fired += Fire((int)(_now & (SlotCount - 1)));
+			}
+			return fired;
+		}
+
+	private:
+		static void Clear(Link &list)
+		{
+			list.prev = list.next = &list;
+		}
+
+		static bool IsEmpty(const Link &list)
+		{
+			return list.next == &list;
+		}
+
+		static void PushBack(Link &list, Link &link)
+		{
+			link.prev = list.prev;
+			link.next = &list;
+			list.prev->next = &link;
+			list.prev = &link;
+		}
+
+		// Move the whole list to an empty one
+		static void Splice(Link &from, Link &to)
+		{
+			if (IsEmpty(from))
+			{
+				Clear(to);
+				return;
+			}
+			to.next = from.next;
+			to.prev = from.prev;
+			to.next->prev = &to;
+			to.prev->next = &to;
+			Clear(from);
+		}
+
+		static int LowestBit(uint64_t bits)
+		{
+			int index = 0;
+			while ((bits & 1) == 0)
+			{
+				bits >>= 1;
+				index++;
+			}
+			return index;
+		}
+
+		// Put the timer in the lowest level whose span (from the current tick) contains its expiry
+		void Insert(Timer &timer, uint64_t earliest)
+		{
+			uint64_t expiry = (timer._expiry < earliest ? earliest : timer._expiry);
+			for (int level = 0; level < LevelCount; level++)
+			{
+				int shift = (level + 1) * SlotBits;
+				if ((expiry >> shift) == (_now >> shift))
+				{
+					int slot = (int)((expiry >> (level * SlotBits)) & (SlotCount - 1));
+					PushBack(_slots[level][slot], timer);
+					_occupied[level] |= uint64_t(1) << slot;
+					timer._level = level;
+					timer._slot = slot;
+					return;
+				}
+			}
+			PushBack(_overflow, timer);
+			timer._level = LevelCount;
+		}
+
+		void Unlink(Timer &timer)
+		{
+			timer.prev->next = timer.next;
+			timer.next->prev = timer.prev;
+			if (timer._level >= 0 && timer._level < LevelCount && IsEmpty(_slots[timer._level][timer._slot]))
+				_occupied[timer._level] &= ~(uint64_t(1) << timer._slot);
+			timer.prev = timer.next = nullptr;
+		}
+
+		// Re-insert the timers of a slot whose time has come into the lower levels
+		void Cascade(Link &list)
+		{
+			Link pending;
+			Splice(list, pending);
+			for (auto link = pending.next; link != &pending; link = link->next)
+				static_cast<Timer*>(link)->_level = -1;
+			while (!IsEmpty(pending))
+			{
+				auto &timer = *static_cast<Timer*>(pending.next);
+				Unlink(timer);
+				Insert(timer, _now);
+			}
+		}
+
+		size_t Fire(int slot)
+		{
+			Link firing;
+			Splice(_slots[0][slot], firing);
+			_occupied[0] &= ~(uint64_t(1) << slot);
+			for (auto link = firing.next; link != &firing; link = link->next)
+				static_cast<Timer*>(link)->_level = -1;
+
+			size_t fired = 0;
+			while (!IsEmpty(firing))
+			{
+				auto &timer = *static_cast<Timer*>(firing.next);
+				Unlink(timer);
+				_count--;
+				fired++;
+
+				// The callback may destroy or reschedule the timer: do not touch it afterwards
+				auto callback = timer.callback;
+				try
+				{
+					if (callback)
+						callback();
+				}
+				catch (...)
+				{
+					// Keep the other timers of the slot for the next tick
+					while (!IsEmpty(firing))
+					{
+						auto &rest = *static_cast<Timer*>(firing.next);
+						Unlink(rest);
+						Insert(rest, _now + 1);
+					}
+					throw;
+				}
+			}
+			return fired;
+		}
+
+		uint64_t _now;
+		size_t _count;
+		Link _slots[LevelCount][SlotCount];
+		uint64_t _occupied[LevelCount]; // bit per non-empty slot
+		Link _overflow;                  // beyond the span of the top level
+	};
+
+	// A TimerWheel in milliseconds driven by its own thread. Callbacks run on that thread with
+	// Lock() held, so they must be short (post the real work elsewhere); they may use the service.
+	class TimerService
+	{
+	public:
+		typedef std::chrono::steady_clock Clock;
+
+		TimerService() : _start(Clock::now()), _stopping(false)
+		{
+			_thread = std::thread([this]() { Run(); });
+		}
+
+		~TimerService()
+		{
+			{
+				std::lock_guard<std::recursive_mutex> guard(_lock);
+				_stopping = true;
+			}
+			_changed.notify_all();
+			_thread.join();
+		}
+
+		TimerService(const TimerService&) = delete;
+		TimerService &operator=(const TimerService&) = delete;
+
+		static TimerService &Default()
+		{
+			static TimerService service;
+			return service;
+		}
+
+		// Guards the wheel; hold it to update a timer together with the state its callback uses
+		std::recursive_mutex &Lock()
+		{
+			return _lock;
+		}
+
+		void Schedule(TimerWheel::Timer &timer, std::chrono::milliseconds delay)
+		{
+			std::lock_guard<std::recursive_mutex> guard(_lock);
+			_wheel.Schedule(timer, Elapsed() + (delay.count() > 0 ? (uint64_t)delay.count() : 0));
+			_changed.notify_one();
+		}
+
+		bool Cancel(TimerWheel::Timer &timer)
+		{
+			std::lock_guard<std::recursive_mutex> guard(_lock);
+			return _wheel.Cancel(timer);
+		}
+
+	private:
+		uint64_t Elapsed() const
+		{
+			return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - _start).count();
+		}
+
+		void Run()
+		{
+			std::unique_lock<std::recursive_mutex> guard(_lock);
+			while (!_stopping)
+			{
+				try
+				{
+					_wheel.Advance(Elapsed());
+				}
+				catch (...)
+				{
+				}
+
+				auto next = _wheel.NextTick();
+				if (next == TimerWheel::Never)
+					_changed.wait(guard);
+				else if (next > Elapsed())
+					_changed.wait_until(guard, _start + std::chrono::milliseconds(next));
+			}
+		}
+
+		Clock::time_point _start;
+		std::recursive_mutex _lock;
+		std::condition_variable_any _changed;
+		TimerWheel _wheel;
+		bool _stopping;
+		std::thread _thread;
+	};
+} // namespace LUwpUtilities
+
+#endif // #ifndef _LUWPUTILITIES_TIMER_WHEEL_
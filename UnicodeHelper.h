@@ -0,0 +1,471 @@
+/**
+ * Fast UTF-8 <-> UTF-16 transcoding that does not depend on C++/CX or the OS.
+ *
+ *  - Utf8ToUtf16Length(src, len) computes the exact number of UTF-16 code units so that
+ *    the destination can be allocated once
+ *  - Utf8ToUtf16(src, len, dest) writes them to dest
+ *  - Utf16ToUtf8Length(src, len) and Utf16ToUtf8(src, len, dest) do the same in reverse
+ *  - Utf16Arena transcodes a whole batch of UTF-8 strings into one reusable block of memory
+ *
+ * Both directions validate the input as they go: each maximal invalid UTF-8 subsequence
+ * and each unpaired surrogate is replaced by U+FFFD (the same policy as MultiByteToWideChar
+ * and WideCharToMultiByte) so that the length and the conversion always agree.
+ * Runs of ASCII are processed 16 at a time with SSE2 (x86/x64) or NEON (ARM64);
+ * other CPUs use a scalar loop.
+ */
+
+#ifndef _LUWPUTILITIES_UNICODE_HELPER_
+#define _LUWPUTILITIES_UNICODE_HELPER_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(_M_X64) || defined(__x86_64__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define LUU_SIMD_SSE2
+#include <emmintrin.h>
+#elif defined(_M_ARM64) || defined(__aarch64__)
+#define LUU_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+namespace LUwpUtilities
+{
+	namespace Unicode
+	{
+		const char16_t ReplacementCharacter = 0xFFFD;
+		// Returned by DecodeSequence for an invalid subsequence
+		const uint32_t InvalidCodePoint = 0x110000;
+
+		// Number of leading ASCII bytes in [src, src + len)
+		inline size_t AsciiPrefixLength(const unsigned char *src, size_t len)
+		{
+			size_t i = 0;
+#if defined(LUU_SIMD_SSE2)
+			for (; i + 16 <= len; i += 16)
+			{
+				int mask = _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)));
+				if (mask != 0)
+				{
+					while ((mask & 1) == 0)
+					{
+						mask >>= 1;
+						i++;
+					}
+					return i;
+				}
+			}
+#elif defined(LUU_SIMD_NEON)
+			for (; i + 16 <= len; i += 16)
+			{
+				if (vmaxvq_u8(vld1q_u8(src + i)) >= 0x80)
+					break;
+			}
+#endif
+			for (; i + 8 <= len; i += 8)
+			{
+				uint64_t block;
+				memcpy(&block, src + i, 8);
+				if ((block & 0x8080808080808080ULL) != 0)
+					break;
+			}
+			while (i < len && src[i] < 0x80)
+				i++;
+			return i;
+		}
+
+		// Widen count ASCII bytes to UTF-16
+		inline void WidenAscii(const unsigned char *src, size_t count, char16_t *dest)
+		{
+			size_t i = 0;
+#if defined(LUU_SIMD_SSE2)
+			const __m128i zero = _mm_setzero_si128();
+			for (; i + 16 <= count; i += 16)
+			{
+				__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i), _mm_unpacklo_epi8(v, zero));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i + 8), _mm_unpackhi_epi8(v, zero));
+			}
+#elif defined(LUU_SIMD_NEON)
+			for (; i + 16 <= count; i += 16)
+			{
+				uint8x16_t v = vld1q_u8(src + i);
+				vst1q_u16(reinterpret_cast<uint16_t*>(dest + i), vmovl_u8(vget_low_u8(v)));
+				vst1q_u16(reinterpret_cast<uint16_t*>(dest + i + 8), vmovl_u8(vget_high_u8(v)));
+			}
+#endif
+			for (; i < count; i++)
+				dest[i] = src[i];
+		}
+
+		// Decode one (possibly invalid) non-ASCII sequence starting at src[0];
+		// store the code point (or InvalidCodePoint) in cp and return the number of bytes consumed.
+		inline size_t DecodeSequence(const unsigned char *src, size_t len, uint32_t &cp)
+		{
+			unsigned char lead = src[0];
+			size_t need;
+			unsigned char lo = 0x80, hi = 0xBF;
+
+			if (lead >= 0xC2 && lead <= 0xDF)
+			{
+				need = 1;
+				cp = lead & 0x1F;
+			}
+			else if (lead >= 0xE0 && lead <= 0xEF)
+			{
+				need = 2;
+				cp = lead & 0x0F;
+				if (lead == 0xE0)
+					lo = 0xA0; // overlong
+				else if (lead == 0xED)
+					hi = 0x9F; // surrogates
+			}
+			else if (lead >= 0xF0 && lead <= 0xF4)
+			{
+				need = 3;
+				cp = lead & 0x07;
+				if (lead == 0xF0)
+					lo = 0x90; // overlong
+				else if (lead == 0xF4)
+					hi = 0x8F; // above U+10FFFF
+			}
+			else
+			{
+				cp = InvalidCodePoint;
+				return 1;
+			}
+
+			// Only the first continuation byte has the restricted range
+			for (size_t k = 1; k <= need; k++)
+			{
+				if (k >= len || src[k] < lo || src[k] > hi)
+				{
+					cp = InvalidCodePoint;
+					return k;
+				}
+				cp = (cp << 6) | (src[k] & 0x3F);
+				lo = 0x80;
+				hi = 0xBF;
+			}
+
+			return need + 1;
+		}
+
+		// Number of leading UTF-16 code units below 0x80 in [src, src + len)
+		inline size_t AsciiPrefixLength(const char16_t *src, size_t len)
+		{
+			size_t i = 0;
+#if defined(LUU_SIMD_SSE2)
+			const __m128i nonAscii = _mm_set1_epi16((short)0xFF80);
+			const __m128i zero = _mm_setzero_si128();
+			for (; i + 8 <= len; i += 8)
+			{
+				__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+				if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(v, nonAscii), zero)) != 0xFFFF)
+					break;
+			}
+#elif defined(LUU_SIMD_NEON)
+			for (; i + 8 <= len; i += 8)
+			{
+				if (vmaxvq_u16(vld1q_u16(reinterpret_cast<const uint16_t*>(src + i))) >= 0x80)
+					break;
+			}
+#endif
+			while (i < len && src[i] < 0x80)
+				i++;
+			return i;
+		}
+
+		// Narrow count ASCII UTF-16 code units to bytes
+		inline void NarrowAscii(const char16_t *src, size_t count, unsigned char *dest)
+		{
+			size_t i = 0;
+#if defined(LUU_SIMD_SSE2)
+			for (; i + 16 <= count; i += 16)
+			{
+				__m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+				__m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 8));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i), _mm_packus_epi16(lo, hi));
+			}
+#elif defined(LUU_SIMD_NEON)
+			for (; i + 8 <= count; i += 8)
+				vst1_u8(dest + i, vmovn_u16(vld1q_u16(reinterpret_cast<const uint16_t*>(src + i))));
+#endif
+			for (; i < count; i++)
+				dest[i] = (unsigned char)src[i];
+		}
+
+		// Decode one non-ASCII code point (or unpaired surrogate) starting at src[0];
+		// store the code point (U+FFFD for an unpaired surrogate) in cp and return the number of units consumed.
+		inline size_t DecodeSequence(const char16_t *src, size_t len, uint32_t &cp)
+		{
+			char16_t u = src[0];
+			if (u < 0xD800 || u > 0xDFFF)
+			{
+				cp = u;
+				return 1;
+			}
+			if (u <= 0xDBFF && len > 1 && src[1] >= 0xDC00 && src[1] <= 0xDFFF)
+			{
+				cp = 0x10000 + ((uint32_t(u) - 0xD800) << 10) + (uint32_t(src[1]) - 0xDC00);
+				return 2;
+			}
+			cp = ReplacementCharacter;
+			return 1;
+		}
+
+		inline size_t Utf8Bytes(uint32_t cp)
+		{
+			return cp < 0x80 ? 1 : cp < 0x800 ? 2 : cp < 0x10000 ? 3 : 4;
+		}
+
+#if defined(LUU_SIMD_SSE2)
+		// Number of UTF-8 bytes for the 8 code units at src if none of them is a surrogate; 0 otherwise
+		inline size_t Utf8BytesNoSurrogate(const char16_t *src)
+		{
+			const __m128i bias = _mm_set1_epi16((short)0x8000);
+			__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+			__m128i surrogates = _mm_cmpeq_epi16(_mm_and_si128(v, _mm_set1_epi16((short)0xF800)), _mm_set1_epi16((short)0xD800));
+			if (_mm_movemask_epi8(surrogates) != 0)
+				return 0;
+
+			// Unsigned comparison via signed comparison of biased values
+			__m128i b = _mm_xor_si128(v, bias);
+			__m128i ge80 = _mm_cmpgt_epi16(b, _mm_set1_epi16((short)(0x007F ^ 0x8000)));
+			__m128i ge800 = _mm_cmpgt_epi16(b, _mm_set1_epi16((short)(0x07FF ^ 0x8000)));
+			// Each lane is 0 or -1 so the sum of the two masks is minus the extra bytes
+			__m128i extra = _mm_madd_epi16(_mm_add_epi16(ge80, ge800), _mm_set1_epi16(-1));
+			extra = _mm_add_epi32(extra, _mm_shuffle_epi32(extra, _MM_SHUFFLE(1, 0, 3, 2)));
+			extra = _mm_add_epi32(extra, _mm_shuffle_epi32(extra, _MM_SHUFFLE(2, 3, 0, 1)));
+			return 8 + (size_t)_mm_cvtsi128_si32(extra);
+		}
+#endif
+	} // namespace Unicode
+
+	// Exact number of UTF-16 code units Utf8ToUtf16 writes for the input.
+	// If valid is not null, it is set to whether the input is well-formed UTF-8.
+	inline size_t Utf8ToUtf16Length(const char *src, size_t len, bool *valid = nullptr)
+	{
+		auto s = reinterpret_cast<const unsigned char*>(src);
+		size_t i = 0, units = 0;
+		bool ok = true;
+
+		while (i < len)
+		{
+			size_t ascii = Unicode::AsciiPrefixLength(s + i, len - i);
+			i += ascii;
+			units += ascii;
+
+			// Non-ASCII run
+			while (i < len && s[i] >= 0x80)
+			{
+				uint32_t cp;
+				size_t n = Unicode::DecodeSequence(s + i, len - i, cp);
+				i += n;
+				if (cp == Unicode::InvalidCodePoint)
+				{
+					ok = false;
+					units++;
+				}
+				else
+					units += (cp >= 0x10000 ? 2 : 1);
+			}
+		}
+
+		if (valid != nullptr)
+			*valid = ok;
+		return units;
+	}
+
+	// Transcode len bytes of UTF-8 to dest which must hold Utf8ToUtf16Length(src, len) units
+	// (len units always suffice). Return the number of code units written.
+	inline size_t Utf8ToUtf16(const char *src, size_t len, char16_t *dest)
+	{
+		auto s = reinterpret_cast<const unsigned char*>(src);
+		size_t i = 0;
+		char16_t *d = dest;
+
+		while (i < len)
+		{
+			size_t ascii = Unicode::AsciiPrefixLength(s + i, len - i);
+			Unicode::WidenAscii(s + i, ascii, d);
+			i += ascii;
+			d += ascii;
+
+			while (i < len && s[i] >= 0x80)
+			{
+				uint32_t cp;
+				i += Unicode::DecodeSequence(s + i, len - i, cp);
+				if (cp == Unicode::InvalidCodePoint)
+					*d++ = Unicode::ReplacementCharacter;
+				else if (cp >= 0x10000)
+				{
+					cp -= 0x10000;
+					*d++ = char16_t(0xD800 + (cp >> 10));
+					*d++ = char16_t(0xDC00 + (cp & 0x3FF));
+				}
+				else
+					*d++ = char16_t(cp);
+			}
+		}
+
+		return d - dest;
+	}
+
+	// Exact number of bytes Utf16ToUtf8 writes for the input.
+	// If valid is not null, it is set to whether the input has no unpaired surrogate.
+	inline size_t Utf16ToUtf8Length(const char16_t *src, size_t len, bool *valid = nullptr)
+	{
+		size_t i = 0, bytes = 0;
+		bool ok = true;
+
+		while (i < len)
+		{
+			size_t ascii = Unicode::AsciiPrefixLength(src + i, len - i);
+			i += ascii;
+			bytes += ascii;
+
+			// Non-ASCII run: blocks without surrogates (e.g. CJK text) are counted 8 at a time
+			while (i < len && src[i] >= 0x80)
+			{
+#if defined(LUU_SIMD_SSE2)
+				if (i + 8 <= len)
+				{
+					size_t n = Unicode::Utf8BytesNoSurrogate(src + i);
+					if (n > 0)
+					{
+						i += 8;
+						bytes += n;
+						continue;
+					}
+				}
+#endif
+				uint32_t cp;
+				size_t n = Unicode::DecodeSequence(src + i, len - i, cp);
+				if (cp == Unicode::ReplacementCharacter && src[i] != Unicode::ReplacementCharacter)
+					ok = false;
+				i += n;
+				bytes += Unicode::Utf8Bytes(cp);
+			}
+		}
+
+		if (valid != nullptr)
+			*valid = ok;
+		return bytes;
+	}
+
+	// Transcode len UTF-16 code units to dest which must hold Utf16ToUtf8Length(src, len) bytes
+	// (3 * len bytes always suffice). Return the number of bytes written.
+	inline size_t Utf16ToUtf8(const char16_t *src, size_t len, char *dest)
+	{
+		auto d = reinterpret_cast<unsigned char*>(dest);
+		size_t i = 0;
+
+		while (i < len)
+		{
+			size_t ascii = Unicode::AsciiPrefixLength(src + i, len - i);
+			Unicode::NarrowAscii(src + i, ascii, d);
+			i += ascii;
+			d += ascii;
+
+			while (i < len && src[i] >= 0x80)
+			{
+				uint32_t cp;
+				i += Unicode::DecodeSequence(src + i, len - i, cp);
+				if (cp < 0x800)
+				{
+					*d++ = (unsigned char)(0xC0 | (cp >> 6));
+					*d++ = (unsigned char)(0x80 | (cp & 0x3F));
+				}
+				else if (cp < 0x10000)
+				{
+					*d++ = (unsigned char)(0xE0 | (cp >> 12));
+					*d++ = (unsigned char)(0x80 | ((cp >> 6) & 0x3F));
+					*d++ = (unsigned char)(0x80 | (cp & 0x3F));
+				}
+				else
+				{
+					*d++ = (unsigned char)(0xF0 | (cp >> 18));
+					*d++ = (unsigned char)(0x80 | ((cp >> 12) & 0x3F));
+					*d++ = (unsigned char)(0x80 | ((cp >> 6) & 0x3F));
+					*d++ = (unsigned char)(0x80 | (cp & 0x3F));
+				}
+			}
+		}
+
+		return d - reinterpret_cast<unsigned char*>(dest);
+	}
+
+	// A UTF-8 string given by pointer and length (not necessarily null-terminated)
+	struct Utf8Slice
+	{
+		const char *data;
+		size_t length;
+	};
+
+	// Transcode many UTF-8 strings (e.g. all the fields of a page of items) into a single block.
+	// Keep the arena around and reuse it for the next batch: the memory is only reallocated
+	// when a batch is larger than all the previous ones.
+	class Utf16Arena
+	{
+	public:
+		Utf16Arena() : _growths(0)
+		{
+		}
+
+		// Forget the previous batch (and invalidate its pointers) but keep the memory
+		void Reset()
+		{
+			_spans.clear();
+		}
+
+		// Transcode all count strings in one pass, replacing the previous batch
+		void Transcode(const Utf8Slice *items, size_t count)
+		{
+			Reset();
+
+			// The UTF-16 length never exceeds the UTF-8 length so the sum is an upper bound
+			size_t capacity = 0;
+			for (size_t i = 0; i < count; i++)
+				capacity += items[i].length;
+			if (capacity > _buffer.size())
+			{
+				_buffer.resize(capacity);
+				_growths++;
+			}
+			if (_spans.capacity() < count)
+				_spans.reserve(count);
+
+			size_t used = 0;
+			for (size_t i = 0; i < count; i++)
+			{
+				Span span;
+				span.offset = used;
+				span.length = (items[i].data == nullptr ? 0 : Utf8ToUtf16(items[i].data, items[i].length, _buffer.data() + used));
+				used += span.length;
+				_spans.push_back(span);
+			}
+		}
+
+		size_t Count() const { return _spans.size(); }
+		const char16_t *Data(size_t i) const { return _buffer.data() + _spans[i].offset; }
+		size_t Length(size_t i) const { return _spans[i].length; }
+
+		// Number of times the arena memory had to grow
+		size_t Growths() const { return _growths; }
+
+	private:
+		struct Span
+		{
+			size_t offset;
+			size_t length;
+		};
+
+		std::vector<char16_t> _buffer;
+		std::vector<Span> _spans;
+		size_t _growths;
+	};
+} // namespace LUwpUtilities
+
+#endif // #ifndef _LUWPUTILITIES_UNICODE_HELPER_
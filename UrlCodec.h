@@ -0,0 +1,484 @@
+/**
+ * RFC 3986 percent-encoding and decoding of UTF-8 text, and query strings (portable C++, no C++/CX).
+ *
+ *  - UrlEncodedLength(src, len) and UrlEncode(src, len, dest) percent-encode every byte but the
+ *    unreserved characters (ALPHA DIGIT - . _ ~), i.e. encodeURIComponent
+ *  - UrlDecode(src, len, dest) decodes %HH escapes (and '+' as space if asked); the output is never
+ *    longer than the input so dest may be src; malformed escapes are copied as they are
+ *  - QueryBuilder computes the exact length of "k1=v1&k2=v2" first and writes it in one allocation
+ *  - ParsedQuery decodes a query string into one buffer and gives the parameters as slices of it
+ *  - NormalizeUrl gives equivalent URLs the same spelling, e.g. to use them as keys; UrlAuthority
+ *    gives the host (and port) of a URL
+ *
+ * Characters are classified with lookup tables; runs of unreserved characters (when encoding) or
+ * of characters without '%' (when decoding) are copied 16 bytes at a time with SSE2 or NEON. After
+ * a block that does not qualify, the next 16 to 256 bytes go one at a time, so that text with
+ * escapes everywhere is not slowed down by blocks that never qualify.
+ */
+
+#ifndef _LUWPUTILITIES_URL_CODEC_
+#define _LUWPUTILITIES_URL_CODEC_
+
+#include <cctype>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include "UnicodeHelper.h"
+
+namespace LUwpUtilities
+{
+	namespace Url
+	{
+		struct Tables
+		{
+			bool unreserved[256];
+			signed char hex[256]; // value of the hexadecimal digit or -1
+
+			Tables()
+			{
+				for (int c = 0; c < 256; c++)
+				{
+					unreserved[c] = (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') ||
+						c == '-' || c == '.' || c == '_' || c == '~';
+					hex[c] = (c >= '0' && c <= '9' ? c - '0' : c >= 'A' && c <= 'F' ? c - 'A' + 10 : c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1);
+				}
+			}
+		};
+
+		inline const Tables &GetTables()
+		{
+			static const Tables tables;
+			return tables;
+		}
+
+		const char HexDigits[] = "0123456789ABCDEF";
+
+		// Are the 16 bytes at src all unreserved?
+		inline bool IsUnreservedBlock(const unsigned char *src)
+		{
+#if defined(LUU_SIMD_SSE2)
+			// Bytes >= 0x80 are negative as signed and fail every range
+			__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+			__m128i lower = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('z' + 1)));
+			__m128i upper = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('Z' + 1)));
+			__m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+			__m128i mark = _mm_or_si128(
+				_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('-')), _mm_cmpeq_epi8(v, _mm_set1_epi8('.'))),
+				_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('_')), _mm_cmpeq_epi8(v, _mm_set1_epi8('~'))));
+			__m128i ok = _mm_or_si128(_mm_or_si128(lower, upper), _mm_or_si128(digit, mark));
+			return _mm_movemask_epi8(ok) == 0xFFFF;
+#elif defined(LUU_SIMD_NEON)
+			uint8x16_t v = vld1q_u8(src);
+			uint8x16_t lower = vandq_u8(vcgeq_u8(v, vdupq_n_u8('a')), vcleq_u8(v, vdupq_n_u8('z')));
+			uint8x16_t upper = vandq_u8(vcgeq_u8(v, vdupq_n_u8('A')), vcleq_u8(v, vdupq_n_u8('Z')));
+			uint8x16_t digit = vandq_u8(vcgeq_u8(v, vdupq_n_u8('0')), vcleq_u8(v, vdupq_n_u8('9')));
+			uint8x16_t mark = vorrq_u8(
+				vorrq_u8(vceqq_u8(v, vdupq_n_u8('-')), vceqq_u8(v, vdupq_n_u8('.'))),
+				vorrq_u8(vceqq_u8(v, vdupq_n_u8('_')), vceqq_u8(v, vdupq_n_u8('~'))));
+			return vminvq_u8(vorrq_u8(vorrq_u8(lower, upper), vorrq_u8(digit, mark))) == 0xFF;
+#else
+			const auto &tables = GetTables();
+			for (int i = 0; i < 16; i++)
+			{
+				if (!tables.unreserved[src[i]])
+					return false;
+			}
+			return true;
+#endif
+		}
+
+		// Does the 16-byte block at src contain no '%' (nor '+' if plus is set)?
+		inline bool IsPlainBlock(const unsigned char *src, bool plus)
+		{
+#if defined(LUU_SIMD_SSE2)
+			__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+			__m128i special = _mm_cmpeq_epi8(v, _mm_set1_epi8('%'));
+			if (plus)
+				special = _mm_or_si128(special, _mm_cmpeq_epi8(v, _mm_set1_epi8('+')));
+			return _mm_movemask_epi8(special) == 0;
+#elif defined(LUU_SIMD_NEON)
+			uint8x16_t v = vld1q_u8(src);
+			uint8x16_t special = vceqq_u8(v, vdupq_n_u8('%'));
+			if (plus)
+				special = vorrq_u8(special, vceqq_u8(v, vdupq_n_u8('+')));
+			return vmaxvq_u8(special) == 0;
+#else
+			for (int i = 0; i < 16; i++)
+			{
+				if (src[i] == '%' || (plus && src[i] == '+'))
+					return false;
+			}
+			return true;
+#endif
+		}
+	} // namespace Url
+
+	// Length of UrlEncode(src, len)
+	inline size_t UrlEncodedLength(const char *src, size_t len)
+	{
+		auto s = reinterpret_cast<const unsigned char*>(src);
+		const auto &tables = Url::GetTables();
+		size_t result = len;
+		size_t i = 0;
+		size_t run = 16;
+		while (i < len)
+		{
+			if (i + 16 <= len && Url::IsUnreservedBlock(s + i))
+			{
+				i += 16;
+				run = 16;
+				continue;
+			}
+			// Byte by byte for a while after a block with something to escape, longer after each
+			// such block in a row: blocks are tried again when it pays off
+			for (size_t end = (len - i < run ? len : i + run); i < end; i++)
+			{
+				if (!tables.unreserved[s[i]])
+					result += 2;
+			}
+			run = (run < 256 ? 2 * run : run);
+		}
+		return result;
+	}
+
+	// Percent-encode src into dest (of UrlEncodedLength(src, len) bytes); return the number of bytes written
+	inline size_t UrlEncode(const char *src, size_t len, char *dest)
+	{
+		auto s = reinterpret_cast<const unsigned char*>(src);
+		const auto &tables = Url::GetTables();
+		size_t o = 0;
+		size_t i = 0;
+		size_t run = 16;
+		while (i < len)
+		{
+			if (i + 16 <= len && Url::IsUnreservedBlock(s + i))
+			{
+				memcpy(dest + o, s + i, 16);
+				i += 16;
+				o += 16;
+				run = 16;
+				continue;
+			}
+
+			for (size_t end = (len - i < run ? len : i + run); i < end; i++)
+			{
+				unsigned char c = s[i];
+				if (tables.unreserved[c])
+				{
+					dest[o++] = (char)c;
+				}
+				else
+				{
+					dest[o++] = '%';
+					dest[o++] = Url::HexDigits[c >> 4];
+					dest[o++] = Url::HexDigits[c & 15];
+				}
+			}
+			run = (run < 256 ? 2 * run : run);
+		}
+		return o;
+	}
+
+	inline std::string UrlEncode(const std::string &text)
+	{
+		std::string result(UrlEncodedLength(text.data(), text.size()), '\0');
+		if (!result.empty())
+			UrlEncode(text.data(), text.size(), &result[0]);
+		return result;
+	}
+
+	// Decode %HH escapes (and '+' to a space if plusAsSpace, as in HTML forms) into dest, which may be src;
+	// return the number of bytes written (at most len)
+	inline size_t UrlDecode(const char *src, size_t len, char *dest, bool plusAsSpace = false)
+	{
+		auto s = reinterpret_cast<const unsigned char*>(src);
+		const auto &tables = Url::GetTables();
+		size_t o = 0;
+		size_t i = 0;
+		size_t run = 16;
+		while (i < len)
+		{
+			if (i + 16 <= len && Url::IsPlainBlock(s + i, plusAsSpace))
+			{
+				memmove(dest + o, s + i, 16);
+				i += 16;
+				o += 16;
+				run = 16;
+				continue;
+			}
+
+			// An escape may end past the run
+			for (size_t end = (len - i < run ? len : i + run); i < end;)
+			{
+				unsigned char c = s[i];
+				if (c == '%' && i + 2 < len && tables.hex[s[i + 1]] >= 0 && tables.hex[s[i + 2]] >= 0)
+				{
+					dest[o++] = (char)((tables.hex[s[i + 1]] << 4) | tables.hex[s[i + 2]]);
+					i += 3;
+				}
+				else
+				{
+					dest[o++] = (c == '+' && plusAsSpace ? ' ' : (char)c);
+					i++;
+				}
+			}
+			run = (run < 256 ? 2 * run : run);
+		}
+		return o;
+	}
+
+	inline std::string UrlDecode(const std::string &text, bool plusAsSpace = false)
+	{
+		std::string result(text);
+		result.resize(UrlDecode(result.data(), result.size(), &result[0], plusAsSpace));
+		return result;
+	}
+
+	// Builds "key1=value1&key2=value2" with the keys and values percent-encoded.
+	// Only pointers are kept: the strings must stay alive until the query is written.
+	class QueryBuilder
+	{
+	public:
+		void Add(const char *key, size_t keyLength, const char *value, size_t valueLength)
+		{
+			Parameter parameter = { key, keyLength, value, valueLength };
+			_parameters.push_back(parameter);
+		}
+
+		void Add(const std::string &key, const std::string &value)
+		{
+			Add(key.data(), key.size(), value.data(), value.size());
+		}
+
+		// Exact length of the query
+		size_t Length() const
+		{
+			size_t length = (_parameters.empty() ? 0 : _parameters.size() * 2 - 1);
+			for (auto &parameter : _parameters)
+				length += UrlEncodedLength(parameter.key, parameter.keyLength) + UrlEncodedLength(parameter.value, parameter.valueLength);
+			return length;
+		}
+
+		// Write the query to dest (of Length() bytes); return the number of bytes written
+		size_t WriteTo(char *dest) const
+		{
+			size_t o = 0;
+			for (size_t i = 0; i < _parameters.size(); i++)
+			{
+				if (i > 0)
+					dest[o++] = '&';
+				o += UrlEncode(_parameters[i].key, _parameters[i].keyLength, dest + o);
+				dest[o++] = '=';
+				o += UrlEncode(_parameters[i].value, _parameters[i].valueLength, dest + o);
+			}
+			return o;
+		}
+
+		std::string ToString() const
+		{
+			std::string result(Length(), '\0');
+			if (!result.empty())
+				WriteTo(&result[0]);
+			return result;
+		}
+
+	private:
+		struct Parameter
+		{
+			const char *key;
+			size_t keyLength;
+			const char *value;
+			size_t valueLength;
+		};
+
+		std::vector<Parameter> _parameters;
+	};
+
+	// The parameters of a query string ("?" optional, '+' decoded as space), decoded into a single buffer
+	class ParsedQuery
+	{
+	public:
+		ParsedQuery(const char *query, size_t length)
+		{
+			if (length > 0 && query[0] == '?')
+			{
+				query++;
+				length--;
+			}
+
+			size_t count = (length == 0 ? 0 : 1);
+			for (size_t i = 0; i < length; i++)
+			{
+				if (query[i] == '&')
+					count++;
+			}
+			_parameters.reserve(count);
+			_buffer.reset(new char[length == 0 ? 1 : length]);
+
+			size_t o = 0;
+			size_t start = 0;
+			while (start < length)
+			{
+				auto end = start;
+				while (end < length && query[end] != '&')
+					end++;
+				auto equal = start;
+				while (equal < end && query[equal] != '=')
+					equal++;
+
+				if (end > start)
+				{
+					Parameter parameter;
+					parameter.key = o;
+					parameter.keyLength = UrlDecode(query + start, equal - start, _buffer.get() + o, true);
+					o += parameter.keyLength;
+					parameter.value = o;
+					parameter.valueLength = (equal < end ? UrlDecode(query + equal + 1, end - equal - 1, _buffer.get() + o, true) : 0);
+					o += parameter.valueLength;
+					_parameters.push_back(parameter);
+				}
+				start = end + 1;
+			}
+		}
+
+		explicit ParsedQuery(const std::string &query) : ParsedQuery(query.data(), query.size())
+		{
+		}
+
+		size_t Count() const
+		{
+			return _parameters.size();
+		}
+
+		Utf8Slice Key(size_t i) const
+		{
+			Utf8Slice slice = { _buffer.get() + _parameters[i].key, _parameters[i].keyLength };
+			return slice;
+		}
+
+		Utf8Slice Value(size_t i) const
+		{
+			Utf8Slice slice = { _buffer.get() + _parameters[i].value, _parameters[i].valueLength };
+			return slice;
+		}
+
+		// Value of the first parameter with the key
+		bool Find(const char *key, size_t keyLength, Utf8Slice &value) const
+		{
+			for (size_t i = 0; i < _parameters.size(); i++)
+			{
+				if (_parameters[i].keyLength == keyLength && memcmp(_buffer.get() + _parameters[i].key, key, keyLength) == 0)
+				{
+					value = Value(i);
+					return true;
+				}
+			}
+			return false;
+		}
+
+	private:
+		struct Parameter
+		{
+			size_t key;
+			size_t keyLength;
+			size_t value;
+			size_t valueLength;
+		};
+
+		std::unique_ptr<char[]> _buffer;
+		std::vector<Parameter> _parameters;
+	};
+
+	// Lowercase scheme and host, no default port (80 or 443), "/" for an empty path, uppercase
+	// %HH escapes and no fragment; the rest (path case, query order) is significant and kept
+	inline std::string NormalizeUrl(const char *url, size_t length)
+	{
+		std::string result;
+		result.reserve(length + 1);
+		const char *end = url + length;
+		const char *fragment = static_cast<const char*>(memchr(url, '#', length));
+		if (fragment != nullptr)
+			end = fragment;
+
+		const char *p = url;
+		const char *scheme = p;
+		while (p < end && *p != ':' && *p != '/' && *p != '?')
+			p++;
+		if (p + 2 < end && p[0] == ':' && p[1] == '/' && p[2] == '/')
+		{
+			for (const char *c = scheme; c < p; c++)
+				result += (char)tolower((unsigned char)*c);
+			result += "://";
+			bool secure = (result == "https://");
+			p += 3;
+
+			const char *host = p;
+			while (p < end && *p != '/' && *p != '?')
+				p++;
+			const char *hostEnd = p;
+			// The port starts at the last ':' that is not inside an IPv6 literal
+			const char *port = hostEnd;
+			for (const char *c = hostEnd; c > host; c--)
+			{
+				if (c[-1] == ']')
+					break;
+				if (c[-1] == ':')
+				{
+					port = c - 1;
+					break;
+				}
+			}
+			for (const char *c = host; c < port; c++)
+				result += (char)tolower((unsigned char)*c);
+			std::string portText(port, hostEnd);
+			bool plain = (result.compare(0, 7, "http://") == 0);
+			if (!(portText == ":" || (secure && portText == ":443") || (plain && portText == ":80")))
+				result += portText;
+			if (p == end || *p == '?')
+				result += '/';
+		}
+		else
+		{
+			p = url;
+		}
+
+		const auto &tables = Url::GetTables();
+		for (; p < end; p++)
+		{
+			if (*p == '%' && p + 2 < end && tables.hex[(unsigned char)p[1]] >= 0 && tables.hex[(unsigned char)p[2]] >= 0)
+			{
+				result += '%';
+				result += (char)toupper((unsigned char)p[1]);
+				result += (char)toupper((unsigned char)p[2]);
+				p += 2;
+			}
+			else
+			{
+				result += *p;
+			}
+		}
+		return result;
+	}
+
+	inline std::string NormalizeUrl(const std::string &url)
+	{
+		return NormalizeUrl(url.data(), url.size());
+	}
+
+	// "host[:port]" of an absolute URL, e.g. to group requests by server; empty if there is none
+	inline std::string UrlAuthority(const std::string &url)
+	{
+		auto start = url.find("://");
+		if (start == std::string::npos)
+			return std::string();
+		start += 3;
+		auto end = url.find_first_of("/?#", start);
+		auto authority = url.substr(start, end == std::string::npos ? std::string::npos : end - start);
+		auto user = authority.rfind('@');
+		return (user == std::string::npos ? authority : authority.substr(user + 1));
+	}
+} // namespace LUwpUtilities
+
+#endif // #ifndef _LUWPUTILITIES_URL_CODEC_
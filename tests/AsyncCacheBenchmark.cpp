@@ -0,0 +1,125 @@
+// AsyncCache under a Zipf-like key distribution: 4 callers each waiting for one Get at a time,
+// over 10000 keys whose computation spins for 20 us on a pool of 2 workers. Hit rate, coalesced
+// requests and latency from Get to the callback, for a few capacities, against computing every
+// request on the pool. AsyncMemo is the same cache behind a C++/CX facade.
+
+#include "AsyncCache.h"
+#include "TestHelper.h"
+#include <cmath>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace LUwpUtilities;
+
+typedef std::chrono::steady_clock Clock;
+
+static const int Keys = 10000;
+static const int Callers = 4;
+
+static int Spin(int key, std::chrono::microseconds cost)
+{
+	auto end = Clock::now() + cost;
+	while (Clock::now() < end)
+		;
+	return key * 2;
+}
+
+// P(rank k) proportional to 1 / k^s, most popular key first
+static std::discrete_distribution<int> Zipf(double s)
+{
+	std::vector<double> weights(Keys);
+	for (int k = 0; k < Keys; k++)
+		weights[k] = 1.0 / std::pow(k + 1, s);
+	return std::discrete_distribution<int>(weights.begin(), weights.end());
+}
+
+struct Result
+{
+	double seconds;
+	std::vector<double> latencies; // microseconds
+};
+
+// Each caller issues requests one after the other; get(key, done) must call done exactly once
+template<typename Get>
+static Result Run(int requests, double s, Get get)
+{
+	Result result;
+	std::vector<std::vector<double>> latencies(Callers);
+	auto start = Clock::now();
+	std::vector<std::thread> threads;
+	for (int c = 0; c < Callers; c++)
+	{
+		threads.emplace_back([&, c]()
+		{
+			std::mt19937 random(100 + c);
+			auto zipf = Zipf(s);
+			latencies[c].reserve(requests);
+			for (int i = 0; i < requests; i++)
+			{
+				int key = zipf(random);
+				std::atomic<bool> done(false);
+				auto issued = Clock::now();
+				get(key, [&done, key](int value)
+				{
+					CHECK(value == key * 2);
+					done = true;
+				});
+				while (!done.load())
+					std::this_thread::yield();
+				latencies[c].push_back(std::chrono::duration<double, std::micro>(Clock::now() - issued).count());
+			}
+		});
+	}
+	for (auto &thread : threads)
+		thread.join();
+	result.seconds = SecondsSince(start);
+	for (auto &list : latencies)
+		result.latencies.insert(result.latencies.end(), list.begin(), list.end());
+	return result;
+}
+
+static void Print(const char *name, const Result &result, double hitRate, double coalesced)
+{
+	printf("%-24s hits %5.1f%%  coalesced %4.1f%%  %9.0f requests/s  p50 %7.1f us  p99 %7.1f us\n", name,
+		hitRate * 100, coalesced * 100, result.latencies.size() / result.seconds,
+		Percentile(result.latencies, 0.5), Percentile(result.latencies, 0.99));
+}
+
+int main(int argc, char **argv)
+{
+	bool quick = HasFlag(argc, argv, "--quick");
+	int requests = (quick ? 500 : 50000);
+	auto cost = std::chrono::microseconds(20);
+	ThreadPool pool(2);
+
+	for (double s : { 0.8, 1.0, 1.2 })
+	{
+		printf("zipf s=%.1f over %d keys\n", s, Keys);
+		auto uncached = Run(requests, s, [&](int key, std::function<void(int)> done)
+		{
+			pool.Submit([key, cost, done]() { done(Spin(key, cost)); });
+		});
+		Print("  no cache", uncached, 0, 0);
+
+		for (size_t capacity : { (size_t)100, (size_t)1000, (size_t)5000 })
+		{
+			AsyncCache<int, int> cache(capacity, nullptr, pool);
+			auto cached = Run(requests, s, [&](int key, std::function<void(int)> done)
+			{
+				cache.Get(key, [key, cost]() { return Spin(key, cost); }, [done](std::shared_ptr<const int> value, std::exception_ptr error)
+				{
+					CHECK(!error);
+					done(*value);
+				});
+			});
+			auto statistics = cache.GetStatistics();
+			size_t total = statistics.hits + statistics.misses + statistics.coalesced;
+			CHECK(total == (size_t)Callers * requests);
+			char name[32];
+			snprintf(name, sizeof(name), "  capacity %zu", capacity);
+			Print(name, cached, (double)statistics.hits / total, (double)statistics.coalesced / total);
+		}
+	}
+	return 0;
+}
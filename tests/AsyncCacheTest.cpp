@@ -0,0 +1,228 @@
+// AsyncCache under concurrency: single flight across threads, errors and invalidation while a
+// computation is in flight, the weight bound, and a mixed stress of Get/TryGet/Invalidate/Clear
+
+#include "AsyncCache.h"
+#include "TestHelper.h"
+#include <atomic>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace LUwpUtilities;
+
+typedef AsyncCache<int, std::string> StringCache;
+
+// Threads asking for the same keys at once start one computation per key
+static void TestSingleFlight()
+{
+	ThreadPool pool(4);
+	StringCache cache(100, nullptr, pool);
+	const int Keys = 16, Threads = 8, Calls = 500;
+	std::atomic<int> computes[Keys];
+	for (auto &count : computes)
+		count = 0;
+	std::atomic<int> done(0), wrong(0);
+	std::atomic<bool> release(false);
+
+	std::vector<std::thread> threads;
+	for (int t = 0; t < Threads; t++)
+	{
+		threads.emplace_back([&, t]()
+		{
+			for (int i = 0; i < Calls; i++)
+			{
+				int key = (i + t) % Keys;
+				cache.Get(key, [&, key]()
+				{
+					computes[key]++;
+					// Keep the flight open until every thread has joined it
+					WaitFor([&]() { return release.load(); });
+					return std::to_string(key);
+				}, [&, key](StringCache::Value value, std::exception_ptr error)
+				{
+					if (error || value == nullptr || *value != std::to_string(key))
+						wrong++;
+					done++;
+				});
+			}
+		});
+	}
+	for (auto &thread : threads)
+		thread.join();
+	release = true;
+	CHECK(WaitFor([&]() { return done.load() == Threads * Calls; }));
+
+	CHECK(wrong == 0);
+	for (auto &count : computes)
+		CHECK(count == 1);
+	auto statistics = cache.GetStatistics();
+	CHECK(statistics.misses == Keys && statistics.hits == 0);
+	CHECK(statistics.coalesced == (size_t)(Threads * Calls - Keys));
+	CHECK(cache.TryGet(3) != nullptr && *cache.TryGet(3) == "3");
+}
+
+// Every waiter of a failed computation gets the error, which is not cached
+static void TestErrors()
+{
+	ThreadPool pool(2);
+	StringCache cache(10, nullptr, pool);
+	std::atomic<bool> release(false);
+	std::atomic<int> errors(0), computes(0);
+	for (int i = 0; i < 10; i++)
+	{
+		cache.Get(1, [&]() -> std::string
+		{
+			computes++;
+			WaitFor([&]() { return release.load(); });
+			throw std::runtime_error("compute");
+		}, [&](StringCache::Value value, std::exception_ptr error)
+		{
+			if (error && value == nullptr)
+				errors++;
+		});
+	}
+	release = true;
+	CHECK(WaitFor([&]() { return errors.load() == 10; }));
+	CHECK(computes == 1 && cache.TryGet(1) == nullptr);
+
+	// The next Get computes again
+	std::atomic<bool> done(false);
+	cache.Get(1, []() { return std::string("one"); }, [&](StringCache::Value value, std::exception_ptr) { done = (value != nullptr); });
+	CHECK(WaitFor([&]() { return done.load(); }));
+	CHECK(computes == 1 && *cache.TryGet(1) == "one");
+}
+
+// A computation invalidated in flight still answers its waiters, but does not fill the entry
+// that a newer computation owns
+static void TestInvalidateInFlight()
+{
+	ThreadPool pool(2);
+	StringCache cache(10, nullptr, pool);
+	std::atomic<bool> releaseOld(false), releaseNew(false);
+	std::atomic<int> answered(0);
+	std::string oldAnswer, newAnswer;
+
+	cache.Get(7, [&]()
+	{
+		WaitFor([&]() { return releaseOld.load(); });
+		return std::string("old");
+	}, [&](StringCache::Value value, std::exception_ptr) { oldAnswer = *value; answered++; });
+	cache.Invalidate(7);
+	cache.Get(7, [&]()
+	{
+		WaitFor([&]() { return releaseNew.load(); });
+		return std::string("new");
+	}, [&](StringCache::Value value, std::exception_ptr) { newAnswer = *value; answered++; });
+
+	releaseOld = true;
+	CHECK(WaitFor([&]() { return answered.load() == 1; }));
+	CHECK(oldAnswer == "old" && cache.TryGet(7) == nullptr);
+	releaseNew = true;
+	CHECK(WaitFor([&]() { return answered.load() == 2; }));
+	CHECK(newAnswer == "new" && *cache.TryGet(7) == "new");
+	CHECK(cache.GetStatistics().misses == 2);
+}
+
+// Values weigh their length: the cached ones stay within the capacity
+static void TestWeightBound()
+{
+	ThreadPool pool(4);
+	const size_t Capacity = 1000;
+	StringCache cache(Capacity, [](const std::string &value) { return value.size(); }, pool);
+	std::atomic<int> done(0);
+	const int Calls = 2000;
+	std::mt19937 random(3);
+	for (int i = 0; i < Calls; i++)
+	{
+		int key = (int)(random() % 300);
+		cache.Get(key, [key]() { return std::string((size_t)(key % 50 + 1), 'x'); },
+			[&](StringCache::Value, std::exception_ptr) { done++; });
+	}
+	CHECK(WaitFor([&]() { return done.load() == Calls; }));
+
+	size_t weight = 0;
+	for (int key = 0; key < 300; key++)
+	{
+		auto value = cache.TryGet(key);
+		if (value != nullptr)
+			weight += value->size();
+	}
+	CHECK(weight <= Capacity && weight > 0);
+	CHECK(cache.GetStatistics().evictions > 0);
+}
+
+// Threads mixing every operation: each callback runs once, with the right value or no value
+static void TestMixedStress()
+{
+	ThreadPool pool(4);
+	StringCache cache(64, nullptr, pool);
+	const int Threads = 6, Operations = 20000;
+	std::atomic<int> requested(0), answered(0), wrong(0);
+
+	std::vector<std::thread> threads;
+	for (int t = 0; t < Threads; t++)
+	{
+		threads.emplace_back([&, t]()
+		{
+			std::mt19937 random(t + 1);
+			for (int i = 0; i < Operations; i++)
+			{
+				int key = (int)(random() % 200);
+				switch (random() % 16)
+				{
+				case 0:
+					cache.Invalidate(key);
+					break;
+				case 1:
+					if (random() % 50 == 0)
+						cache.Clear();
+					break;
+				case 2:
+				case 3:
+				{
+					auto value = cache.TryGet(key);
+					if (value != nullptr && *value != std::to_string(key))
+						wrong++;
+					break;
+				}
+				default:
+					requested++;
+					cache.Get(key, [key]()
+					{
+						if (key % 97 == 0)
+							throw std::runtime_error("compute");
+						return std::to_string(key);
+					}, [&, key](StringCache::Value value, std::exception_ptr error)
+					{
+						bool right = (error ? value == nullptr && key % 97 == 0 : value != nullptr && *value == std::to_string(key));
+						if (!right)
+							wrong++;
+						answered++;
+					});
+				}
+			}
+		});
+	}
+	for (auto &thread : threads)
+		thread.join();
+	CHECK(WaitFor([&]() { return answered.load() == requested.load(); }));
+	CHECK(wrong == 0);
+
+	auto statistics = cache.GetStatistics();
+	CHECK(statistics.misses + statistics.coalesced <= (size_t)requested.load());
+	printf("stress: %d gets, hits=%zu misses=%zu coalesced=%zu evictions=%zu\n", requested.load(), statistics.hits,
+		statistics.misses, statistics.coalesced, statistics.evictions);
+}
+
+int main()
+{
+	TestSingleFlight();
+	TestErrors();
+	TestInvalidateInFlight();
+	TestWeightBound();
+	TestMixedStress();
+	puts("AsyncCacheTest passed");
+	return 0;
+}
@@ -0,0 +1,160 @@
+// Nanoseconds per allocate/release of short-lived buffers from BufferPool::Default() against
+// new[]/delete[], with the heap allocations each makes: released on the allocating thread, and
+// handed over to another thread that releases them, as a buffer filled by a download and consumed
+// on the UI thread is
+
+#include "BufferPool.h"
+#include "TestHelper.h"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace LUwpUtilities;
+
+// Sizes of strings and chunks, 256 B to 64 KB
+static size_t RequestSize(long i)
+{
+	static const size_t Sizes[] = { 200, 1000, 3000, 4096, 16000, 60000 };
+	return Sizes[i % 6];
+}
+
+struct Result
+{
+	double nanoseconds;
+	size_t heapAllocations;
+};
+
+// Blocks handed from the allocating thread to the releasing one, in batches
+template<typename Block>
+class Handoff
+{
+public:
+	Handoff() : _done(false)
+	{
+	}
+
+	void Push(std::vector<Block> &&batch)
+	{
+		std::lock_guard<std::mutex> guard(_lock);
+		_batches.push_back(std::move(batch));
+		_ready.notify_one();
+	}
+
+	void Close()
+	{
+		std::lock_guard<std::mutex> guard(_lock);
+		_done = true;
+		_ready.notify_one();
+	}
+
+	bool Pop(std::vector<Block> &batch)
+	{
+		std::unique_lock<std::mutex> guard(_lock);
+		_ready.wait(guard, [this]() { return _done || !_batches.empty(); });
+		if (_batches.empty())
+			return false;
+		batch = std::move(_batches.front());
+		_batches.pop_front();
+		return true;
+	}
+
+private:
+	std::mutex _lock;
+	std::condition_variable _ready;
+	std::deque<std::vector<Block>> _batches;
+	bool _done;
+};
+
+template<typename Block>
+static double CrossThread(long count, const std::function<Block(long)> &allocate, const std::function<void(Block&)> &release)
+{
+	const long Batch = 64;
+	Handoff<Block> handoff;
+	auto start = std::chrono::steady_clock::now();
+	std::thread consumer([&]()
+	{
+		std::vector<Block> batch;
+		while (handoff.Pop(batch))
+		{
+			for (auto &block : batch)
+				release(block);
+			batch.clear();
+		}
+	});
+	std::vector<Block> batch;
+	for (long i = 0; i < count; i++)
+	{
+		batch.push_back(allocate(i));
+		if ((long)batch.size() == Batch)
+		{
+			handoff.Push(std::move(batch));
+			batch = std::vector<Block>();
+		}
+	}
+	handoff.Push(std::move(batch));
+	handoff.Close();
+	consumer.join();
+	return SecondsSince(start) * 1e9 / count;
+}
+
+static Result PoolSameThread(long count)
+{
+	auto &pool = BufferPool::Default();
+	auto before = pool.GetStatistics().heapAllocations;
+	auto start = std::chrono::steady_clock::now();
+	for (long i = 0; i < count; i++)
+	{
+		auto buffer = pool.Allocate<char>(RequestSize(i));
+		buffer[0] = (char)i;
+	}
+	double nanoseconds = SecondsSince(start) * 1e9 / count;
+	return { nanoseconds, pool.GetStatistics().heapAllocations - before };
+}
+
+static Result HeapSameThread(long count)
+{
+	auto start = std::chrono::steady_clock::now();
+	for (long i = 0; i < count; i++)
+	{
+		char *volatile buffer = new char[RequestSize(i)];
+		buffer[0] = (char)i;
+		delete[] buffer;
+	}
+	return { SecondsSince(start) * 1e9 / count, (size_t)count };
+}
+
+static Result PoolCrossThread(long count)
+{
+	auto &pool = BufferPool::Default();
+	auto before = pool.GetStatistics().heapAllocations;
+	double nanoseconds = CrossThread<PooledBuffer<char>>(count,
+		[&](long i) { auto buffer = pool.Allocate<char>(RequestSize(i)); buffer[0] = (char)i; return buffer; },
+		[](PooledBuffer<char> &buffer) { buffer.Release(); });
+	return { nanoseconds, pool.GetStatistics().heapAllocations - before };
+}
+
+static Result HeapCrossThread(long count)
+{
+	double nanoseconds = CrossThread<char*>(count,
+		[](long i) { char *buffer = new char[RequestSize(i)]; buffer[0] = (char)i; return buffer; },
+		[](char *&buffer) { delete[] buffer; });
+	return { nanoseconds, (size_t)count };
+}
+
+static void Print(const char *name, long count, Result result)
+{
+	printf("%-28s %7.1f ns/buffer, %8zu heap allocations for %ld buffers\n", name, result.nanoseconds, result.heapAllocations, count);
+}
+
+int main(int argc, char **argv)
+{
+	long count = (HasFlag(argc, argv, "--quick") ? 20000 : 5000000);
+	Print("pool, same thread", count, PoolSameThread(count));
+	Print("new[]/delete[], same thread", count, HeapSameThread(count));
+	Print("pool, cross thread", count, PoolCrossThread(count));
+	Print("new[]/delete[], cross thread", count, HeapCrossThread(count));
+	return 0;
+}
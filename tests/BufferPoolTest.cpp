@@ -0,0 +1,59 @@
+// BufferPool: reuse of the blocks, and the byte bounds of the thread caches and the shared lists
+
+#include "BufferPool.h"
+#include "TestHelper.h"
+#include <thread>
+#include <vector>
+
+using namespace LUwpUtilities;
+
+int main()
+{
+	auto &pool = BufferPool::Default();
+
+	// A small block comes back from the thread cache
+	{
+		auto before = pool.GetStatistics();
+		{
+			auto buffer = pool.Allocate<wchar_t>(100);
+			CHECK(buffer.Size() >= 100);
+			buffer[99] = L'x';
+		}
+		auto again = pool.Allocate<wchar_t>(100);
+		CHECK(pool.GetStatistics().threadCacheHits == before.threadCacheHits + 1);
+	}
+
+	// 1 MB blocks are too big for the thread cache and only SharedBytes of them are kept
+	{
+		const size_t Count = 8;
+		auto before = pool.GetStatistics();
+		{
+			std::vector<PooledBuffer<char>> buffers;
+			for (size_t i = 0; i < Count; i++)
+				buffers.push_back(pool.Allocate<char>(1 << 20));
+		}
+		std::vector<PooledBuffer<char>> buffers;
+		for (size_t i = 0; i < Count; i++)
+			buffers.push_back(pool.Allocate<char>(1 << 20));
+		auto after = pool.GetStatistics();
+		CHECK(after.threadCacheHits == before.threadCacheHits);
+		CHECK(after.sharedHits - before.sharedHits == BufferPool::SharedBytes / (1 << 20));
+	}
+
+	// A thread keeps at most ThreadCacheBytes: four 64 KB blocks, not four of each larger class
+	std::thread([&pool]()
+	{
+		{
+			std::vector<PooledBuffer<char>> buffers;
+			for (size_t bytes : { 64 * 1024, 64 * 1024, 64 * 1024, 64 * 1024, 128 * 1024, 256 * 1024 })
+				buffers.push_back(pool.Allocate<char>(bytes));
+		}
+		auto before = pool.GetStatistics();
+		std::vector<PooledBuffer<char>> buffers;
+		for (size_t bytes : { 64 * 1024, 64 * 1024, 64 * 1024, 64 * 1024, 128 * 1024, 256 * 1024 })
+			buffers.push_back(pool.Allocate<char>(bytes));
+		auto after = pool.GetStatistics();
+		CHECK(after.threadCacheHits - before.threadCacheHits == 4);
+	}).join();
+	return 0;
+}
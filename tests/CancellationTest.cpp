@@ -0,0 +1,143 @@
+// Test of CancellationState: callbacks, deadlines posted to the pool, and the queued work that still
+// runs after a deadline with and without checking IsCancelled()
+
+#include "CancellationState.h"
+#include "TestHelper.h"
+#include <atomic>
+#include <memory>
+#include <thread>
+
+using namespace LUwpUtilities;
+
+static void TestCallbacks()
+{
+	CancellationState state;
+	int hits = 0;
+	state.Register([&]() { hits++; });
+	auto dropped = state.Register([&]() { hits += 10; });
+	state.Unregister(dropped);
+	CHECK(!state.IsCancelled());
+
+	state.Cancel();
+	state.Cancel();
+	CHECK(state.IsCancelled() && hits == 1);
+
+	// Too late to register: the callback runs right away
+	CHECK(state.Register([&]() { hits++; }) == 0);
+	CHECK(hits == 2);
+}
+
+// The deadline's Cancel() runs on a pool thread, without the wheel's lock
+static void TestDeadlineRunsOnThePool()
+{
+	TimerService service;
+	std::atomic<bool> probed(false);
+	std::thread::id timerThread;
+	TimerWheel::Timer probe;
+	probe.callback = [&]()
+	{
+		timerThread = std::this_thread::get_id();
+		probed = true;
+	};
+	service.Schedule(probe, std::chrono::milliseconds(0));
+	CHECK(WaitFor([&]() { return probed.load(); }));
+
+	CancellationState state(service);
+	std::atomic<bool> called(false);
+	std::thread::id callbackThread;
+	bool reschedules = false;
+	state.Register([&]()
+	{
+		callbackThread = std::this_thread::get_id();
+		// The timer thread is free to run other timers meanwhile
+		std::atomic<bool> fired(false);
+		TimerWheel::Timer other;
+		other.callback = [&]() { fired = true; };
+		service.Schedule(other, std::chrono::milliseconds(1));
+		reschedules = WaitFor([&]() { return fired.load(); }, std::chrono::milliseconds(2000));
+		service.Cancel(other);
+		called = true;
+	});
+	state.CancelAfter(std::chrono::milliseconds(5));
+	CHECK(WaitFor([&]() { return called.load(); }));
+	CHECK(state.IsCancelled());
+	CHECK(callbackThread != timerThread && callbackThread != std::this_thread::get_id());
+	CHECK(reschedules);
+}
+
+// States destroyed while their deadline is being posted, and a callback dropping the last reference
+static void TestLifetime()
+{
+	TimerService service;
+	for (int i = 0; i < 500; i++)
+	{
+		CancellationState state(service);
+		state.CancelAfter(std::chrono::milliseconds(1));
+		std::this_thread::sleep_for(std::chrono::microseconds((i % 7) * 250));
+	}
+
+	std::atomic<int> released(0);
+	for (int i = 0; i < 50; i++)
+	{
+		auto holder = std::make_shared<std::shared_ptr<CancellationState>>(std::make_shared<CancellationState>(service));
+		auto state = holder->get();
+		state->Register([holder, &released]()
+		{
+			holder->reset();
+			released++;
+		});
+		state->CancelAfter(std::chrono::milliseconds(1));
+	}
+	CHECK(WaitFor([&]() { return released.load() == 50; }));
+}
+
+// Queued 1 ms tasks, cancelled after 20 ms: how many still start after the deadline
+static int WastedTasks(bool check, int &ran)
+{
+	const int Tasks = 2000;
+	const unsigned Workers = 2;
+	std::atomic<int> started(0), wasted(0);
+	std::atomic<bool> fired(false);
+	{
+		ThreadPool pool(Workers);
+		auto state = std::make_shared<CancellationState>();
+		state->Register([&]() { fired = true; });
+		state->CancelAfter(std::chrono::milliseconds(20));
+		for (int i = 0; i < Tasks; i++)
+		{
+			pool.Submit([&, state]()
+			{
+				if (check && state->IsCancelled())
+					return;
+				if (fired)
+					wasted++;
+				started++;
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			});
+		}
+	}
+	ran = started;
+	return wasted;
+}
+
+static void TestWastedWork()
+{
+	int ranUnchecked, ranChecked;
+	auto unchecked = WastedTasks(false, ranUnchecked);
+	auto checked = WastedTasks(true, ranChecked);
+	printf("wasted tasks after the deadline: %d of %d run without checking, %d of %d run checking IsCancelled()\n",
+		unchecked, ranUnchecked, checked, ranChecked);
+	CHECK(unchecked > 1000);
+	// At most the task each worker had just checked when the flag was set
+	CHECK(checked <= 2);
+}
+
+int main()
+{
+	TestCallbacks();
+	TestDeadlineRunsOnThePool();
+	TestLifetime();
+	TestWastedWork();
+	puts("CancellationTest passed");
+	return 0;
+}
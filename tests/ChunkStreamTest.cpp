@@ -0,0 +1,368 @@
+// ChunkPump over a mock transport (reads of random sizes answered synchronously, from another
+// thread, or mixed), its errors and stops, CollectingConsumer and CountingConsumer, then real bodies
+// from LoopbackServer
+
+#include "ChunkStream.h"
+#include "LoopbackClient.h"
+#include "LoopbackServer.h"
+#include "TestHelper.h"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace LUwpUtilities;
+
+// Checks the content and the calls it gets: one chunk at a time, then exactly one end
+class CheckingConsumer : public ChunkConsumer
+{
+public:
+	explicit CheckingConsumer(std::string expected, size_t stopAfter = 0)
+		: _expected(std::move(expected)), _stopAfter(stopAfter), _inside(false), _chunks(0), _maxChunk(0), _ends(0), _errors(0), _wrong(0)
+	{
+	}
+
+	void OnStart(int64_t contentLength) override
+	{
+		if (contentLength >= 0 && contentLength != (int64_t)_expected.size())
+			_wrong++;
+	}
+
+	bool OnChunk(BufferView chunk) override
+	{
+		if (_inside.exchange(true) || _ends + _errors > 0)
+			_wrong++;
+		if (_received.size() + chunk.size() > _expected.size() ||
+			_expected.compare(_received.size(), chunk.size(), std::string(chunk.begin(), chunk.end())) != 0)
+			_wrong++;
+		_received.append(chunk.begin(), chunk.end());
+		if (chunk.size() > _maxChunk)
+			_maxChunk = chunk.size();
+		_chunks++;
+		_inside = false;
+		return _stopAfter == 0 || _chunks < _stopAfter;
+	}
+
+	void OnEnd() override
+	{
+		if (_received != _expected)
+			_wrong++;
+		_ends++;
+	}
+
+	void OnError(std::exception_ptr) override
+	{
+		_errors++;
+	}
+
+	bool Ended() const
+	{
+		return _ends == 1 && _errors == 0 && _wrong == 0;
+	}
+
+	bool Failed() const
+	{
+		return _ends == 0 && _errors == 1 && _wrong == 0;
+	}
+
+	size_t Chunks() const { return _chunks; }
+	size_t MaxChunk() const { return _maxChunk; }
+	size_t Received() const { return _received.size(); }
+	int Calls() const { return _ends + _errors; }
+
+private:
+	std::string _expected;
+	std::string _received;
+	size_t _stopAfter;
+	std::atomic<bool> _inside;
+	std::atomic<size_t> _chunks;
+	std::atomic<size_t> _maxChunk;
+	std::atomic<int> _ends;
+	std::atomic<int> _errors;
+	std::atomic<int> _wrong;
+};
+
+// A body served by reads of random sizes up to the capacity; a read is answered in place, on
+// another thread, or either, and may fail at a given offset
+class MockTransport
+{
+public:
+	enum Mode { Synchronous, Asynchronous, Mixed };
+
+	MockTransport(std::string body, Mode mode, uint32_t seed, size_t failAt = SIZE_MAX)
+		: _body(std::move(body)), _mode(mode), _random(seed), _failAt(failAt), _offset(0), _reading(false), _reads(0), _overlaps(0)
+	{
+	}
+
+	~MockTransport()
+	{
+		for (auto &thread : _threads)
+			thread.join();
+	}
+
+	ChunkPump::Read Read()
+	{
+		return [this](size_t capacity, ChunkPump::ReadDone done)
+		{
+			// The pump asks for a chunk only once the previous one was consumed
+			if (_reading.exchange(true))
+				_overlaps++;
+			_reads++;
+			bool async = (_mode == Asynchronous || (_mode == Mixed && _random() % 2 == 0));
+			auto size = std::min<size_t>(capacity, 1 + _random() % capacity);
+			if (async)
+				_threads.emplace_back([this, size, done]() { Answer(size, done); });
+			else
+				Answer(size, done);
+		};
+	}
+
+	size_t Reads() const { return _reads; }
+	int Overlaps() const { return _overlaps; }
+
+private:
+	void Answer(size_t size, const ChunkPump::ReadDone &done)
+	{
+		if (_offset >= _failAt)
+		{
+			_reading = false;
+			done(BufferView(), std::make_exception_ptr(std::runtime_error("connection reset")));
+			return;
+		}
+		size = std::min(size, _body.size() - _offset);
+		_chunk.assign(_body.begin() + _offset, _body.begin() + _offset + size);
+		_offset += size;
+		_reading = false;
+		done(BufferView(_chunk.data(), _chunk.size()), nullptr);
+	}
+
+	std::string _body;
+	Mode _mode;
+	std::mt19937 _random;
+	size_t _failAt;
+	size_t _offset;
+	std::vector<char> _chunk;
+	std::atomic<bool> _reading;
+	std::atomic<size_t> _reads;
+	std::atomic<int> _overlaps;
+	std::vector<std::thread> _threads;
+};
+
+static std::string RandomBody(size_t size, uint32_t seed)
+{
+	std::mt19937 random(seed);
+	std::string body(size, '\0');
+	for (auto &c : body)
+		c = (char)random();
+	return body;
+}
+
+static void TestWholeBody()
+{
+	const MockTransport::Mode Modes[] = { MockTransport::Synchronous, MockTransport::Asynchronous, MockTransport::Mixed };
+	const size_t Sizes[] = { 0, 1, 4095, 4096, 4097, 300000 };
+	uint32_t seed = 1;
+	for (auto mode : Modes)
+	{
+		for (auto size : Sizes)
+		{
+			auto body = RandomBody(size, seed++);
+			auto consumer = std::make_shared<CheckingConsumer>(body);
+			std::shared_ptr<ChunkPump> pump;
+			{
+				MockTransport transport(body, mode, seed);
+				pump = ChunkPump::Start(transport.Read(), consumer, (seed % 2 == 0 ? (int64_t)size : -1), 4096);
+				CHECK(WaitFor([&]() { return pump->IsFinished(); }));
+				CHECK(transport.Overlaps() == 0);
+			}
+			CHECK(consumer->Ended() && consumer->MaxChunk() <= 4096);
+			CHECK(pump->BytesRead() == size);
+		}
+	}
+}
+
+// A long body read one byte at a time, synchronously: the pump loops instead of recursing
+static void TestManySynchronousReads()
+{
+	auto body = RandomBody(1000000, 5);
+	auto consumer = std::make_shared<CheckingConsumer>(body);
+	MockTransport transport(body, MockTransport::Synchronous, 5);
+	auto pump = ChunkPump::Start(transport.Read(), consumer, -1, 1);
+	CHECK(pump->IsFinished() && consumer->Ended() && consumer->Chunks() == body.size());
+}
+
+static void TestErrorsAndStops()
+{
+	auto body = RandomBody(100000, 9);
+
+	// The transport fails in the middle
+	{
+		auto consumer = std::make_shared<CheckingConsumer>(body);
+		MockTransport transport(body, MockTransport::Mixed, 9, 50000);
+		auto pump = ChunkPump::Start(transport.Read(), consumer, -1, 4096);
+		CHECK(WaitFor([&]() { return pump->IsFinished(); }));
+		CHECK(consumer->Failed() && consumer->Received() >= 50000 && consumer->Received() < body.size());
+	}
+
+	// The consumer stops reading after 3 chunks: neither OnEnd nor OnError
+	{
+		auto consumer = std::make_shared<CheckingConsumer>(body, 3);
+		MockTransport transport(body, MockTransport::Asynchronous, 10);
+		auto pump = ChunkPump::Start(transport.Read(), consumer, -1, 1000);
+		CHECK(WaitFor([&]() { return pump->IsFinished(); }));
+		CHECK(transport.Reads() == 3 && consumer->Chunks() == 3 && consumer->Calls() == 0);
+	}
+
+	// A throwing consumer gets OnError, and so does one refusing the content length
+	{
+		struct Throwing : public ChunkConsumer
+		{
+			bool throwAtStart = false;
+			int chunks = 0, errors = 0, ends = 0;
+			void OnStart(int64_t) override { if (throwAtStart) throw std::length_error("too large"); }
+			bool OnChunk(BufferView) override { if (++chunks == 2) throw std::runtime_error("parse error"); return true; }
+			void OnEnd() override { ends++; }
+			void OnError(std::exception_ptr) override { errors++; }
+		};
+		auto throwing = std::make_shared<Throwing>();
+		MockTransport transport(body, MockTransport::Synchronous, 11);
+		ChunkPump::Start(transport.Read(), throwing, -1, 1000);
+		CHECK(throwing->chunks == 2 && throwing->errors == 1 && throwing->ends == 0 && transport.Reads() == 2);
+
+		auto refusing = std::make_shared<Throwing>();
+		refusing->throwAtStart = true;
+		MockTransport unused(body, MockTransport::Synchronous, 12);
+		ChunkPump::Start(unused.Read(), refusing, (int64_t)body.size(), 1000);
+		CHECK(refusing->errors == 1 && unused.Reads() == 0);
+	}
+
+	// Stop() while a read is pending: OnError with the stop error once the read returns
+	{
+		ChunkPump::ReadDone pending;
+		int reads = 0;
+		static const char Data[10] = {};
+		auto pump = ChunkPump::Start([&](size_t, ChunkPump::ReadDone done)
+		{
+			if (++reads == 3)
+				pending = done;
+			else
+				done(BufferView(Data, sizeof(Data)), nullptr);
+		}, std::make_shared<CollectingConsumer>(1000, [&](std::vector<unsigned char> &received, std::exception_ptr error)
+		{
+			CHECK(error && received.empty());
+			try
+			{
+				std::rethrow_exception(error);
+			}
+			catch (const std::runtime_error &e)
+			{
+				CHECK(std::string(e.what()) == "stopped");
+			}
+		}), -1);
+		pump->Stop(std::make_exception_ptr(std::runtime_error("stopped")));
+		CHECK(!pump->IsFinished());
+		pending(BufferView(Data, sizeof(Data)), nullptr);
+		CHECK(pump->IsFinished() && reads == 3 && pump->BytesRead() == 20);
+	}
+}
+
+static void TestCollectingConsumer()
+{
+	static const char Data[] = "abc";
+	int reads = 0;
+	std::string collected;
+	ChunkPump::Start([&](size_t, ChunkPump::ReadDone done)
+	{
+		done(reads++ < 3 ? BufferView(Data, 3) : BufferView(), nullptr);
+	}, std::make_shared<CollectingConsumer>(9, [&](std::vector<unsigned char> &body, std::exception_ptr error)
+	{
+		CHECK(!error);
+		collected.assign(body.begin(), body.end());
+	}), 9);
+	CHECK(collected == "abcabcabc");
+
+	// Over the limit, by the announced length or by the bytes received
+	int errors = 0;
+	auto over = [&](std::vector<unsigned char> &body, std::exception_ptr error) { errors += (error && body.empty()); };
+	auto endless = [&](size_t, ChunkPump::ReadDone done) { done(BufferView(Data, 3), nullptr); };
+	ChunkPump::Start(endless, std::make_shared<CollectingConsumer>(8, over), 9);
+	ChunkPump::Start(endless, std::make_shared<CollectingConsumer>(8, over), -1);
+	CHECK(errors == 2);
+}
+
+// The bytes up to the end, or up to the failure
+static void TestCountingConsumer()
+{
+	static const char Data[] = "abc";
+	int reads = 0;
+	bool success = false;
+	int64_t bytes = -1;
+	auto counted = [&](bool result, int64_t count)
+	{
+		success = result;
+		bytes = count;
+	};
+	ChunkPump::Start([&](size_t, ChunkPump::ReadDone done)
+	{
+		done(reads++ < 3 ? BufferView(Data, 3) : BufferView(), nullptr);
+	}, std::make_shared<CountingConsumer>(counted), -1);
+	CHECK(success && bytes == 9);
+
+	reads = 0;
+	ChunkPump::Start([&](size_t, ChunkPump::ReadDone done)
+	{
+		if (reads++ < 2)
+			done(BufferView(Data, 3), nullptr);
+		else
+			done(BufferView(), std::make_exception_ptr(std::runtime_error("connection reset")));
+	}, std::make_shared<CountingConsumer>(counted), 9);
+	CHECK(!success && bytes == 6);
+}
+
+// Real bodies through LoopbackClient, whose reads are ChunkPump reads from a socket
+static void TestLoopback()
+{
+	LoopbackServer server;
+	LoopbackClient client(server.Port(), 4);
+	const char *Targets[] =
+	{
+		"/fixed?size=3000000",
+		"/chunked?size=3000000&chunked=1",
+		"/empty?size=0",
+		"/slow?size=200000&chunked=1&latency=5",
+	};
+	for (auto target : Targets)
+	{
+		auto consumer = std::make_shared<CheckingConsumer>(server.Body(target));
+		client.Get(target, LoopbackClient::Fields(), nullptr, consumer);
+		CHECK(WaitFor([&]() { return consumer->Calls() > 0; }));
+		CHECK(consumer->Ended() && consumer->MaxChunk() <= ChunkPump::DefaultChunkSize);
+	}
+
+	// The connection drops in the middle of the body
+	const char *Dropped[] = { "/dropped?size=1000000&drop_after=300000", "/dropped?size=1000000&chunked=1&drop_after=300000" };
+	for (auto target : Dropped)
+	{
+		auto consumer = std::make_shared<CheckingConsumer>(server.Body(target));
+		client.Get(target, LoopbackClient::Fields(), nullptr, consumer);
+		CHECK(WaitFor([&]() { return consumer->Calls() > 0; }));
+		CHECK(consumer->Failed() && consumer->Received() <= 300000);
+	}
+}
+
+int main()
+{
+	TestWholeBody();
+	TestManySynchronousReads();
+	TestErrorsAndStops();
+	TestCollectingConsumer();
+	TestCountingConsumer();
+	TestLoopback();
+	puts("ChunkStreamTest passed");
+	return 0;
+}
@@ -0,0 +1,122 @@
+// Cost of a co_await on CoTask (C++20) that completes at once, and of hopping to a ThreadPool
+// worker with ResumeBackground(), with the heap allocations of each, against the callbacks they
+// replace: a std::function continuation and a chain of ThreadPool::Submit
+
+#include "CoTask.h"
+#include "TestHelper.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+using namespace LUwpUtilities;
+
+// Counts every new of the program (coroutine frames are allocated with it)
+static std::atomic<size_t> allocations(0);
+
+void *operator new(size_t size)
+{
+	allocations++;
+	if (void *block = malloc(size == 0 ? 1 : size))
+		return block;
+	throw std::bad_alloc();
+}
+
+// Out of line, so that the compiler does not see a frame from new reaching free()
+static void __attribute__((noinline)) Free(void *block)
+{
+	free(block);
+}
+
+void operator delete(void *block) noexcept
+{
+	Free(block);
+}
+
+void operator delete(void *block, size_t) noexcept
+{
+	Free(block);
+}
+
+static CoTask<int> Value(int i)
+{
+	co_return i;
+}
+
+static CoTask<long long> AwaitLoop(int count)
+{
+	long long sum = 0;
+	for (int i = 0; i < count; i++)
+		sum += co_await Value(i);
+	co_return sum;
+}
+
+// What the await replaces: a function reporting its result to a continuation
+static void __attribute__((noinline)) ValueThen(int i, const std::function<void(int)> &then)
+{
+	then(i);
+}
+
+static CoTask<void> Hops(ThreadPool &pool, int count, std::atomic<bool> &done)
+{
+	for (int i = 0; i < count; i++)
+		co_await ResumeBackground(pool);
+	done = true;
+}
+
+static void SubmitChain(ThreadPool &pool, int remaining, std::atomic<bool> &done)
+{
+	if (remaining == 0)
+	{
+		done = true;
+		return;
+	}
+	pool.Submit([&pool, remaining, &done]() { SubmitChain(pool, remaining - 1, done); });
+}
+
+static void Print(const char *name, double seconds, size_t before, int count)
+{
+	printf("%-36s %8.1f ns, %5.2f allocations each\n", name, seconds * 1e9 / count, (double)(allocations - before) / count);
+}
+
+int main(int argc, char **argv)
+{
+	bool quick = HasFlag(argc, argv, "--quick");
+#ifdef LUU_NO_TAIL_CALLS
+	int awaits = 1000;
+#else
+	int awaits = (quick ? 10000 : 20000000);
+#endif
+	int hops = (quick ? 1000 : 200000);
+
+	long long sum = 0;
+	size_t before = allocations;
+	auto start = std::chrono::steady_clock::now();
+	auto runner = [&]() -> CoTask<void> { sum = co_await AwaitLoop(awaits); };
+	Spawn(runner());
+	Print("co_await CoTask", SecondsSince(start), before, awaits);
+	CHECK(sum == (long long)awaits * (awaits - 1) / 2);
+
+	long long callbackSum = 0;
+	before = allocations;
+	start = std::chrono::steady_clock::now();
+	for (int i = 0; i < awaits; i++)
+		ValueThen(i, [&callbackSum](int value) { callbackSum += value; });
+	Print("std::function continuation", SecondsSince(start), before, awaits);
+	CHECK(callbackSum == sum);
+
+	ThreadPool pool(2);
+	std::atomic<bool> done(false);
+	before = allocations;
+	start = std::chrono::steady_clock::now();
+	Spawn(Hops(pool, hops, done));
+	CHECK(WaitFor([&]() { return done.load(); }, std::chrono::milliseconds(120000)));
+	Print("co_await ResumeBackground", SecondsSince(start), before, hops);
+
+	done = false;
+	before = allocations;
+	start = std::chrono::steady_clock::now();
+	SubmitChain(pool, hops, done);
+	CHECK(WaitFor([&]() { return done.load(); }, std::chrono::milliseconds(120000)));
+	Print("ThreadPool::Submit chain", SecondsSince(start), before, hops);
+	return 0;
+}
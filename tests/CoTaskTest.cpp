@@ -0,0 +1,196 @@
+// CoTask (C++20): long chains of awaits run in constant stack through symmetric transfer,
+// exceptions reach the awaiting coroutine, an unawaited task never runs and frees its frame,
+// Spawn() and ResumeBackground()
+
+#include "CoTask.h"
+#include "TestHelper.h"
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+using namespace LUwpUtilities;
+
+static uintptr_t StackAddress()
+{
+	volatile char marker = 0;
+	return (uintptr_t)&marker;
+}
+
+static uintptr_t deepest;
+
+// Each level awaits the next one: a million nested frames, each started and resumed by a tail call
+static CoTask<int> Depth(int n)
+{
+	if (n == 0)
+	{
+		deepest = StackAddress();
+		co_return 0;
+	}
+	co_return 1 + co_await Depth(n - 1);
+}
+
+static CoTask<int> Value(int i)
+{
+	co_return i;
+}
+
+// A million tasks that complete synchronously, awaited one after the other in a loop
+static CoTask<long long> Sum(int count)
+{
+	long long sum = 0;
+	for (int i = 0; i < count; i++)
+		sum += co_await Value(i);
+	co_return sum;
+}
+
+// Run a task to completion on this thread; it must not suspend anywhere else
+template<typename T>
+static T RunSynchronously(CoTask<T> task)
+{
+	T result{};
+	bool done = false;
+	auto runner = [&]() -> CoTask<void>
+	{
+		result = co_await std::move(task);
+		done = true;
+	};
+	Spawn(runner());
+	CHECK(done);
+	return result;
+}
+
+static void TestSymmetricTransfer()
+{
+#ifdef LUU_NO_TAIL_CALLS
+	const int Levels = 1000;
+#else
+	const int Levels = 1000000;
+#endif
+	uintptr_t top = StackAddress();
+	CHECK(RunSynchronously(Depth(Levels)) == Levels);
+	// Without symmetric transfer each level would take at least a few dozen bytes of stack
+	uintptr_t growth = (top > deepest ? top - deepest : deepest - top);
+	printf("stack growth over %d levels: %zu bytes\n", Levels, (size_t)growth);
+#ifndef LUU_NO_TAIL_CALLS
+	CHECK(growth < 64 * 1024);
+#endif
+
+	CHECK(RunSynchronously(Sum(Levels)) == (long long)Levels * (Levels - 1) / 2);
+}
+
+static CoTask<int> Fail(const char *message)
+{
+	throw std::runtime_error(message);
+	co_return 0;
+}
+
+static CoTask<int> Rethrow(int levels)
+{
+	if (levels == 0)
+		co_return co_await Fail("deep");
+	co_return co_await Rethrow(levels - 1);
+}
+
+static CoTask<std::string> Catch()
+{
+	try
+	{
+		co_await Fail("first");
+	}
+	catch (const std::runtime_error &e)
+	{
+		co_return std::string("caught ") + e.what();
+	}
+	co_return "not thrown";
+}
+
+static void TestExceptions()
+{
+	CHECK(RunSynchronously(Catch()) == "caught first");
+
+	// Through several levels, to the coroutine that handles it
+	auto outer = []() -> CoTask<std::string>
+	{
+		try
+		{
+			co_await Rethrow(100);
+		}
+		catch (const std::runtime_error &e)
+		{
+			co_return e.what();
+		}
+		co_return "";
+	};
+	CHECK(RunSynchronously(outer()) == "deep");
+
+	// Spawn() swallows what escapes the task
+	bool after = false;
+	auto escaping = [&]() -> CoTask<void>
+	{
+		co_await Fail("escaping");
+		after = true;
+	};
+	Spawn(escaping());
+	CHECK(!after);
+}
+
+static CoTask<void> Hold(std::shared_ptr<int> counter)
+{
+	(*counter)++;
+	co_return;
+}
+
+static void TestUnawaited()
+{
+	auto counter = std::make_shared<int>(0);
+	{
+		auto task = Hold(counter);
+		// Lazily started: the body has not run, the frame holds a copy of the argument
+		CHECK(*counter == 0 && counter.use_count() == 2);
+		auto moved = std::move(task);
+		CHECK(counter.use_count() == 2);
+	}
+	CHECK(*counter == 0 && counter.use_count() == 1);
+
+	// Assigning over a task destroys its frame too
+	auto task = Hold(counter);
+	task = Hold(counter);
+	CHECK(counter.use_count() == 2);
+	task = CoTask<void>();
+	CHECK(counter.use_count() == 1);
+
+	// A finished task frees its frame when it goes away
+	auto awaited = [&]() -> CoTask<void> { co_await Hold(counter); };
+	Spawn(awaited());
+	CHECK(*counter == 1 && counter.use_count() == 1);
+}
+
+static void TestResumeBackground()
+{
+	ThreadPool pool(2);
+	std::atomic<int> stage(0);
+	std::atomic<bool> onCaller(true);
+	auto caller = std::this_thread::get_id();
+	auto work = [&]() -> CoTask<void>
+	{
+		stage = 1;
+		co_await ResumeBackground(pool);
+		onCaller = (std::this_thread::get_id() == caller);
+		int value = co_await Value(41);
+		stage = value + 1;
+	};
+	Spawn(work());
+	CHECK(WaitFor([&]() { return stage.load() == 42; }));
+	CHECK(!onCaller.load());
+}
+
+int main()
+{
+	TestSymmetricTransfer();
+	TestExceptions();
+	TestUnawaited();
+	TestResumeBackground();
+	puts("CoTaskTest passed");
+	return 0;
+}
@@ -0,0 +1,106 @@
+// Continuations from 4 threads to a fake UI loop through CoalescingDispatcher against one dispatch
+// per continuation: throughput when flooded, latency from Post to run for bursts of 50, and the
+// number of UI dispatches. Each dispatch can be given a fixed cost on the loop, which stands for
+// the message pump and the CoreDispatcher::RunAsync call it replaces.
+
+#include "DispatchQueue.h"
+#include "TestHelper.h"
+#include <thread>
+#include <vector>
+
+using namespace LUwpUtilities;
+
+typedef std::chrono::steady_clock Clock;
+
+struct UiDispatcher
+{
+	CoalescingDispatcher dispatcher;
+	FakeUiLoop loop;
+	std::chrono::microseconds cost;
+
+	explicit UiDispatcher(std::chrono::microseconds cost)
+		: dispatcher([this]() { Dispatch([this]() { dispatcher.Drain(); }); }), cost(cost)
+	{
+	}
+
+	void Dispatch(std::function<void()> callback)
+	{
+		auto spent = cost;
+		loop.Dispatch([spent, callback]()
+		{
+			auto end = Clock::now() + spent;
+			while (Clock::now() < end)
+				;
+			callback();
+		});
+	}
+};
+
+struct Result
+{
+	double seconds;
+	size_t dispatches;
+	std::vector<double> latencies; // microseconds
+};
+
+// Producers post bursts of continuations; each records its latency on the loop thread
+static Result Run(bool coalesce, std::chrono::microseconds cost, int producers, int bursts, int burst, std::chrono::microseconds pause)
+{
+	Result result;
+	result.latencies.reserve((size_t)producers * bursts * burst);
+	std::atomic<int> executed(0);
+	auto start = Clock::now();
+	{
+		UiDispatcher ui(cost);
+		std::vector<std::thread> threads;
+		for (int p = 0; p < producers; p++)
+		{
+			threads.emplace_back([&]()
+			{
+				for (int b = 0; b < bursts; b++)
+				{
+					for (int i = 0; i < burst; i++)
+					{
+						auto posted = Clock::now();
+						auto work = [&result, &executed, posted]()
+						{
+							result.latencies.push_back(std::chrono::duration<double, std::micro>(Clock::now() - posted).count());
+							executed++;
+						};
+						if (coalesce)
+							ui.dispatcher.Post(work);
+						else
+							ui.Dispatch(work);
+					}
+					if (pause.count() > 0)
+						std::this_thread::sleep_for(pause);
+				}
+			});
+		}
+		for (auto &thread : threads)
+			thread.join();
+		CHECK(WaitFor([&]() { return executed.load() == producers * bursts * burst; }, std::chrono::milliseconds(120000)));
+		result.seconds = SecondsSince(start);
+		result.dispatches = ui.loop.Dispatches();
+	}
+	return result;
+}
+
+int main(int argc, char **argv)
+{
+	bool quick = HasFlag(argc, argv, "--quick");
+	const int Producers = 4;
+	for (auto cost : { std::chrono::microseconds(0), std::chrono::microseconds(5) })
+	{
+		for (bool coalesce : { true, false })
+		{
+			const char *name = (coalesce ? "coalescing" : "dispatch each");
+			auto flood = Run(coalesce, cost, Producers, 1, quick ? 2000 : 200000, std::chrono::microseconds(0));
+			auto bursts = Run(coalesce, cost, Producers, quick ? 5 : 200, 50, std::chrono::microseconds(2000));
+			printf("cost=%dus %-14s flood: %9.0f/s %7zu dispatches; bursts of 50: p50 %6.1fus p99 %7.1fus %5zu dispatches\n",
+				(int)cost.count(), name, flood.latencies.size() / flood.seconds, flood.dispatches,
+				Percentile(bursts.latencies, 0.5), Percentile(bursts.latencies, 0.99), bursts.dispatches);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,167 @@
+// CoalescingDispatcher on a fake UI loop: FIFO order per producer, at most one dispatch pending
+// while producers race with the drains, no lost work, the time budget, and exceptions
+
+#include "DispatchQueue.h"
+#include "TestHelper.h"
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace LUwpUtilities;
+
+// A dispatcher waking a fake UI loop; the loop goes first, running what is left, and then the dispatcher
+struct UiDispatcher
+{
+	CoalescingDispatcher dispatcher;
+	FakeUiLoop loop;
+
+	explicit UiDispatcher(std::chrono::microseconds budget = std::chrono::microseconds(4000))
+		: dispatcher([this]() { loop.Dispatch([this]() { dispatcher.Drain(); }); }, budget)
+	{
+	}
+};
+
+// Producers post as fast as they can while the loop drains; every item runs once, on the loop,
+// in the order its producer posted it
+static void TestContention(std::chrono::microseconds budget)
+{
+	const int Producers = 4;
+	const int Items = 20000;
+	std::vector<int> next(Producers, 0);
+	std::atomic<int> executed(0);
+	bool ordered = true, onLoop = true;
+	{
+		UiDispatcher ui(budget);
+		auto &loop = ui.loop;
+		auto dispatcher = &ui.dispatcher;
+		std::vector<std::thread> producers;
+		for (int p = 0; p < Producers; p++)
+		{
+			producers.emplace_back([&, p]()
+			{
+				for (int i = 0; i < Items; i++)
+				{
+					dispatcher->Post([&, p, i]()
+					{
+						// Only the loop thread touches next
+						ordered = ordered && next[p] == i;
+						onLoop = onLoop && loop.OnLoop();
+						next[p] = i + 1;
+						executed++;
+					});
+					if (i % 1000 == 0)
+						std::this_thread::yield();
+				}
+			});
+		}
+		for (auto &producer : producers)
+			producer.join();
+
+		CHECK(WaitFor([&]() { return executed.load() == Producers * Items; }));
+		CHECK(WaitFor([&]() { return loop.Pending() == 0; }));
+		auto statistics = dispatcher->GetStatistics();
+		CHECK(statistics.posted == (size_t)(Producers * Items) && statistics.executed == statistics.posted);
+		CHECK(statistics.wakeUps == loop.Dispatches() && statistics.drains == loop.Dispatches());
+		CHECK(loop.MaxPending() == 1);
+		CHECK(loop.Dispatches() < statistics.posted);
+		printf("budget=%dus posted=%zu dispatches=%zu\n", (int)budget.count(), statistics.posted, loop.Dispatches());
+	}
+	CHECK(ordered && onLoop);
+	for (int p = 0; p < Producers; p++)
+		CHECK(next[p] == Items);
+}
+
+// One post at a time, each racing with the end of the drain of the one before: none is stranded
+static void TestPostRacingDrain()
+{
+	UiDispatcher ui;
+	auto &loop = ui.loop;
+	auto dispatcher = &ui.dispatcher;
+	std::atomic<int> executed(0);
+	for (int i = 0; i < 20000; i++)
+	{
+		dispatcher->Post([&]() { executed++; });
+		// Give the drain a chance to be finishing as the next post comes
+		if (i % 3 == 0)
+			std::this_thread::yield();
+	}
+	CHECK(WaitFor([&]() { return executed.load() == 20000; }));
+	CHECK(loop.MaxPending() == 1);
+	// Work posted from the loop itself, during a drain
+	dispatcher->Post([&]() { dispatcher->Post([&]() { executed++; }); });
+	CHECK(WaitFor([&]() { return executed.load() == 20001; }));
+}
+
+// A batch longer than the budget runs over several dispatches, still in order
+static void TestBudget()
+{
+	UiDispatcher ui(std::chrono::microseconds(1000));
+	auto &loop = ui.loop;
+	auto dispatcher = &ui.dispatcher;
+	std::vector<int> order;
+	std::atomic<int> executed(0);
+	std::atomic<bool> release(false);
+	// Hold the loop so that the whole batch is queued before the first drain
+	loop.Dispatch([&]() { WaitFor([&]() { return release.load(); }); });
+	for (int i = 0; i < 20; i++)
+	{
+		dispatcher->Post([&, i]()
+		{
+			std::this_thread::sleep_for(std::chrono::microseconds(300));
+			order.push_back(i);
+			executed++;
+		});
+	}
+	release = true;
+	CHECK(WaitFor([&]() { return executed.load() == 20 && loop.Pending() == 0; }));
+	CHECK(loop.MaxPending() <= 2);
+	auto statistics = dispatcher->GetStatistics();
+	CHECK(statistics.drains >= 4 && statistics.drains == statistics.wakeUps);
+	for (int i = 0; i < 20; i++)
+		CHECK(order[i] == i);
+}
+
+// An exception reaches the loop, and the work behind it still runs
+static void TestException()
+{
+	UiDispatcher ui;
+	auto &loop = ui.loop;
+	auto dispatcher = &ui.dispatcher;
+	std::atomic<bool> release(false);
+	std::atomic<int> executed(0);
+	loop.Dispatch([&]() { WaitFor([&]() { return release.load(); }); });
+	dispatcher->Post([&]() { executed++; });
+	dispatcher->Post([]() { throw std::runtime_error("failed"); });
+	dispatcher->Post([&]() { executed++; });
+	release = true;
+	CHECK(WaitFor([&]() { return executed.load() == 2 && loop.Pending() == 0; }));
+	CHECK(loop.Exceptions() == 1);
+	dispatcher->Post([&]() { executed++; });
+	CHECK(WaitFor([&]() { return executed.load() == 3; }));
+}
+
+// Work still queued when the dispatcher goes away is destroyed without running
+static void TestDestruction()
+{
+	int wakeUps = 0;
+	auto counter = std::make_shared<int>(0);
+	{
+		CoalescingDispatcher dispatcher([&]() { wakeUps++; });
+		for (int i = 0; i < 10; i++)
+			dispatcher.Post([counter]() { (*counter)++; });
+	}
+	CHECK(wakeUps == 1 && *counter == 0 && counter.use_count() == 1);
+}
+
+int main()
+{
+	TestContention(std::chrono::microseconds(4000));
+	TestContention(std::chrono::microseconds(50));
+	TestPostRacingDrain();
+	TestBudget();
+	TestException();
+	TestDestruction();
+	puts("DispatchQueueTest passed");
+	return 0;
+}
@@ -0,0 +1,112 @@
+// GB/s of JsonReader on a feed-like document (items with ids, titles, tags, nested objects and
+// long bodies): the tokenizer, the push parser and the pointer extractor fed 64 KB chunks, against
+// building a DOM with the reference parser and, when it is installed, with jsoncpp
+
+#include "JsonReader.h"
+#include "JsonReference.h"
+#include "TestHelper.h"
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#ifdef LUU_HAVE_JSONCPP
+#include <json/json.h>
+#endif
+
+using namespace LUwpUtilities;
+
+static std::string FeedDocument(int items)
+{
+	std::mt19937 random(1);
+	std::string text = "{\"items\":[";
+	for (int i = 0; i < items; i++)
+	{
+		if (i > 0)
+			text += ",";
+		text += "{\"id\":" + std::to_string(random()) + ",\"title\":\"Item number " + std::to_string(i) +
+			" with a longer title\",\"score\":" + std::to_string(random() % 1000) + ".25,\"tags\":[\"a\",\"bb\",\"ccc\"],"
+			"\"author\":{\"name\":\"someone\",\"verified\":true},\"body\":\"" + std::string(80 + random() % 200, 'x') + "\\n\"}";
+	}
+	return text + "],\"next\":\"cursor\"}";
+}
+
+// Best of a few runs
+static void Measure(const char *name, const std::string &text, int runs, const std::function<void()> &parse)
+{
+	double best = 1e9;
+	for (int i = 0; i < runs; i++)
+	{
+		auto start = std::chrono::steady_clock::now();
+		parse();
+		best = std::min(best, SecondsSince(start));
+	}
+	printf("%-32s %6.2f GB/s\n", name, text.size() / best / 1e9);
+}
+
+static void PushInChunks(JsonHandler &handler, const std::string &text)
+{
+	const size_t Chunk = 64 * 1024;
+	JsonPushParser parser(handler);
+	for (size_t offset = 0; offset < text.size(); offset += Chunk)
+		CHECK(parser.Feed(text.data() + offset, std::min(Chunk, text.size() - offset)));
+	CHECK(parser.Finish());
+}
+
+int main(int argc, char **argv)
+{
+	bool quick = HasFlag(argc, argv, "--quick");
+	int runs = (quick ? 1 : 5);
+	auto text = FeedDocument(quick ? 2000 : 200000);
+	printf("document: %.1f MB\n", text.size() / 1e6);
+
+	size_t tokens = 0;
+	Measure("tokenizer", text, runs, [&]()
+	{
+		JsonTokenizer tokenizer;
+		tokenizer.SetInput(text.data(), text.size(), true);
+		for (auto token = tokenizer.Next(); token != JsonToken::End; token = tokenizer.Next())
+		{
+			CHECK(token != JsonToken::Error);
+			tokens++;
+		}
+	});
+
+	Measure("push parser, 64 KB chunks", text, runs, [&]()
+	{
+		JsonHandler handler;
+		PushInChunks(handler, text);
+	});
+
+	size_t found = 0;
+	Measure("pointer extractor, 64 KB chunks", text, runs, [&]()
+	{
+		JsonPointerExtractor extractor({ "/items/*/title", "/items/*/id", "/next" }, [&](size_t, JsonToken, Utf8Slice) { found++; return true; });
+		PushInChunks(extractor, text);
+	});
+
+	size_t items = 0;
+	Measure("reference DOM", text, runs, [&]()
+	{
+		JsonValue root;
+		CHECK(ParseReferenceJson(text, root));
+		items += root.members[0].second.items.size();
+	});
+
+#ifdef LUU_HAVE_JSONCPP
+	Measure("jsoncpp DOM", text, runs, [&]()
+	{
+		Json::CharReaderBuilder builder;
+		std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+		Json::Value root;
+		std::string error;
+		CHECK(reader->parse(text.data(), text.data() + text.size(), &root, &error));
+		items += root["items"].size();
+	});
+#else
+	puts("jsoncpp DOM                      (not found at build time)");
+#endif
+
+	CHECK(tokens > 0 && found > 0 && items > 0);
+	return 0;
+}
@@ -0,0 +1,359 @@
+// JsonReader against the reference parser of JsonReference.h: random documents, valid or mutated,
+// through JsonTokenizer in one piece and JsonPushParser in chunks of random sizes (down to empty
+// and single bytes) must give the reference's events, or fail where it fails; then nesting
+// limits, JSON pointers, number conversions, SkipContainer and JsonChunkConsumer
+
+#include "JsonReader.h"
+#include "JsonReference.h"
+#include "TestHelper.h"
+#include <algorithm>
+#include <cinttypes>
+#include <cmath>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace LUwpUtilities;
+
+static void AppendEvent(std::string &events, JsonToken type, Utf8Slice text)
+{
+	switch (type)
+	{
+	case JsonToken::StartObject: events += "{\n"; break;
+	case JsonToken::EndObject: events += "}\n"; break;
+	case JsonToken::StartArray: events += "[\n"; break;
+	case JsonToken::EndArray: events += "]\n"; break;
+	case JsonToken::Key: AppendEvent(events, 'K', text.data, text.length); break;
+	case JsonToken::String: AppendEvent(events, 'S', text.data, text.length); break;
+	case JsonToken::Number: AppendEvent(events, 'N', text.data, text.length); break;
+	case JsonToken::True: events += "true\n"; break;
+	case JsonToken::False: events += "false\n"; break;
+	case JsonToken::Null: events += "null\n"; break;
+	default: CHECK(false);
+	}
+}
+
+class LoggingHandler : public JsonHandler
+{
+public:
+	bool StartObject() override { AppendEvent(events, JsonToken::StartObject, Utf8Slice{ nullptr, 0 }); return true; }
+	bool EndObject() override { AppendEvent(events, JsonToken::EndObject, Utf8Slice{ nullptr, 0 }); return true; }
+	bool StartArray() override { AppendEvent(events, JsonToken::StartArray, Utf8Slice{ nullptr, 0 }); return true; }
+	bool EndArray() override { AppendEvent(events, JsonToken::EndArray, Utf8Slice{ nullptr, 0 }); return true; }
+	bool Key(Utf8Slice key) override { AppendEvent(events, JsonToken::Key, key); return true; }
+	bool Value(JsonToken type, Utf8Slice text) override { AppendEvent(events, type, text); return true; }
+
+	std::string events;
+};
+
+// The whole document as the last input
+static bool Tokenize(const std::string &text, std::string &events)
+{
+	JsonTokenizer tokenizer;
+	tokenizer.SetInput(text.data(), text.size(), true);
+	for (;;)
+	{
+		auto token = tokenizer.Next();
+		if (token == JsonToken::End)
+			return true;
+		if (token == JsonToken::Error)
+			return false;
+		CHECK(token != JsonToken::NeedMore);
+		AppendEvent(events, token, tokenizer.Text());
+	}
+}
+
+// Chunks of random sizes, mostly small so that tokens are cut everywhere
+static bool PushParse(const std::string &text, std::mt19937_64 &random, std::string &events)
+{
+	LoggingHandler handler;
+	JsonPushParser parser(handler);
+	bool ok = true;
+	for (size_t offset = 0; ok && offset < text.size();)
+	{
+		size_t size;
+		switch (random() % 4)
+		{
+		case 0: size = random() % 3; break;
+		case 1: size = random() % 8; break;
+		default: size = random() % 300; break;
+		}
+		size = std::min(size, text.size() - offset);
+		ok = parser.Feed(text.data() + offset, size);
+		offset += size;
+	}
+	ok = ok && parser.Finish();
+	events = handler.events;
+	return ok;
+}
+
+static std::string Whitespace(std::mt19937_64 &random)
+{
+	static const char *Spaces[] = { "", " ", "\n  ", "\t\r\n                    " };
+	return Spaces[random() % 4];
+}
+
+// A random document: nested containers, repeated keys, numbers of every form, strings with escapes,
+// surrogate pairs, lone surrogates, raw UTF-8 and long runs
+static std::string RandomDocument(std::mt19937_64 &random, int depth = 0)
+{
+	static const char *Numbers[] = { "0", "-0", "12", "-3.5", "1e10", "2.25E-3", "123456789012345678901", "0.000001", "-1234567.125e+2" };
+	std::string text;
+	switch (random() % (depth > 6 ? 6 : 9))
+	{
+	case 0: return "true";
+	case 1: return "false";
+	case 2: return "null";
+	case 3: return Numbers[random() % 9];
+	case 4:
+	case 5:
+	{
+		text = "\"";
+		int length = (int)(random() % 40);
+		for (int i = 0; i < length; i++)
+		{
+			switch (random() % 20)
+			{
+			case 0: text += "\\n"; break;
+			case 1: text += "\\u00e9"; break;
+			case 2: text += "\\ud83d\\ude00"; break;
+			case 3: text += "\\\""; break;
+			case 4: text += "\xc3\xa9"; break;
+			case 5: text += "\\ud800x"; break;
+			case 6: text += "\\/\\b\\f\\r\\t\\\\"; break;
+			default: text += (char)('a' + random() % 26); break;
+			}
+		}
+		if (random() % 4 == 0)
+			text += std::string(100, 'x');
+		return text + "\"";
+	}
+	case 6:
+	case 7:
+	{
+		text = "[" + Whitespace(random);
+		int count = (int)(random() % 6);
+		for (int i = 0; i < count; i++)
+		{
+			if (i > 0)
+				text += "," + Whitespace(random);
+			text += RandomDocument(random, depth + 1) + Whitespace(random);
+		}
+		return text + "]";
+	}
+	default:
+	{
+		text = "{" + Whitespace(random);
+		int count = (int)(random() % 6);
+		for (int i = 0; i < count; i++)
+		{
+			if (i > 0)
+				text += ",";
+			text += Whitespace(random) + "\"k" + std::to_string(random() % 5) + "\"" + Whitespace(random) + ":" +
+				Whitespace(random) + RandomDocument(random, depth + 1);
+		}
+		return text + Whitespace(random) + "}";
+	}
+	}
+}
+
+// Delete, insert or replace a few bytes with ones that matter to the grammar
+static void Mutate(std::string &text, std::mt19937_64 &random)
+{
+	static const char Bytes[] = "{}[]\",:\\ 0-.eEtfnu1a\x01";
+	int count = 1 + (int)(random() % 3);
+	for (int i = 0; i < count && !text.empty(); i++)
+	{
+		size_t at = random() % text.size();
+		char c = Bytes[random() % (sizeof(Bytes) - 1)];
+		switch (random() % 3)
+		{
+		case 0: text.erase(at, 1); break;
+		case 1: text.insert(at, 1, c); break;
+		default: text[at] = c; break;
+		}
+	}
+}
+
+static void TestAgainstReference()
+{
+	std::mt19937_64 random(42);
+	int valid = 0, invalid = 0;
+	for (int iteration = 0; iteration < 50000; iteration++)
+	{
+		auto text = RandomDocument(random);
+		if (random() % 2 == 0)
+			Mutate(text, random);
+
+		JsonValue root;
+		bool expected = ParseReferenceJson(text, root);
+		std::string tokenized, pushed;
+		bool tokenizerOk = Tokenize(text, tokenized);
+		bool pushOk = PushParse(text, random, pushed);
+		if (tokenizerOk != expected || pushOk != expected || (expected && (tokenized != ReferenceEvents(root) || pushed != tokenized)))
+		{
+			fprintf(stderr, "Document: %s\nReference: %d\nTokenizer: %d\n%sPush parser: %d\n%s", text.c_str(), (int)expected,
+				(int)tokenizerOk, tokenized.c_str(), (int)pushOk, pushed.c_str());
+			CHECK(false);
+		}
+		// Before an error, the chunks make no difference either
+		CHECK(expected || pushed == tokenized);
+		(expected ? valid : invalid)++;
+	}
+	printf("valid=%d invalid=%d\n", valid, invalid);
+	CHECK(valid > 15000 && invalid > 10000);
+}
+
+static void TestEdgeCases()
+{
+	const char *Valid[] =
+	{
+		"0", " \t\r\n\"\" ", "[]", "{}", "[[[]]]", "{\"\":{}}", "-0.0e-0", "1E+2", "\"\\u0000\"", "\"\\uDBFF\\uDFFF\"",
+		"\"\\uDC00\\uD800\"", "\"\x7f\xff\"", "[1,\"a\",true,false,null,{\"b\":[]}]",
+	};
+	const char *Invalid[] =
+	{
+		"", " ", "01", "-", "1.", ".5", "1e", "+1", "[1,]", "{\"a\":1,}", "{\"a\"}", "{a:1}", "[1 2]", "\"\t\"", "\"\\x\"",
+		"\"\\u12\"", "\"abc", "tru", "nul", "true false", "[}", "{]", "]", "\"\\", "NaN", "[1]x",
+	};
+	for (auto text : Valid)
+	{
+		JsonValue root;
+		std::string events;
+		CHECK(ParseReferenceJson(text, root));
+		CHECK(Tokenize(text, events) && events == ReferenceEvents(root));
+	}
+	for (auto text : Invalid)
+	{
+		JsonValue root;
+		std::string events;
+		CHECK(!ParseReferenceJson(text, root) && !Tokenize(text, events));
+	}
+
+	std::string events;
+	CHECK(Tokenize("\"\\ud83d\\ude00\\ud800x\\udc00\"", events) && events == "S11:\xf0\x9f\x98\x80\xef\xbf\xbdx\xef\xbf\xbd\n");
+}
+
+// 512 levels are fine, 513 are not, and a deep document fails without recursing
+static void TestDepth()
+{
+	std::string events;
+	CHECK(Tokenize(std::string(512, '[') + std::string(512, ']'), events));
+	events.clear();
+	CHECK(!Tokenize(std::string(513, '[') + std::string(513, ']'), events));
+	events.clear();
+	CHECK(!Tokenize(std::string(1000000, '['), events));
+
+	JsonTokenizer shallow(2);
+	shallow.SetInput("[[1]]", 5, true);
+	CHECK(shallow.Next() == JsonToken::StartArray && shallow.Next() == JsonToken::StartArray);
+	CHECK(shallow.Next() == JsonToken::Number && shallow.Next() == JsonToken::EndArray);
+	JsonTokenizer tooShallow(1);
+	tooShallow.SetInput("[[1]]", 5, true);
+	CHECK(tooShallow.Next() == JsonToken::StartArray && tooShallow.Next() == JsonToken::Error);
+	CHECK(tooShallow.ErrorMessage() != nullptr);
+}
+
+static void TestPointers()
+{
+	const std::string document = "{\"items\":[{\"id\":1,\"title\":\"a\",\"x\":{\"title\":\"no\"}},{\"title\":\"b\\u00e9\",\"id\":-2}],"
+		"\"next\":\"n\",\"a/b\":{\"c~d\":true}}";
+	std::string found;
+	JsonPointerExtractor extractor({ "/items/*/title", "/next", "/a~1b/c~0d", "/items/1/id" }, [&](size_t pointer, JsonToken, Utf8Slice text)
+	{
+		found += std::to_string(pointer) + ":" + std::string(text.data, text.length) + ";";
+		return true;
+	});
+	// One byte at a time
+	JsonPushParser parser(extractor);
+	for (char c : document)
+		CHECK(parser.Feed(&c, 1));
+	CHECK(parser.Finish());
+	CHECK(found == "0:a;0:b\xc3\xa9;3:-2;1:n;2:true;");
+
+	// Stopping at the first match stops the parse
+	int calls = 0;
+	JsonPointerExtractor first({ "/items/*/title" }, [&](size_t, JsonToken, Utf8Slice) { return ++calls < 1; });
+	JsonPushParser stopped(first);
+	CHECK(!stopped.Feed(document.data(), document.size()) && stopped.IsStopped() && calls == 1);
+}
+
+static void TestNumbers()
+{
+	std::mt19937_64 random(3);
+	for (int i = 0; i < 200000; i++)
+	{
+		// Random mantissas and exponents, against strtod
+		char text[64];
+		int length;
+		switch (random() % 3)
+		{
+		case 0: length = snprintf(text, sizeof(text), "%" PRId64, (int64_t)random() >> (random() % 64)); break;
+		case 1: length = snprintf(text, sizeof(text), "%.*g", (int)(1 + random() % 17), (double)(random() % 1000000) / (1 + random() % 1000)); break;
+		default: length = snprintf(text, sizeof(text), "%" PRIu64 "e%d", (uint64_t)(random() % 100000000000ull), (int)(random() % 80) - 40); break;
+		}
+		double value;
+		CHECK(JsonToDouble(Utf8Slice{ text, (size_t)length }, value));
+		CHECK(value == strtod(text, nullptr));
+	}
+
+	double value;
+	int64_t integer;
+	CHECK(JsonToDouble(Utf8Slice{ "-3.5", 4 }, value) && value == -3.5);
+	CHECK(JsonToDouble(Utf8Slice{ "0.1", 3 }, value) && value == 0.1);
+	CHECK(JsonToInt64(Utf8Slice{ "-9223372036854775808", 20 }, integer) && integer == INT64_MIN);
+	CHECK(JsonToInt64(Utf8Slice{ "9223372036854775807", 19 }, integer) && integer == INT64_MAX);
+	CHECK(!JsonToInt64(Utf8Slice{ "9223372036854775808", 19 }, integer));
+	CHECK(!JsonToInt64(Utf8Slice{ "1.0", 3 }, integer) && !JsonToInt64(Utf8Slice{ "1e2", 3 }, integer));
+}
+
+static void TestSkipContainer()
+{
+	const std::string text = "{\"a\":{\"b\":[1,{\"c\":\"}\"}]},\"d\":3}";
+	JsonTokenizer tokenizer;
+	tokenizer.SetInput(text.data(), text.size(), true);
+	CHECK(tokenizer.Next() == JsonToken::StartObject && tokenizer.Next() == JsonToken::Key);
+	CHECK(tokenizer.Next() == JsonToken::StartObject && tokenizer.SkipContainer() == JsonToken::EndObject);
+	CHECK(tokenizer.Next() == JsonToken::Key && std::string(tokenizer.Text().data, tokenizer.Text().length) == "d");
+	CHECK(tokenizer.Next() == JsonToken::Number && tokenizer.Next() == JsonToken::EndObject && tokenizer.Next() == JsonToken::End);
+}
+
+// Through the ChunkStream consumer: done once, with null or the error
+static void TestChunkConsumer()
+{
+	const std::string Documents[] = { "{\"items\":[1,2,3]}", "{\"items\":[1,2,", "{\"items\":[1,2]]" };
+	for (int i = 0; i < 3; i++)
+	{
+		auto handler = std::make_shared<LoggingHandler>();
+		int calls = 0;
+		bool failed = false;
+		JsonChunkConsumer consumer(handler, [&](std::exception_ptr error) { calls++; failed = (error != nullptr); });
+		bool going = true;
+		try
+		{
+			for (size_t offset = 0; going && offset < Documents[i].size(); offset += 4)
+				going = consumer.OnChunk(BufferView(Documents[i].data() + offset, std::min<size_t>(4, Documents[i].size() - offset)));
+			consumer.OnEnd();
+		}
+		catch (const std::runtime_error &)
+		{
+			// The pump reports a throwing consumer to its OnError
+			consumer.OnError(std::current_exception());
+		}
+		CHECK(calls == 1 && failed == (i != 0));
+	}
+}
+
+int main()
+{
+	TestAgainstReference();
+	TestEdgeCases();
+	TestDepth();
+	TestPointers();
+	TestNumbers();
+	TestSkipContainer();
+	TestChunkConsumer();
+	puts("JsonReaderTest passed");
+	return 0;
+}
@@ -0,0 +1,326 @@
+/**
+ * A plain recursive JSON parser building a DOM, written for clarity and straight from RFC 8259,
+ * to check JsonReader.h against and to benchmark it with:
+ *
+ *     JsonValue root;
+ *     if (ParseReferenceJson(text, root))
+ *         CHECK(ReferenceEvents(root) == events);
+ *
+ * Like JsonReader.h, escapes are decoded, a lone surrogate becomes U+FFFD, raw bytes are not
+ * validated, numbers are kept as written and more than 512 levels of nesting are an error.
+ */
+
+#ifndef _LUWPUTILITIES_JSON_REFERENCE_
+#define _LUWPUTILITIES_JSON_REFERENCE_
+
+#include "JsonReader.h"
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace LUwpUtilities
+{
+	struct JsonValue
+	{
+		JsonToken type = JsonToken::Null; // StartObject, StartArray or a value token
+		std::string text;                 // String (decoded) or Number (as written)
+		std::vector<std::pair<std::string, JsonValue>> members;
+		std::vector<JsonValue> items;
+	};
+
+	class JsonReferenceParser
+	{
+	public:
+		explicit JsonReferenceParser(const std::string &text) : _text(text), _position(0), _depth(0)
+		{
+		}
+
+		bool Parse(JsonValue &root)
+		{
+			if (!ParseValue(root))
+				return false;
+			SkipWhitespace();
+			return _position == _text.size();
+		}
+
+	private:
+		bool AtEnd() const
+		{
+			return _position >= _text.size();
+		}
+
+		void SkipWhitespace()
+		{
+			while (!AtEnd() && (_text[_position] == ' ' || _text[_position] == '\t' || _text[_position] == '\n' || _text[_position] == '\r'))
+				_position++;
+		}
+
+		bool Literal(const char *word, JsonToken type, JsonValue &value)
+		{
+			size_t length = strlen(word);
+			if (_text.compare(_position, length, word) != 0)
+				return false;
+			_position += length;
+			value.type = type;
+			return true;
+		}
+
+		bool ParseValue(JsonValue &value)
+		{
+			SkipWhitespace();
+			if (AtEnd())
+				return false;
+			switch (_text[_position])
+			{
+			case '{': return ParseObject(value);
+			case '[': return ParseArray(value);
+			case '"':
+				value.type = JsonToken::String;
+				return ParseString(value.text);
+			case 't': return Literal("true", JsonToken::True, value);
+			case 'f': return Literal("false", JsonToken::False, value);
+			case 'n': return Literal("null", JsonToken::Null, value);
+			default: return ParseNumber(value);
+			}
+		}
+
+		bool ParseObject(JsonValue &value)
+		{
+			if (++_depth > 512)
+				return false;
+			value.type = JsonToken::StartObject;
+			_position++;
+			SkipWhitespace();
+			if (!AtEnd() && _text[_position] == '}')
+			{
+				_position++;
+				_depth--;
+				return true;
+			}
+			for (;;)
+			{
+				value.members.emplace_back();
+				auto &member = value.members.back();
+				SkipWhitespace();
+				if (AtEnd() || _text[_position] != '"' || !ParseString(member.first))
+					return false;
+				SkipWhitespace();
+				if (AtEnd() || _text[_position] != ':')
+					return false;
+				_position++;
+				if (!ParseValue(member.second))
+					return false;
+				SkipWhitespace();
+				if (AtEnd())
+					return false;
+				if (_text[_position++] == '}')
+					break;
+				if (_text[_position - 1] != ',')
+					return false;
+			}
+			_depth--;
+			return true;
+		}
+
+		bool ParseArray(JsonValue &value)
+		{
+			if (++_depth > 512)
+				return false;
+			value.type = JsonToken::StartArray;
+			_position++;
+			SkipWhitespace();
+			if (!AtEnd() && _text[_position] == ']')
+			{
+				_position++;
+				_depth--;
+				return true;
+			}
+			for (;;)
+			{
+				value.items.emplace_back();
+				if (!ParseValue(value.items.back()))
+					return false;
+				SkipWhitespace();
+				if (AtEnd())
+					return false;
+				if (_text[_position++] == ']')
+					break;
+				if (_text[_position - 1] != ',')
+					return false;
+			}
+			_depth--;
+			return true;
+		}
+
+		bool ParseHex(size_t at, uint32_t &value) const
+		{
+			if (at + 4 > _text.size())
+				return false;
+			value = 0;
+			for (size_t i = at; i < at + 4; i++)
+			{
+				int digit = JsonScan::HexValue(_text[i]);
+				if (digit < 0)
+					return false;
+				value = value * 16 + (uint32_t)digit;
+			}
+			return true;
+		}
+
+		bool ParseString(std::string &result)
+		{
+			_position++;
+			result.clear();
+			for (;;)
+			{
+				if (AtEnd())
+					return false;
+				unsigned char c = (unsigned char)_text[_position++];
+				if (c == '"')
+					return true;
+				if (c < 0x20)
+					return false;
+				if (c != '\\')
+				{
+					result += (char)c;
+					continue;
+				}
+				if (AtEnd())
+					return false;
+				switch (_text[_position++])
+				{
+				case '"': result += '"'; break;
+				case '\\': result += '\\'; break;
+				case '/': result += '/'; break;
+				case 'b': result += '\b'; break;
+				case 'f': result += '\f'; break;
+				case 'n': result += '\n'; break;
+				case 'r': result += '\r'; break;
+				case 't': result += '\t'; break;
+				case 'u':
+				{
+					uint32_t code, low;
+					if (!ParseHex(_position, code))
+						return false;
+					_position += 4;
+					if (code >= 0xD800 && code <= 0xDBFF)
+					{
+						// A high surrogate pairs with an escaped low one, otherwise it stands alone
+						if (_text.compare(_position, 2, "\\u") == 0 && ParseHex(_position + 2, low) && low >= 0xDC00 && low <= 0xDFFF)
+						{
+							code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+							_position += 6;
+						}
+						else
+						{
+							code = 0xFFFD;
+						}
+					}
+					else if (code >= 0xDC00 && code <= 0xDFFF)
+					{
+						code = 0xFFFD;
+					}
+					JsonScan::AppendUtf8(result, code);
+					break;
+				}
+				default:
+					return false;
+				}
+			}
+		}
+
+		size_t SkipDigits()
+		{
+			size_t start = _position;
+			while (!AtEnd() && _text[_position] >= '0' && _text[_position] <= '9')
+				_position++;
+			return _position - start;
+		}
+
+		bool ParseNumber(JsonValue &value)
+		{
+			size_t start = _position;
+			if (_text[_position] == '-')
+				_position++;
+			size_t integer = _position;
+			size_t digits = SkipDigits();
+			if (digits == 0 || (digits > 1 && _text[integer] == '0'))
+				return false;
+			if (!AtEnd() && _text[_position] == '.')
+			{
+				_position++;
+				if (SkipDigits() == 0)
+					return false;
+			}
+			if (!AtEnd() && (_text[_position] == 'e' || _text[_position] == 'E'))
+			{
+				_position++;
+				if (!AtEnd() && (_text[_position] == '+' || _text[_position] == '-'))
+					_position++;
+				if (SkipDigits() == 0)
+					return false;
+			}
+			value.type = JsonToken::Number;
+			value.text = _text.substr(start, _position - start);
+			return true;
+		}
+
+		const std::string &_text;
+		size_t _position;
+		size_t _depth;
+	};
+
+	inline bool ParseReferenceJson(const std::string &text, JsonValue &root)
+	{
+		return JsonReferenceParser(text).Parse(root);
+	}
+
+	// Text carries its length, so that no content can pass for another event
+	inline void AppendEvent(std::string &events, char kind, const char *text, size_t length)
+	{
+		events += kind;
+		events += std::to_string(length);
+		events += ':';
+		events.append(text, length);
+		events += '\n';
+	}
+
+	// One line per event, as the tests log the events of the reader: "{", "K3:key", "S5:value",
+	// "N2:-1", "true", "}"...
+	inline void AppendReferenceEvents(const JsonValue &value, std::string &events)
+	{
+		switch (value.type)
+		{
+		case JsonToken::StartObject:
+			events += "{\n";
+			for (auto &member : value.members)
+			{
+				AppendEvent(events, 'K', member.first.data(), member.first.size());
+				AppendReferenceEvents(member.second, events);
+			}
+			events += "}\n";
+			break;
+		case JsonToken::StartArray:
+			events += "[\n";
+			for (auto &item : value.items)
+				AppendReferenceEvents(item, events);
+			events += "]\n";
+			break;
+		case JsonToken::String: AppendEvent(events, 'S', value.text.data(), value.text.size()); break;
+		case JsonToken::Number: AppendEvent(events, 'N', value.text.data(), value.text.size()); break;
+		case JsonToken::True: events += "true\n"; break;
+		case JsonToken::False: events += "false\n"; break;
+		default: events += "null\n"; break;
+		}
+	}
+
+	inline std::string ReferenceEvents(const JsonValue &root)
+	{
+		std::string events;
+		AppendReferenceEvents(root, events);
+		return events;
+	}
+} // namespace LUwpUtilities
+
+#endif // #ifndef _LUWPUTILITIES_JSON_REFERENCE_
@@ -0,0 +1,148 @@
+// Requests/s and latency percentiles of the request paths, driven by LoadGenerator against
+// LoopbackServer: plain GETs, RequestScheduler admission, RequestCoalescer, RequestPolicy over a
+// server with a latency tail and failures, streaming of large bodies, and an open loop
+
+#include "ChunkStream.h"
+#include "LoadGenerator.h"
+#include "LoopbackClient.h"
+#include "LoopbackServer.h"
+#include "RequestCoalescer.h"
+#include "RequestPolicy.h"
+#include "RequestScheduler.h"
+#include "TestHelper.h"
+#include <condition_variable>
+
+using namespace LUwpUtilities;
+
+// A status other than 200 fails the request
+static LoopbackClient::Headers ExpectOk()
+{
+	return [](const LoopbackResponse &response)
+	{
+		if (response.status != 200)
+			throw std::runtime_error("HTTP " + std::to_string(response.status));
+	};
+}
+
+static LoopbackClient::Abort Fetch(LoopbackClient &client, const std::string &target, LoadGenerator::RequestDone done)
+{
+	return client.Get(target, LoopbackClient::Fields(), ExpectOk(), std::make_shared<CountingConsumer>(std::move(done)));
+}
+
+static LoadReport Run(const char *name, LoadGenerator::Request request, const LoadGenerator::Options &options)
+{
+	std::mutex lock;
+	std::condition_variable finished;
+	bool done = false;
+	LoadReport result;
+	auto generator = LoadGenerator::Start(std::move(request), options, [&](const LoadReport &report)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		result = report;
+		done = true;
+		finished.notify_all();
+	});
+	std::unique_lock<std::mutex> guard(lock);
+	finished.wait(guard, [&]() { return done; });
+	printf("%-12s %s", name, result.Describe().c_str());
+	return result;
+}
+
+int main(int argc, char **argv)
+{
+	bool quick = HasFlag(argc, argv, "--quick");
+	LoopbackServer server;
+	LoopbackClient client(server.Port(), 64);
+
+	auto options = LoadGenerator::DefaultOptions();
+	options.concurrency = 16;
+	options.requests = (quick ? 200 : 20000);
+	options.warmup = 32;
+
+	auto direct = Run("direct", [&](size_t, LoadGenerator::RequestDone done)
+	{
+		Fetch(client, "/small?size=1024", std::move(done));
+	}, options);
+	CHECK(direct.errors == 0 && direct.requests == options.requests);
+
+	// Two slots per host out of the 16 requests in flight
+	RequestScheduler::Options limits = RequestScheduler::DefaultOptions();
+	limits.host.concurrency = 2;
+	RequestScheduler scheduler(limits);
+	auto scheduled = Run("scheduler", [&](size_t, LoadGenerator::RequestDone done)
+	{
+		scheduler.Submit("127.0.0.1", WorkPriority::Normal, [&client, done](RequestScheduler::Done release)
+		{
+			Fetch(client, "/small?size=1024", [release, done](bool success, int64_t bytes)
+			{
+				release();
+				done(success, bytes);
+			});
+		});
+	}, options);
+	CHECK(scheduled.errors == 0);
+
+	// Eight distinct URLs, each taking 2 ms: most callers join a request in flight
+	struct Outcome
+	{
+		bool success;
+		int64_t bytes;
+	};
+	RequestCoalescer<Outcome> coalescer;
+	auto before = server.Requests();
+	auto coalesced = Run("coalescer", [&](size_t index, LoadGenerator::RequestDone done)
+	{
+		auto target = "/shared" + std::to_string(index % 8) + "?size=4096&latency=2";
+		coalescer.Request(target, [&client, target](RequestCoalescer<Outcome>::Callback complete)
+		{
+			return Fetch(client, target, [complete](bool success, int64_t bytes) { complete(Outcome{ success, bytes }); });
+		}, [done](const Outcome &outcome) { done(outcome.success, outcome.bytes); });
+	}, options);
+	CHECK(coalesced.errors == 0);
+	printf("%-12s server requests=%zu\n", "", server.Requests() - before);
+
+	// 1 ms to 3 ms, a 60 ms request in 20 and a 503 in 25: hedges cut the tail, retries the errors
+	auto policyOptions = RequestPolicy::DefaultOptions();
+	policyOptions.minHedgeDelay = 1000;
+	policyOptions.baseBackoff = 1000;
+	policyOptions.budgetRatio = 0.2;
+	RequestPolicy policy(policyOptions);
+	auto tail = Run("policy", [&](size_t, LoadGenerator::RequestDone done)
+	{
+		policy.Execute<Outcome>([&client](RequestPolicy::AttemptDone<Outcome> attempt)
+		{
+			auto consumer = std::make_shared<CountingConsumer>([attempt](bool success, int64_t bytes)
+			{
+				attempt(Outcome{ success, bytes }, success ? AttemptOutcome::Success : AttemptOutcome::Transient);
+			});
+			return client.Get("/tail?size=1024&latency=1&jitter=2&slow_every=20&slow=60&fail_every=25",
+				LoopbackClient::Fields(), ExpectOk(), consumer);
+		}, [done](const Outcome &outcome, AttemptOutcome) { done(outcome.success, outcome.bytes); });
+	}, options);
+	auto statistics = policy.GetStatistics();
+	printf("%-12s hedges=%zu hedge_wins=%zu retries=%zu budget_denied=%zu\n", "", statistics.hedges, statistics.hedgeWins,
+		statistics.retries, statistics.budgetDenied);
+
+	// Large chunked bodies through ChunkPump
+	auto streamingOptions = options;
+	streamingOptions.concurrency = 4;
+	streamingOptions.requests = (quick ? 20 : 500);
+	streamingOptions.warmup = 4;
+	auto streaming = Run("streaming", [&](size_t, LoadGenerator::RequestDone done)
+	{
+		Fetch(client, "/large?size=4000000&chunked=1", std::move(done));
+	}, streamingOptions);
+	CHECK(streaming.errors == 0 && streaming.bytes == streamingOptions.requests * 4000000ull);
+	printf("%-12s %.1f MB/s\n", "", streaming.bytes / 1e6 / (streaming.elapsed / 1e9));
+
+	// Open loop at a fixed rate, with a latency tail on the server
+	auto openOptions = options;
+	openOptions.ratePerSecond = 1000;
+	openOptions.requests = (quick ? 100 : 5000);
+	auto open = Run("open-loop", [&](size_t, LoadGenerator::RequestDone done)
+	{
+		Fetch(client, "/paced?size=1024&slow_every=50&slow=30", std::move(done));
+	}, openOptions);
+	CHECK(open.errors == 0);
+	return (tail.errors * 10 <= tail.requests ? 0 : 1);
+}
@@ -0,0 +1,87 @@
+// Speed-up of ParallelFor over a serial loop with 1 to 8 workers, on a skewed workload (the last
+// tenth of the items costs 20 times more), against splitting the range into one equal part per
+// worker. Only as many workers as there are cores can help.
+
+#include "ParallelHelper.h"
+#include "TestHelper.h"
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <thread>
+
+using namespace LUwpUtilities;
+
+static size_t Cost(size_t i, size_t count)
+{
+	return (i >= count - count / 10 ? 2000 : 100);
+}
+
+static std::atomic<size_t> total(0);
+
+static void Body(size_t first, size_t last, size_t count)
+{
+	size_t sum = 0;
+	for (size_t i = first; i < last; i++)
+	{
+		volatile size_t sink = 0;
+		for (size_t k = Cost(i, count); k > 0; k--)
+			sink = sink + k;
+		sum += i;
+	}
+	total += sum;
+}
+
+// One equal part per worker, the caller waiting
+static void StaticSplit(ThreadPool &pool, size_t count)
+{
+	size_t parts = pool.WorkerCount();
+	std::atomic<size_t> finished(0);
+	for (size_t p = 0; p < parts; p++)
+	{
+		pool.Submit([&finished, p, parts, count]()
+		{
+			Body(count * p / parts, count * (p + 1) / parts, count);
+			finished++;
+		});
+	}
+	while (finished.load() < parts)
+		std::this_thread::yield();
+}
+
+// Best of a few runs, in seconds
+static double Measure(int runs, const std::function<void()> &loop)
+{
+	double best = 1e9;
+	for (int r = 0; r < runs; r++)
+	{
+		auto start = std::chrono::steady_clock::now();
+		loop();
+		best = std::min(best, SecondsSince(start));
+	}
+	return best;
+}
+
+int main(int argc, char **argv)
+{
+	bool quick = HasFlag(argc, argv, "--quick");
+	size_t count = (quick ? 2000 : 200000);
+	int runs = (quick ? 1 : 5);
+	size_t expected = count * (count - 1) / 2;
+
+	total = 0;
+	double serial = Measure(runs, [&]() { Body(0, count, count); });
+	CHECK(total.load() == expected * runs);
+	printf("cores=%u serial: %.1f ms\n", std::thread::hardware_concurrency(), serial * 1e3);
+
+	for (unsigned workers : { 1u, 2u, 4u, 8u })
+	{
+		ThreadPool pool(workers);
+		total = 0;
+		double guided = Measure(runs, [&]() { ParallelFor(pool, 0, count, [count](size_t first, size_t last) { Body(first, last, count); }); });
+		double split = Measure(runs, [&]() { StaticSplit(pool, count); });
+		CHECK(total.load() == 2 * expected * runs);
+		printf("workers=%u ParallelFor: %7.1f ms (x%.2f)  equal parts: %7.1f ms (x%.2f)\n", workers,
+			guided * 1e3, serial / guided, split * 1e3, serial / split);
+	}
+	return 0;
+}
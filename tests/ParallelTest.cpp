@@ -0,0 +1,176 @@
+// ParallelFor and ParallelForAsync: every index visited exactly once for any range, chunk size
+// and pool size, guided chunks that shrink towards the end, uneven per-item costs, an exception
+// in one chunk, and a ParallelFor nested in a worker
+
+#include "ParallelHelper.h"
+#include "TestHelper.h"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace LUwpUtilities;
+
+// Work proportional to cost, that the compiler cannot drop
+static void Spin(size_t cost)
+{
+	volatile size_t sink = 0;
+	for (size_t k = 0; k < cost; k++)
+		sink = sink + k;
+}
+
+static void TestEveryIndexOnce()
+{
+	for (unsigned workers : { 1u, 2u, 4u })
+	{
+		ThreadPool pool(workers);
+		for (size_t count : { (size_t)0, (size_t)1, (size_t)7, (size_t)1000, (size_t)100003 })
+		{
+			for (size_t minChunk : { (size_t)1, (size_t)16, (size_t)5000 })
+			{
+				const size_t Begin = 5;
+				std::unique_ptr<std::atomic<int>[]> visits(new std::atomic<int>[count + 1]);
+				for (size_t i = 0; i < count; i++)
+					visits[i] = 0;
+				auto body = [&](size_t first, size_t last)
+				{
+					CHECK(first >= Begin && first < last && last <= Begin + count);
+					for (size_t i = first; i < last; i++)
+						visits[i - Begin]++;
+				};
+				ParallelFor(pool, Begin, Begin + count, body, minChunk);
+				for (size_t i = 0; i < count; i++)
+					CHECK(visits[i].load() == 1);
+
+				for (size_t i = 0; i < count; i++)
+					visits[i] = 0;
+				std::atomic<int> completions(0);
+				ParallelForAsync(pool, Begin, Begin + count, body, [&](std::exception_ptr error)
+				{
+					CHECK(!error);
+					completions++;
+				}, minChunk);
+				CHECK(WaitFor([&]() { return completions.load() == 1; }));
+				for (size_t i = 0; i < count; i++)
+					CHECK(visits[i].load() == 1);
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				CHECK(completions.load() == 1);
+			}
+		}
+	}
+}
+
+// Chunks start at a share of the range and shrink, but never below minChunk
+static void TestGuidedChunks()
+{
+	ThreadPool pool(4);
+	const size_t Count = 100000, MinChunk = 8;
+	std::mutex lock;
+	std::vector<std::pair<size_t, size_t>> chunks;
+	ParallelFor(pool, 0, Count, [&](size_t first, size_t last)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		chunks.emplace_back(first, last);
+	}, MinChunk);
+
+	std::sort(chunks.begin(), chunks.end());
+	CHECK(chunks.front().first == 0 && chunks.back().second == Count);
+	for (size_t c = 0; c < chunks.size(); c++)
+	{
+		size_t size = chunks[c].second - chunks[c].first;
+		CHECK(size >= MinChunk || chunks[c].second == Count);
+		if (c > 0)
+			CHECK(chunks[c].first == chunks[c - 1].second && size <= chunks[c - 1].second - chunks[c - 1].first);
+	}
+	CHECK(chunks.front().second == Count / 8);
+	// Far fewer claims than indices, far more than participants
+	printf("chunks=%zu\n", chunks.size());
+	CHECK(chunks.size() > 8 && chunks.size() < 200);
+}
+
+// A few items cost a hundred times more than the others, all at the end of the range
+static void TestUnevenWork()
+{
+	ThreadPool pool(4);
+	const size_t Count = 20000;
+	std::atomic<size_t> visited(0);
+	std::mutex lock;
+	std::vector<std::thread::id> threads;
+	ParallelFor(pool, 0, Count, [&](size_t first, size_t last)
+	{
+		for (size_t i = first; i < last; i++)
+			Spin(i >= Count - 100 ? 100000 : 1000);
+		visited += last - first;
+		std::lock_guard<std::mutex> guard(lock);
+		if (std::find(threads.begin(), threads.end(), std::this_thread::get_id()) == threads.end())
+			threads.push_back(std::this_thread::get_id());
+	});
+	CHECK(visited.load() == Count);
+	printf("participants=%zu\n", threads.size());
+}
+
+// The other chunks still run, and the first error is reported once
+static void TestException()
+{
+	ThreadPool pool(4);
+	const size_t Count = 10000;
+	std::atomic<size_t> visited(0);
+	auto body = [&](size_t first, size_t last)
+	{
+		visited += last - first;
+		if (first <= 5000 && 5000 < last)
+			throw std::runtime_error("chunk");
+	};
+
+	bool thrown = false;
+	try
+	{
+		ParallelFor(pool, 0, Count, body, 4);
+	}
+	catch (const std::runtime_error &e)
+	{
+		thrown = (strcmp(e.what(), "chunk") == 0);
+	}
+	CHECK(thrown && visited.load() == Count);
+
+	visited = 0;
+	std::atomic<int> errors(0), completions(0);
+	ParallelForAsync(pool, 0, Count, body, [&](std::exception_ptr error)
+	{
+		if (error)
+			errors++;
+		completions++;
+	}, 4);
+	CHECK(WaitFor([&]() { return completions.load() == 1; }));
+	CHECK(errors.load() == 1 && visited.load() == Count);
+}
+
+// The calling worker takes part, so a loop in the only worker of a pool completes
+static void TestNestedInWorker()
+{
+	ThreadPool pool(1);
+	std::atomic<size_t> visited(0);
+	std::atomic<bool> done(false);
+	pool.Submit([&]()
+	{
+		ParallelFor(pool, 0, 1000, [&](size_t first, size_t last) { visited += last - first; });
+		done = true;
+	});
+	CHECK(WaitFor([&]() { return done.load(); }));
+	CHECK(visited.load() == 1000);
+}
+
+int main()
+{
+	TestEveryIndexOnce();
+	TestGuidedChunks();
+	TestUnevenWork();
+	TestException();
+	TestNestedInWorker();
+	puts("ParallelTest passed");
+	return 0;
+}
@@ -0,0 +1,118 @@
+// Throughput of a Pipeline of synthetic stages that spin for a fixed time per item, against
+// running the same stages in a loop and one ThreadPool task per item, with the utilization of
+// each stage (the bottleneck is near 1); then the overhead per item and stage with empty stages
+
+#include "Pipeline.h"
+#include "TestHelper.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace LUwpUtilities;
+
+typedef std::chrono::steady_clock Clock;
+
+struct SyntheticStage
+{
+	const char *name;
+	std::chrono::microseconds cost;
+	size_t parallelism;
+};
+
+static void Spin(std::chrono::microseconds cost)
+{
+	auto end = Clock::now() + cost;
+	while (Clock::now() < end)
+		;
+}
+
+static double Serial(const std::vector<SyntheticStage> &stages, int items)
+{
+	auto start = Clock::now();
+	for (int i = 0; i < items; i++)
+	{
+		for (auto &stage : stages)
+			Spin(stage.cost);
+	}
+	return items / SecondsSince(start);
+}
+
+// Every item as one task doing all the stages: no bound on what is queued
+static double TaskPerItem(ThreadPool &pool, const std::vector<SyntheticStage> &stages, int items)
+{
+	std::atomic<int> done(0);
+	auto start = Clock::now();
+	for (int i = 0; i < items; i++)
+	{
+		pool.Submit([&]()
+		{
+			for (auto &stage : stages)
+				Spin(stage.cost);
+			done++;
+		});
+	}
+	CHECK(WaitFor([&]() { return done.load() == items; }, std::chrono::milliseconds(600000)));
+	return items / SecondsSince(start);
+}
+
+static double Pipelined(ThreadPool &pool, const std::vector<SyntheticStage> &stages, int items, bool print)
+{
+	auto pipeline = Pipeline<int>::Create(pool);
+	for (auto &stage : stages)
+	{
+		auto cost = stage.cost;
+		pipeline->AddStage(stage.name, [cost](int &item)
+		{
+			if (cost.count() > 0)
+				Spin(cost);
+			item++;
+			return true;
+		}, stage.parallelism, 16);
+	}
+
+	std::atomic<bool> drained(false);
+	auto start = Clock::now();
+	for (int i = 0; i < items; i++)
+		pipeline->Push(i);
+	pipeline->Close([&]() { drained = true; });
+	CHECK(WaitFor([&]() { return drained.load(); }, std::chrono::milliseconds(600000)));
+	double throughput = items / SecondsSince(start);
+
+	for (auto &stage : pipeline->GetStatistics())
+	{
+		CHECK(stage.processed == (size_t)items);
+		if (print)
+			printf("  %-6s utilization %.2f  stalls %zu\n", stage.name.c_str(), stage.utilization, stage.stalls);
+	}
+	return throughput;
+}
+
+int main(int argc, char **argv)
+{
+	bool quick = HasFlag(argc, argv, "--quick");
+	int items = (quick ? 200 : 50000);
+	ThreadPool pool(4);
+
+	// fetch -> parse -> map -> ui: parse is the bottleneck unless it gets enough parallelism
+	std::vector<SyntheticStage> stages = {
+		{ "fetch", std::chrono::microseconds(5), 2 },
+		{ "parse", std::chrono::microseconds(40), 2 },
+		{ "map", std::chrono::microseconds(10), 2 },
+		{ "ui", std::chrono::microseconds(2), 1 },
+	};
+	printf("cores=%u workers=%u, %d items\n", std::thread::hardware_concurrency(), pool.WorkerCount(), items);
+	printf("serial loop:       %9.0f items/s\n", Serial(stages, items));
+	printf("task per item:     %9.0f items/s\n", TaskPerItem(pool, stages, items));
+	printf("pipeline:          %9.0f items/s\n", Pipelined(pool, stages, items, true));
+
+	std::vector<SyntheticStage> empty = {
+		{ "a", std::chrono::microseconds(0), 4 },
+		{ "b", std::chrono::microseconds(0), 4 },
+		{ "c", std::chrono::microseconds(0), 4 },
+		{ "d", std::chrono::microseconds(0), 1 },
+	};
+	int emptyItems = items * 4;
+	double throughput = Pipelined(pool, empty, emptyItems, false);
+	printf("empty stages:      %9.0f items/s (%.0f ns per item and stage)\n", throughput, 1e9 / throughput / empty.size());
+	return 0;
+}
@@ -0,0 +1,161 @@
+// Pipeline: a blocked stage fills the queues before it and then blocks Push() and fails TryPush()
+// at the entrance, every item goes through once the stage is released, dropped and failing items
+// reach the statistics and the error handler, Close() reports the drain once, and a stage with
+// its own executor runs there one item at a time
+
+#include "Pipeline.h"
+#include "TestHelper.h"
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace LUwpUtilities;
+
+static void TestBackpressure()
+{
+	ThreadPool pool(4);
+	auto pipeline = Pipeline<int>::Create(pool);
+	std::atomic<bool> release(false);
+	std::atomic<int> sum(0);
+	pipeline->AddStage("fast", [](int &item) { item *= 2; return true; }, 4, 4);
+	pipeline->AddStage("blocked", [&](int &item)
+	{
+		while (!release.load())
+			std::this_thread::yield();
+		sum += item;
+		return true;
+	}, 1, 2);
+	pipeline->AddStage("sink", [](int &) { return true; }, 1, 1);
+
+	const int Items = 20;
+	std::atomic<int> pushed(0);
+	std::thread producer([&]()
+	{
+		for (int i = 0; i < Items; i++)
+		{
+			pipeline->Push(i);
+			pushed++;
+		}
+	});
+
+	// One item in the blocked stage, two in its queue, four in the first queue, then Push() waits
+	CHECK(WaitFor([&]() { return pushed.load() == 7; }));
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	CHECK(pushed.load() == 7);
+	CHECK(!pipeline->TryPush(100));
+	auto statistics = pipeline->GetStatistics();
+	CHECK(statistics[0].queued == 4 && statistics[0].running == 0 && statistics[0].processed == 3);
+	CHECK(statistics[0].stalls >= 1);
+	CHECK(statistics[1].queued == 2 && statistics[1].running == 1 && statistics[1].processed == 0);
+	CHECK(statistics[2].processed == 0);
+
+	release = true;
+	producer.join();
+	std::atomic<int> drained(0);
+	pipeline->Close([&]() { drained++; });
+	CHECK(WaitFor([&]() { return drained.load() == 1; }));
+	CHECK(sum.load() == Items * (Items - 1));
+	statistics = pipeline->GetStatistics();
+	for (auto &stage : statistics)
+		CHECK(stage.processed == Items && stage.dropped == 0 && stage.queued == 0 && stage.running == 0);
+	CHECK(!pipeline->TryPush(0));
+	std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	CHECK(drained.load() == 1);
+}
+
+// Dropped items stop where they are dropped; errors go to the handler and drop the item too
+static void TestDropsAndErrors()
+{
+	ThreadPool pool(4);
+	auto pipeline = Pipeline<int>::Create(pool);
+	std::atomic<int> errors(0), reached(0);
+	pipeline->OnError([&](std::exception_ptr error)
+	{
+		try
+		{
+			std::rethrow_exception(error);
+		}
+		catch (const std::runtime_error &)
+		{
+			errors++;
+		}
+	});
+	pipeline->AddStage("filter", [](int &item) { return item % 3 != 0; }, 2, 8);
+	pipeline->AddStage("fail", [](int &item)
+	{
+		if (item % 3 == 1)
+			throw std::runtime_error("fail");
+		return true;
+	}, 2, 8);
+	pipeline->AddStage("sink", [&](int &item)
+	{
+		CHECK(item % 3 == 2);
+		reached++;
+		return true;
+	}, 1, 8);
+
+	const int Items = 300;
+	for (int i = 0; i < Items; i++)
+		pipeline->Push(i);
+	std::atomic<int> drained(0);
+	pipeline->Close([&]() { drained++; });
+	CHECK(WaitFor([&]() { return drained.load() == 1; }));
+	CHECK(errors.load() == Items / 3 && reached.load() == Items / 3);
+	auto statistics = pipeline->GetStatistics();
+	CHECK(statistics[0].processed == 2 * Items / 3 && statistics[0].dropped == Items / 3);
+	CHECK(statistics[1].processed == Items / 3 && statistics[1].dropped == Items / 3);
+	CHECK(statistics[2].processed == Items / 3 && statistics[2].dropped == 0);
+}
+
+// Close() on an empty pipeline reports the drain at once, on the calling thread
+static void TestCloseEmpty()
+{
+	ThreadPool pool(1);
+	auto pipeline = Pipeline<int>::Create(pool);
+	pipeline->AddStage("only", [](int &) { return true; }, 1, 1);
+	bool drained = false;
+	pipeline->Close([&]() { drained = true; });
+	CHECK(drained);
+}
+
+// The last stage runs on a UI loop, one item at a time, and the drain is reported after it
+static void TestExecutor()
+{
+	ThreadPool pool(4);
+	FakeUiLoop loop;
+	auto pipeline = Pipeline<int>::Create(pool);
+	std::atomic<int> running(0), overlaps(0), offLoop(0), appended(0);
+	pipeline->AddStage("map", [](int &item) { item += 1; return true; }, 4, 8);
+	pipeline->AddStage("ui", [&](int &)
+	{
+		if (running++ != 0)
+			overlaps++;
+		if (!loop.OnLoop())
+			offLoop++;
+		std::this_thread::sleep_for(std::chrono::microseconds(100));
+		appended++;
+		running--;
+		return true;
+	}, 1, 4, [&](std::function<void()> work) { loop.Dispatch(std::move(work)); });
+
+	const int Items = 100;
+	for (int i = 0; i < Items; i++)
+		pipeline->Push(i);
+	std::atomic<bool> drained(false);
+	pipeline->Close([&]() { drained = (appended.load() == Items); });
+	CHECK(WaitFor([&]() { return drained.load(); }));
+	CHECK(overlaps.load() == 0 && offLoop.load() == 0);
+	// Never more UI work queued than the stage lets run
+	CHECK(loop.MaxPending() <= 1);
+}
+
+int main()
+{
+	TestBackpressure();
+	TestDropsAndErrors();
+	TestCloseEmpty();
+	TestExecutor();
+	puts("PipelineTest passed");
+	return 0;
+}
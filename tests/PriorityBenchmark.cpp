@@ -0,0 +1,72 @@
+// Start latency of urgent work while the pool is saturated with background work: UserBlocking
+// work should start at the next task boundary, where Normal work waits behind the backlog
+
+#include "ThreadPool.h"
+#include "TestHelper.h"
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+using namespace LUwpUtilities;
+
+static void Spin(std::chrono::microseconds duration)
+{
+	auto start = std::chrono::steady_clock::now();
+	while (std::chrono::steady_clock::now() - start < duration)
+	{
+	}
+}
+
+static const char *Name(WorkPriority priority)
+{
+	static const char *names[] = { "UserBlocking", "Normal", "Prefetch", "Idle" };
+	return names[(int)priority];
+}
+
+// Percentiles in microseconds of the delay between Submit and the start of probes, sent while a
+// backlog of 200 us background tasks at the given priority drains
+static void Measure(WorkPriority background, WorkPriority probe, int backlog, int probes)
+{
+	ThreadPool pool(4);
+	std::atomic<int> finished(0);
+	for (int i = 0; i < backlog; i++)
+	{
+		pool.Submit([&finished]()
+		{
+			Spin(std::chrono::microseconds(200));
+			finished++;
+		}, background);
+	}
+
+	// Spread over the time the backlog takes on the four workers
+	auto interval = std::chrono::microseconds(backlog * 200 / 4 / probes);
+	std::vector<double> latencies(probes);
+	std::atomic<int> started(0);
+	for (int i = 0; i < probes; i++)
+	{
+		auto submitted = std::chrono::steady_clock::now();
+		pool.Submit([&latencies, &started, i, submitted]()
+		{
+			latencies[i] = SecondsSince(submitted) * 1e6;
+			started++;
+		}, probe);
+		std::this_thread::sleep_for(interval);
+	}
+	CHECK(WaitFor([&]() { return started.load() == probes && finished.load() == backlog; }, std::chrono::milliseconds(120000)));
+	std::sort(latencies.begin(), latencies.end());
+	printf("background=%-8s probe=%-12s p50=%.1f us p99=%.1f us max=%.1f us\n", Name(background), Name(probe),
+		latencies[latencies.size() / 2], latencies[latencies.size() * 99 / 100], latencies.back());
+}
+
+int main(int argc, char **argv)
+{
+	bool quick = HasFlag(argc, argv, "--quick");
+	int backlog = (quick ? 500 : 20000);
+	int probes = (quick ? 50 : 1000);
+	// Same lane: the probe waits for the backlog ahead of it
+	Measure(WorkPriority::Normal, WorkPriority::Normal, backlog, probes);
+	// Background backlog: the probe runs on the worker kept free or at the next task boundary
+	Measure(WorkPriority::Prefetch, WorkPriority::Normal, backlog, probes);
+	Measure(WorkPriority::Idle, WorkPriority::UserBlocking, backlog, probes);
+	return 0;
+}
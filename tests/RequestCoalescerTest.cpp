@@ -0,0 +1,243 @@
+// RequestCoalescer over a mock transport: fan-out of responses and errors, callers leaving,
+// aborts of abandoned requests (whose late answer must not reach a newer request), synchronous
+// completion, and threads racing Request/Leave against completions from a pool
+
+#include "RequestCoalescer.h"
+#include "TestHelper.h"
+#include "ThreadPool.h"
+#include <atomic>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace LUwpUtilities;
+
+struct Response
+{
+	int status;      // 0 for an error
+	std::string body;
+};
+
+typedef RequestCoalescer<Response> Coalescer;
+
+// Requests sent through it wait until the test answers them; an abort answers with an error
+class MockTransport
+{
+public:
+	struct Sent
+	{
+		std::string key;
+		Coalescer::Callback complete;
+		bool aborted;
+	};
+
+	Coalescer::Send Send(const std::string &key)
+	{
+		return [this, key](Coalescer::Callback complete)
+		{
+			auto index = _sent.size();
+			_sent.push_back(Sent{ key, complete, false });
+			return Coalescer::Abort([this, index]()
+			{
+				_sent[index].aborted = true;
+				_aborts++;
+			});
+		};
+	}
+
+	size_t Count() const
+	{
+		return _sent.size();
+	}
+
+	Sent &operator[](size_t index)
+	{
+		return _sent[index];
+	}
+
+	// The transport reports an abort as an error
+	void AnswerAborted(size_t index)
+	{
+		_sent[index].complete(Response{ 0, "aborted" });
+	}
+
+	int Aborts() const
+	{
+		return _aborts;
+	}
+
+private:
+	std::vector<Sent> _sent;
+	int _aborts = 0;
+};
+
+static void TestFanOut()
+{
+	Coalescer coalescer;
+	MockTransport transport;
+	const std::string key = "http://example.com/a";
+	std::vector<Response> received;
+	for (int i = 0; i < 5; i++)
+		coalescer.Request(key, transport.Send(key), [&](const Response &response) { received.push_back(response); });
+	// Another URL is a request of its own
+	int other = 0;
+	coalescer.Request("http://example.com/b", transport.Send("http://example.com/b"), [&](const Response&) { other++; });
+	CHECK(transport.Count() == 2 && coalescer.Count() == 2);
+
+	transport[0].complete(Response{ 200, "a" });
+	CHECK(received.size() == 5 && coalescer.Count() == 1);
+	for (auto &response : received)
+		CHECK(response.status == 200 && response.body == "a");
+	// A second answer of the same request goes nowhere
+	transport[0].complete(Response{ 500, "late" });
+	CHECK(received.size() == 5);
+
+	// The key is free again: the next caller sends anew, and an error fans out like a response
+	int errors = 0;
+	coalescer.Request(key, transport.Send(key), [&](const Response &response) { errors += (response.status == 0); });
+	coalescer.Request(key, transport.Send(key), [&](const Response &response) { errors += (response.status == 0); });
+	CHECK(transport.Count() == 3);
+	transport[2].complete(Response{ 0, "connection reset" });
+	CHECK(errors == 2 && other == 0);
+	transport[1].complete(Response{ 200, "b" });
+	CHECK(other == 1 && coalescer.Count() == 0);
+
+	auto statistics = coalescer.GetStatistics();
+	CHECK(statistics.requests == 3 && statistics.coalesced == 5 && statistics.aborted == 0);
+}
+
+static void TestLeave()
+{
+	Coalescer coalescer;
+	MockTransport transport;
+	const std::string key = "http://example.com/leave";
+	int called = 0;
+	auto first = coalescer.Request(key, transport.Send(key), [&](const Response&) { called++; });
+	auto second = coalescer.Request(key, transport.Send(key), [&](const Response&) { called++; });
+
+	// One caller leaves: the request goes on for the other
+	CHECK(coalescer.Leave(key, first) && transport.Aborts() == 0);
+	CHECK(!coalescer.Leave(key, first));
+	// The last one leaves: the request is aborted and forgotten
+	CHECK(coalescer.Leave(key, second) && transport.Aborts() == 1 && transport[0].aborted);
+	CHECK(coalescer.Count() == 0);
+
+	// A new request for the key; the abort's late error must not reach it
+	Response latest = { -1, "" };
+	auto third = coalescer.Request(key, transport.Send(key), [&](const Response &response) { latest = response; });
+	CHECK(transport.Count() == 2);
+	transport.AnswerAborted(0);
+	CHECK(called == 0 && latest.status == -1 && coalescer.Count() == 1);
+	transport[1].complete(Response{ 200, "fresh" });
+	CHECK(latest.status == 200 && latest.body == "fresh");
+	// Too late to leave
+	CHECK(!coalescer.Leave(key, third));
+	CHECK(coalescer.GetStatistics().aborted == 1);
+}
+
+static void TestCompletionDuringSend()
+{
+	// Answered before send returns
+	Coalescer coalescer;
+	int status = 0;
+	coalescer.Request("k", [](Coalescer::Callback complete)
+	{
+		complete(Response{ 204, "" });
+		return Coalescer::Abort([]() { CHECK(false); });
+	}, [&](const Response &response) { status = response.status; });
+	CHECK(status == 204 && coalescer.Count() == 0);
+
+	// Every caller left while send was running: aborted as soon as send returns
+	Coalescer fresh;
+	int aborts = 0;
+	auto ticket = fresh.Request("k", [&](Coalescer::Callback)
+	{
+		// The first ticket of a coalescer is 1
+		CHECK(fresh.Leave("k", 1));
+		CHECK(aborts == 0);
+		return Coalescer::Abort([&]() { aborts++; });
+	}, [](const Response&) { CHECK(false); });
+	CHECK(ticket == 1 && aborts == 1 && fresh.Count() == 0);
+}
+
+// Callers on several threads, answers on a pool after a random delay, some callers leaving:
+// each caller either gets exactly one answer or successfully leaves, never both
+static void TestConcurrentCallers()
+{
+	Coalescer coalescer;
+	ThreadPool pool(4);
+	const int Threads = 8, Calls = 3000, Keys = 7;
+	std::vector<std::atomic<int>> outcomes(Threads * Calls); // answers + 10 * successful leaves
+	for (auto &outcome : outcomes)
+		outcome = 0;
+	std::atomic<int> sends(0), aborts(0), wrong(0), answered(0);
+
+	std::vector<std::thread> threads;
+	for (int t = 0; t < Threads; t++)
+	{
+		threads.emplace_back([&, t]()
+		{
+			std::mt19937 random(t + 1);
+			for (int i = 0; i < Calls; i++)
+			{
+				int caller = t * Calls + i;
+				auto key = std::to_string(i % Keys);
+				auto delay = (int)(random() % 200);
+				auto ticket = coalescer.Request(key, [&, key, delay](Coalescer::Callback complete)
+				{
+					sends++;
+					auto abort = std::make_shared<std::atomic<bool>>(false);
+					pool.Submit([key, delay, abort, complete]()
+					{
+						std::this_thread::sleep_for(std::chrono::microseconds(delay));
+						complete(*abort ? Response{ 0, "aborted" } : Response{ 200, key });
+					});
+					return Coalescer::Abort([abort, &aborts]()
+					{
+						*abort = true;
+						aborts++;
+					});
+				}, [&, caller, key](const Response &response)
+				{
+					// Only abandoned requests are aborted, so nobody waiting gets that error
+					if (response.status != 200 || response.body != key)
+						wrong++;
+					outcomes[caller]++;
+					answered++;
+				});
+				if (random() % 4 == 0 && coalescer.Leave(key, ticket))
+					outcomes[caller] += 10;
+			}
+		});
+	}
+	for (auto &thread : threads)
+		thread.join();
+	CHECK(WaitFor([&]() { return coalescer.Count() == 0; }));
+
+	int left = 0;
+	for (auto &outcome : outcomes)
+	{
+		CHECK(WaitFor([&]() { return outcome.load() != 0; }));
+		CHECK(outcome == 1 || outcome == 10);
+		left += (outcome == 10);
+	}
+	CHECK(wrong == 0 && answered + left == Threads * Calls);
+
+	auto statistics = coalescer.GetStatistics();
+	CHECK(statistics.requests == (size_t)sends.load() && statistics.aborted == (size_t)aborts.load());
+	CHECK(statistics.requests + statistics.coalesced == (size_t)(Threads * Calls));
+	printf("callers=%d sent=%zu coalesced=%zu left=%d aborted=%zu\n", Threads * Calls, statistics.requests,
+		statistics.coalesced, left, statistics.aborted);
+}
+
+int main()
+{
+	TestFanOut();
+	TestLeave();
+	TestCompletionDuringSend();
+	TestConcurrentCallers();
+	puts("RequestCoalescerTest passed");
+	return 0;
+}
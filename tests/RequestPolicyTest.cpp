@@ -0,0 +1,170 @@
+// RequestPolicy: hedging and retries simulated in virtual time, then real attempts against
+// LoopbackServer with injected latency tails and 503s
+
+#include "LoopbackClient.h"
+#include "LoopbackServer.h"
+#include "RequestPolicy.h"
+#include "TestHelper.h"
+#include <algorithm>
+#include <random>
+#include <vector>
+
+using namespace LUwpUtilities;
+
+struct SimulationResult
+{
+	double p99;     // milliseconds
+	int failures;
+	double load;    // attempts per call
+};
+
+// 5000 calls of ~40 ms, 2% of the attempts stall for 1.5 s and failRate of them answer 503
+static SimulationResult Simulate(bool policy, double failRate)
+{
+	Simulation simulation;
+	auto options = RequestPolicy::DefaultOptions();
+	options.seed = 7;
+	if (!policy)
+	{
+		options.hedgePercentile = 0;
+		options.maxAttempts = 1;
+	}
+	RequestPolicy engine(options, [&]() { return simulation.now; },
+		[&](uint64_t delay, std::function<void()> action) { simulation.At(simulation.now + delay, action); });
+	std::mt19937 random(7);
+	std::lognormal_distribution<double> latency(std::log(40000.0), 0.3);
+	std::uniform_real_distribution<double> uniform(0, 1);
+	std::vector<double> latencies;
+	int failures = 0, attempts = 0;
+
+	for (int i = 0; i < 5000; i++)
+	{
+		uint64_t start = i * 20000ull;
+		simulation.At(start, [&, start]()
+		{
+			engine.Execute<int>([&](RequestPolicy::AttemptDone<int> done)
+			{
+				attempts++;
+				auto duration = latency(random) + (uniform(random) < 0.02 ? 1500000 : 0);
+				bool fail = uniform(random) < failRate;
+				auto alive = std::make_shared<bool>(true);
+				simulation.At(simulation.now + (uint64_t)duration, [done, fail, alive]()
+				{
+					if (*alive)
+						done(fail ? 503 : 200, fail ? AttemptOutcome::Transient : AttemptOutcome::Success);
+				});
+				return RequestPolicy::Abort([alive]() { *alive = false; });
+			}, [&, start](const int &status, AttemptOutcome)
+			{
+				latencies.push_back((simulation.now - start) / 1000.0);
+				if (status != 200)
+					failures++;
+			});
+		});
+	}
+	simulation.Run();
+	CHECK(latencies.size() == 5000);
+
+	SimulationResult result = { Percentile(latencies, 0.99), failures, attempts / 5000.0 };
+	printf("%-7s fail=%2.0f%% p50=%.0f ms p99=%.0f ms failures=%d load=%.3f\n", policy ? "policy" : "single", failRate * 100,
+		Percentile(latencies, 0.5), result.p99, failures, result.load);
+	return result;
+}
+
+static void TestSimulation()
+{
+	auto single = Simulate(false, 0.05);
+	auto policy = Simulate(true, 0.05);
+	// Hedges cut the stalls out of the tail, retries fix most 503s (hedges use the budget too)...
+	CHECK(single.p99 > 1000 && policy.p99 < 300);
+	CHECK(policy.failures * 4 < single.failures);
+	// ...within the budget: 10% more attempts plus the initial tokens
+	CHECK(policy.load < 1.1 + 10 / 5000.0 + 0.001);
+	// A server that is down gets little more load than without the policy
+	auto down = Simulate(true, 0.6);
+	CHECK(down.load < 1.12);
+}
+
+// Attempt that GETs target and reports the status
+static std::function<RequestPolicy::Abort(RequestPolicy::AttemptDone<int>)> Attempt(LoopbackClient &client, std::string target,
+	std::shared_ptr<std::atomic<int>> attempts = nullptr)
+{
+	return [&client, target, attempts](RequestPolicy::AttemptDone<int> done)
+	{
+		if (attempts != nullptr)
+			(*attempts)++;
+		auto status = std::make_shared<int>(0);
+		auto consumer = std::make_shared<CollectingConsumer>(1 << 20, [status, done](std::vector<unsigned char>&, std::exception_ptr error)
+		{
+			if (error != nullptr || *status == 0)
+				done(0, AttemptOutcome::Transient);
+			else if (*status == 503)
+				done(*status, AttemptOutcome::Transient);
+			else
+				done(*status, *status == 200 ? AttemptOutcome::Success : AttemptOutcome::Permanent);
+		});
+		return client.Get(target, LoopbackClient::Fields(), [status](const LoopbackResponse &response) { *status = response.status; }, consumer);
+	};
+}
+
+// Every 4th request of a path stalls 800 ms (a hedge answers first) and every 3rd of another
+// answers 503 (a retry succeeds)
+static void TestLoopback()
+{
+	LoopbackServer server;
+	LoopbackClient client(server.Port());
+	auto options = RequestPolicy::DefaultOptions();
+	options.initialHedgeDelay = 100000;
+	options.baseBackoff = 20000;
+	options.budgetMax = 100;
+	RequestPolicy policy(options);
+
+	// One call at a time, so that the server's counts per path decide which attempts stall or fail
+	const int Calls = 40;
+	int failed = 0;
+	double slowest = 0;
+	for (int i = 0; i < Calls; i++)
+	{
+		auto target = (i % 2 == 0 ? "/tail?latency=5&slow_every=4&slow=800" : "/flaky?latency=5&fail_every=3");
+		auto start = std::chrono::steady_clock::now();
+		std::atomic<int> status(-1);
+		policy.Execute<int>(Attempt(client, target), [&](const int &result, AttemptOutcome) { status = result; });
+		CHECK(WaitFor([&]() { return status.load() != -1; }));
+		if (status.load() != 200)
+			failed++;
+		slowest = std::max(slowest, SecondsSince(start) * 1000);
+	}
+	auto statistics = policy.GetStatistics();
+	printf("loopback: slowest=%.0f ms hedges=%zu wins=%zu retries=%zu\n", slowest, statistics.hedges, statistics.hedgeWins,
+		statistics.retries);
+	CHECK(failed == 0);
+	CHECK(slowest < 400);
+	CHECK(statistics.hedgeWins > 0 && statistics.retries > 0);
+
+	// A permanent failure is not retried
+	auto attempts = std::make_shared<std::atomic<int>>(0);
+	std::atomic<int> status(0);
+	policy.Execute<int>(Attempt(client, "/missing?status=404", attempts), [&](const int &result, AttemptOutcome outcome)
+	{
+		CHECK(outcome == AttemptOutcome::Permanent);
+		status = result;
+	});
+	CHECK(WaitFor([&]() { return status.load() == 404; }));
+	CHECK(attempts->load() == 1);
+
+	// A cancelled call never completes
+	std::atomic<bool> called(false);
+	auto cancel = policy.Execute<int>(Attempt(client, "/cancelled?latency=200"), [&](const int&, AttemptOutcome) { called = true; });
+	CHECK(cancel());
+	CHECK(!cancel());
+	std::this_thread::sleep_for(std::chrono::milliseconds(400));
+	CHECK(!called.load());
+}
+
+int main()
+{
+	TestSimulation();
+	TestLoopback();
+	puts("RequestPolicyTest passed");
+	return 0;
+}
@@ -0,0 +1,190 @@
+// RequestRecorder fed by a mock transport on a fake clock: stages, host statistics, CSV export,
+// streamed bodies, progress reported from another thread, and concurrent recording
+
+#include "RequestRecorder.h"
+#include "TestHelper.h"
+#include <thread>
+#include <vector>
+
+using namespace LUwpUtilities;
+
+static const int64_t Millisecond = 1000000;
+
+static void TestStagesAndHosts()
+{
+	std::atomic<int64_t> now(1000);
+	RequestRecorder recorder(8, [&]() { return now.load(); });
+	CHECK(recorder.Begin("http://a.com/x") == nullptr);
+	recorder.Enable(true);
+
+	// Mock transport: i ms of queue, 20 ms to the headers, 5 * (i % 4) ms of body
+	for (int i = 0; i < 100; i++)
+	{
+		auto timing = recorder.Begin(i % 3 ? "https://api.example.com/v1/items?i=" + std::to_string(i) : "http://img.example.com:8080/p,\"q\".png");
+		now += i * Millisecond;
+		timing->sent = recorder.Now();
+		now += 20 * Millisecond;
+		timing->headers = recorder.Now();
+		now += 5 * Millisecond * (i % 4);
+		timing->lastByte = recorder.Now();
+		timing->status = (i % 17 == 0 ? 503 : 200);
+		timing->bytes = 1000 + i;
+		timing->cache = (i % 5 == 0 ? RequestCacheStatus::Revalidated : RequestCacheStatus::None);
+		recorder.Record(*timing);
+	}
+	RequestTiming hit;
+	hit.url = "https://api.example.com/c";
+	hit.host = "api.example.com";
+	hit.status = 200;
+	hit.cache = RequestCacheStatus::Hit;
+	hit.bytes = 10;
+	recorder.Record(hit);
+
+	auto recent = recorder.Recent();
+	CHECK(recent.size() == 8);
+	CHECK(recent.back().cache == RequestCacheStatus::Hit && recent.back().QueueTime() == -1);
+	CHECK(recent[6].QueueTime() == 99 * Millisecond && recent[6].TimeToHeaders() == 20 * Millisecond);
+	CHECK(recent[6].TimeToLastByte() == 35 * Millisecond);
+
+	auto hosts = recorder.Hosts();
+	CHECK(hosts.size() == 2 && hosts[0].host == "api.example.com" && hosts[1].host == "img.example.com:8080");
+	CHECK(hosts[0].requests == 67 && hosts[0].cacheHits == 1 && hosts[0].timeToHeaders.total == 66);
+	CHECK(hosts[1].requests == 34 && hosts[1].errors == 2); // 0 and 51
+	CHECK(hosts[0].revalidations + hosts[1].revalidations == 20);
+
+	auto csv = recorder.ExportCsv();
+	CHECK(csv.compare(0, 4, "url,") == 0);
+	CHECK(csv.find("\"http://img.example.com:8080/p,\"\"q\"\".png\",img.example.com:8080,200,none,96000,20000,20000,1096\n") != std::string::npos);
+	CHECK(recorder.Dump().find("api.example.com requests=67") == 0);
+}
+
+// A streamed body through RecordingConsumer: the bytes and last byte of a complete body, and the
+// bytes without last byte of a failed one
+static void TestStreamedBody()
+{
+	std::atomic<int64_t> now(1000);
+	RequestRecorder recorder(4, [&]() { return now.load(); });
+	recorder.Enable(true);
+
+	struct Inner : ChunkConsumer
+	{
+		int ends = 0;
+		int errors = 0;
+		bool OnChunk(BufferView) override { return true; }
+		void OnEnd() override { ends++; }
+		void OnError(std::exception_ptr) override { errors++; }
+	};
+
+	for (bool fail : { false, true })
+	{
+		auto inner = std::make_shared<Inner>();
+		auto timing = recorder.Begin("https://dl.example.com/big");
+		timing->sent = recorder.Now();
+		now += Millisecond;
+		timing->headers = recorder.Now();
+		timing->status = 200;
+		std::vector<unsigned char> data(300000, 'x');
+		size_t offset = 0;
+		ChunkPump::Start([&](size_t capacity, ChunkPump::ReadDone done)
+		{
+			if (fail && offset >= 100000)
+			{
+				done(BufferView(), std::make_exception_ptr(std::runtime_error("reset")));
+				return;
+			}
+			size_t size = std::min(capacity, data.size() - offset);
+			BufferView chunk(data.data() + offset, size);
+			offset += size;
+			now += 100;
+			done(chunk, nullptr);
+		}, std::make_shared<RecordingConsumer>(inner, timing, recorder), (int64_t)data.size());
+		CHECK(inner->ends == (fail ? 0 : 1) && inner->errors == (fail ? 1 : 0));
+
+		auto last = recorder.Recent().back();
+		CHECK(last.bytes == (fail ? 131072 : 300000));
+		CHECK(fail ? last.TimeToLastByte() == -1 : last.TimeToLastByte() > Millisecond);
+	}
+}
+
+// The mock transport reports progress on its own thread while the request completes on another,
+// as WinRT does: the progress goes through RequestProgress (run under -DLUU_SANITIZE=thread)
+static void TestProgressFromAnotherThread()
+{
+	RequestRecorder recorder;
+	recorder.Enable(true);
+	for (int round = 0; round < 200; round++)
+	{
+		auto timing = recorder.Begin("https://api.example.com/feed");
+		timing->sent = recorder.Now();
+		auto progress = std::make_shared<RequestProgress>();
+		std::atomic<bool> completed(false);
+		std::thread transport([&]()
+		{
+			for (int64_t received = 0; received <= 64 * 1024 && !completed.load(); received += 4096)
+				progress->Update(received > 0, received, recorder);
+		});
+		std::this_thread::yield();
+		// Completion: fold what was reported so far, then the final values win
+		progress->FoldInto(*timing);
+		completed = true;
+		timing->status = 200;
+		timing->lastByte = recorder.Now();
+		recorder.Record(*timing);
+		transport.join();
+
+		auto recorded = recorder.Recent().back();
+		CHECK(recorded.headers == 0 || (recorded.headers >= recorded.sent && recorded.bytes > 0));
+	}
+
+	RequestProgress progress;
+	progress.Update(false, 0, recorder);
+	CHECK(progress.headers.load() == 0);
+	progress.Update(true, 100, recorder);
+	auto first = progress.headers.load();
+	progress.Update(true, 200, recorder);
+	CHECK(first != 0 && progress.headers.load() == first && progress.bytes.load() == 200);
+	RequestTiming timing;
+	timing.headers = 5;
+	progress.FoldInto(timing);
+	CHECK(timing.headers == 5 && timing.bytes == 200);
+}
+
+static void TestConcurrentRecording()
+{
+	RequestRecorder recorder;
+	recorder.Enable(true);
+	std::vector<std::thread> threads;
+	for (int k = 0; k < 4; k++)
+	{
+		threads.emplace_back([&recorder]()
+		{
+			for (int i = 0; i < 10000; i++)
+			{
+				auto timing = recorder.Begin("http://h" + std::to_string(i % 100) + ".com/");
+				timing->sent = recorder.Now();
+				timing->headers = recorder.Now();
+				timing->status = 200;
+				recorder.Record(*timing);
+			}
+		});
+	}
+	for (auto &thread : threads)
+		thread.join();
+
+	uint64_t total = 0;
+	auto hosts = recorder.Hosts();
+	for (auto &host : hosts)
+		total += host.requests;
+	// 64 hosts and the shared entry of the others
+	CHECK(total == 40000 && hosts.size() == RequestRecorder::MaxHosts + 1);
+}
+
+int main()
+{
+	TestStagesAndHosts();
+	TestStreamedBody();
+	TestProgressFromAnotherThread();
+	TestConcurrentRecording();
+	puts("RequestRecorderTest passed");
+	return 0;
+}
@@ -0,0 +1,202 @@
+// RequestScheduler simulated in virtual time: priority lanes under a burst of prefetches, token
+// bucket rates, raise/cancel, fair turns between hosts; then real threads and timers
+
+#include "RequestScheduler.h"
+#include "TestHelper.h"
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <vector>
+
+using namespace LUwpUtilities;
+
+// A scheduler whose clock and timer are the simulation's
+static std::unique_ptr<RequestScheduler> SimulatedScheduler(Simulation &simulation, const RequestScheduler::Options &options)
+{
+	auto scheduler = std::make_shared<RequestScheduler*>(nullptr);
+	std::unique_ptr<RequestScheduler> result(new RequestScheduler(options, [&simulation]() { return simulation.now; },
+		[&simulation, scheduler](uint64_t delay) { simulation.At(simulation.now + delay, [scheduler]() { (*scheduler)->Pump(); }); }));
+	*scheduler = result.get();
+	return result;
+}
+
+// p99 in milliseconds of API calls every 250 ms while bursts of 60 thumbnails arrive every 3 s
+static double ApiTail(bool prioritized)
+{
+	Simulation simulation;
+	auto options = RequestScheduler::DefaultOptions();
+	if (!prioritized)
+		options.reservedSlots = 0;
+	auto scheduler = SimulatedScheduler(simulation, options);
+	std::mt19937 random(42);
+	std::exponential_distribution<double> thumbnail(1 / 150000.0), api(1 / 80000.0);
+	std::vector<double> apiLatencies, thumbnailLatencies;
+
+	auto submit = [&](uint64_t time, WorkPriority priority, double duration, std::vector<double> &latencies)
+	{
+		simulation.At(time, [&, time, priority, duration]()
+		{
+			scheduler->Submit("cdn.example.com", priority, [&, time, duration](RequestScheduler::Done done)
+			{
+				simulation.At(simulation.now + (uint64_t)duration, [&, time, done]()
+				{
+					latencies.push_back((simulation.now - time) / 1000.0);
+					done();
+				});
+			});
+		});
+	};
+	for (int burst = 0; burst < 20; burst++)
+	{
+		for (int i = 0; i < 60; i++)
+			submit(burst * 3000000ull + i * 2000, prioritized ? WorkPriority::Prefetch : WorkPriority::Normal, thumbnail(random), thumbnailLatencies);
+	}
+	for (int i = 0; i < 240; i++)
+		submit(i * 250000ull + 7000, prioritized ? WorkPriority::UserBlocking : WorkPriority::Normal, api(random), apiLatencies);
+	simulation.Run();
+
+	CHECK(apiLatencies.size() == 240 && thumbnailLatencies.size() == 1200);
+	auto tail = Percentile(apiLatencies, 0.99);
+	printf("%-12s api p50=%.0f ms p99=%.0f ms, thumbnails p50=%.0f ms p99=%.0f ms\n", prioritized ? "prioritized" : "fifo",
+		Percentile(apiLatencies, 0.5), tail, Percentile(thumbnailLatencies, 0.5), Percentile(thumbnailLatencies, 0.99));
+	return tail;
+}
+
+// 10 requests/s with a burst of 2: 2 + 30 start in the first 3 s
+static void TestRateLimit()
+{
+	Simulation simulation;
+	auto scheduler = SimulatedScheduler(simulation, RequestScheduler::DefaultOptions());
+	scheduler->SetHostLimits("h", { 100, 10, 2 });
+	std::vector<uint64_t> starts;
+	for (int i = 0; i < 100; i++)
+	{
+		scheduler->Submit("h", WorkPriority::Normal, [&](RequestScheduler::Done done)
+		{
+			starts.push_back(simulation.now);
+			done();
+		});
+	}
+	simulation.Run();
+	CHECK(starts.size() == 100);
+	auto early = std::count_if(starts.begin(), starts.end(), [](uint64_t time) { return time <= 3000000; });
+	CHECK(early >= 31 && early <= 33);
+}
+
+static void TestRaiseAndCancel()
+{
+	Simulation simulation;
+	auto options = RequestScheduler::DefaultOptions();
+	options.host.concurrency = 1;
+	options.reservedSlots = 0;
+	auto scheduler = SimulatedScheduler(simulation, options);
+	std::vector<int> order;
+	std::vector<RequestScheduler::Done> running;
+	auto submit = [&](int id, WorkPriority priority)
+	{
+		return scheduler->Submit("a", priority, [&, id](RequestScheduler::Done done)
+		{
+			order.push_back(id);
+			running.push_back(done);
+		});
+	};
+	submit(0, WorkPriority::Normal);
+	auto lowered = submit(1, WorkPriority::Prefetch);
+	submit(2, WorkPriority::Prefetch);
+	auto raised = submit(3, WorkPriority::Prefetch);
+	submit(4, WorkPriority::Normal);
+	CHECK(scheduler->Raise(raised, WorkPriority::UserBlocking));
+	CHECK(scheduler->Raise(lowered, WorkPriority::Idle)); // never lowers
+	CHECK(scheduler->Cancel(lowered));
+	CHECK(!scheduler->Cancel(lowered));
+	while (!running.empty())
+	{
+		auto done = running.back();
+		running.pop_back();
+		done();
+		done(); // only the first call frees the slot
+	}
+	CHECK((order == std::vector<int>{ 0, 3, 4, 2 }));
+}
+
+// One slot in total: hosts take turns instead of x starving y
+static void TestFairness()
+{
+	Simulation simulation;
+	auto options = RequestScheduler::DefaultOptions();
+	options.host.concurrency = 1;
+	options.totalConcurrency = 1;
+	options.reservedSlots = 0;
+	auto scheduler = SimulatedScheduler(simulation, options);
+	std::vector<int> order;
+	std::vector<RequestScheduler::Done> running;
+	for (int i = 0; i < 4; i++)
+		scheduler->Submit("x", WorkPriority::Normal, [&, i](RequestScheduler::Done done) { order.push_back(i); running.push_back(done); });
+	for (int i = 0; i < 2; i++)
+		scheduler->Submit("y", WorkPriority::Normal, [&, i](RequestScheduler::Done done) { order.push_back(10 + i); running.push_back(done); });
+	while (!running.empty())
+	{
+		auto done = running.back();
+		running.pop_back();
+		done();
+	}
+	CHECK((order == std::vector<int>{ 0, 10, 1, 11, 2, 3 }));
+}
+
+// Submissions, cancellations and raises from several threads, woken by a private TimerService
+static void TestThreads()
+{
+	TimerService service;
+	RequestScheduler scheduler(RequestScheduler::DefaultOptions(), nullptr, nullptr, service);
+	scheduler.SetHostLimits("r", { 3, 2000, 5 });
+	std::atomic<int> running(0), peak(0), finished(0);
+	std::vector<std::thread> threads;
+	for (int k = 0; k < 4; k++)
+	{
+		threads.emplace_back([&]()
+		{
+			for (int i = 0; i < 300; i++)
+			{
+				auto ticket = scheduler.Submit(i % 2 ? "r" : "q", (WorkPriority)(i % 4), [&](RequestScheduler::Done done)
+				{
+					int now = ++running;
+					int high = peak;
+					while (now > high && !peak.compare_exchange_weak(high, now))
+					{
+					}
+					std::thread([&, done]()
+					{
+						std::this_thread::sleep_for(std::chrono::microseconds(200));
+						running--;
+						done();
+						finished++;
+					}).detach();
+				});
+				if (i % 7 == 0 && scheduler.Cancel(ticket))
+					finished++;
+				if (i % 5 == 0)
+					scheduler.Raise(ticket, WorkPriority::UserBlocking);
+			}
+		});
+	}
+	for (auto &thread : threads)
+		thread.join();
+	CHECK(WaitFor([&]() { return finished.load() == 1200; }, std::chrono::milliseconds(60000)));
+	auto statistics = scheduler.GetStatistics();
+	CHECK(statistics.queued == 0);
+	// 3 for r, 6 for q
+	CHECK(peak.load() <= 9 && statistics.running == 0);
+}
+
+int main()
+{
+	auto fifo = ApiTail(false);
+	auto prioritized = ApiTail(true);
+	CHECK(prioritized < fifo / 2);
+	TestRateLimit();
+	TestRaiseAndCancel();
+	TestFairness();
+	TestThreads();
+	puts("RequestSchedulerTest passed");
+	return 0;
+}
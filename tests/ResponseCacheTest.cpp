@@ -0,0 +1,338 @@
+// ResponseCache driven the way Http::GetCachedAsync drives it, against LoopbackServer: fresh hits
+// without a request, 304 revalidation with If-None-Match and with If-Modified-Since alone,
+// stale-while-revalidate, new content after a deployment, the memory tier's byte bound and LRU
+// order, the disk tier across instances with truncated and corrupt files, and the counters
+
+#include "ResponseCache.h"
+#include "LoopbackClient.h"
+#include "LoopbackServer.h"
+#include "TestHelper.h"
+#include <dirent.h>
+#include <unistd.h>
+#include <atomic>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace LUwpUtilities;
+
+typedef std::shared_ptr<const std::vector<unsigned char>> Body;
+
+static Body MakeBody(const std::string &text)
+{
+	return std::make_shared<const std::vector<unsigned char>>(text.begin(), text.end());
+}
+
+static std::string Text(const Body &body)
+{
+	return (body ? std::string(body->begin(), body->end()) : std::string());
+}
+
+// Status of the last response, 304 when no body was downloaded
+static int lastStatus = 0;
+
+// SendCachedRequest: a conditional GET if there is an entry, then 304 -> Revalidated, 200 -> Store
+static ResponseCache::Entry Send(ResponseCache &cache, LoopbackClient &client, const std::string &target, const ResponseCache::Entry &entry)
+{
+	LoopbackClient::Fields fields;
+	if (entry != nullptr && !entry->etag.empty())
+		fields["If-None-Match"] = entry->etag;
+	if (entry != nullptr && !entry->lastModified.empty())
+		fields["If-Modified-Since"] = entry->lastModified;
+
+	LoopbackResponse response;
+	std::vector<unsigned char> body;
+	std::atomic<bool> done(false);
+	auto consumer = std::make_shared<CollectingConsumer>((size_t)1 << 24, [&](std::vector<unsigned char> &received, std::exception_ptr error)
+	{
+		CHECK(!error);
+		body.swap(received);
+		done = true;
+	});
+	client.Get(target, fields, [&](const LoopbackResponse &head) { response = head; }, consumer);
+	CHECK(WaitFor([&]() { return done.load(); }));
+
+	lastStatus = response.status;
+	auto control = CacheControl::Parse(response.Header("cache-control"));
+	if (response.status == 304)
+	{
+		CHECK(entry != nullptr);
+		return cache.Revalidated(entry, control);
+	}
+	CHECK(response.status == 200);
+	return cache.Store(target, control, response.Header("etag"), response.Header("last-modified"), response.Header("content-type"),
+		std::make_shared<const std::vector<unsigned char>>(std::move(body)));
+}
+
+// GetCachedAsync with the background refresh of a stale entry run before returning
+static ResponseCache::Entry CachedGet(ResponseCache &cache, LoopbackClient &client, const std::string &target, bool staleWhileRevalidate = false)
+{
+	auto entry = cache.Find(target);
+	if (entry != nullptr)
+	{
+		auto freshness = ResponseCache::Check(*entry, ResponseCache::Now(), staleWhileRevalidate);
+		if (freshness != CacheFreshness::Expired)
+		{
+			cache.RecordHit(entry);
+			if (freshness == CacheFreshness::Stale)
+				Send(cache, client, target, entry);
+			return entry;
+		}
+	}
+	return Send(cache, client, target, entry);
+}
+
+static void CheckStatistics(const ResponseCache &cache, size_t hits, size_t revalidations, size_t misses, uint64_t bytesSaved)
+{
+	auto statistics = cache.GetStatistics();
+	CHECK(statistics.hits == hits && statistics.revalidations == revalidations);
+	CHECK(statistics.misses == misses && statistics.bytesSaved == bytesSaved);
+}
+
+static void TestRevalidation()
+{
+	LoopbackServer server;
+	LoopbackClient client(server.Port(), 2);
+	ResponseCache cache(1 << 20, "");
+
+	// Fresh for a minute: the second GET sends nothing
+	const std::string Fresh = "/fresh?size=3000&max_age=60";
+	CHECK(Text(CachedGet(cache, client, Fresh)->body) == server.Body(Fresh));
+	auto requests = server.Requests();
+	CHECK(Text(CachedGet(cache, client, Fresh)->body) == server.Body(Fresh));
+	CHECK(server.Requests() == requests);
+	CheckStatistics(cache, 1, 0, 1, 3000);
+
+	// Without max-age the entry is revalidated every time; the server matches If-None-Match
+	const std::string Tagged = "/tagged?size=5000";
+	auto tagged = CachedGet(cache, client, Tagged);
+	CHECK(!tagged->etag.empty() && !tagged->lastModified.empty());
+	auto revalidated = CachedGet(cache, client, Tagged);
+	CHECK(lastStatus == 304 && revalidated != tagged && revalidated->body == tagged->body);
+	CheckStatistics(cache, 1, 1, 2, 8000);
+
+	// Only Last-Modified: If-Modified-Since alone gets the 304
+	const std::string Dated = "/dated?size=4000&etag=0";
+	auto dated = CachedGet(cache, client, Dated);
+	CHECK(dated->etag.empty() && !dated->lastModified.empty());
+	CHECK(CachedGet(cache, client, Dated)->body == dated->body && lastStatus == 304);
+	CheckStatistics(cache, 1, 2, 3, 12000);
+
+	// A 304 carrying max-age makes the entry fresh
+	const std::string Extended = "/extended?size=1000&max_age=0";
+	auto extended = CachedGet(cache, client, Extended);
+	CHECK(ResponseCache::Check(*extended, ResponseCache::Now(), false) == CacheFreshness::Expired);
+	auto control = CacheControl::Parse("max-age=60");
+	CHECK(ResponseCache::Check(*cache.Revalidated(extended, control), ResponseCache::Now(), false) == CacheFreshness::Fresh);
+	CHECK(ResponseCache::Check(*cache.Find(Extended), ResponseCache::Now(), false) == CacheFreshness::Fresh);
+	CheckStatistics(cache, 1, 3, 4, 13000);
+
+	// New content: both validators change, the body is downloaded again and replaces the entry
+	server.SetVersion(2);
+	auto replaced = CachedGet(cache, client, Tagged);
+	CHECK(lastStatus == 200 && Text(replaced->body) == server.Body(Tagged));
+	CHECK(replaced->etag != tagged->etag && replaced->lastModified != tagged->lastModified && cache.Find(Tagged) == replaced);
+	CheckStatistics(cache, 1, 3, 5, 13000);
+
+	// Nothing to revalidate with and no max-age, or no-store: not kept
+	const std::string Plain = "/plain?size=100&validators=0";
+	CachedGet(cache, client, Plain);
+	CHECK(cache.Find(Plain) == nullptr);
+	cache.Store("/secret", CacheControl::Parse("no-store, max-age=60"), "\"1\"", "", "", MakeBody("x"));
+	CHECK(cache.Find("/secret") == nullptr);
+	CheckStatistics(cache, 1, 3, 7, 13000);
+}
+
+static void TestStaleWhileRevalidate()
+{
+	// Fresh, stale within the window, then expired
+	CachedResponse response;
+	response.freshUntil = 1000;
+	response.staleUntil = 1030;
+	CHECK(ResponseCache::Check(response, 999, false) == CacheFreshness::Fresh);
+	CHECK(ResponseCache::Check(response, 1000, false) == CacheFreshness::Stale);
+	CHECK(ResponseCache::Check(response, 1029, false) == CacheFreshness::Stale);
+	CHECK(ResponseCache::Check(response, 1030, false) == CacheFreshness::Expired);
+	// The caller's stale_while_revalidate serves any stale entry
+	CHECK(ResponseCache::Check(response, 5000, true) == CacheFreshness::Stale);
+	auto control = CacheControl::Parse("Public, MAX-AGE=10, stale-while-revalidate=30");
+	CHECK(control.maxAge == 10 && control.staleWhileRevalidate == 30 && !control.noCache && !control.noStore);
+
+	LoopbackServer server;
+	LoopbackClient client(server.Port(), 2);
+	ResponseCache cache(1 << 20, "");
+	const std::string Target = "/feed?size=2000&max_age=0&stale=60";
+	auto old = CachedGet(cache, client, Target);
+	auto oldBody = server.Body(Target);
+	CHECK(old->staleUntil >= old->freshUntil + 60);
+
+	// Within the window the old body is served at once and refreshed behind it
+	server.SetVersion(2);
+	auto requests = server.Requests();
+	auto served = CachedGet(cache, client, Target);
+	CHECK(served == old && Text(served->body) == oldBody && lastStatus == 200);
+	CHECK(server.Requests() == requests + 1);
+	auto refreshed = cache.Find(Target);
+	CHECK(refreshed != old && Text(refreshed->body) == server.Body(Target) && Text(refreshed->body) != oldBody);
+	CheckStatistics(cache, 1, 0, 2, 2000);
+
+	// Unchanged content: the refresh is a 304
+	served = CachedGet(cache, client, Target);
+	CHECK(served == refreshed && lastStatus == 304);
+	CheckStatistics(cache, 2, 1, 2, 6000);
+
+	// Outside any window only the caller's flag serves it stale
+	const std::string Untimed = "/untimed?size=500";
+	CachedGet(cache, client, Untimed);
+	requests = server.Requests();
+	served = CachedGet(cache, client, Untimed, true);
+	CHECK(server.Requests() == requests + 1 && lastStatus == 304 && Text(served->body) == server.Body(Untimed));
+	CheckStatistics(cache, 3, 2, 3, 7000);
+}
+
+// The memory tier alone: a byte bound over url, validators and body, least recently used out first
+static void TestMemoryBound()
+{
+	auto control = CacheControl::Parse("max-age=60");
+	auto body = MakeBody(std::string(3000, 'b'));
+	auto entrySize = [](const ResponseCache::Entry &entry) { return entry->Size(); };
+	ResponseCache sizing(1 << 20, "");
+	size_t size = entrySize(sizing.Store("/1", control, "\"e\"", "", "text/plain", body));
+	CHECK(size == 2 + 3 + 10 + 3000);
+
+	ResponseCache cache(3 * size, "");
+	cache.Store("/1", control, "\"e\"", "", "text/plain", body);
+	cache.Store("/2", control, "\"e\"", "", "text/plain", body);
+	cache.Store("/3", control, "\"e\"", "", "text/plain", body);
+	CHECK(cache.Find("/1") != nullptr); // now the most recently used
+	cache.Store("/4", control, "\"e\"", "", "text/plain", body);
+	CHECK(cache.Find("/2") == nullptr);
+	CHECK(cache.Find("/1") != nullptr && cache.Find("/3") != nullptr && cache.Find("/4") != nullptr);
+	// The lookups above left 4 3 1, most recent first
+	cache.Store("/5", control, "\"e\"", "", "text/plain", body);
+	CHECK(cache.Find("/1") == nullptr && cache.Find("/3") != nullptr && cache.Find("/4") != nullptr && cache.Find("/5") != nullptr);
+
+	// Replacing an entry by a smaller one frees its room: /6 only pushes out /3, now the oldest
+	cache.Store("/4", control, "\"e\"", "", "text/plain", MakeBody("small"));
+	cache.Store("/6", control, "\"e\"", "", "text/plain", body);
+	CHECK(cache.Find("/3") == nullptr && cache.Find("/4") != nullptr && cache.Find("/5") != nullptr && cache.Find("/6") != nullptr);
+
+	// An entry larger than the bound stays, alone
+	cache.Store("/huge", control, "\"e\"", "", "text/plain", MakeBody(std::string(4 * size, 'h')));
+	CHECK(cache.Find("/huge") != nullptr);
+	for (auto url : { "/4", "/5", "/6" })
+		CHECK(cache.Find(url) == nullptr);
+
+	cache.Remove("/huge");
+	CHECK(cache.Find("/huge") == nullptr);
+}
+
+static std::vector<std::string> Files(const std::string &directory)
+{
+	std::vector<std::string> files;
+	auto dir = opendir(directory.c_str());
+	CHECK(dir != nullptr);
+	while (auto entry = readdir(dir))
+	{
+		std::string name = entry->d_name;
+		if (name != "." && name != "..")
+			files.push_back(directory + "/" + name);
+	}
+	closedir(dir);
+	return files;
+}
+
+static std::string ReadFile(const std::string &path)
+{
+	std::ifstream file(path, std::ios::binary);
+	return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+static void WriteFile(const std::string &path, const std::string &data)
+{
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	file.write(data.data(), data.size());
+}
+
+// The disk tier: a new instance (the next run of the app) finds the entries, bad files are misses
+static void TestDisk()
+{
+	char pattern[] = "/tmp/ResponseCacheTestXXXXXX";
+	CHECK(mkdtemp(pattern) != nullptr);
+	std::string directory = pattern;
+
+	LoopbackServer server;
+	LoopbackClient client(server.Port(), 2);
+	const std::string Target = "/disk?size=70000&max_age=0&stale=60";
+	std::string path;
+	{
+		ResponseCache cache(1 << 20, directory);
+		CachedGet(cache, client, Target);
+		auto files = Files(directory);
+		CHECK(files.size() == 1);
+		path = files[0];
+		// A body with line breaks and NULs; one file per URL and no temporary file left
+		cache.Store("/binary", CacheControl::Parse("max-age=60"), "", "Thu, 01 Jan 1970 00:00:00 GMT", "application/octet-stream",
+			MakeBody(std::string("\0\r\n\xff line\n", 10)));
+		CHECK(Files(directory).size() == 2);
+	}
+
+	{
+		ResponseCache cache(1 << 20, directory);
+		auto entry = cache.Find(Target);
+		CHECK(entry != nullptr && Text(entry->body) == server.Body(Target) && entry->url == Target);
+		CHECK(!entry->etag.empty() && !entry->lastModified.empty() && entry->staleUntil >= entry->freshUntil + 60);
+		auto binary = cache.Find("/binary");
+		CHECK(binary != nullptr && Text(binary->body) == std::string("\0\r\n\xff line\n", 10));
+		CHECK(binary->etag.empty() && binary->contentType == "application/octet-stream");
+
+		// Revalidated from disk: the 304 is written back too
+		CHECK(CachedGet(cache, client, Target) == entry && lastStatus == 304);
+		CheckStatistics(cache, 1, 1, 0, 140000);
+	}
+
+	auto original = ReadFile(path);
+	auto header = original.substr(0, original.size() - 70000);
+	const std::string Bad[] =
+	{
+		"",
+		original.substr(0, original.size() - 1),             // truncated body
+		original + "x",                                      // trailing bytes
+		original.substr(0, header.size() - 3),               // cut in the header
+		header.substr(0, header.rfind("70000")) + "99999999999999999999\n" + original.substr(header.size()), // absurd size
+		header.substr(0, header.rfind("70000")) + "7000x\n" + original.substr(header.size()),               // not a number
+		"/other\n" + original.substr(original.find('\n') + 1), // another URL's file under this name
+	};
+	for (auto &bad : Bad)
+	{
+		WriteFile(path, bad);
+		ResponseCache cache(1 << 20, directory);
+		CHECK(cache.Find(Target) == nullptr);
+	}
+
+	// A bad file is replaced by the next download, and Remove deletes the file
+	{
+		ResponseCache cache(1 << 20, directory);
+		CHECK(Text(CachedGet(cache, client, Target)->body) == server.Body(Target));
+		CheckStatistics(cache, 0, 0, 1, 0);
+		ResponseCache next(1 << 20, directory);
+		auto entry = next.Find(Target);
+		CHECK(entry != nullptr && Text(entry->body) == server.Body(Target));
+		cache.Remove(Target);
+		cache.Remove("/binary");
+		CHECK(Files(directory).empty());
+	}
+	rmdir(directory.c_str());
+}
+
+int main()
+{
+	TestRevalidation();
+	TestStaleWhileRevalidate();
+	TestMemoryBound();
+	TestDisk();
+	puts("ResponseCacheTest passed");
+	return 0;
+}
@@ -0,0 +1,485 @@
+// SegmentedDownload against LoopbackServer's Range support, through LoopbackClient: parallel
+// segments, connections dropped mid-segment and 503s (resumed with Range and If-Range), cancel
+// then resume from the state file, a resource that changes during the download, a server that
+// ignores Range, an empty resource, and the errors that end a download
+
+#include "SegmentedDownload.h"
+#include "LoopbackClient.h"
+#include "LoopbackServer.h"
+#include "TestHelper.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace LUwpUtilities;
+
+static const char *StatePath = "SegmentedDownloadTest.state";
+
+class MemoryFile : public DownloadFile
+{
+public:
+	uint64_t Size() override
+	{
+		std::lock_guard<std::mutex> guard(_lock);
+		return _data.size();
+	}
+
+	void Resize(uint64_t size) override
+	{
+		std::lock_guard<std::mutex> guard(_lock);
+		_data.resize((size_t)size);
+	}
+
+	void Write(uint64_t offset, const unsigned char *data, size_t size) override
+	{
+		std::lock_guard<std::mutex> guard(_lock);
+		if (_data.size() < offset + size)
+			_data.resize((size_t)(offset + size));
+		memcpy(&_data[(size_t)offset], data, size);
+	}
+
+	size_t Read(uint64_t offset, unsigned char *data, size_t size) override
+	{
+		std::lock_guard<std::mutex> guard(_lock);
+		if (offset >= _data.size())
+			return 0;
+		size = std::min(size, _data.size() - (size_t)offset);
+		memcpy(data, &_data[(size_t)offset], size);
+		return size;
+	}
+
+	std::string Data()
+	{
+		std::lock_guard<std::mutex> guard(_lock);
+		return _data;
+	}
+
+private:
+	std::mutex _lock;
+	std::string _data;
+};
+
+// Fetch of SegmentedDownload over LoopbackClient, like Http::FetchRange over HttpClient; it keeps
+// the requests it sent and how many are in flight
+class RangeFetcher
+{
+public:
+	RangeFetcher(LoopbackClient &client, std::string target) : _client(client), _target(std::move(target)), _inFlight(0), _maxInFlight(0)
+	{
+	}
+
+	SegmentedDownload::Fetch Fetch()
+	{
+		return [this](const RangeRequest &range, SegmentedDownload::Headers headers, std::shared_ptr<ChunkConsumer> consumer)
+		{
+			LoopbackClient::Fields fields;
+			if (range.start != 0 || range.end != 0)
+				fields["Range"] = "bytes=" + std::to_string(range.start) + "-" + (range.end != 0 ? std::to_string(range.end - 1) : std::string());
+			if (!range.ifRange.empty())
+				fields["If-Range"] = range.ifRange;
+			{
+				std::lock_guard<std::mutex> guard(_lock);
+				_requests.push_back(range);
+			}
+			auto count = ++_inFlight;
+			for (auto max = _maxInFlight.load(); count > max && !_maxInFlight.compare_exchange_weak(max, count);)
+			{
+			}
+			return _client.Get(_target, fields, [headers](const LoopbackResponse &response)
+			{
+				RangeResponse result;
+				result.status = response.status;
+				result.contentLength = response.contentLength;
+				result.contentRange = response.Header("content-range");
+				result.etag = response.Header("etag");
+				result.lastModified = response.Header("last-modified");
+				headers(result);
+			}, std::make_shared<Counted>(std::move(consumer), _inFlight));
+		};
+	}
+
+	std::vector<RangeRequest> Requests()
+	{
+		std::lock_guard<std::mutex> guard(_lock);
+		return _requests;
+	}
+
+	int InFlight() const { return _inFlight; }
+	int MaxInFlight() const { return _maxInFlight; }
+
+private:
+	// Leaves the count once the whole body is in (before the download hears of it, since a segment
+	// that completes launches the next one from its last chunk), on error, or when the download
+	// stops reading
+	class Counted : public ChunkConsumer
+	{
+	public:
+		Counted(std::shared_ptr<ChunkConsumer> consumer, std::atomic<int> &count)
+			: _consumer(std::move(consumer)), _count(count), _length(-1), _received(0), _left(false)
+		{
+		}
+
+		void OnStart(int64_t contentLength) override
+		{
+			_length = contentLength;
+			_consumer->OnStart(contentLength);
+		}
+
+		bool OnChunk(BufferView chunk) override
+		{
+			_received += (int64_t)chunk.size();
+			if (_length >= 0 && _received >= _length)
+				Leave();
+			if (_consumer->OnChunk(chunk))
+				return true;
+			Leave();
+			return false;
+		}
+
+		void OnEnd() override
+		{
+			Leave();
+			_consumer->OnEnd();
+		}
+
+		void OnError(std::exception_ptr error) override
+		{
+			Leave();
+			_consumer->OnError(error);
+		}
+
+	private:
+		void Leave()
+		{
+			if (!_left)
+				_count--;
+			_left = true;
+		}
+
+		std::shared_ptr<ChunkConsumer> _consumer;
+		std::atomic<int> &_count;
+		int64_t _length;
+		int64_t _received;
+		bool _left;
+	};
+
+	LoopbackClient &_client;
+	std::string _target;
+	std::mutex _lock;
+	std::vector<RangeRequest> _requests;
+	std::atomic<int> _inFlight;
+	std::atomic<int> _maxInFlight;
+};
+
+// What done got
+class Outcome
+{
+public:
+	Outcome() : _calls(0)
+	{
+	}
+
+	SegmentedDownload::Done Done()
+	{
+		return [this](std::exception_ptr error)
+		{
+			std::lock_guard<std::mutex> guard(_lock);
+			_error = error;
+			_calls++;
+		};
+	}
+
+	bool Wait()
+	{
+		return WaitFor([this]() { return _calls.load() > 0; }, std::chrono::milliseconds(60000));
+	}
+
+	bool Succeeded()
+	{
+		std::lock_guard<std::mutex> guard(_lock);
+		return _calls == 1 && !_error;
+	}
+
+	// 0 without an error, 1 for a DownloadCancelled, 2 for a permanent DownloadError, 3 for another one
+	int Kind()
+	{
+		std::lock_guard<std::mutex> guard(_lock);
+		CHECK(_calls == 1);
+		if (!_error)
+			return 0;
+		try
+		{
+			std::rethrow_exception(_error);
+		}
+		catch (const DownloadCancelled&)
+		{
+			return 1;
+		}
+		catch (const DownloadError &e)
+		{
+			return (e.IsPermanent() ? 2 : 3);
+		}
+		catch (...)
+		{
+			return 3;
+		}
+	}
+
+private:
+	std::mutex _lock;
+	std::exception_ptr _error;
+	std::atomic<int> _calls;
+};
+
+static std::string Digest(const std::string &data)
+{
+	Sha256 hash;
+	hash.Update(data.data(), data.size());
+	return hash.HexDigest();
+}
+
+static bool StateExists()
+{
+	return (bool)std::ifstream(StatePath);
+}
+
+static SegmentedDownload::Options TestOptions(const std::string &body)
+{
+	auto options = SegmentedDownload::DefaultOptions();
+	options.segmentSize = 300000;
+	options.connections = 4;
+	options.baseBackoff = 1000;
+	options.maxBackoff = 20000;
+	options.saveInterval = 100000;
+	options.statePath = StatePath;
+	options.sha256 = Digest(body);
+	return options;
+}
+
+static void TestParallelSegments()
+{
+	LoopbackServer server;
+	LoopbackClient client(server.Port());
+	const std::string target = "/file?size=5000123";
+	auto body = server.Body(target);
+	RangeFetcher fetcher(client, target);
+	auto file = std::make_shared<MemoryFile>();
+	std::atomic<uint64_t> progress(0);
+	Outcome outcome;
+	auto download = SegmentedDownload::Start(server.Url(target), fetcher.Fetch(), file, TestOptions(body),
+		[&](uint64_t done, int64_t size) { CHECK(size == (int64_t)body.size()); progress = std::max(progress.load(), done); }, outcome.Done());
+	CHECK(outcome.Wait() && outcome.Succeeded());
+	CHECK(file->Data() == body && download->BytesDone() == body.size() && progress == body.size());
+	CHECK(!StateExists());
+
+	// One request per segment (the first one is the probe), each with If-Range but the probe,
+	// never more than the connections at once
+	auto requests = fetcher.Requests();
+	CHECK(requests.size() == (body.size() + 299999) / 300000);
+	for (size_t i = 0; i < requests.size(); i++)
+		CHECK(requests[i].end - requests[i].start <= 300000 && requests[i].ifRange.empty() == (i == 0));
+	CHECK(fetcher.MaxInFlight() > 1 && fetcher.MaxInFlight() <= 4);
+	CHECK(WaitFor([&]() { return fetcher.InFlight() == 0; }));
+}
+
+// Every third request drops its connection after 100 KB and every fourth answers 503: the
+// segments resume from their last byte
+static void TestFailuresResume()
+{
+	LoopbackServer server;
+	LoopbackClient client(server.Port());
+	const std::string target = "/flaky?size=3000000&drop_after=100000&drop_every=3&fail_every=4";
+	auto body = server.Body(target);
+	RangeFetcher fetcher(client, target);
+	auto file = std::make_shared<MemoryFile>();
+	Outcome outcome;
+	auto options = TestOptions(body);
+	options.maxRetries = 10;
+	SegmentedDownload::Start(server.Url(target), fetcher.Fetch(), file, options, nullptr, outcome.Done());
+	CHECK(outcome.Wait() && outcome.Succeeded());
+	CHECK(file->Data() == body);
+
+	int resumed = 0;
+	for (auto &request : fetcher.Requests())
+		resumed += (request.start % 300000 != 0);
+	CHECK(resumed > 0 && fetcher.Requests().size() > 10);
+	CHECK(WaitFor([&]() { return fetcher.InFlight() == 0; }));
+}
+
+// Cancelled halfway, then started again with the same file: only the missing bytes are fetched
+static void TestCancelAndResume()
+{
+	LoopbackServer server;
+	LoopbackClient client(server.Port());
+	const std::string target = "/resume?size=4000000&latency=2";
+	auto body = server.Body(target);
+	auto file = std::make_shared<MemoryFile>();
+	auto options = TestOptions(body);
+
+	RangeFetcher first(client, target);
+	Outcome cancelled;
+	std::shared_ptr<SegmentedDownload> download;
+	std::mutex started;
+	{
+		std::lock_guard<std::mutex> guard(started);
+		download = SegmentedDownload::Start(server.Url(target), first.Fetch(), file, options, [&](uint64_t done, int64_t)
+		{
+			if (done > 1500000)
+			{
+				std::lock_guard<std::mutex> guard(started);
+				download->Cancel();
+			}
+		}, cancelled.Done());
+	}
+	CHECK(cancelled.Wait() && cancelled.Kind() == 1);
+	CHECK(WaitFor([&]() { return first.InFlight() == 0; }));
+	auto before = download->BytesDone();
+	CHECK(before > 1500000 && before < body.size() && StateExists());
+
+	RangeFetcher second(client, target);
+	std::atomic<uint64_t> resumedAt(UINT64_MAX);
+	Outcome resumed;
+	SegmentedDownload::Start(server.Url(target), second.Fetch(), file, options, [&](uint64_t done, int64_t)
+	{
+		if (resumedAt == UINT64_MAX)
+			resumedAt = done;
+	}, resumed.Done());
+	CHECK(resumed.Wait() && resumed.Succeeded());
+	CHECK(file->Data() == body && !StateExists());
+
+	// No probe: the first progress is the saved one, and the requests cover the missing bytes only
+	CHECK(resumedAt >= before);
+	uint64_t requested = 0;
+	for (auto &request : second.Requests())
+	{
+		CHECK(!request.ifRange.empty());
+		requested += request.end - request.start;
+	}
+	CHECK(requested == body.size() - before);
+}
+
+// New content is deployed in the middle of the download: If-Range gets the whole new body, and
+// the download starts over on the new version
+static void TestResourceChanged()
+{
+	LoopbackServer server;
+	LoopbackClient client(server.Port());
+	const std::string target = "/changing?size=3000000&latency=2";
+	server.SetVersion(2);
+	auto newBody = server.Body(target);
+	server.SetVersion(1);
+	auto oldBody = server.Body(target);
+	CHECK(newBody != oldBody);
+
+	RangeFetcher fetcher(client, target);
+	auto file = std::make_shared<MemoryFile>();
+	Outcome outcome;
+	std::atomic<bool> deployed(false);
+	SegmentedDownload::Start(server.Url(target), fetcher.Fetch(), file, TestOptions(newBody), [&](uint64_t done, int64_t)
+	{
+		if (done > 1000000 && !deployed.exchange(true))
+			server.SetVersion(2);
+	}, outcome.Done());
+	CHECK(outcome.Wait() && outcome.Succeeded());
+	CHECK(deployed && file->Data() == newBody);
+
+	// A second probe, without If-Range
+	int probes = 0;
+	for (auto &request : fetcher.Requests())
+		probes += request.ifRange.empty();
+	CHECK(probes == 2);
+	CHECK(WaitFor([&]() { return fetcher.InFlight() == 0; }));
+}
+
+// A chunked body of unknown size from a server without Range: one request for the whole body,
+// fetched again from the start when the connection drops
+static void TestWithoutRanges()
+{
+	LoopbackServer server;
+	LoopbackClient client(server.Port());
+	const std::string target = "/plain?size=1000000&ranges=0&chunked=1&drop_after=300000&drop_every=2";
+	auto body = server.Body(target);
+	auto options = TestOptions(body);
+	options.statePath.clear();
+
+	// The first request of the path goes through, the second one drops
+	for (int i = 0; i < 2; i++)
+	{
+		RangeFetcher fetcher(client, target);
+		auto file = std::make_shared<MemoryFile>();
+		Outcome outcome;
+		auto download = SegmentedDownload::Start(server.Url(target), fetcher.Fetch(), file, options, nullptr, outcome.Done());
+		CHECK(outcome.Wait() && outcome.Succeeded());
+		CHECK(file->Data() == body && download->Size() == (int64_t)body.size());
+
+		auto requests = fetcher.Requests();
+		CHECK(requests.size() == (size_t)(i + 1));
+		for (size_t k = 1; k < requests.size(); k++)
+			CHECK(requests[k].start == 0 && requests[k].end == 0 && requests[k].ifRange.empty());
+	}
+}
+
+static void TestEndings()
+{
+	LoopbackServer server;
+	LoopbackClient client(server.Port());
+
+	// An empty resource answers the probe with 416 "bytes */0"
+	{
+		RangeFetcher fetcher(client, "/empty?size=0");
+		auto file = std::make_shared<MemoryFile>();
+		Outcome outcome;
+		SegmentedDownload::Start(server.Url("/empty?size=0"), fetcher.Fetch(), file, TestOptions(""), nullptr, outcome.Done());
+		CHECK(outcome.Wait() && outcome.Succeeded());
+		CHECK(file->Size() == 0 && fetcher.Requests().size() == 1);
+	}
+
+	// 404 is permanent: no retry
+	{
+		RangeFetcher fetcher(client, "/missing?status=404");
+		Outcome outcome;
+		SegmentedDownload::Start(server.Url("/missing?status=404"), fetcher.Fetch(), std::make_shared<MemoryFile>(),
+			TestOptions(""), nullptr, outcome.Done());
+		CHECK(outcome.Wait() && outcome.Kind() == 2 && fetcher.Requests().size() == 1);
+	}
+
+	// 503 again and again: given up after the retries
+	{
+		RangeFetcher fetcher(client, "/down?fail_every=1");
+		auto options = TestOptions("");
+		options.maxRetries = 2;
+		Outcome outcome;
+		SegmentedDownload::Start(server.Url("/down?fail_every=1"), fetcher.Fetch(), std::make_shared<MemoryFile>(), options,
+			nullptr, outcome.Done());
+		CHECK(outcome.Wait() && outcome.Kind() == 3 && fetcher.Requests().size() == 3);
+	}
+
+	// A wrong checksum fails for good, and the state is removed so that the next start is afresh
+	{
+		const std::string target = "/corrupt?size=700000";
+		RangeFetcher fetcher(client, target);
+		auto options = TestOptions("");
+		options.sha256 = std::string(64, '0');
+		Outcome outcome;
+		SegmentedDownload::Start(server.Url(target), fetcher.Fetch(), std::make_shared<MemoryFile>(), options, nullptr, outcome.Done());
+		CHECK(outcome.Wait() && outcome.Kind() == 2 && !StateExists());
+	}
+}
+
+int main()
+{
+	std::remove(StatePath);
+	TestParallelSegments();
+	TestFailuresResume();
+	TestCancelAndResume();
+	TestResourceChanged();
+	TestWithoutRanges();
+	TestEndings();
+	puts("SegmentedDownloadTest passed");
+	return 0;
+}
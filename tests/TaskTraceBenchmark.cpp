@@ -0,0 +1,89 @@
+// What TaskTrace adds to a task: ThreadPool::Submit of an empty task as is, wrapped the way
+// TaskHelper wraps it with tracing off, and with tracing on; then a timer alone on one thread
+
+#include "TaskTrace.h"
+#include "ThreadPool.h"
+#include "TestHelper.h"
+#include <atomic>
+#include <functional>
+
+using namespace LUwpUtilities;
+
+static std::atomic<long> count(0);
+
+static void Plain(ThreadPool &pool)
+{
+	pool.Submit([]() { count++; });
+}
+
+// As TH::RunAsync does it
+static void Traced(ThreadPool &pool)
+{
+	auto timer = TaskTrace::Timer::Enqueue("Benchmark");
+	pool.Submit([timer]()
+	{
+		auto trace = timer;
+		trace.Start();
+		count++;
+		trace.End();
+		trace.Finish();
+	});
+}
+
+// Tasks per second, submitted from outside the pool
+static double Throughput(ThreadPool &pool, long tasks, void (*submit)(ThreadPool &))
+{
+	count = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (long i = 0; i < tasks; i++)
+		submit(pool);
+	CHECK(WaitFor([&]() { return count.load() == tasks; }, std::chrono::milliseconds(120000)));
+	return tasks / SecondsSince(start);
+}
+
+// Best of a few runs of Enqueue, Start, End and Finish, in ns per timer
+static double TimerCost(long timers)
+{
+	double best = 1e9;
+	for (int r = 0; r < 3; r++)
+	{
+		auto start = std::chrono::steady_clock::now();
+		for (long i = 0; i < timers; i++)
+		{
+			auto timer = TaskTrace::Timer::Enqueue("Benchmark");
+			timer.Start();
+			timer.End();
+			timer.Finish();
+		}
+		best = std::min(best, SecondsSince(start) * 1e9 / timers);
+	}
+	return best;
+}
+
+int main(int argc, char **argv)
+{
+	bool quick = HasFlag(argc, argv, "--quick");
+	long tasks = (quick ? 20000 : 2000000);
+	long timers = (quick ? 10000 : 10000000);
+
+	for (unsigned workers : { 1u, 4u })
+	{
+		ThreadPool pool(workers);
+		double plain = Throughput(pool, tasks, Plain);
+		TaskTrace::Enable(false);
+		double off = Throughput(pool, tasks, Traced);
+		TaskTrace::Enable(true);
+		double on = Throughput(pool, tasks, Traced);
+		TaskTrace::Enable(false);
+		printf("workers=%u Submit: %10.0f tasks/s (%5.0f ns)  tracing off: %10.0f tasks/s (%5.0f ns)  on: %10.0f tasks/s (%5.0f ns)\n",
+			workers, plain, 1e9 / plain, off, 1e9 / off, on, 1e9 / on);
+	}
+
+	double off = TimerCost(timers);
+	TaskTrace::Enable(true);
+	double on = TimerCost(timers);
+	TaskTrace::Enable(false);
+	printf("timer alone: tracing off %.1f ns, on %.1f ns\n", off, on);
+	CHECK(TaskTrace::Dump().find("Benchmark\n") != std::string::npos);
+	return 0;
+}
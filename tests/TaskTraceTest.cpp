@@ -0,0 +1,186 @@
+// TaskTrace: the bucket math of LatencyHistogram (every value in the bucket it names, at most
+// 12.5% below it), percentiles against exact ones, the merge of histograms recorded on several
+// threads, decay, and the call sites of Dump()
+
+#include "TaskTrace.h"
+#include "TestHelper.h"
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace LUwpUtilities;
+
+static void CheckBucket(uint64_t value)
+{
+	int bucket = LatencyHistogram::Index(value);
+	CHECK(bucket >= 0 && bucket < LatencyHistogram::BucketCount);
+	uint64_t lower = LatencyHistogram::LowerBound(bucket);
+	CHECK(lower <= value);
+	if (bucket < LatencyHistogram::BucketCount - 1)
+	{
+		CHECK(value < LatencyHistogram::LowerBound(bucket + 1));
+		// 8 sub-buckets per power of two
+		CHECK((value - lower) * LatencyHistogram::SubCount <= value);
+	}
+}
+
+static void TestBuckets()
+{
+	// Exhaustively where the buckets are narrow, at every power of two and its neighbours above
+	for (uint64_t value = 0; value < (1 << 16); value++)
+		CheckBucket(value);
+	for (int exponent = 16; exponent <= LatencyHistogram::MaxExponent; exponent++)
+	{
+		uint64_t power = uint64_t(1) << exponent;
+		for (uint64_t value : { power - 1, power, power + 1, power + power / 2, 2 * power - 1 })
+			CheckBucket(value);
+	}
+	std::mt19937_64 random(1);
+	for (int i = 0; i < 1000000; i++)
+		CheckBucket(random() >> (random() % 64));
+
+	// Bounds increase with the bucket, and each bucket is the index of its lower bound
+	for (int bucket = 0; bucket < LatencyHistogram::BucketCount; bucket++)
+	{
+		CHECK(LatencyHistogram::Index(LatencyHistogram::LowerBound(bucket)) == bucket);
+		if (bucket > 0)
+			CHECK(LatencyHistogram::LowerBound(bucket) > LatencyHistogram::LowerBound(bucket - 1));
+	}
+	// Beyond MaxExponent everything goes to the last bucket
+	CHECK(LatencyHistogram::Index(UINT64_MAX) == LatencyHistogram::BucketCount - 1);
+}
+
+// Percentile() is the lower bound of the bucket of the exact sample of the same rank
+static void TestPercentiles()
+{
+	std::mt19937_64 random(2);
+	std::lognormal_distribution<double> latency(11.0, 2.0); // around 60 us, with a long tail
+	for (int round = 0; round < 20; round++)
+	{
+		std::vector<uint64_t> values(1 + random() % 20000);
+		LatencySnapshot snapshot;
+		for (auto &value : values)
+		{
+			value = (uint64_t)latency(random);
+			snapshot.Add(value);
+		}
+		std::sort(values.begin(), values.end());
+		for (double q : { 0.001, 0.1, 0.5, 0.9, 0.99, 0.999, 1.0 })
+		{
+			auto rank = std::max<uint64_t>(1, (uint64_t)(q * values.size()));
+			uint64_t exact = values[rank - 1];
+			uint64_t estimate = snapshot.Percentile(q);
+			CHECK(estimate <= exact && (exact - estimate) * LatencyHistogram::SubCount <= exact);
+		}
+	}
+	CHECK(LatencySnapshot().Percentile(0.5) == 0);
+}
+
+// Histograms recorded by several threads add up to one holding every sample
+static void TestMerge()
+{
+	const int Threads = 4;
+	const int Samples = 100000;
+	std::vector<std::unique_ptr<LatencyHistogram>> histograms;
+	for (int t = 0; t < Threads; t++)
+		histograms.emplace_back(new LatencyHistogram());
+
+	std::vector<std::thread> threads;
+	for (int t = 0; t < Threads; t++)
+	{
+		threads.emplace_back([&, t]()
+		{
+			std::mt19937_64 random(10 + t);
+			for (int i = 0; i < Samples; i++)
+				histograms[t]->Record(random() >> (20 + t));
+		});
+	}
+	// Reading while the threads record is allowed; the counts only grow
+	LatencySnapshot during;
+	for (auto &histogram : histograms)
+		during.Add(*histogram);
+	for (auto &thread : threads)
+		thread.join();
+	CHECK(during.total <= (uint64_t)Threads * Samples);
+
+	LatencySnapshot merged, expected;
+	for (auto &histogram : histograms)
+		merged.Add(*histogram);
+	for (int t = 0; t < Threads; t++)
+	{
+		std::mt19937_64 random(10 + t);
+		for (int i = 0; i < Samples; i++)
+			expected.Add(random() >> (20 + t));
+	}
+	CHECK(merged.total == (uint64_t)Threads * Samples);
+	for (int i = 0; i < LatencyHistogram::BucketCount; i++)
+		CHECK(merged.counts[i] == expected.counts[i]);
+
+	merged.Decay();
+	uint64_t total = 0;
+	for (int i = 0; i < LatencyHistogram::BucketCount; i++)
+	{
+		CHECK(merged.counts[i] == expected.counts[i] / 2);
+		total += merged.counts[i];
+	}
+	CHECK(merged.total == total);
+}
+
+// Tasks traced on several threads under one site show up once in Dump(), with every sample
+static void TestSites()
+{
+	auto before = TaskTrace::Dump();
+	auto untraced = TaskTrace::Timer::Enqueue("Disabled");
+	CHECK(untraced.site == nullptr);
+	untraced.Start();
+	untraced.End();
+	untraced.Finish();
+
+	TaskTrace::Enable(true);
+	std::vector<std::thread> threads;
+	for (int t = 0; t < 4; t++)
+	{
+		threads.emplace_back([t]()
+		{
+			TaskTrace::Site site("Merged");
+			for (int i = 0; i < 1000; i++)
+			{
+				auto timer = TaskTrace::Timer::Enqueue("Default");
+				CHECK(strcmp(timer.site, "Merged") == 0);
+				timer.Start();
+				timer.End();
+				if (t % 2 == 0)
+					timer.Finish();
+				else
+					timer.Dispatched();
+			}
+		});
+	}
+	for (auto &thread : threads)
+		thread.join();
+	auto outside = TaskTrace::Timer::Enqueue("Outside");
+	outside.Finish();
+	TaskTrace::Enable(false);
+
+	auto dump = TaskTrace::Dump();
+	CHECK(before.find("Disabled") == std::string::npos && dump.find("Disabled") == std::string::npos);
+	auto merged = dump.find("Merged\n");
+	CHECK(merged != std::string::npos && dump.find("Merged\n", merged + 1) == std::string::npos);
+	CHECK(dump.find("Merged\n  queue wait n=4000 ") == merged);
+	CHECK(dump.find("  execution  n=4000 ", merged) != std::string::npos);
+	CHECK(dump.find("  dispatch   n=2000 ", merged) != std::string::npos);
+	CHECK(dump.find("Outside\n  queue wait n=1 ") != std::string::npos);
+}
+
+int main()
+{
+	TestBuckets();
+	TestPercentiles();
+	TestMerge();
+	TestSites();
+	puts("TaskTraceTest passed");
+	return 0;
+}
@@ -0,0 +1,190 @@
+/**
+ * Minimal helpers for the Linux tests of the portable headers (no test framework needed):
+ *
+ *     CHECK(pool.WorkerCount() == 4);
+ *     CHECK(WaitFor([&]() { return done.load(); }));
+ *
+ * A failed CHECK prints the expression and exits with 1, whatever NDEBUG is. Benchmarks take
+ * --quick to run a few iterations only, which is how ctest smoke-tests them. Simulation runs
+ * discrete events in virtual time, for the engines that take a clock and a timer. FakeUiLoop
+ * stands in for CoreDispatcher: one thread running what is dispatched to it, in order.
+ */
+
+#ifndef _LUWPUTILITIES_TEST_HELPER_
+#define _LUWPUTILITIES_TEST_HELPER_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// The sanitizers keep calls in tail position from being made jumps, so the symmetric transfer of
+// coroutines takes stack for each await there
+#if defined(__SANITIZE_ADDRESS__) || defined(__SANITIZE_THREAD__)
+#define LUU_NO_TAIL_CALLS
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer) || __has_feature(thread_sanitizer)
+#define LUU_NO_TAIL_CALLS
+#endif
+#endif
+
+#define CHECK(condition) \
+	do \
+	{ \
+		if (!(condition)) \
+		{ \
+			fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+			exit(1); \
+		} \
+	} while (0)
+
+namespace LUwpUtilities
+{
+	// Poll until the predicate holds; false after the timeout
+	template<typename Predicate>
+	bool WaitFor(Predicate predicate, std::chrono::milliseconds timeout = std::chrono::milliseconds(10000))
+	{
+		auto deadline = std::chrono::steady_clock::now() + timeout;
+		while (!predicate())
+		{
+			if (std::chrono::steady_clock::now() > deadline)
+				return false;
+			std::this_thread::sleep_for(std::chrono::microseconds(200));
+		}
+		return true;
+	}
+
+	inline bool HasFlag(int argc, char **argv, const char *flag)
+	{
+		for (int i = 1; i < argc; i++)
+		{
+			if (strcmp(argv[i], flag) == 0)
+				return true;
+		}
+		return false;
+	}
+
+	inline double SecondsSince(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// Nearest-rank percentile, p in [0, 1]
+	inline double Percentile(std::vector<double> values, double p)
+	{
+		std::sort(values.begin(), values.end());
+		return values[(size_t)(p * (values.size() - 1))];
+	}
+
+	// Discrete events in virtual microseconds
+	struct Simulation
+	{
+		uint64_t now = 0;
+		std::multimap<uint64_t, std::function<void()>> events;
+
+		void At(uint64_t time, std::function<void()> action)
+		{
+			events.emplace(time, std::move(action));
+		}
+
+		void Run()
+		{
+			while (!events.empty())
+			{
+				auto first = events.begin();
+				now = first->first;
+				auto action = std::move(first->second);
+				events.erase(first);
+				action();
+			}
+		}
+	};
+
+	// A UI thread: Dispatch() queues a callback from any thread, the loop runs them one at a time.
+	// An exception thrown by a callback is counted and the loop goes on, as the app's handler would.
+	class FakeUiLoop
+	{
+	public:
+		FakeUiLoop() : _stop(false), _pending(0), _maxPending(0), _dispatches(0), _exceptions(0)
+		{
+			_thread = std::thread([this]() { Run(); });
+		}
+
+		// Runs what was already dispatched first
+		~FakeUiLoop()
+		{
+			{
+				std::lock_guard<std::mutex> guard(_lock);
+				_stop = true;
+			}
+			_ready.notify_one();
+			_thread.join();
+		}
+
+		void Dispatch(std::function<void()> callback)
+		{
+			{
+				std::lock_guard<std::mutex> guard(_lock);
+				_callbacks.push_back(std::move(callback));
+				_dispatches++;
+				_maxPending = std::max(_maxPending.load(), ++_pending);
+			}
+			_ready.notify_one();
+		}
+
+		bool OnLoop() const { return std::this_thread::get_id() == _thread.get_id(); }
+		// Dispatched callbacks that have not started yet
+		size_t Pending() const { return _pending; }
+		size_t MaxPending() const { return _maxPending; }
+		size_t Dispatches() const { return _dispatches; }
+		size_t Exceptions() const { return _exceptions; }
+
+	private:
+		void Run()
+		{
+			std::unique_lock<std::mutex> guard(_lock);
+			for (;;)
+			{
+				_ready.wait(guard, [this]() { return _stop || !_callbacks.empty(); });
+				if (_callbacks.empty())
+					return;
+				auto callback = std::move(_callbacks.front());
+				_callbacks.pop_front();
+				_pending--;
+				guard.unlock();
+				try
+				{
+					callback();
+				}
+				catch (...)
+				{
+					_exceptions++;
+				}
+				callback = nullptr;
+				guard.lock();
+			}
+		}
+
+		std::mutex _lock;
+		std::condition_variable _ready;
+		std::deque<std::function<void()>> _callbacks;
+		bool _stop;
+		std::atomic<size_t> _pending;
+		std::atomic<size_t> _maxPending;
+		std::atomic<size_t> _dispatches;
+		std::atomic<size_t> _exceptions;
+		std::thread _thread;
+	};
+} // namespace LUwpUtilities
+
+#endif // #ifndef _LUWPUTILITIES_TEST_HELPER_
@@ -0,0 +1,46 @@
+// Tasks per second through ThreadPool, submitted from outside the pool and from its workers
+
+#include "ThreadPool.h"
+#include "TestHelper.h"
+#include <atomic>
+
+using namespace LUwpUtilities;
+
+static double External(ThreadPool &pool, long tasks)
+{
+	std::atomic<long> count(0);
+	auto start = std::chrono::steady_clock::now();
+	for (long i = 0; i < tasks; i++)
+		pool.Submit([&count]() { count++; });
+	CHECK(WaitFor([&]() { return count.load() == tasks; }, std::chrono::milliseconds(120000)));
+	return tasks / SecondsSince(start);
+}
+
+// Fan-out from a worker: the tasks land in its deque and the other workers steal them
+static double Nested(ThreadPool &pool, long tasks)
+{
+	std::atomic<long> count(0);
+	auto start = std::chrono::steady_clock::now();
+	const long Batch = 100;
+	for (long i = 0; i < tasks / Batch; i++)
+	{
+		pool.Submit([&pool, &count]()
+		{
+			for (long k = 0; k < Batch; k++)
+				pool.Submit([&count]() { count++; });
+		});
+	}
+	CHECK(WaitFor([&]() { return count.load() == tasks / Batch * Batch; }, std::chrono::milliseconds(120000)));
+	return tasks / SecondsSince(start);
+}
+
+int main(int argc, char **argv)
+{
+	long tasks = (HasFlag(argc, argv, "--quick") ? 20000 : 2000000);
+	for (unsigned workers : { 1u, 2u, 4u, 8u })
+	{
+		ThreadPool pool(workers);
+		printf("workers=%u external=%.0f tasks/s nested=%.0f tasks/s\n", workers, External(pool, tasks), Nested(pool, tasks));
+	}
+	return 0;
+}
@@ -0,0 +1,189 @@
+// Stress test of ThreadPool: external and nested submissions, stealing, parking and shutdown
+
+#include "ThreadPool.h"
+#include "TestHelper.h"
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace LUwpUtilities;
+
+static void TestAllWorkRuns()
+{
+	std::atomic<long> count(0);
+	const long Outer = 100000;
+	{
+		ThreadPool pool(4);
+		// Every tenth task spawns five more from the worker (its own deque, stolen by the others)
+		for (long i = 0; i < Outer; i++)
+		{
+			pool.Submit([&pool, &count, i]()
+			{
+				count++;
+				if (i % 10 == 0)
+				{
+					for (int k = 0; k < 5; k++)
+						pool.Submit([&count]() { count++; });
+				}
+			});
+		}
+		CHECK(WaitFor([&]() { return count.load() == Outer + Outer / 10 * 5; }));
+	}
+	CHECK(count.load() == Outer + Outer / 10 * 5);
+}
+
+static void TestDestructorFinishesWork()
+{
+	std::atomic<int> count(0);
+	{
+		ThreadPool pool(2);
+		for (int i = 0; i < 1000; i++)
+		{
+			pool.Submit([&count]()
+			{
+				std::this_thread::sleep_for(std::chrono::microseconds(10));
+				count++;
+			}, (WorkPriority)(i % ThreadPool::LaneCount));
+		}
+	}
+	CHECK(count.load() == 1000);
+}
+
+static void TestExceptionsAreSwallowed()
+{
+	std::atomic<int> count(0);
+	ThreadPool pool(2);
+	for (int i = 0; i < 100; i++)
+	{
+		pool.Submit([&count, i]()
+		{
+			count++;
+			if (i % 2 == 0)
+				throw std::runtime_error("ignored");
+		});
+	}
+	CHECK(WaitFor([&]() { return count.load() == 100; }));
+	std::atomic<bool> after(false);
+	pool.Submit([&after]() { after = true; });
+	CHECK(WaitFor([&]() { return after.load(); }));
+}
+
+// Blocking tasks only finish if they run on distinct workers at once
+static void TestWorkSpreadsAcrossWorkers()
+{
+	const unsigned Workers = 4;
+	ThreadPool pool(Workers);
+	std::mutex lock;
+	std::set<std::thread::id> threads;
+	std::atomic<unsigned> arrived(0);
+	std::atomic<unsigned> done(0);
+	pool.Submit([&]()
+	{
+		// Submitted from a worker: the others have to steal them
+		for (unsigned i = 0; i < Workers; i++)
+		{
+			pool.Submit([&]()
+			{
+				{
+					std::lock_guard<std::mutex> guard(lock);
+					threads.insert(std::this_thread::get_id());
+				}
+				arrived++;
+				WaitFor([&]() { return arrived.load() >= Workers - 1; });
+				done++;
+			});
+		}
+	});
+	CHECK(WaitFor([&]() { return done.load() == Workers; }));
+	CHECK(threads.size() >= Workers - 1);
+}
+
+// Parked workers wake up for every submission
+static void TestWakeAfterIdle()
+{
+	ThreadPool pool(3);
+	for (int round = 0; round < 200; round++)
+	{
+		if (round % 50 == 0)
+			std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		std::atomic<bool> done(false);
+		pool.Submit([&done]() { done = true; });
+		CHECK(WaitFor([&]() { return done.load(); }));
+	}
+}
+
+// A worker that finishes a task takes the most urgent lane first
+static void TestLaneOrder()
+{
+	ThreadPool pool(2);
+	std::atomic<bool> releaseFirst(false), releaseSecond(false);
+	std::atomic<int> blocked(0);
+	for (auto release : { &releaseFirst, &releaseSecond })
+	{
+		pool.Submit([release, &blocked]()
+		{
+			blocked++;
+			while (!release->load())
+				std::this_thread::yield();
+		});
+	}
+	CHECK(WaitFor([&]() { return blocked.load() == 2; }));
+
+	std::mutex lock;
+	std::vector<WorkPriority> order;
+	for (auto priority : { WorkPriority::Idle, WorkPriority::Prefetch, WorkPriority::Normal, WorkPriority::UserBlocking })
+	{
+		pool.Submit([priority, &lock, &order]()
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			order.push_back(priority);
+		}, priority);
+	}
+	// Only one worker is free: it runs everything in lane order
+	releaseSecond = true;
+	CHECK(WaitFor([&]() { std::lock_guard<std::mutex> guard(lock); return order.size() == 4; }));
+	CHECK(order[0] == WorkPriority::UserBlocking && order[1] == WorkPriority::Normal);
+	CHECK(order[2] == WorkPriority::Prefetch && order[3] == WorkPriority::Idle);
+	releaseFirst = true;
+}
+
+// Background work never takes the last worker: urgent work starts while it runs
+static void TestBackgroundLeavesAWorker()
+{
+	ThreadPool pool(2);
+	std::atomic<bool> release(false);
+	std::atomic<int> running(0);
+	for (int i = 0; i < 4; i++)
+	{
+		pool.Submit([&release, &running]()
+		{
+			running++;
+			while (!release.load())
+				std::this_thread::yield();
+			running--;
+		}, i % 2 == 0 ? WorkPriority::Idle : WorkPriority::Prefetch);
+	}
+	CHECK(WaitFor([&]() { return running.load() == 1; }));
+
+	std::atomic<bool> urgent(false);
+	pool.Submit([&urgent]() { urgent = true; }, WorkPriority::UserBlocking);
+	CHECK(WaitFor([&]() { return urgent.load(); }));
+	CHECK(running.load() == 1);
+	release = true;
+}
+
+int main()
+{
+	TestAllWorkRuns();
+	TestDestructorFinishesWork();
+	TestExceptionsAreSwallowed();
+	TestWorkSpreadsAcrossWorkers();
+	TestWakeAfterIdle();
+	TestLaneOrder();
+	TestBackgroundLeavesAWorker();
+	puts("ThreadPoolTest passed");
+	return 0;
+}
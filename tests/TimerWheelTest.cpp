@@ -0,0 +1,217 @@
+// TimerWheel against a reference (the expected tick of each timer) on a virtual clock: random
+// schedules, cancels and reschedules across levels and the overflow list, irregular Advance
+// steps, callbacks touching the wheel, and a throwing callback; then TimerService in real time
+
+#include "TimerWheel.h"
+#include "TestHelper.h"
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+using namespace LUwpUtilities;
+
+// Expected tick of a timer scheduled at now for expiry
+static uint64_t Due(uint64_t now, uint64_t expiry)
+{
+	return (expiry <= now ? now + 1 : expiry);
+}
+
+static void TestAgainstReference(uint64_t seed)
+{
+	std::mt19937_64 random(seed);
+	uint64_t start = random() % (1ull << 40);
+	TimerWheel wheel(start);
+	const int Count = 5000;
+	std::vector<std::unique_ptr<TimerWheel::Timer>> timers;
+	std::map<int, uint64_t> expected; // timer -> tick, for the scheduled ones
+	std::vector<uint64_t> fired(Count, 0);
+	uint64_t last = start;
+	bool ordered = true;
+
+	for (int i = 0; i < Count; i++)
+	{
+		timers.emplace_back(new TimerWheel::Timer());
+		timers[i]->callback = [&, i]()
+		{
+			CHECK(fired[i] == 0);
+			fired[i] = wheel.Now();
+			ordered = ordered && wheel.Now() >= last;
+			last = wheel.Now();
+		};
+	}
+
+	// Mostly short delays, some spanning the upper levels and beyond 64^4 ticks (overflow)
+	auto delay = [&]() -> uint64_t
+	{
+		switch (random() % 8)
+		{
+		case 0: return random() % (1ull << 30);
+		case 1: return random() % (1ull << 20);
+		case 2: return 0;
+		default: return random() % 5000;
+		}
+	};
+	for (int i = 0; i < Count; i++)
+	{
+		auto expiry = start + delay();
+		wheel.Schedule(*timers[i], expiry);
+		expected[i] = Due(start, expiry);
+	}
+	CHECK(wheel.Count() == Count);
+
+	uint64_t now = start;
+	while (wheel.Count() > 0)
+	{
+		// Between steps, cancel and reschedule some timers relative to the current tick
+		for (int k = 0; k < 20; k++)
+		{
+			int i = (int)(random() % Count);
+			bool scheduled = timers[i]->IsScheduled();
+			CHECK(scheduled == (expected.count(i) == 1));
+			if (scheduled && random() % 2 == 0)
+			{
+				CHECK(wheel.Cancel(*timers[i]));
+				expected.erase(i);
+			}
+			else if (fired[i] == 0)
+			{
+				auto expiry = now + delay();
+				wheel.Schedule(*timers[i], expiry);
+				expected[i] = Due(now, expiry);
+			}
+		}
+		CHECK(wheel.Count() == expected.size());
+
+		// The next tick is never after the earliest expiry (it may be a cascade before it)
+		uint64_t earliest = TimerWheel::Never;
+		for (auto &entry : expected)
+			earliest = std::min(earliest, entry.second);
+		auto next = wheel.NextTick();
+		CHECK(next > now && next <= earliest);
+
+		now += (random() % 3 == 0 ? random() % 300000 : random() % 70);
+		if (random() % 50 == 0)
+			now = std::max(now, earliest);
+		wheel.Advance(now);
+		CHECK(wheel.Now() == now);
+		for (auto it = expected.begin(); it != expected.end();)
+		{
+			if (it->second <= now)
+			{
+				CHECK(fired[it->first] == it->second);
+				it = expected.erase(it);
+			}
+			else
+			{
+				CHECK(fired[it->first] == 0);
+				++it;
+			}
+		}
+	}
+	CHECK(ordered && expected.empty() && wheel.NextTick() == TimerWheel::Never);
+}
+
+// Each timer fires at exactly its tick when the clock moves one tick at a time
+static void TestEveryTick()
+{
+	TimerWheel wheel(100);
+	const uint64_t Delays[] = { 1, 63, 64, 65, 4095, 4096, 4097, 262144, 262145 };
+	std::vector<std::unique_ptr<TimerWheel::Timer>> timers;
+	std::vector<uint64_t> fired;
+	for (auto delay : Delays)
+	{
+		timers.emplace_back(new TimerWheel::Timer());
+		auto index = fired.size();
+		fired.push_back(0);
+		timers.back()->callback = [&, index]() { fired[index] = wheel.Now(); };
+		wheel.Schedule(*timers.back(), 100 + delay);
+	}
+	for (uint64_t tick = 101; tick <= 100 + 262150; tick++)
+		wheel.Advance(tick);
+	for (size_t i = 0; i < fired.size(); i++)
+		CHECK(fired[i] == 100 + Delays[i]);
+}
+
+static void TestCallbacksUseTheWheel()
+{
+	TimerWheel wheel;
+	TimerWheel::Timer periodic, victim, late;
+	int runs = 0, victimRuns = 0, lateRuns = 0;
+	periodic.callback = [&]()
+	{
+		if (++runs < 5)
+			wheel.Schedule(periodic, wheel.Now() + 10);
+		wheel.Cancel(victim);
+		// Due in the past: next tick
+		wheel.Schedule(late, 0);
+	};
+	victim.callback = [&]() { victimRuns++; };
+	late.callback = [&]() { lateRuns++; CHECK(wheel.Now() % 10 == 1); };
+	wheel.Schedule(periodic, 10);
+	wheel.Schedule(victim, 10);
+	wheel.Advance(1000);
+	CHECK(runs == 5 && victimRuns == 0 && lateRuns == 5 && wheel.Count() == 0);
+}
+
+// A throwing callback propagates; the other timers of its tick run at the next Advance()
+static void TestThrowingCallback()
+{
+	TimerWheel wheel;
+	TimerWheel::Timer bad, good;
+	int goodRuns = 0;
+	bad.callback = []() { throw std::runtime_error("callback"); };
+	good.callback = [&]() { goodRuns++; };
+	wheel.Schedule(bad, 5);
+	wheel.Schedule(good, 5);
+	bool thrown = false;
+	try
+	{
+		wheel.Advance(5);
+	}
+	catch (const std::runtime_error&)
+	{
+		thrown = true;
+	}
+	CHECK(thrown && goodRuns == 0 && wheel.Count() == 1);
+	wheel.Advance(6);
+	CHECK(goodRuns == 1 && wheel.Count() == 0);
+}
+
+static void TestService()
+{
+	TimerService service;
+	TimerWheel::Timer first, second;
+	std::atomic<int> order(0), firstAt(0), secondAt(0);
+	first.callback = [&]() { firstAt = ++order; };
+	second.callback = [&]() { secondAt = ++order; };
+	auto start = std::chrono::steady_clock::now();
+	service.Schedule(second, std::chrono::milliseconds(40));
+	service.Schedule(first, std::chrono::milliseconds(20));
+	CHECK(WaitFor([&]() { return order.load() == 2; }));
+	CHECK(firstAt == 1 && secondAt == 2 && SecondsSince(start) >= 0.039);
+
+	// Cancelled before its time: never runs
+	std::atomic<int> cancelledRuns(0);
+	TimerWheel::Timer cancelled;
+	cancelled.callback = [&]() { cancelledRuns++; };
+	service.Schedule(cancelled, std::chrono::milliseconds(30));
+	CHECK(service.Cancel(cancelled));
+	std::this_thread::sleep_for(std::chrono::milliseconds(60));
+	CHECK(cancelledRuns == 0);
+}
+
+int main()
+{
+	for (uint64_t seed = 1; seed <= 20; seed++)
+		TestAgainstReference(seed);
+	TestEveryTick();
+	TestCallbacksUseTheWheel();
+	TestThrowingCallback();
+	TestService();
+	puts("TimerWheelTest passed");
+	return 0;
+}
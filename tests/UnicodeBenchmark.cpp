@@ -0,0 +1,312 @@
+// GB/s (of UTF-8) of UnicodeHelper.h on ASCII, mostly-ASCII and CJK text, both ways, against the
+// usual loops that convert one code point at a time: making the same two passes (the exact length,
+// then the conversion), and making one pass into a worst-case buffer.
+// Then pages of feed items through a reused Utf16Arena against converting each field into its own
+// buffer, with the heap allocations of each. On UWP, each string still costs one more allocation
+// for its Platform::String either way.
+
+#include "UnicodeHelper.h"
+#include "TestHelper.h"
+#include <algorithm>
+#include <cstdlib>
+#include <functional>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace LUwpUtilities;
+
+// Counts every new and new[] of the program, which has one thread
+static size_t Allocations;
+
+static void *CountedMalloc(size_t size)
+{
+	Allocations++;
+	if (void *block = malloc(size == 0 ? 1 : size))
+		return block;
+	throw std::bad_alloc();
+}
+
+void *operator new(size_t size)
+{
+	return CountedMalloc(size);
+}
+
+void *operator new[](size_t size)
+{
+	return CountedMalloc(size);
+}
+
+void operator delete(void *block) noexcept
+{
+	free(block);
+}
+
+void operator delete(void *block, size_t) noexcept
+{
+	free(block);
+}
+
+void operator delete[](void *block) noexcept
+{
+	free(block);
+}
+
+void operator delete[](void *block, size_t) noexcept
+{
+	free(block);
+}
+
+// One code point (or InvalidCodePoint) per call, like a hand-written validating decoder
+static uint32_t DecodeNext(const unsigned char *s, size_t len, size_t &i)
+{
+	uint32_t cp = s[i];
+	if (cp < 0x80)
+		i++;
+	else
+		i += Unicode::DecodeSequence(s + i, len - i, cp);
+	return cp;
+}
+
+static size_t PerCodePointUtf8ToUtf16Length(const char *src, size_t len)
+{
+	auto s = reinterpret_cast<const unsigned char*>(src);
+	size_t units = 0;
+	for (size_t i = 0; i < len; )
+	{
+		uint32_t cp = DecodeNext(s, len, i);
+		units += (cp >= 0x10000 && cp != Unicode::InvalidCodePoint ? 2 : 1);
+	}
+	return units;
+}
+
+static size_t PerCodePointUtf8ToUtf16(const char *src, size_t len, char16_t *dest)
+{
+	auto s = reinterpret_cast<const unsigned char*>(src);
+	char16_t *d = dest;
+	for (size_t i = 0; i < len; )
+	{
+		uint32_t cp = DecodeNext(s, len, i);
+		if (cp == Unicode::InvalidCodePoint)
+			*d++ = Unicode::ReplacementCharacter;
+		else if (cp >= 0x10000)
+		{
+			*d++ = char16_t(0xD800 + ((cp - 0x10000) >> 10));
+			*d++ = char16_t(0xDC00 + ((cp - 0x10000) & 0x3FF));
+		}
+		else
+			*d++ = char16_t(cp);
+	}
+	return d - dest;
+}
+
+static size_t PerCodePointUtf16ToUtf8Length(const char16_t *src, size_t len)
+{
+	size_t bytes = 0;
+	for (size_t i = 0; i < len; )
+	{
+		uint32_t cp;
+		i += Unicode::DecodeSequence(src + i, len - i, cp);
+		bytes += Unicode::Utf8Bytes(cp);
+	}
+	return bytes;
+}
+
+static size_t PerCodePointUtf16ToUtf8(const char16_t *src, size_t len, char *dest)
+{
+	auto d = reinterpret_cast<unsigned char*>(dest);
+	for (size_t i = 0; i < len; )
+	{
+		uint32_t cp;
+		i += Unicode::DecodeSequence(src + i, len - i, cp);
+		if (cp < 0x80)
+			*d++ = (unsigned char)cp;
+		else if (cp < 0x800)
+		{
+			*d++ = (unsigned char)(0xC0 | (cp >> 6));
+			*d++ = (unsigned char)(0x80 | (cp & 0x3F));
+		}
+		else if (cp < 0x10000)
+		{
+			*d++ = (unsigned char)(0xE0 | (cp >> 12));
+			*d++ = (unsigned char)(0x80 | ((cp >> 6) & 0x3F));
+			*d++ = (unsigned char)(0x80 | (cp & 0x3F));
+		}
+		else
+		{
+			*d++ = (unsigned char)(0xF0 | (cp >> 18));
+			*d++ = (unsigned char)(0x80 | ((cp >> 12) & 0x3F));
+			*d++ = (unsigned char)(0x80 | ((cp >> 6) & 0x3F));
+			*d++ = (unsigned char)(0x80 | (cp & 0x3F));
+		}
+	}
+	return d - reinterpret_cast<unsigned char*>(dest);
+}
+
+static std::string Text(const std::string &kind, size_t bytes)
+{
+	std::mt19937 random(1);
+	std::string text;
+	while (text.size() < bytes)
+	{
+		if (kind == "ASCII")
+		{
+			text += (char)(' ' + random() % 95);
+		}
+		else if (kind == "mostly ASCII")
+		{
+			// Accented letters, a few euro signs
+			text += (random() % 20 == 0 ? "\xC3\xA9" : random() % 200 == 0 ? "\xE2\x82\xAC" : std::string(1, (char)('a' + random() % 26)));
+		}
+		else
+		{
+			// CJK ideographs with some ASCII punctuation
+			uint32_t cp = (random() % 10 == 0 ? (uint32_t)',' : 0x4E00 + random() % 0x5000);
+			if (cp < 0x80)
+				text += (char)cp;
+			else
+				text += { (char)(0xE0 | (cp >> 12)), (char)(0x80 | ((cp >> 6) & 0x3F)), (char)(0x80 | (cp & 0x3F)) };
+		}
+	}
+	return text;
+}
+
+// Fields of a page of feed items: ids, short titles and names, longer mostly-ASCII bodies
+static std::vector<std::string> PageFields(std::mt19937 &random, size_t items)
+{
+	std::vector<std::string> fields;
+	for (size_t i = 0; i < items; i++)
+	{
+		fields.push_back(std::to_string(random()));
+		fields.push_back(Text("ASCII", 20 + random() % 60));
+		fields.push_back(Text(random() % 4 == 0 ? "CJK" : "mostly ASCII", 10 + random() % 20));
+		fields.push_back(Text("mostly ASCII", 100 + random() % 400));
+	}
+	return fields;
+}
+
+static void MeasureArena(bool quick)
+{
+	std::mt19937 random(2);
+	std::vector<std::vector<std::string>> pages;
+	for (int p = 0; p < 16; p++)
+		pages.push_back(PageFields(random, 25 + random() % 50));
+	std::vector<std::vector<Utf8Slice>> slices;
+	size_t strings = 0;
+	for (auto &page : pages)
+	{
+		slices.emplace_back();
+		for (auto &field : page)
+			slices.back().push_back({ field.data(), field.size() });
+		strings += page.size();
+	}
+
+	int rounds = (quick ? 10 : 2000);
+	size_t checksum = 0, expected = 0;
+	Utf16Arena arena;
+	size_t before = Allocations;
+	auto start = std::chrono::steady_clock::now();
+	for (int r = 0; r < rounds; r++)
+	{
+		for (auto &page : slices)
+		{
+			arena.Transcode(page.data(), page.size());
+			for (size_t i = 0; i < arena.Count(); i++)
+				checksum += arena.Length(i) + arena.Data(i)[0];
+		}
+	}
+	double arenaTime = SecondsSince(start);
+	size_t arenaAllocations = Allocations - before;
+
+	before = Allocations;
+	start = std::chrono::steady_clock::now();
+	for (int r = 0; r < rounds; r++)
+	{
+		for (auto &page : pages)
+		{
+			for (auto &field : page)
+			{
+				size_t length = Utf8ToUtf16Length(field.data(), field.size());
+				char16_t *data = new char16_t[length];
+				Utf8ToUtf16(field.data(), field.size(), data);
+				expected += length + data[0];
+				delete[] data;
+			}
+		}
+	}
+	double perStringTime = SecondsSince(start);
+	size_t perStringAllocations = Allocations - before;
+	CHECK(checksum == expected);
+
+	double total = (double)strings * rounds;
+	printf("%-58s %6.1f ns/string, %zu allocations for %.0f strings (the arena grew %zu times)\n", "feed pages: Utf16Arena",
+		arenaTime * 1e9 / total, arenaAllocations, total, arena.Growths());
+	printf("%-58s %6.1f ns/string, %zu allocations for %.0f strings\n", "feed pages: one buffer per string",
+		perStringTime * 1e9 / total, perStringAllocations, total);
+}
+
+// Best of a few runs
+static void Measure(const std::string &name, size_t bytes, int runs, const std::function<void()> &convert)
+{
+	double best = 1e9;
+	for (int i = 0; i < runs; i++)
+	{
+		auto start = std::chrono::steady_clock::now();
+		convert();
+		best = std::min(best, SecondsSince(start));
+	}
+	printf("%-58s %6.2f GB/s\n", name.c_str(), bytes / best / 1e9);
+}
+
+int main(int argc, char **argv)
+{
+	bool quick = HasFlag(argc, argv, "--quick");
+	int runs = (quick ? 1 : 5);
+	size_t bytes = (quick ? 1 << 16 : 16 << 20);
+	for (std::string kind : { "ASCII", "mostly ASCII", "CJK" })
+	{
+		auto text = Text(kind, bytes);
+		std::vector<char16_t> utf16(text.size());
+		size_t units = 0, reference = 0, onePass = 0;
+
+		Measure(kind + ", to UTF-16: Utf8ToUtf16Length + Utf8ToUtf16", text.size(), runs, [&]()
+		{
+			units = Utf8ToUtf16Length(text.data(), text.size());
+			CHECK(Utf8ToUtf16(text.data(), text.size(), utf16.data()) == units);
+		});
+		Measure(kind + ", to UTF-16: per code point, two passes", text.size(), runs, [&]()
+		{
+			reference = PerCodePointUtf8ToUtf16Length(text.data(), text.size());
+			CHECK(PerCodePointUtf8ToUtf16(text.data(), text.size(), utf16.data()) == reference);
+		});
+		Measure(kind + ", to UTF-16: per code point, one pass", text.size(), runs, [&]()
+		{
+			onePass = PerCodePointUtf8ToUtf16(text.data(), text.size(), utf16.data());
+		});
+		CHECK(units == reference && units == onePass);
+
+		utf16.resize(units);
+		std::string utf8(3 * units, '\0');
+		size_t bytes = 0;
+		Measure(kind + ", to UTF-8: Utf16ToUtf8Length + Utf16ToUtf8", text.size(), runs, [&]()
+		{
+			bytes = Utf16ToUtf8Length(utf16.data(), utf16.size());
+			CHECK(Utf16ToUtf8(utf16.data(), utf16.size(), &utf8[0]) == bytes);
+		});
+		Measure(kind + ", to UTF-8: per code point, two passes", text.size(), runs, [&]()
+		{
+			reference = PerCodePointUtf16ToUtf8Length(utf16.data(), utf16.size());
+			CHECK(PerCodePointUtf16ToUtf8(utf16.data(), utf16.size(), &utf8[0]) == reference);
+		});
+		Measure(kind + ", to UTF-8: per code point, one pass", text.size(), runs, [&]()
+		{
+			onePass = PerCodePointUtf16ToUtf8(utf16.data(), utf16.size(), &utf8[0]);
+		});
+		CHECK(bytes == text.size() && reference == bytes && onePass == bytes);
+		CHECK(utf8.compare(0, bytes, text) == 0);
+	}
+
+	MeasureArena(quick);
+	return 0;
+}
@@ -0,0 +1,471 @@
+// UnicodeHelper.h against one code point at a time references: random valid and invalid UTF-8
+// (truncated and overlong sequences, encoded surrogates, stray continuation and lead bytes) and
+// UTF-16 (lone and reversed surrogates, pairs cut at the end) of every length and placed at every
+// offset around the SIMD blocks, and UTF-8 split at every position
+
+#include "UnicodeHelper.h"
+#include "TestHelper.h"
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace LUwpUtilities;
+
+typedef std::u16string Utf16;
+
+static void AppendUtf16(Utf16 &result, uint32_t cp)
+{
+	if (cp >= 0x10000)
+	{
+		result += char16_t(0xD800 + ((cp - 0x10000) >> 10));
+		result += char16_t(0xDC00 + ((cp - 0x10000) & 0x3FF));
+	}
+	else
+	{
+		result += char16_t(cp);
+	}
+}
+
+static std::string EncodeUtf8(uint32_t cp)
+{
+	std::string result;
+	if (cp < 0x80)
+		result += (char)cp;
+	else if (cp < 0x800)
+		result += { (char)(0xC0 | (cp >> 6)), (char)(0x80 | (cp & 0x3F)) };
+	else if (cp < 0x10000)
+		result += { (char)(0xE0 | (cp >> 12)), (char)(0x80 | ((cp >> 6) & 0x3F)), (char)(0x80 | (cp & 0x3F)) };
+	else
+		result += { (char)(0xF0 | (cp >> 18)), (char)(0x80 | ((cp >> 12) & 0x3F)), (char)(0x80 | ((cp >> 6) & 0x3F)), (char)(0x80 | (cp & 0x3F)) };
+	return result;
+}
+
+// Well-formed byte sequences (Table 3-7 of the Unicode Standard): the range of the second byte
+// for each lead byte, the others being 80..BF
+struct LeadByte
+{
+	unsigned char first, last; // of the lead bytes
+	int length;
+	unsigned char low, high;   // of the second byte
+};
+
+static const LeadByte LeadBytes[] =
+{
+	{ 0xC2, 0xDF, 2, 0x80, 0xBF },
+	{ 0xE0, 0xE0, 3, 0xA0, 0xBF },
+	{ 0xE1, 0xEC, 3, 0x80, 0xBF },
+	{ 0xED, 0xED, 3, 0x80, 0x9F },
+	{ 0xEE, 0xEF, 3, 0x80, 0xBF },
+	{ 0xF0, 0xF0, 4, 0x90, 0xBF },
+	{ 0xF1, 0xF3, 4, 0x80, 0xBF },
+	{ 0xF4, 0xF4, 4, 0x80, 0x8F },
+};
+
+// Each maximal subpart of an ill-formed sequence becomes one U+FFFD
+static Utf16 ReferenceUtf8ToUtf16(const std::string &text, bool *valid = nullptr)
+{
+	Utf16 result;
+	bool ok = true;
+	size_t i = 0;
+	while (i < text.size())
+	{
+		unsigned char lead = (unsigned char)text[i];
+		if (lead < 0x80)
+		{
+			result += char16_t(lead);
+			i++;
+			continue;
+		}
+
+		const LeadByte *form = nullptr;
+		for (auto &candidate : LeadBytes)
+			if (lead >= candidate.first && lead <= candidate.last)
+				form = &candidate;
+		if (form == nullptr)
+		{
+			result += char16_t(0xFFFD);
+			ok = false;
+			i++;
+			continue;
+		}
+
+		uint32_t cp = lead & (0xFF >> (form->length + 1));
+		int matched = 1;
+		for (; matched < form->length && i + matched < text.size(); matched++)
+		{
+			unsigned char c = (unsigned char)text[i + matched];
+			unsigned char low = (matched == 1 ? form->low : 0x80), high = (matched == 1 ? form->high : 0xBF);
+			if (c < low || c > high)
+				break;
+			cp = (cp << 6) | (c & 0x3F);
+		}
+		if (matched == form->length)
+		{
+			AppendUtf16(result, cp);
+		}
+		else
+		{
+			result += char16_t(0xFFFD);
+			ok = false;
+		}
+		i += matched;
+	}
+	if (valid != nullptr)
+		*valid = ok;
+	return result;
+}
+
+static Utf16 ToUtf16(const std::string &text, bool *valid = nullptr)
+{
+	size_t length = Utf8ToUtf16Length(text.data(), text.size(), valid);
+	// One unit of slack to catch a write past the computed length
+	Utf16 result(length + 1, u'\x1234');
+	CHECK(Utf8ToUtf16(text.data(), text.size(), &result[0]) == length);
+	CHECK(result[length] == u'\x1234');
+	result.resize(length);
+	return result;
+}
+
+static void CheckUtf8(const std::string &text)
+{
+	bool expectedValid, valid;
+	auto expected = ReferenceUtf8ToUtf16(text, &expectedValid);
+	auto converted = ToUtf16(text, &valid);
+	if (converted != expected || valid != expectedValid)
+	{
+		fprintf(stderr, "UTF-8:");
+		for (unsigned char c : text)
+			fprintf(stderr, " %02X", c);
+		fprintf(stderr, "\n");
+		CHECK(false);
+	}
+	CHECK(converted.size() <= text.size());
+}
+
+// Mostly pieces of well-formed text, with the bytes that make it ill-formed mixed in
+static std::string RandomUtf8(std::mt19937_64 &random, size_t pieces)
+{
+	static const uint32_t Planes[] = { 0x80, 0x800, 0x10000, 0x110000 };
+	static const char *Invalid[] =
+	{
+		"\x80", "\xBF", "\xC0\x80", "\xC1\xBF", "\xE0\x80\x80", "\xE0\x9F\xBF", "\xF0\x8F\xBF\xBF", "\xED\xA0\x80", "\xED\xBF\xBF",
+		"\xF4\x90\x80\x80", "\xF5\x80\x80\x80", "\xFE", "\xFF", "\xC2", "\xE1\x80", "\xF1\x80\x80", "\xF4\x8F\xBF",
+	};
+	std::string text;
+	for (size_t p = 0; p < pieces; p++)
+	{
+		switch (random() % 8)
+		{
+		case 0:
+		case 1:
+			text += std::string(random() % 40, (char)('a' + random() % 26));
+			break;
+		case 2:
+			text += Invalid[random() % (sizeof(Invalid) / sizeof(Invalid[0]))];
+			break;
+		case 3:
+			text += (char)random();
+			break;
+		default:
+		{
+			uint32_t cp;
+			do
+				cp = (uint32_t)(random() % Planes[random() % 4]);
+			while (cp >= 0xD800 && cp <= 0xDFFF);
+			text += EncodeUtf8(cp);
+			break;
+		}
+		}
+	}
+	return text;
+}
+
+// An unpaired surrogate becomes U+FFFD
+static std::string ReferenceUtf16ToUtf8(const Utf16 &text, bool *valid = nullptr)
+{
+	std::string result;
+	bool ok = true;
+	for (size_t i = 0; i < text.size(); i++)
+	{
+		uint32_t cp = text[i];
+		if (cp >= 0xD800 && cp <= 0xDBFF && i + 1 < text.size() && text[i + 1] >= 0xDC00 && text[i + 1] <= 0xDFFF)
+		{
+			cp = 0x10000 + ((cp - 0xD800) << 10) + (text[i + 1] - 0xDC00);
+			i++;
+		}
+		else if (cp >= 0xD800 && cp <= 0xDFFF)
+		{
+			cp = 0xFFFD;
+			ok = false;
+		}
+		result += EncodeUtf8(cp);
+	}
+	if (valid != nullptr)
+		*valid = ok;
+	return result;
+}
+
+static std::string ToUtf8(const Utf16 &text, bool *valid = nullptr)
+{
+	size_t length = Utf16ToUtf8Length(text.data(), text.size(), valid);
+	std::string result(length + 1, '#');
+	CHECK(Utf16ToUtf8(text.data(), text.size(), &result[0]) == length);
+	CHECK(result[length] == '#');
+	result.resize(length);
+	return result;
+}
+
+static void CheckUtf16(const Utf16 &text)
+{
+	bool expectedValid, valid;
+	auto expected = ReferenceUtf16ToUtf8(text, &expectedValid);
+	auto converted = ToUtf8(text, &valid);
+	if (converted != expected || valid != expectedValid)
+	{
+		fprintf(stderr, "UTF-16:");
+		for (char16_t c : text)
+			fprintf(stderr, " %04X", (unsigned)c);
+		fprintf(stderr, "\n");
+		CHECK(false);
+	}
+	CHECK(converted.size() <= 3 * text.size());
+	// Well-formed text makes the round trip
+	if (valid)
+		CHECK(ToUtf16(converted) == text);
+}
+
+// Runs of ASCII, Latin, CJK and astral code points, with unpaired surrogates mixed in
+static Utf16 RandomUtf16(std::mt19937_64 &random, size_t pieces)
+{
+	Utf16 text;
+	for (size_t p = 0; p < pieces; p++)
+	{
+		size_t run = random() % 20;
+		switch (random() % 6)
+		{
+		case 0:
+			text += Utf16(run, char16_t('a' + random() % 26));
+			break;
+		case 1:
+			for (size_t k = 0; k < run; k++)
+				text += char16_t(0x80 + random() % 0x780);
+			break;
+		case 2:
+			for (size_t k = 0; k < run; k++)
+				text += char16_t(0x4E00 + random() % 0x5000);
+			break;
+		case 3:
+			for (size_t k = 0; k < run % 4; k++)
+				AppendUtf16(text, 0x10000 + random() % 0x100000);
+			break;
+		case 4:
+			text += char16_t(0xD800 + random() % 0x800);
+			break;
+		default:
+			text += char16_t(random() % 3 == 0 ? 0xFFFD : 0xE000 + random() % 0x2000);
+			break;
+		}
+	}
+	return text;
+}
+
+static void TestUtf8Examples()
+{
+	// Table 3-8 of the Unicode Standard
+	CHECK(ReferenceUtf8ToUtf16("\x61\xF1\x80\x80\xE1\x80\xC2\x62\x80\x63\x80\xBF\x64") == u"\x61\xFFFD\xFFFD\xFFFD\x62\xFFFD\x63\xFFFD\xFFFD\x64");
+	CheckUtf8("\x61\xF1\x80\x80\xE1\x80\xC2\x62\x80\x63\x80\xBF\x64");
+
+	struct Case
+	{
+		const char *utf8;
+		Utf16 utf16;
+	};
+	const Case Cases[] =
+	{
+		{ "", u"" },
+		{ "\xC3\xA9", u"\x00E9" },
+		{ "\xE2\x82\xAC", u"\x20AC" },
+		{ "\xF0\x9F\x98\x80", u"\xD83D\xDE00" },
+		{ "\xF4\x8F\xBF\xBF", u"\xDBFF\xDFFF" },
+		// Overlong
+		{ "\xC0\xAF", u"\xFFFD\xFFFD" },
+		{ "\xE0\x80\xAF", u"\xFFFD\xFFFD\xFFFD" },
+		{ "\xF0\x80\x80\xAF", u"\xFFFD\xFFFD\xFFFD\xFFFD" },
+		// Encoded surrogates and beyond U+10FFFF
+		{ "\xED\xA0\x80", u"\xFFFD\xFFFD\xFFFD" },
+		{ "\xED\xB0\x80x", u"\xFFFD\xFFFD\xFFFDx" },
+		{ "\xF4\x90\x80\x80", u"\xFFFD\xFFFD\xFFFD\xFFFD" },
+		// Truncated: one U+FFFD for the whole prefix
+		{ "\xE2\x82", u"\xFFFD" },
+		{ "\xF0\x9F\x98", u"\xFFFD" },
+		{ "\xF0\x9F\x98x", u"\xFFFDx" },
+		{ "\xE2\x82\xE2\x82\xAC", u"\xFFFD\x20AC" },
+	};
+	for (auto &c : Cases)
+	{
+		bool valid;
+		CHECK(ToUtf16(c.utf8, &valid) == c.utf16);
+		CHECK(valid == (c.utf16.find(u'\xFFFD') == Utf16::npos));
+		CheckUtf8(c.utf8);
+	}
+}
+
+// Every interesting sequence, whole and truncated, at every offset around two SIMD blocks
+static void TestUtf8Offsets()
+{
+	const char *Sequences[] =
+	{
+		"\xC3\xA9", "\xE4\xB8\xAD", "\xF0\x9F\x98\x80", "\xC0\x80", "\xE0\x80\x80", "\xED\xA0\x80", "\xF4\x90\x80\x80", "\x80", "\xFF",
+	};
+	for (auto sequence : Sequences)
+	{
+		std::string whole = sequence;
+		for (size_t cut = 1; cut <= whole.size(); cut++)
+		{
+			for (size_t offset = 0; offset <= 40; offset++)
+			{
+				std::string prefix(offset, 'a');
+				CheckUtf8(prefix + whole.substr(0, cut));
+				CheckUtf8(prefix + whole.substr(0, cut) + std::string(20, 'b'));
+				CheckUtf8(prefix + whole.substr(0, cut) + "\xE4\xB8\xAD" + std::string(offset % 17, 'c'));
+			}
+		}
+	}
+}
+
+// Text converted in two chunks split anywhere is what the reference makes of the two chunks
+static void TestUtf8Splits()
+{
+	std::mt19937_64 random(5);
+	for (int iteration = 0; iteration < 300; iteration++)
+	{
+		auto text = RandomUtf8(random, 12);
+		for (size_t split = 0; split <= text.size(); split++)
+		{
+			auto head = text.substr(0, split), tail = text.substr(split);
+			CHECK(ToUtf16(head) + ToUtf16(tail) == ReferenceUtf8ToUtf16(head) + ReferenceUtf8ToUtf16(tail));
+		}
+	}
+}
+
+static void TestUtf8Fuzz()
+{
+	std::mt19937_64 random(11);
+	int valid = 0, invalid = 0;
+	for (int iteration = 0; iteration < 50000; iteration++)
+	{
+		std::string text;
+		if (iteration % 4 == 0)
+		{
+			// Raw random bytes, mostly above 0x7F
+			text.resize(random() % 64);
+			for (auto &c : text)
+				c = (char)(random() % 3 == 0 ? 'a' + random() % 26 : 0x80 + random() % 0x80);
+		}
+		else
+		{
+			text = RandomUtf8(random, 1 + random() % 10);
+		}
+		CheckUtf8(text);
+		bool ok;
+		ReferenceUtf8ToUtf16(text, &ok);
+		(ok ? valid : invalid)++;
+	}
+	printf("valid=%d invalid=%d\n", valid, invalid);
+	CHECK(valid > 5000 && invalid > 20000);
+}
+
+static void TestUtf16Examples()
+{
+	struct Case
+	{
+		Utf16 utf16;
+		const char *utf8;
+		bool valid;
+	};
+	const Case Cases[] =
+	{
+		{ u"", "", true },
+		{ u"\x00E9\x20AC", "\xC3\xA9\xE2\x82\xAC", true },
+		{ u"\xD83D\xDE00", "\xF0\x9F\x98\x80", true },
+		{ u"\xFFFD", "\xEF\xBF\xBD", true },
+		{ u"\xD83D", "\xEF\xBF\xBD", false },
+		{ u"\xDE00", "\xEF\xBF\xBD", false },
+		{ u"\xDE00\xD83D", "\xEF\xBF\xBD\xEF\xBF\xBD", false },
+		{ u"\xD83Dx", "\xEF\xBF\xBDx", false },
+		{ u"\xD83D\xD83D\xDE00", "\xEF\xBF\xBD\xF0\x9F\x98\x80", false },
+	};
+	for (auto &c : Cases)
+	{
+		bool valid;
+		CHECK(ToUtf8(c.utf16, &valid) == c.utf8);
+		CHECK(valid == c.valid);
+		CheckUtf16(c.utf16);
+	}
+}
+
+// Every length up to a few blocks, with a lone surrogate, a pair or a pair cut short at every
+// position, in ASCII and in CJK (where the length is counted 8 units at a time)
+static void TestUtf16Positions()
+{
+	const Utf16 Inserts[] = { u"\xD800", u"\xDFFF", u"\xD83D\xDE00", u"\xDE00\xD83D", u"\x00E9", u"\xFFFD" };
+	for (char16_t fill : { u'a', u'\x4E2D', u'\x07FF' })
+	{
+		for (size_t length = 0; length <= 40; length++)
+		{
+			Utf16 text(length, fill);
+			CheckUtf16(text);
+			for (auto &insert : Inserts)
+			{
+				for (size_t at = 0; at <= length; at++)
+				{
+					auto modified = text;
+					modified.insert(at, insert);
+					CheckUtf16(modified);
+					// A pair cut short by the end of the input
+					CheckUtf16(modified.substr(0, at + 1));
+				}
+			}
+		}
+	}
+}
+
+static void TestUtf16Fuzz()
+{
+	std::mt19937_64 random(13);
+	int valid = 0, invalid = 0;
+	for (int iteration = 0; iteration < 50000; iteration++)
+	{
+		Utf16 text;
+		if (iteration % 4 == 0)
+		{
+			// Raw random units, a third of them surrogates
+			text.resize(random() % 64);
+			for (auto &c : text)
+				c = char16_t(random() % 3 == 0 ? 0xD800 + random() % 0x800 : random() % 0x10000);
+		}
+		else
+		{
+			text = RandomUtf16(random, 1 + random() % 10);
+		}
+		CheckUtf16(text);
+		bool ok;
+		ReferenceUtf16ToUtf8(text, &ok);
+		(ok ? valid : invalid)++;
+	}
+	printf("valid=%d invalid=%d\n", valid, invalid);
+	CHECK(valid > 10000 && invalid > 20000);
+}
+
+int main()
+{
+	TestUtf8Examples();
+	TestUtf8Offsets();
+	TestUtf8Splits();
+	TestUtf8Fuzz();
+	TestUtf16Examples();
+	TestUtf16Positions();
+	TestUtf16Fuzz();
+	puts("UnicodeTest passed");
+	return 0;
+}
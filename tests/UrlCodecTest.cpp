@@ -0,0 +1,211 @@
+// UrlCodec against straightforward byte-at-a-time references: random text of every length around
+// the 16-byte SIMD blocks, at every alignment, long texts alternating plain and escaped pieces,
+// malformed escapes, in-place decoding, queries and URL normalization
+
+#include "UrlCodec.h"
+#include "UrlReference.h"
+#include "TestHelper.h"
+#include <algorithm>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace LUwpUtilities;
+
+// Random bytes, URL-ish text with escapes (some malformed) or long unreserved runs
+static std::string RandomText(std::mt19937 &random)
+{
+	static const char Mixed[] = "aZ09-._~%%+ /?&=#\xc3\xa9\xff" "4fF";
+	static const char Plain[] = "abcXYZ019-_.~";
+	size_t length = random() % 80;
+	std::string text(length, '\0');
+	int kind = (int)(random() % 3);
+	for (auto &c : text)
+	{
+		if (kind == 0)
+			c = (char)(random() % 256);
+		else if (kind == 1)
+			c = Mixed[random() % (sizeof(Mixed) - 1)];
+		else
+			c = Plain[random() % (sizeof(Plain) - 1)];
+	}
+	// An unreserved run with a single special byte somewhere in a block
+	if (kind == 2 && length > 0 && random() % 2 == 0)
+		text[random() % length] = (random() % 2 == 0 ? '%' : ' ');
+	return text;
+}
+
+static void TestAgainstReference()
+{
+	std::mt19937 random(7);
+	std::vector<char> buffer;
+	for (int iteration = 0; iteration < 100000; iteration++)
+	{
+		auto text = RandomText(random);
+		auto expected = ReferenceEncode(text);
+		auto encoded = UrlEncode(text);
+		CHECK(encoded == expected);
+		CHECK(UrlEncodedLength(text.data(), text.size()) == expected.size());
+		CHECK(UrlDecode(encoded) == text);
+
+		bool plus = (random() % 2 == 0);
+		auto decoded = ReferenceDecode(text, plus);
+		CHECK(UrlDecode(text, plus) == decoded);
+
+		// Unaligned input and output, and decoding in place
+		size_t offset = random() % 16;
+		buffer.assign(offset + text.size() + 1, '\0');
+		std::copy(text.begin(), text.end(), buffer.begin() + offset);
+		auto length = UrlDecode(buffer.data() + offset, text.size(), buffer.data() + offset, plus);
+		CHECK(std::string(buffer.data() + offset, length) == decoded);
+		buffer.assign(offset + expected.size() + 1, '\0');
+		CHECK(UrlEncode(text.data(), text.size(), buffer.data() + offset) == expected.size());
+		CHECK(std::string(buffer.data() + offset, expected.size()) == expected);
+	}
+}
+
+// Texts of several pieces of up to 600 bytes each: the byte-by-byte runs after a block with escapes
+// grow up to 256 bytes and end anywhere in a piece
+static void TestLongTexts()
+{
+	std::mt19937 random(8);
+	for (int iteration = 0; iteration < 1000; iteration++)
+	{
+		std::string text;
+		for (int piece = (int)(random() % 6); piece >= 0; piece--)
+		{
+			auto part = RandomText(random);
+			size_t repeat = random() % 8;
+			for (size_t k = 0; k < repeat; k++)
+				text += part;
+		}
+		auto expected = ReferenceEncode(text);
+		CHECK(UrlEncode(text) == expected);
+		CHECK(UrlEncodedLength(text.data(), text.size()) == expected.size());
+		CHECK(UrlDecode(expected) == text);
+		bool plus = (random() % 2 == 0);
+		CHECK(UrlDecode(text, plus) == ReferenceDecode(text, plus));
+	}
+}
+
+static void TestEdgeCases()
+{
+	CHECK(UrlEncode("") == "" && UrlDecode("") == "");
+	CHECK(UrlEncode("a b&c=d/e?f") == "a%20b%26c%3Dd%2Fe%3Ff");
+	CHECK(UrlEncode("caf\xc3\xa9") == "caf%C3%A9");
+	// Malformed or cut escapes are kept as they are
+	CHECK(UrlDecode("%") == "%" && UrlDecode("%4") == "%4" && UrlDecode("%G1") == "%G1" && UrlDecode("abc%") == "abc%");
+	CHECK(UrlDecode("%41%4a%4A") == "AJJ");
+	CHECK(UrlDecode("a+b", false) == "a+b" && UrlDecode("a+b", true) == "a b" && UrlDecode("%2B", true) == "+");
+	// Escapes straddling the end of a 16-byte block
+	CHECK(UrlDecode("0123456789abcde%41") == "0123456789abcdeA");
+	CHECK(UrlDecode("0123456789abcdef%41") == "0123456789abcdefA");
+}
+
+// Split on '&' then '=' and decode with '+' as space; empty parameters are skipped
+static std::vector<std::pair<std::string, std::string>> ReferenceQuery(std::string query)
+{
+	std::vector<std::pair<std::string, std::string>> parameters;
+	if (!query.empty() && query[0] == '?')
+		query.erase(0, 1);
+	size_t start = 0;
+	while (start < query.size())
+	{
+		auto end = query.find('&', start);
+		if (end == std::string::npos)
+			end = query.size();
+		if (end > start)
+		{
+			auto field = query.substr(start, end - start);
+			auto equal = field.find('=');
+			if (equal == std::string::npos)
+				parameters.emplace_back(ReferenceDecode(field, true), std::string());
+			else
+				parameters.emplace_back(ReferenceDecode(field.substr(0, equal), true), ReferenceDecode(field.substr(equal + 1), true));
+		}
+		start = end + 1;
+	}
+	return parameters;
+}
+
+static void TestQueries()
+{
+	std::mt19937 random(11);
+	for (int iteration = 0; iteration < 20000; iteration++)
+	{
+		// Built from random keys and values, parsed back
+		std::vector<std::pair<std::string, std::string>> parameters(random() % 6);
+		QueryBuilder builder;
+		for (auto &parameter : parameters)
+		{
+			parameter.first = RandomText(random);
+			parameter.second = RandomText(random);
+			builder.Add(parameter.first, parameter.second);
+		}
+		auto query = builder.ToString();
+		CHECK(query.size() == builder.Length());
+		ParsedQuery parsed(query);
+		auto reference = ReferenceQuery(query);
+		CHECK(parsed.Count() == reference.size());
+		for (size_t i = 0; i < reference.size(); i++)
+		{
+			CHECK(std::string(parsed.Key(i).data, parsed.Key(i).length) == reference[i].first);
+			CHECK(std::string(parsed.Value(i).data, parsed.Value(i).length) == reference[i].second);
+		}
+
+		// Any text parses like the reference
+		auto text = (random() % 2 == 0 ? "?" : "") + RandomText(random);
+		ParsedQuery any(text);
+		auto expected = ReferenceQuery(text);
+		CHECK(any.Count() == expected.size());
+		for (size_t i = 0; i < expected.size(); i++)
+		{
+			CHECK(std::string(any.Key(i).data, any.Key(i).length) == expected[i].first);
+			CHECK(std::string(any.Value(i).data, any.Value(i).length) == expected[i].second);
+		}
+	}
+
+	ParsedQuery query("?q=caf%C3%A9+%26+more&page=2&flag&&x=a+b&q=second");
+	Utf8Slice value;
+	CHECK(query.Count() == 5);
+	CHECK(query.Find("q", 1, value) && std::string(value.data, value.length) == "caf\xc3\xa9 & more");
+	CHECK(query.Find("flag", 4, value) && value.length == 0);
+	CHECK(query.Find("x", 1, value) && std::string(value.data, value.length) == "a b");
+	CHECK(!query.Find("missing", 7, value));
+}
+
+static void TestNormalizeUrl()
+{
+	const char *Cases[][2] =
+	{
+		{ "HTTP://Example.COM:80/Path?B=1&a=2#top", "http://example.com/Path?B=1&a=2" },
+		{ "https://example.com:443", "https://example.com/" },
+		{ "https://example.com:8443?x", "https://example.com:8443/?x" },
+		{ "http://example.com:443/", "http://example.com:443/" },
+		{ "http://example.com:/a", "http://example.com/a" },
+		{ "http://[::1]:8080/a%2fb", "http://[::1]:8080/a%2Fb" },
+		{ "http://[::1]/", "http://[::1]/" },
+		{ "http://user@Host/%7e%zz%4", "http://user@host/%7E%zz%4" },
+		{ "/relative/%aa?q#f", "/relative/%AA?q" },
+		{ "", "" },
+	};
+	for (auto &test : Cases)
+		CHECK(NormalizeUrl(test[0]) == test[1]);
+
+	CHECK(UrlAuthority("https://user:pw@Example.com:8080/path?q") == "Example.com:8080");
+	CHECK(UrlAuthority("http://example.com") == "example.com");
+	CHECK(UrlAuthority("http://example.com#x") == "example.com");
+	CHECK(UrlAuthority("/relative") == "");
+}
+
+int main()
+{
+	TestAgainstReference();
+	TestLongTexts();
+	TestEdgeCases();
+	TestQueries();
+	TestNormalizeUrl();
+	puts("UrlCodecTest passed");
+	return 0;
+}
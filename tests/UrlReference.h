@@ -0,0 +1,68 @@
+/**
+ * Straightforward byte-at-a-time percent-encoding and decoding, written for clarity, to check
+ * UrlCodec.h against and to benchmark it with. Same rules: every byte but ALPHA DIGIT - . _ ~ is
+ * encoded with uppercase digits, malformed escapes are copied as they are.
+ */
+
+#ifndef _LUWPUTILITIES_URL_REFERENCE_
+#define _LUWPUTILITIES_URL_REFERENCE_
+
+#include <string>
+
+namespace LUwpUtilities
+{
+	inline bool ReferenceUnreserved(unsigned char c)
+	{
+		return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '-' || c == '.' || c == '_' || c == '~';
+	}
+
+	inline std::string ReferenceEncode(const std::string &text)
+	{
+		std::string result;
+		for (unsigned char c : text)
+		{
+			if (ReferenceUnreserved(c))
+			{
+				result += (char)c;
+			}
+			else
+			{
+				result += '%';
+				result += "0123456789ABCDEF"[c >> 4];
+				result += "0123456789ABCDEF"[c & 15];
+			}
+		}
+		return result;
+	}
+
+	inline int ReferenceHex(char c)
+	{
+		if (c >= '0' && c <= '9')
+			return c - '0';
+		if (c >= 'a' && c <= 'f')
+			return c - 'a' + 10;
+		if (c >= 'A' && c <= 'F')
+			return c - 'A' + 10;
+		return -1;
+	}
+
+	inline std::string ReferenceDecode(const std::string &text, bool plusAsSpace)
+	{
+		std::string result;
+		for (size_t i = 0; i < text.size(); i++)
+		{
+			if (text[i] == '%' && i + 2 < text.size() && ReferenceHex(text[i + 1]) >= 0 && ReferenceHex(text[i + 2]) >= 0)
+			{
+				result += (char)(ReferenceHex(text[i + 1]) * 16 + ReferenceHex(text[i + 2]));
+				i += 2;
+			}
+			else
+			{
+				result += (plusAsSpace && text[i] == '+' ? ' ' : text[i]);
+			}
+		}
+		return result;
+	}
+} // namespace LUwpUtilities
+
+#endif // #ifndef _LUWPUTILITIES_URL_REFERENCE_
@@ -0,0 +1,383 @@
+/**
+ * Minimal HTTP/1.1 client of LoopbackServer for the Linux tests and benchmarks: it plays the part
+ * of the HttpClient behind the Http helpers, i.e. what a Fetch/Send/Start function of the engines
+ * (RequestScheduler, RequestCoalescer, RequestPolicy, ChunkPump, SegmentedDownload...) calls.
+ *
+ *     LoopbackClient client(server.Port());
+ *     auto abort = client.Get("/file?size=100000", { { "Range", "bytes=0-99" } },
+ *         [](const LoopbackResponse &response) { ... throw to reject ... }, consumer);
+ *
+ * Each request blocks a thread of the client's own pool, reuses an idle keep-alive connection if
+ * any, decodes Content-Length or chunked bodies and feeds the consumer through a ChunkPump.
+ * Connection errors, short bodies and aborts reach the consumer as OnError.
+ */
+
+#ifndef _LUWPUTILITIES_LOOPBACK_CLIENT_
+#define _LUWPUTILITIES_LOOPBACK_CLIENT_
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "ChunkStream.h"
+#include "ThreadPool.h"
+
+namespace LUwpUtilities
+{
+	struct LoopbackResponse
+	{
+		int status;
+		int64_t contentLength; // -1 if unknown (chunked)
+		std::map<std::string, std::string> headers; // lowercase names
+
+		std::string Header(const std::string &name) const
+		{
+			auto found = headers.find(name);
+			return (found == headers.end() ? std::string() : found->second);
+		}
+	};
+
+	class LoopbackClient
+	{
+	public:
+		typedef std::function<void()> Abort;
+		// The response headers; throw to reject the response (the consumer gets OnError)
+		typedef std::function<void(const LoopbackResponse &response)> Headers;
+		typedef std::map<std::string, std::string> Fields;
+
+		// Requests in flight are bounded by threads
+		explicit LoopbackClient(uint16_t port, unsigned threads = 32) : _port(port), _closed(false), _pool(threads)
+		{
+		}
+
+		// The pool finishes the requests in flight (abort them first to be quick)
+		~LoopbackClient()
+		{
+			std::lock_guard<std::mutex> guard(_lock);
+			_closed = true;
+			for (auto socket : _idle)
+				close(socket);
+			_idle.clear();
+		}
+
+		LoopbackClient(const LoopbackClient&) = delete;
+		LoopbackClient &operator=(const LoopbackClient&) = delete;
+
+		Abort Get(const std::string &target, const Fields &fields, Headers headers, std::shared_ptr<ChunkConsumer> consumer)
+		{
+			auto exchange = std::make_shared<Exchange>();
+			_pool.Submit([this, exchange, target, fields, headers, consumer]()
+			{
+				Run(*exchange, target, fields, headers, consumer);
+			});
+			return [exchange]()
+			{
+				std::lock_guard<std::mutex> guard(exchange->lock);
+				exchange->aborted = true;
+				if (exchange->socket >= 0)
+					shutdown(exchange->socket, SHUT_RDWR);
+			};
+		}
+
+		// The whole body, or the error (with status 0 if there was no response)
+		void Get(const std::string &target, std::function<void(int status, std::vector<unsigned char> &body, std::exception_ptr error)> done)
+		{
+			auto status = std::make_shared<int>(0);
+			auto consumer = std::make_shared<CollectingConsumer>((size_t)1 << 30,
+				[status, done](std::vector<unsigned char> &body, std::exception_ptr error) { done(*status, body, error); });
+			Get(target, Fields(), [status](const LoopbackResponse &response) { *status = response.status; }, consumer);
+		}
+
+		// Connections opened so far (the others were reused)
+		size_t Connections() const
+		{
+			return _connections;
+		}
+
+	private:
+		struct Exchange
+		{
+			std::mutex lock;
+			int socket = -1;
+			bool aborted = false;
+		};
+
+		// Body of one response on a connection: Content-Length, chunked, or until the connection closes
+		struct BodyReader
+		{
+			int socket;
+			std::string buffer;       // received, not consumed
+			int64_t remaining;        // of the body, or of the current chunk if chunked
+			bool chunked;
+			bool complete;
+			std::vector<char> chunk;
+
+			// Up to capacity bytes of the body; empty at the end; throws on errors
+			BufferView Read(size_t capacity)
+			{
+				if (complete)
+					return BufferView();
+				if (chunked && remaining == 0)
+				{
+					auto size = Line();
+					remaining = (int64_t)strtoll(size.c_str(), nullptr, 16);
+					if (remaining == 0)
+					{
+						// Trailers until the empty line
+						while (!Line().empty())
+						{
+						}
+						complete = true;
+						return BufferView();
+					}
+				}
+				if (remaining == 0)
+				{
+					complete = true;
+					return BufferView();
+				}
+				if (buffer.empty() && !Receive())
+				{
+					if (remaining < 0)
+					{
+						complete = true;
+						return BufferView();
+					}
+					throw std::runtime_error("The connection closed before the end of the body");
+				}
+				size_t size = std::min(capacity, buffer.size());
+				if (remaining > 0)
+					size = std::min(size, (size_t)remaining);
+				chunk.assign(buffer.begin(), buffer.begin() + size);
+				buffer.erase(0, size);
+				if (remaining > 0)
+					remaining -= (int64_t)size;
+				if (chunked && remaining == 0)
+					Line();
+				return BufferView(chunk.data(), chunk.size());
+			}
+
+			std::string Line()
+			{
+				size_t end;
+				while ((end = buffer.find("\r\n")) == std::string::npos)
+				{
+					if (!Receive())
+						throw std::runtime_error("The connection closed in a chunk header");
+				}
+				auto line = buffer.substr(0, end);
+				buffer.erase(0, end + 2);
+				return line;
+			}
+
+			bool Receive()
+			{
+				char data[65536];
+				auto count = recv(socket, data, sizeof(data), 0);
+				if (count <= 0)
+					return false;
+				buffer.append(data, (size_t)count);
+				return true;
+			}
+		};
+
+		void Run(Exchange &exchange, const std::string &target, const Fields &fields, const Headers &headers,
+			const std::shared_ptr<ChunkConsumer> &consumer)
+		{
+			// A reused connection may have been closed by the server: retry once on a new one
+			for (int attempt = 0; ; attempt++)
+			{
+				bool reused;
+				int socket = Connect(reused);
+				{
+					std::lock_guard<std::mutex> guard(exchange.lock);
+					exchange.socket = socket;
+					if (exchange.aborted && socket >= 0)
+						shutdown(socket, SHUT_RDWR);
+				}
+				if (socket < 0)
+				{
+					consumer->OnError(std::make_exception_ptr(std::runtime_error("Cannot connect to the server")));
+					return;
+				}
+
+				BodyReader reader;
+				reader.socket = socket;
+				LoopbackResponse response;
+				if (!Send(socket, target, fields) || !ReadHead(reader, response))
+				{
+					Release(exchange, socket, false);
+					if (reused && attempt == 0 && !Aborted(exchange))
+						continue;
+					consumer->OnError(std::make_exception_ptr(std::runtime_error(
+						Aborted(exchange) ? "The request was aborted" : "The connection closed before the response")));
+					return;
+				}
+
+				try
+				{
+					if (headers)
+						headers(response);
+				}
+				catch (...)
+				{
+					Release(exchange, socket, false);
+					consumer->OnError(std::current_exception());
+					return;
+				}
+
+				// Reads are synchronous: the pump is done when Start returns
+				ChunkPump::Start([&reader](size_t capacity, ChunkPump::ReadDone done)
+				{
+					BufferView chunk;
+					try
+					{
+						chunk = reader.Read(capacity);
+					}
+					catch (...)
+					{
+						done(BufferView(), std::current_exception());
+						return;
+					}
+					done(chunk, nullptr);
+				}, consumer, response.contentLength);
+				bool keep = reader.complete && reader.buffer.empty() && (reader.chunked || response.contentLength >= 0)
+					&& response.Header("connection") != "close";
+				Release(exchange, socket, keep && !Aborted(exchange));
+				return;
+			}
+		}
+
+		int Connect(bool &reused)
+		{
+			{
+				std::lock_guard<std::mutex> guard(_lock);
+				if (!_idle.empty())
+				{
+					reused = true;
+					int socket = _idle.back();
+					_idle.pop_back();
+					return socket;
+				}
+			}
+			reused = false;
+			int socket = ::socket(AF_INET, SOCK_STREAM, 0);
+			if (socket < 0)
+				return -1;
+			sockaddr_in address = {};
+			address.sin_family = AF_INET;
+			address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+			address.sin_port = htons(_port);
+			if (connect(socket, (sockaddr*)&address, sizeof(address)) != 0)
+			{
+				close(socket);
+				return -1;
+			}
+			int one = 1;
+			setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+			_connections++;
+			return socket;
+		}
+
+		// Keep the connection for another request, or close it
+		void Release(Exchange &exchange, int socket, bool keep)
+		{
+			{
+				std::lock_guard<std::mutex> guard(exchange.lock);
+				exchange.socket = -1;
+			}
+			std::lock_guard<std::mutex> guard(_lock);
+			if (keep && !_closed)
+				_idle.push_back(socket);
+			else
+				close(socket);
+		}
+
+		static bool Aborted(Exchange &exchange)
+		{
+			std::lock_guard<std::mutex> guard(exchange.lock);
+			return exchange.aborted;
+		}
+
+		bool Send(int socket, const std::string &target, const Fields &fields)
+		{
+			auto request = "GET " + target + " HTTP/1.1\r\nHost: 127.0.0.1:" + std::to_string(_port) + "\r\n";
+			for (auto &field : fields)
+				request += field.first + ": " + field.second + "\r\n";
+			request += "\r\n";
+			const char *data = request.data();
+			size_t size = request.size();
+			while (size > 0)
+			{
+				auto sent = send(socket, data, size, MSG_NOSIGNAL);
+				if (sent <= 0)
+					return false;
+				data += sent;
+				size -= (size_t)sent;
+			}
+			return true;
+		}
+
+		static bool ReadHead(BodyReader &reader, LoopbackResponse &response)
+		{
+			size_t end;
+			while ((end = reader.buffer.find("\r\n\r\n")) == std::string::npos)
+			{
+				if (!reader.Receive())
+					return false;
+			}
+			auto head = reader.buffer.substr(0, end + 2);
+			reader.buffer.erase(0, end + 4);
+			if (head.compare(0, 9, "HTTP/1.1 ") != 0)
+				return false;
+			response.status = atoi(head.c_str() + 9);
+			for (size_t start = head.find("\r\n") + 2; start < head.size();)
+			{
+				auto next = head.find("\r\n", start);
+				auto field = head.substr(start, next - start);
+				auto colon = field.find(':');
+				if (colon != std::string::npos)
+				{
+					auto name = field.substr(0, colon);
+					std::transform(name.begin(), name.end(), name.begin(), [](char c) { return (char)tolower((unsigned char)c); });
+					auto value = field.substr(colon + 1);
+					value.erase(0, value.find_first_not_of(' '));
+					response.headers[name] = value;
+				}
+				start = next + 2;
+			}
+
+			auto length = response.Header("content-length");
+			reader.chunked = (response.Header("transfer-encoding") == "chunked");
+			reader.complete = false;
+			bool empty = (response.status == 204 || response.status == 304);
+			response.contentLength = (empty ? 0 : (length.empty() || reader.chunked ? -1 : atoll(length.c_str())));
+			reader.remaining = (reader.chunked ? 0 : response.contentLength);
+			return true;
+		}
+
+		uint16_t _port;
+		std::atomic<size_t> _connections{0};
+
+		std::mutex _lock;
+		std::vector<int> _idle;
+		bool _closed;
+
+		// Last, so that the requests in flight finish before the rest goes
+		ThreadPool _pool;
+	};
+} // namespace LUwpUtilities
+
+#endif // #ifndef _LUWPUTILITIES_LOOPBACK_CLIENT_
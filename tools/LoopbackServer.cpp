@@ -0,0 +1,36 @@
+/**
+ * Run LoopbackServer alone, e.g. as the backend of Http::RunLoadAsync from the app on the same
+ * machine or for curl:
+ *
+ *     LoopbackServer [--port 8080]
+ *     curl -v "http://127.0.0.1:8080/file?size=100000&chunked=1&latency=20"
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include "LoopbackServer.h"
+
+using namespace LUwpUtilities;
+
+int main(int argc, char **argv)
+{
+	uint16_t port = 8080;
+	for (int i = 1; i + 1 < argc; i++)
+	{
+		if (strcmp(argv[i], "--port") == 0)
+			port = (uint16_t)atoi(argv[i + 1]);
+	}
+
+	LoopbackServer server(port);
+	printf("Listening on %s\n", server.Url("/").c_str());
+	fflush(stdout);
+	for (;;)
+	{
+		std::this_thread::sleep_for(std::chrono::seconds(10));
+		printf("requests=%zu body_bytes=%llu\n", server.Requests(), (unsigned long long)server.BodyBytes());
+		fflush(stdout);
+	}
+}
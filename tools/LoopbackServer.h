@@ -0,0 +1,517 @@
+/**
+ * Local stand-in of an HTTP/1.1 backend on 127.0.0.1 (POSIX sockets, for the Linux tests and
+ * benchmarks; see LoopbackServer.cpp to run it alone). Every path serves a deterministic body,
+ * and the query string scripts the behavior:
+ *
+ *     size=N          body bytes (default 1024)
+ *     latency=MS      delay before the headers; jitter=MS adds a uniform random delay on top
+ *     slow_every=K    every Kth request of the path waits slow=MS more (a latency tail)
+ *     chunked=1       Transfer-Encoding: chunked instead of Content-Length
+ *     status=CODE     answer CODE with a short text body
+ *     fail_every=K    every Kth request of the path answers 503
+ *     drop_after=B    close the connection after B body bytes (drop_every=K: only every Kth request)
+ *     ranges=0        ignore Range; validators=0 no ETag/Last-Modified; etag=0 no ETag
+ *     max_age=S       Cache-Control: max-age=S; stale=S adds stale-while-revalidate=S
+ *     seed=S          which body (default: from the path)
+ *
+ * Range (bytes=a-b, a-, -n) answers 206 or 416 and honors If-Range. A matching If-None-Match, or
+ * without it an If-Modified-Since equal to Last-Modified, answers 304.
+ * SetVersion() changes every body and validator at once, like a deployment of new content.
+ * Connections are kept alive unless the client sends Connection: close.
+ *
+ *     LoopbackServer server;
+ *     auto url = server.Url("/file?size=1000000&chunked=1");
+ *     auto expected = server.Body("/file?size=1000000&chunked=1");
+ */
+
+#ifndef _LUWPUTILITIES_LOOPBACK_SERVER_
+#define _LUWPUTILITIES_LOOPBACK_SERVER_
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <map>
+#include <mutex>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+namespace LUwpUtilities
+{
+	class LoopbackServer
+	{
+	public:
+		// Listen on 127.0.0.1; port 0 picks a free one
+		explicit LoopbackServer(uint16_t port = 0) : _version(1), _requests(0), _bodyBytes(0), _connections(0), _stopping(false)
+		{
+			_socket = socket(AF_INET, SOCK_STREAM, 0);
+			if (_socket < 0)
+				throw std::runtime_error("socket() failed");
+			int one = 1;
+			setsockopt(_socket, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+			sockaddr_in address = {};
+			address.sin_family = AF_INET;
+			address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+			address.sin_port = htons(port);
+			socklen_t length = sizeof(address);
+			if (bind(_socket, (sockaddr*)&address, sizeof(address)) != 0 || listen(_socket, 512) != 0
+				|| getsockname(_socket, (sockaddr*)&address, &length) != 0)
+			{
+				close(_socket);
+				throw std::runtime_error("Cannot listen on the loopback interface");
+			}
+			_port = ntohs(address.sin_port);
+			_acceptor = std::thread([this]() { Accept(); });
+		}
+
+		// Close the listening socket and every connection, then wait for their threads
+		~LoopbackServer()
+		{
+			{
+				std::lock_guard<std::mutex> guard(_lock);
+				_stopping = true;
+				for (auto client : _clients)
+					shutdown(client, SHUT_RDWR);
+			}
+			shutdown(_socket, SHUT_RDWR);
+			close(_socket);
+			_acceptor.join();
+			std::unique_lock<std::mutex> guard(_lock);
+			_idle.wait(guard, [this]() { return _connections == 0; });
+		}
+
+		LoopbackServer(const LoopbackServer&) = delete;
+		LoopbackServer &operator=(const LoopbackServer&) = delete;
+
+		uint16_t Port() const
+		{
+			return _port;
+		}
+
+		std::string Url(const std::string &target) const
+		{
+			return "http://127.0.0.1:" + std::to_string(_port) + target;
+		}
+
+		void SetVersion(int version)
+		{
+			_version = version;
+		}
+
+		// Requests answered, and body bytes sent, since the start
+		size_t Requests() const
+		{
+			return _requests;
+		}
+
+		uint64_t BodyBytes() const
+		{
+			return _bodyBytes;
+		}
+
+		// The whole body the target serves now
+		std::string Body(const std::string &target) const
+		{
+			auto query = Query(target);
+			auto size = Number(query, "size", 1024);
+			std::string body((size_t)size, '\0');
+			Fill(Seed(target, query), 0, &body[0], body.size());
+			return body;
+		}
+
+	private:
+		typedef std::map<std::string, std::string> Fields;
+
+		struct Request
+		{
+			std::string method;
+			std::string target;
+			Fields headers; // lowercase names
+		};
+
+		void Accept()
+		{
+			for (;;)
+			{
+				int client = accept(_socket, nullptr, nullptr);
+				if (client < 0)
+					return;
+				std::lock_guard<std::mutex> guard(_lock);
+				if (_stopping)
+				{
+					close(client);
+					return;
+				}
+				int one = 1;
+				setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+				_clients.insert(client);
+				_connections++;
+				std::thread([this, client]() { Serve(client); }).detach();
+			}
+		}
+
+		void Serve(int client)
+		{
+			std::string buffer;
+			Request request;
+			while (ReadRequest(client, buffer, request))
+			{
+				_requests++;
+				bool keep = Answer(client, request);
+				auto connection = Lower(Header(request.headers, "connection"));
+				if (!keep || connection == "close")
+					break;
+			}
+
+			std::lock_guard<std::mutex> guard(_lock);
+			_clients.erase(client);
+			close(client);
+			if (--_connections == 0)
+				_idle.notify_all();
+		}
+
+		bool ReadRequest(int client, std::string &buffer, Request &request)
+		{
+			size_t end;
+			while ((end = buffer.find("\r\n\r\n")) == std::string::npos)
+			{
+				char data[4096];
+				auto count = recv(client, data, sizeof(data), 0);
+				if (count <= 0 || buffer.size() > 65536)
+					return false;
+				buffer.append(data, (size_t)count);
+			}
+
+			auto head = buffer.substr(0, end);
+			buffer.erase(0, end + 4);
+			auto line_end = head.find("\r\n");
+			auto line = head.substr(0, line_end);
+			auto first = line.find(' ');
+			auto second = line.find(' ', first + 1);
+			if (first == std::string::npos || second == std::string::npos)
+				return false;
+			request.method = line.substr(0, first);
+			request.target = line.substr(first + 1, second - first - 1);
+			request.headers.clear();
+			for (size_t start = line_end; start != std::string::npos && start < head.size();)
+			{
+				start += 2;
+				auto next = head.find("\r\n", start);
+				auto field = head.substr(start, next == std::string::npos ? std::string::npos : next - start);
+				auto colon = field.find(':');
+				if (colon != std::string::npos)
+				{
+					auto value = field.substr(colon + 1);
+					value.erase(0, value.find_first_not_of(' '));
+					request.headers[Lower(field.substr(0, colon))] = value;
+				}
+				start = next;
+			}
+			return true;
+		}
+
+		// Send the scripted response; false to close the connection
+		bool Answer(int client, const Request &request)
+		{
+			auto query = Query(request.target);
+			auto count = Count(Path(request.target));
+
+			uint64_t delay = Number(query, "latency", 0);
+			auto jitter = Number(query, "jitter", 0);
+			if (jitter > 0)
+				delay += Random() % (jitter + 1);
+			auto slow_every = Number(query, "slow_every", 0);
+			if (slow_every > 0 && count % slow_every == 0)
+				delay += Number(query, "slow", 0);
+			if (delay > 0)
+				std::this_thread::sleep_for(std::chrono::milliseconds(delay));
+
+			auto fail_every = Number(query, "fail_every", 0);
+			int status = (int)Number(query, "status", 0);
+			if (fail_every > 0 && count % fail_every == 0)
+				status = 503;
+			if (request.method != "GET" && request.method != "HEAD")
+				status = 405;
+			if (status != 0 && status != 200)
+			{
+				auto text = "Scripted status " + std::to_string(status) + "\n";
+				auto head = StatusLine(status) + "Content-Type: text/plain\r\nContent-Length: " + std::to_string(text.size()) + "\r\n\r\n";
+				return Send(client, head) && (request.method == "HEAD" || Send(client, text));
+			}
+
+			auto size = Number(query, "size", 1024);
+			auto seed = Seed(request.target, query);
+			bool validators = (Number(query, "validators", 1) != 0);
+			auto etag = "\"" + std::to_string(seed) + "-" + std::to_string(size) + "\"";
+			auto modified = LastModified();
+
+			if (Number(query, "etag", 1) == 0)
+				etag.clear();
+
+			std::string head;
+			if (validators && !etag.empty())
+				head += "ETag: " + etag + "\r\n";
+			if (validators)
+				head += "Last-Modified: " + modified + "\r\n";
+			if (query.count("max_age"))
+			{
+				head += "Cache-Control: max-age=" + query["max_age"];
+				if (query.count("stale"))
+					head += ", stale-while-revalidate=" + query["stale"];
+				head += "\r\n";
+			}
+			head += "Accept-Ranges: " + std::string(Number(query, "ranges", 1) != 0 ? "bytes" : "none") + "\r\n";
+
+			// If-Modified-Since only counts without If-None-Match (RFC 7232, 3.3)
+			auto if_none_match = Header(request.headers, "if-none-match");
+			bool not_modified = (!if_none_match.empty() ? if_none_match == etag : Header(request.headers, "if-modified-since") == modified);
+			if (validators && not_modified)
+				return Send(client, StatusLine(304) + head + "\r\n");
+
+			// Range, unless If-Range names another version
+			uint64_t first = 0;
+			uint64_t last = size;
+			int code = 200;
+			auto range = Header(request.headers, "range");
+			auto if_range = Header(request.headers, "if-range");
+			bool current = if_range.empty() || (validators && (if_range == etag || if_range == modified));
+			if (!range.empty() && Number(query, "ranges", 1) != 0 && current)
+			{
+				if (!ParseRange(range, size, first, last))
+				{
+					head += "Content-Range: bytes */" + std::to_string(size) + "\r\nContent-Length: 0\r\n\r\n";
+					return Send(client, StatusLine(416) + head);
+				}
+				code = 206;
+				head += "Content-Range: bytes " + std::to_string(first) + "-" + std::to_string(last - 1) + "/" + std::to_string(size) + "\r\n";
+			}
+
+			bool chunked = (Number(query, "chunked", 0) != 0);
+			head += (chunked ? std::string("Transfer-Encoding: chunked\r\n") : "Content-Length: " + std::to_string(last - first) + "\r\n");
+			if (!Send(client, StatusLine(code) + head + "\r\n"))
+				return false;
+			if (request.method == "HEAD")
+				return true;
+
+			// Mid-body connection drop
+			uint64_t limit = last;
+			auto drop_every = Number(query, "drop_every", 1);
+			if (query.count("drop_after") && drop_every > 0 && count % drop_every == 0)
+				limit = std::min(last, first + Number(query, "drop_after", 0));
+
+			char data[65536];
+			for (uint64_t offset = first; offset < limit;)
+			{
+				size_t length = (size_t)std::min<uint64_t>(sizeof(data), limit - offset);
+				Fill(seed, offset, data, length);
+				if (chunked)
+				{
+					char size_line[32];
+					snprintf(size_line, sizeof(size_line), "%zx\r\n", length);
+					if (!Send(client, size_line) || !Send(client, data, length) || !Send(client, "\r\n"))
+						return false;
+				}
+				else if (!Send(client, data, length))
+				{
+					return false;
+				}
+				offset += length;
+				_bodyBytes += length;
+			}
+			if (limit < last)
+				return false;
+			return !chunked || Send(client, "0\r\n\r\n");
+		}
+
+		// bytes=a-b, bytes=a- or bytes=-n of a body of the given size; last is exclusive
+		static bool ParseRange(const std::string &range, uint64_t size, uint64_t &first, uint64_t &last)
+		{
+			if (range.compare(0, 6, "bytes=") != 0 || range.find(',') != std::string::npos)
+				return false;
+			auto spec = range.substr(6);
+			auto dash = spec.find('-');
+			if (dash == std::string::npos)
+				return false;
+			auto from = spec.substr(0, dash);
+			auto to = spec.substr(dash + 1);
+			if (from.empty())
+			{
+				auto suffix = strtoull(to.c_str(), nullptr, 10);
+				if (suffix == 0 || size == 0)
+					return false;
+				first = size - std::min<uint64_t>(suffix, size);
+				last = size;
+				return true;
+			}
+			first = strtoull(from.c_str(), nullptr, 10);
+			last = (to.empty() ? size : std::min<uint64_t>(strtoull(to.c_str(), nullptr, 10) + 1, size));
+			return first < size && first < last;
+		}
+
+		bool Send(int client, const std::string &text)
+		{
+			return Send(client, text.data(), text.size());
+		}
+
+		bool Send(int client, const char *data, size_t size)
+		{
+			while (size > 0)
+			{
+				auto sent = send(client, data, size, MSG_NOSIGNAL);
+				if (sent <= 0)
+					return false;
+				data += sent;
+				size -= (size_t)sent;
+			}
+			return true;
+		}
+
+		static std::string StatusLine(int code)
+		{
+			const char *reason;
+			switch (code)
+			{
+			case 200: reason = "OK"; break;
+			case 206: reason = "Partial Content"; break;
+			case 304: reason = "Not Modified"; break;
+			case 404: reason = "Not Found"; break;
+			case 405: reason = "Method Not Allowed"; break;
+			case 416: reason = "Range Not Satisfiable"; break;
+			case 429: reason = "Too Many Requests"; break;
+			case 500: reason = "Internal Server Error"; break;
+			case 503: reason = "Service Unavailable"; break;
+			default: reason = "Scripted"; break;
+			}
+			return "HTTP/1.1 " + std::to_string(code) + " " + reason + "\r\n";
+		}
+
+		// Requests of the path so far, this one included
+		uint64_t Count(const std::string &path)
+		{
+			std::lock_guard<std::mutex> guard(_lock);
+			return ++_counts[path];
+		}
+
+		std::string LastModified() const
+		{
+			// One day per version
+			time_t time = 1700000000 + 86400 * (time_t)_version.load();
+			tm parts;
+			gmtime_r(&time, &parts);
+			char text[64];
+			strftime(text, sizeof(text), "%a, %d %b %Y %H:%M:%S GMT", &parts);
+			return text;
+		}
+
+		uint64_t Seed(const std::string &target, const Fields &query) const
+		{
+			auto seed = (query.count("seed") ? strtoull(query.at("seed").c_str(), nullptr, 10) : Hash(Path(target)));
+			return seed * 1000003 + (uint64_t)_version.load();
+		}
+
+		// Byte i of a body is byte i % 8 of Mix(seed + i / 8)
+		static void Fill(uint64_t seed, uint64_t offset, char *data, size_t size)
+		{
+			for (size_t i = 0; i < size;)
+			{
+				auto position = offset + i;
+				auto word = Mix(seed + position / 8);
+				for (auto byte = position % 8; byte < 8 && i < size; byte++, i++)
+					data[i] = (char)(word >> (byte * 8));
+			}
+		}
+
+		static uint64_t Mix(uint64_t x)
+		{
+			x += 0x9E3779B97F4A7C15ull;
+			x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+			x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+			return x ^ (x >> 31);
+		}
+
+		static uint64_t Hash(const std::string &text)
+		{
+			uint64_t hash = 14695981039346656037ull;
+			for (auto c : text)
+				hash = (hash ^ (unsigned char)c) * 1099511628211ull;
+			return hash % 1000000007;
+		}
+
+		static uint64_t Random()
+		{
+			static thread_local std::mt19937_64 random(std::random_device{}());
+			return random();
+		}
+
+		static std::string Path(const std::string &target)
+		{
+			return target.substr(0, target.find('?'));
+		}
+
+		static Fields Query(const std::string &target)
+		{
+			Fields query;
+			auto mark = target.find('?');
+			if (mark == std::string::npos)
+				return query;
+			for (size_t start = mark + 1; start <= target.size();)
+			{
+				auto end = target.find('&', start);
+				if (end == std::string::npos)
+					end = target.size();
+				auto pair = target.substr(start, end - start);
+				auto equal = pair.find('=');
+				if (!pair.empty())
+					query[pair.substr(0, equal)] = (equal == std::string::npos ? std::string() : pair.substr(equal + 1));
+				start = end + 1;
+			}
+			return query;
+		}
+
+		static uint64_t Number(const Fields &query, const char *name, uint64_t fallback)
+		{
+			auto found = query.find(name);
+			return (found == query.end() ? fallback : strtoull(found->second.c_str(), nullptr, 10));
+		}
+
+		static std::string Header(const Fields &headers, const char *name)
+		{
+			auto found = headers.find(name);
+			return (found == headers.end() ? std::string() : found->second);
+		}
+
+		static std::string Lower(std::string text)
+		{
+			std::transform(text.begin(), text.end(), text.begin(), [](char c) { return (char)tolower((unsigned char)c); });
+			return text;
+		}
+
+		int _socket;
+		uint16_t _port;
+		std::thread _acceptor;
+		std::atomic<int> _version;
+		std::atomic<size_t> _requests;
+		std::atomic<uint64_t> _bodyBytes;
+
+		std::mutex _lock;
+		std::condition_variable _idle;
+		std::set<int> _clients;
+		size_t _connections;
+		bool _stopping;
+		std::map<std::string, uint64_t> _counts;
+	};
+} // namespace LUwpUtilities
+
+#endif // #ifndef _LUWPUTILITIES_LOOPBACK_SERVER_